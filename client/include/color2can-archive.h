@@ -0,0 +1,114 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "color2can.h"
+
+// Archive of samples, stored by column. Samples are grouped in blocks
+// of up to COLOR2CAN_ARCHIVE_BLOCK_ROWS samples of a single sensor, and
+// each field of the samples of a block is compressed separately. An
+// index at the end of the file gives the sensor and time interval of
+// each block, so that a query only reads and decodes the blocks, and
+// the columns, it needs.
+
+#define COLOR2CAN_ARCHIVE_MAGIC   "C2CARCH\0"
+#define COLOR2CAN_ARCHIVE_VERSION 1
+
+#define COLOR2CAN_ARCHIVE_BLOCK_ROWS 16384
+
+// Columns
+#define COLOR2CAN_ARCHIVE_TIME         0
+#define COLOR2CAN_ARCHIVE_RED          1
+#define COLOR2CAN_ARCHIVE_GREEN        2
+#define COLOR2CAN_ARCHIVE_BLUE         3
+#define COLOR2CAN_ARCHIVE_CLEAR        4
+#define COLOR2CAN_ARCHIVE_WITHIN_RANGE 5
+#define COLOR2CAN_ARCHIVE_RANGE_ID     6
+#define COLOR2CAN_ARCHIVE_COLUMNS      7
+
+#define COLOR2CAN_ARCHIVE_ALL_COLUMNS ((1 << COLOR2CAN_ARCHIVE_COLUMNS) - 1)
+
+struct color2can_archive_writer;
+struct color2can_archive_reader;
+
+// Writer: creates (or truncates) the file at 'path'. Returns NULL on
+// error, with errno set.
+extern struct color2can_archive_writer *color2can_archive_create(
+    const char *path
+);
+
+// Adds a sample of a sensor (1...31). The samples of each sensor must be
+// added in time order: a sample older than the previous one of the same
+// sensor is rejected with EINVAL. Returns 0 on success, or -1 on error
+// (errno is set).
+extern int color2can_archive_add(struct color2can_archive_writer *writer,
+                                 int sensor_id, uint64_t time,
+                                 const struct color2can_sample *sample);
+
+// Writes the remaining blocks and the index, and closes the file.
+// Returns 0 on success, or -1 on error (errno is set).
+extern int color2can_archive_finish(struct color2can_archive_writer *writer);
+
+// Reader: maps the file at 'path'. Returns NULL on error, with errno set
+// (EINVAL if the file is not an archive).
+extern struct color2can_archive_reader *color2can_archive_open(
+    const char *path
+);
+extern void color2can_archive_close(struct color2can_archive_reader *reader);
+
+struct color2can_archive_info {
+    uint64_t blocks;
+    uint64_t rows;
+    uint64_t time_min, time_max;
+
+    // compressed size of each column, in bytes
+    uint64_t column_size[COLOR2CAN_ARCHIVE_COLUMNS];
+};
+
+extern void color2can_archive_get_info(
+    const struct color2can_archive_reader *reader,
+    struct color2can_archive_info *info
+);
+
+struct color2can_archive_query {
+    uint32_t sensors;   // bit i set = sensor i, 0 = all sensors
+    uint64_t time_from; // inclusive
+    uint64_t time_to;   // exclusive, 0 = no limit
+    uint32_t columns;   // bit i set = column i (COLOR2CAN_ARCHIVE_*)
+};
+
+// Rows of a block matching a query. Only the requested columns are set;
+// the others are NULL.
+struct color2can_archive_rows {
+    int sensor_id;
+    int count;
+
+    const uint64_t *time;
+    const uint16_t *color[3];
+    const uint16_t *clear;
+    const uint8_t  *within_range;
+    const uint8_t  *range_id;
+};
+
+// Called for each block matching a query, in time order for each
+// sensor. Returning non-zero stops the query.
+typedef int (*color2can_archive_callback)(
+    const struct color2can_archive_rows *rows, void *user
+);
+
+// Returns the number of rows, or -1 if the archive is corrupted (errno
+// is set to EINVAL).
+extern int64_t color2can_archive_query(
+    struct color2can_archive_reader *reader,
+    const struct color2can_archive_query *query,
+    color2can_archive_callback callback, void *user
+);
+
+#ifdef __cplusplus
+}
+#endif
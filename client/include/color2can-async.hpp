@@ -0,0 +1,558 @@
+#pragma once
+
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
+#include <ctime>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <list>
+#include <map>
+#include <optional>
+#include <stop_token>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+#include "color2can-client.hpp"
+
+// C++20 coroutine API on top of color2can::Client: a single-threaded
+// event loop multiplexes any number of outstanding requests over one
+// socket.
+//
+//   color2can::Task<void> read(color2can::Loop &loop) {
+//       auto sample = co_await loop.sensor(3).sample(10ms);
+//       if(sample)
+//           printf("%d\n", sample->sample.color[0]);
+//   }
+//   loop.spawn(read(loop));
+//   loop.run();
+//
+// Sensors answer sample requests in order, without identifying them:
+// the n-th sample received from a sensor answers its n-th pending
+// request. A request that times out or is cancelled keeps its place, so
+// that its late answer is discarded instead of being given to the next
+// request, until Loop::orphan_timeout expires. Requests should only be
+// used with sensors that are not sending periodic samples.
+//
+// All coroutines run on the thread calling Loop::run(): cancellation
+// (std::stop_source::request_stop) must happen on that thread as well.
+namespace color2can {
+
+using namespace std::chrono_literals;
+
+/* ================================================================== */
+/*                                Task                                */
+/* ================================================================== */
+
+template<typename T = void>
+class Task;
+
+namespace detail {
+
+struct PromiseBase {
+    std::coroutine_handle<> continuation = std::noop_coroutine();
+    std::exception_ptr exception;
+
+    std::suspend_always initial_suspend() noexcept {
+        return {};
+    }
+
+    // resume the coroutine awaiting this one
+    struct FinalAwaiter {
+        bool await_ready() noexcept {
+            return false;
+        }
+
+        template<typename P>
+        std::coroutine_handle<>
+        await_suspend(std::coroutine_handle<P> handle) noexcept {
+            return handle.promise().continuation;
+        }
+
+        void await_resume() noexcept {
+        }
+    };
+
+    FinalAwaiter final_suspend() noexcept {
+        return {};
+    }
+
+    void unhandled_exception() {
+        exception = std::current_exception();
+    }
+};
+
+template<typename T>
+struct Promise : PromiseBase {
+    std::optional<T> value;
+
+    Task<T> get_return_object();
+
+    void return_value(T v) {
+        value = std::move(v);
+    }
+
+    T result() {
+        if(exception)
+            std::rethrow_exception(exception);
+        return std::move(*value);
+    }
+};
+
+template<>
+struct Promise<void> : PromiseBase {
+    Task<void> get_return_object();
+
+    void return_void() {
+    }
+
+    void result() {
+        if(exception)
+            std::rethrow_exception(exception);
+    }
+};
+
+} // namespace detail
+
+// Lazy coroutine: it starts when awaited, or when passed to Loop::spawn
+template<typename T>
+class [[nodiscard]] Task {
+public:
+    using promise_type = detail::Promise<T>;
+
+    explicit Task(std::coroutine_handle<promise_type> handle)
+        : handle(handle) {
+    }
+
+    Task(Task &&other) noexcept
+        : handle(std::exchange(other.handle, nullptr)) {
+    }
+
+    Task(const Task &) = delete;
+    Task &operator=(const Task &) = delete;
+
+    ~Task() {
+        if(handle)
+            handle.destroy();
+    }
+
+    bool await_ready() const noexcept {
+        return false;
+    }
+
+    std::coroutine_handle<>
+    await_suspend(std::coroutine_handle<> awaiting) noexcept {
+        handle.promise().continuation = awaiting;
+        return handle;
+    }
+
+    T await_resume() {
+        return handle.promise().result();
+    }
+
+private:
+    friend class Loop;
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+namespace detail {
+
+template<typename T>
+inline Task<T> Promise<T>::get_return_object() {
+    return Task<T>(std::coroutine_handle<Promise<T>>::from_promise(*this));
+}
+
+inline Task<void> Promise<void>::get_return_object() {
+    return Task<void>(
+        std::coroutine_handle<Promise<void>>::from_promise(*this)
+    );
+}
+
+} // namespace detail
+
+/* ================================================================== */
+/*                                Loop                                */
+/* ================================================================== */
+
+class Loop;
+class SampleAwaiter;
+
+struct PendingRequest {
+    SampleAwaiter *awaiter; // nullptr if orphaned
+    uint64_t expire;        // orphans only: when to forget it
+};
+
+// Awaitable returned by Sensor::sample: resolves to the sample message,
+// or to std::nullopt on timeout, cancellation or if the request could
+// not be sent.
+class SampleAwaiter {
+public:
+    SampleAwaiter(Loop &loop, int sensor_id,
+                  std::chrono::microseconds timeout, std::stop_token stop)
+        : loop(loop), sensor_id(sensor_id),
+          timeout(timeout), stop(std::move(stop)) {
+    }
+
+    bool await_ready();
+    void await_suspend(std::coroutine_handle<> handle);
+
+    std::optional<Event> await_resume() {
+        return std::move(result);
+    }
+
+private:
+    friend class Loop;
+
+    struct Cancel {
+        SampleAwaiter *self;
+        void operator()() noexcept;
+    };
+
+    Loop &loop;
+    int sensor_id;
+    std::chrono::microseconds timeout;
+    std::stop_token stop;
+
+    std::coroutine_handle<> handle;
+    std::optional<Event> result;
+    bool done = false;
+
+    // position in the sensor's queue, and in the loop's timers
+    std::list<PendingRequest>::iterator request;
+    std::multimap<uint64_t, std::function<void()>>::iterator timer;
+    std::optional<std::stop_callback<Cancel>> stop_callback;
+};
+
+class SleepAwaiter {
+public:
+    SleepAwaiter(Loop &loop, std::chrono::microseconds duration)
+        : loop(loop), duration(duration) {
+    }
+
+    bool await_ready() const noexcept {
+        return duration.count() <= 0;
+    }
+
+    void await_suspend(std::coroutine_handle<> handle);
+
+    void await_resume() const noexcept {
+    }
+
+private:
+    Loop &loop;
+    std::chrono::microseconds duration;
+};
+
+class Sensor {
+public:
+    Sensor(Loop &loop, int id) : loop(loop), id(id) {
+    }
+
+    // Requests a sample and waits for it
+    SampleAwaiter sample(std::chrono::microseconds timeout = 100ms,
+                         std::stop_token stop = {}) {
+        return SampleAwaiter(loop, id, timeout, std::move(stop));
+    }
+
+private:
+    Loop &loop;
+    int id;
+};
+
+class Loop {
+public:
+    // time an orphaned request waits for its late answer
+    std::chrono::microseconds orphan_timeout = 1s;
+
+    explicit Loop(Client &client) : client_(client) {
+        epfd    = epoll_create1(0);
+        timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+        if(epfd < 0 || timerfd < 0)
+            throw std::system_error(errno, std::generic_category(),
+                                    "color2can::Loop");
+
+        for(int fd : { client.fd(), timerfd }) {
+            epoll_event ev = {};
+            ev.events  = EPOLLIN;
+            ev.data.fd = fd;
+            epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+        }
+
+        // samples of all sensors answer pending requests
+        client.on_sample(0, [this](const Event &event) {
+            on_sample(event);
+        });
+    }
+
+    ~Loop() {
+        client_.on_sample(0, nullptr);
+        for(auto handle : detached)
+            handle.destroy();
+        close(timerfd);
+        close(epfd);
+    }
+
+    Loop(const Loop &) = delete;
+    Loop &operator=(const Loop &) = delete;
+
+    Client &client() {
+        return client_;
+    }
+
+    Sensor sensor(int id) {
+        return Sensor(*this, id);
+    }
+
+    SleepAwaiter sleep(std::chrono::microseconds duration) {
+        return SleepAwaiter(*this, duration);
+    }
+
+    // Starts a coroutine, owned by the loop until it completes.
+    // Exceptions escaping it are rethrown by run().
+    void spawn(Task<void> task) {
+        ready.push_back(start(std::move(task)).handle);
+    }
+
+    // Runs until stop() is called
+    void run() {
+        running = true;
+        while(running) {
+            resume_ready();
+            if(!running)
+                break;
+
+            epoll_event events[2];
+            const int n = epoll_wait(epfd, events, 2, -1);
+            if(n < 0) {
+                if(errno == EINTR)
+                    continue;
+                throw std::system_error(errno, std::generic_category(),
+                                        "epoll_wait");
+            }
+
+            for(int i = 0; i < n; i++) {
+                if(events[i].data.fd == timerfd) {
+                    // the timer is re-armed by fire_timers
+                    uint64_t expirations;
+                    [[maybe_unused]] ssize_t ret = read(
+                        timerfd, &expirations, sizeof(expirations)
+                    );
+                } else {
+                    client_.dispatch();
+                }
+            }
+            fire_timers();
+        }
+    }
+
+    void stop() {
+        running = false;
+    }
+
+    // number of requests waiting for an answer
+    size_t pending() const {
+        size_t count = 0;
+        for(const auto &queue : queues)
+            for(const auto &request : queue)
+                count += (request.awaiter != nullptr);
+        return count;
+    }
+
+private:
+    friend class SampleAwaiter;
+    friend class SleepAwaiter;
+
+    using Timers = std::multimap<uint64_t, std::function<void()>>;
+
+    // Wraps a task into a coroutine that removes itself when complete
+    struct Detached {
+        struct promise_type {
+            std::exception_ptr exception;
+
+            Detached get_return_object() {
+                return Detached{
+                    std::coroutine_handle<promise_type>::from_promise(*this)
+                };
+            }
+
+            std::suspend_always initial_suspend() noexcept {
+                return {};
+            }
+
+            std::suspend_always final_suspend() noexcept {
+                return {};
+            }
+
+            void return_void() {
+            }
+
+            void unhandled_exception() {
+                exception = std::current_exception();
+            }
+        };
+
+        std::coroutine_handle<promise_type> handle;
+    };
+
+    Detached start(Task<void> task) {
+        Detached d = run_detached(std::move(task));
+        detached.push_back(d.handle);
+        return d;
+    }
+
+    static Detached run_detached(Task<void> task) {
+        co_await task;
+    }
+
+    static uint64_t now() {
+        timespec t;
+        clock_gettime(CLOCK_MONOTONIC, &t);
+        return (uint64_t) t.tv_sec * 1000000 + t.tv_nsec / 1000;
+    }
+
+    Timers::iterator add_timer(uint64_t time, std::function<void()> fire) {
+        auto it = timers.emplace(time, std::move(fire));
+        if(it == timers.begin())
+            arm_timer();
+        return it;
+    }
+
+    void arm_timer() {
+        itimerspec spec = {};
+        if(!timers.empty()) {
+            const uint64_t time = timers.begin()->first;
+            spec.it_value.tv_sec  = time / 1000000;
+            spec.it_value.tv_nsec = (time % 1000000) * 1000 + 1;
+        }
+        timerfd_settime(timerfd, TFD_TIMER_ABSTIME, &spec, nullptr);
+    }
+
+    void fire_timers() {
+        const uint64_t t = now();
+        while(!timers.empty() && timers.begin()->first <= t) {
+            auto fire = std::move(timers.begin()->second);
+            timers.erase(timers.begin());
+            fire();
+        }
+        arm_timer();
+    }
+
+    void resume_ready() {
+        while(!ready.empty()) {
+            auto handle = ready.front();
+            ready.pop_front();
+            handle.resume();
+        }
+
+        // remove the coroutines that completed
+        for(auto it = detached.begin(); it != detached.end();) {
+            if(!it->done()) {
+                it++;
+                continue;
+            }
+
+            auto exception = it->promise().exception;
+            it->destroy();
+            it = detached.erase(it);
+            if(exception)
+                std::rethrow_exception(exception);
+        }
+    }
+
+    void on_sample(const Event &event) {
+        auto &queue = queues[event.sensor_id];
+        const uint64_t t = now();
+
+        // forget the orphans whose answer never came
+        while(!queue.empty() && !queue.front().awaiter &&
+              queue.front().expire < t)
+            queue.pop_front();
+        if(queue.empty())
+            return;
+
+        PendingRequest request = queue.front();
+        queue.pop_front();
+        if(request.awaiter) // orphans discard their late answer
+            finish(request.awaiter, event);
+    }
+
+    // Resolve a request: its entry must already be removed from the queue
+    void finish(SampleAwaiter *awaiter, std::optional<Event> result) {
+        awaiter->done   = true;
+        awaiter->result = std::move(result);
+        if(awaiter->timer != timers.end())
+            timers.erase(awaiter->timer);
+
+        // may run the cancellation callback: 'done' is already set
+        awaiter->stop_callback.reset();
+        ready.push_back(awaiter->handle);
+    }
+
+    // Timeout or cancellation: the request becomes an orphan
+    void abandon(SampleAwaiter *awaiter) {
+        if(awaiter->done)
+            return;
+
+        awaiter->request->awaiter = nullptr;
+        awaiter->request->expire  = now() + orphan_timeout.count();
+        finish(awaiter, std::nullopt);
+    }
+
+    Client &client_;
+    int epfd;
+    int timerfd;
+    bool running = false;
+
+    Timers timers;
+    std::deque<std::coroutine_handle<>> ready;
+    std::list<std::coroutine_handle<Detached::promise_type>> detached;
+
+    std::list<PendingRequest> queues[COLOR2CAN_MAX_SENSOR_COUNT];
+};
+
+/* ================================================================== */
+/*                              Awaiters                              */
+/* ================================================================== */
+
+inline bool SampleAwaiter::await_ready() {
+    if(stop.stop_requested() || sensor_id <= 0 ||
+       sensor_id >= COLOR2CAN_MAX_SENSOR_COUNT)
+        return true;
+
+    // if the request cannot be sent, there is nothing to wait for
+    return !loop.client().request_sample(sensor_id);
+}
+
+inline void SampleAwaiter::await_suspend(std::coroutine_handle<> h) {
+    handle = h;
+
+    auto &queue = loop.queues[sensor_id];
+    request = queue.insert(queue.end(), PendingRequest{ this, 0 });
+    timer = loop.add_timer(Loop::now() + timeout.count(), [this] {
+        timer = loop.timers.end(); // already removed
+        loop.abandon(this);
+    });
+
+    // the callback runs immediately if a stop was requested meanwhile
+    stop_callback.emplace(stop, Cancel{ this });
+}
+
+inline void SampleAwaiter::Cancel::operator()() noexcept {
+    self->loop.abandon(self);
+}
+
+inline void SleepAwaiter::await_suspend(std::coroutine_handle<> handle) {
+    loop.add_timer(
+        Loop::now() + duration.count(),
+        [this, handle] { loop.ready.push_back(handle); }
+    );
+}
+
+} // namespace color2can
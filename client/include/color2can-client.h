@@ -0,0 +1,138 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "color2can.h"
+
+// Host client of the Color-to-CAN protocol, on a SocketCAN interface.
+//
+// The socket is non-blocking and only receives the message types the
+// client subscribed to (CAN_RAW_FILTER). Frames are read in batches
+// (recvmmsg) and timestamped by the kernel (SO_TIMESTAMP). Received
+// messages are either returned as an array of events, or delivered to
+// callbacks registered for each sensor.
+//
+// A client must not be used by more than one thread at a time, except
+// that the send functions may be called while another thread receives.
+
+// Message types to receive, for color2can_client_open
+#define COLOR2CAN_CLIENT_SAMPLE      (1 << 0)
+#define COLOR2CAN_CLIENT_SAMPLE_INFO (1 << 1)
+#define COLOR2CAN_CLIENT_BITRATE     (1 << 2)
+#define COLOR2CAN_CLIENT_STATUS      (1 << 3)
+#define COLOR2CAN_CLIENT_LATENCY     (1 << 4)
+#define COLOR2CAN_CLIENT_TRACE       (1 << 5)
+#define COLOR2CAN_CLIENT_ALL         0x3f
+
+#define COLOR2CAN_EVENT_SAMPLE      0
+#define COLOR2CAN_EVENT_SAMPLE_INFO 1
+#define COLOR2CAN_EVENT_BITRATE     2
+#define COLOR2CAN_EVENT_STATUS      3
+#define COLOR2CAN_EVENT_LATENCY     4
+#define COLOR2CAN_EVENT_TRACE       5
+#define COLOR2CAN_EVENT_TYPES       6
+
+struct color2can_event {
+    uint8_t type;      // COLOR2CAN_EVENT_*
+    uint8_t sensor_id; // 1...31
+    uint8_t len;
+
+    uint64_t time; // kernel receive time (microseconds since the epoch)
+
+    union {
+        struct color2can_sample      sample;
+        struct color2can_sample_info sample_info;
+        struct color2can_bitrate     bitrate;
+        struct color2can_status      status;
+        struct color2can_latency     latency;
+        struct color2can_trace       trace;
+        uint8_t data[8];
+    };
+};
+
+typedef void (*color2can_callback)(const struct color2can_event *event,
+                                   void *user);
+
+struct color2can_client_stats {
+    uint64_t frames;    // frames received
+    uint64_t events;    // frames decoded into events
+    uint64_t malformed; // frames of unexpected length
+    uint32_t dropped;   // frames dropped by the socket (SO_RXQ_OVFL)
+};
+
+struct color2can_client;
+
+// Returns NULL on error, with errno set. 'types' is a combination of
+// COLOR2CAN_CLIENT_*.
+extern struct color2can_client *color2can_client_open(const char *ifname,
+                                                      uint32_t types);
+
+// Same as color2can_client_open, on a socket opened by the caller: a CAN
+// socket already bound, or any socket carrying struct can_frame
+// datagrams, such as one end of a socketpair. The client owns the socket
+// and makes it non-blocking.
+extern struct color2can_client *color2can_client_open_socket(
+    int sockfd, uint32_t types
+);
+extern void color2can_client_close(struct color2can_client *client);
+
+// File descriptor to wait on (poll, epoll) for received messages
+extern int color2can_client_fd(const struct color2can_client *client);
+
+// Reads the messages available, up to 'max' events. Returns the number
+// of events, 0 if there are none, or -1 on error (errno is set).
+extern int color2can_client_receive(struct color2can_client *client,
+                                    struct color2can_event *events, int max);
+
+// Calls 'callback' for each event of a sensor (1...31) and type, or of
+// all sensors if 'sensor_id' is 0. Callbacks of a specific sensor take
+// precedence over those of all sensors. A NULL callback removes it.
+extern void color2can_client_set_callback(struct color2can_client *client,
+                                          int sensor_id, int type,
+                                          color2can_callback callback,
+                                          void *user);
+
+// Reads the messages available and calls the callbacks. Returns the
+// number of events, or -1 on error (errno is set).
+extern int color2can_client_dispatch(struct color2can_client *client);
+
+extern void color2can_client_get_stats(const struct color2can_client *client,
+                                       struct color2can_client_stats *stats);
+
+// The send functions return 0 on success, or -1 on error (errno is set,
+// EAGAIN or ENOBUFS if the transmit queue is full). A sensor ID of 0 is
+// a broadcast.
+
+extern int color2can_client_send(struct color2can_client *client,
+                                 uint32_t id, const void *data, int len,
+                                 bool rtr);
+
+extern int color2can_client_configure(struct color2can_client *client,
+                                      int sensor_id,
+                                      const struct color2can_config *config);
+extern int color2can_client_configure_ext(
+    struct color2can_client *client, int sensor_id,
+    const struct color2can_config_ext *config
+);
+extern int color2can_client_set_range(struct color2can_client *client,
+                                      int sensor_id,
+                                      const struct color2can_range *range);
+
+extern int color2can_client_request_sample(struct color2can_client *client,
+                                           int sensor_id);
+extern int color2can_client_request_samples(struct color2can_client *client,
+                                            int sensor_id,
+                                            int count, int spacing);
+extern int color2can_client_sync(struct color2can_client *client,
+                                 int counter, int stagger);
+extern int color2can_client_request_status(struct color2can_client *client,
+                                           int sensor_id);
+
+#ifdef __cplusplus
+}
+#endif
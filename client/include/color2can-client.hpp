@@ -0,0 +1,202 @@
+#pragma once
+
+#include <cerrno>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "color2can-client.h"
+#include "color2can-latest.h"
+
+// C++ wrapper of color2can-client.h. Errors are reported by throwing
+// std::system_error, except for send() and the request functions, which
+// return false if the transmit queue is full.
+namespace color2can {
+
+using Event    = color2can_event;
+using Stats    = color2can_client_stats;
+using Callback = std::function<void(const Event &)>;
+
+using LatestSample = color2can_latest_sample;
+
+// Latest sample of each sensor, see color2can-latest.h
+class Latest {
+public:
+    Latest() : latest(color2can_latest_create()) {
+        if(!latest)
+            throw std::system_error(errno, std::generic_category(),
+                                    "color2can_latest_create");
+    }
+
+    ~Latest() {
+        color2can_latest_destroy(latest);
+    }
+
+    Latest(const Latest &) = delete;
+    Latest &operator=(const Latest &) = delete;
+
+    std::optional<LatestSample> read(int sensor_id) const {
+        LatestSample sample;
+        if(color2can_latest_read(latest, sensor_id, &sample))
+            return std::nullopt;
+        return sample;
+    }
+
+    static uint64_t age(const LatestSample &sample) {
+        return color2can_latest_age(&sample);
+    }
+
+    color2can_latest *get() {
+        return latest;
+    }
+
+private:
+    color2can_latest *latest;
+};
+
+class Client {
+public:
+    explicit Client(const std::string &ifname,
+                    uint32_t types = COLOR2CAN_CLIENT_ALL)
+        : client(color2can_client_open(ifname.c_str(), types)) {
+        if(!client)
+            throw std::system_error(errno, std::generic_category(),
+                                    "color2can_client_open");
+    }
+
+    // see color2can_client_open_socket
+    explicit Client(int sockfd, uint32_t types = COLOR2CAN_CLIENT_ALL)
+        : client(color2can_client_open_socket(sockfd, types)) {
+        if(!client)
+            throw std::system_error(errno, std::generic_category(),
+                                    "color2can_client_open_socket");
+    }
+
+    ~Client() {
+        color2can_client_close(client);
+    }
+
+    Client(const Client &) = delete;
+    Client &operator=(const Client &) = delete;
+
+    int fd() const {
+        return color2can_client_fd(client);
+    }
+
+    // Appends the available events to 'events', returns their number
+    size_t receive(std::vector<Event> &events) {
+        size_t total = 0;
+        while(true) {
+            Event batch[64];
+            const int n = color2can_client_receive(client, batch, 64);
+            if(n < 0)
+                throw std::system_error(errno, std::generic_category(),
+                                        "color2can_client_receive");
+            events.insert(events.end(), batch, batch + n);
+            total += n;
+
+            if(n < 64)
+                return total;
+        }
+    }
+
+    // Calls 'callback' for each event of a sensor, or of all sensors if
+    // 'sensor_id' is 0. An empty callback removes it.
+    void on(int sensor_id, int type, Callback callback) {
+        if(sensor_id < 0 || sensor_id >= COLOR2CAN_MAX_SENSOR_COUNT ||
+           type < 0 || type >= COLOR2CAN_EVENT_TYPES)
+            return;
+
+        Callback &slot = callbacks[sensor_id][type];
+        slot = std::move(callback);
+        color2can_client_set_callback(
+            client, sensor_id, type,
+            slot ? trampoline : nullptr, &slot
+        );
+    }
+
+    void on_sample(int sensor_id, Callback callback) {
+        on(sensor_id, COLOR2CAN_EVENT_SAMPLE, std::move(callback));
+    }
+
+    void on_sample_info(int sensor_id, Callback callback) {
+        on(sensor_id, COLOR2CAN_EVENT_SAMPLE_INFO, std::move(callback));
+    }
+
+    void on_status(int sensor_id, Callback callback) {
+        on(sensor_id, COLOR2CAN_EVENT_STATUS, std::move(callback));
+    }
+
+    // Reads the available messages and calls the callbacks
+    int dispatch() {
+        const int n = color2can_client_dispatch(client);
+        if(n < 0)
+            throw std::system_error(errno, std::generic_category(),
+                                    "color2can_client_dispatch");
+        return n;
+    }
+
+    // Updates 'latest' with each event received, until called again.
+    // 'latest' must outlive the client, or be removed with nullptr.
+    void set_latest(Latest *latest) {
+        color2can_client_set_latest(client, latest ? latest->get() : nullptr);
+    }
+
+    Stats stats() const {
+        Stats s;
+        color2can_client_get_stats(client, &s);
+        return s;
+    }
+
+    bool send(uint32_t id, const void *data, int len, bool rtr = false) {
+        return !color2can_client_send(client, id, data, len, rtr);
+    }
+
+    bool configure(int sensor_id, const color2can_config &config) {
+        return !color2can_client_configure(client, sensor_id, &config);
+    }
+
+    bool configure(int sensor_id, const color2can_config_ext &config) {
+        return !color2can_client_configure_ext(client, sensor_id, &config);
+    }
+
+    bool set_range(int sensor_id, const color2can_range &range) {
+        return !color2can_client_set_range(client, sensor_id, &range);
+    }
+
+    bool request_sample(int sensor_id) {
+        return !color2can_client_request_sample(client, sensor_id);
+    }
+
+    bool request_samples(int sensor_id, int count, int spacing) {
+        return !color2can_client_request_samples(
+            client, sensor_id, count, spacing
+        );
+    }
+
+    bool sync(int counter, int stagger) {
+        return !color2can_client_sync(client, counter, stagger);
+    }
+
+    bool request_status(int sensor_id) {
+        return !color2can_client_request_status(client, sensor_id);
+    }
+
+    // the underlying C client
+    color2can_client *get() {
+        return client;
+    }
+
+private:
+    static void trampoline(const Event *event, void *user) {
+        (*static_cast<Callback *>(user))(*event);
+    }
+
+    color2can_client *client;
+    Callback callbacks[COLOR2CAN_MAX_SENSOR_COUNT][COLOR2CAN_EVENT_TYPES];
+};
+
+} // namespace color2can
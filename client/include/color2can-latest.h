@@ -0,0 +1,60 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "color2can.h"
+#include "color2can-client.h"
+
+// Table of the latest sample of each sensor (1...31), for consumers that
+// do not need every sample. It is filled by a single writer, usually
+// the receive path of a client (color2can_client_set_latest), and read
+// by any number of threads at any rate.
+//
+// Each entry is a seqlock: readers never block the writer, and take no
+// lock. A read is only retried if it overlaps the writer updating the
+// same entry, which takes a few nanoseconds.
+
+struct color2can_latest_sample {
+    uint32_t sequence; // samples received from the sensor: 0=none
+    bool info_valid;   // 'info' was received after this sample
+
+    uint64_t time; // kernel receive time (microseconds since the epoch)
+
+    struct color2can_sample sample;
+    struct color2can_sample_info info;
+};
+
+struct color2can_latest;
+
+// Returns NULL on error, with errno set
+extern struct color2can_latest *color2can_latest_create(void);
+extern void color2can_latest_destroy(struct color2can_latest *latest);
+
+// Writer: store a sample or sample info event. Other events are ignored.
+extern void color2can_latest_update(struct color2can_latest *latest,
+                                    const struct color2can_event *event);
+
+// Reader: returns 0 on success, 1 if the sensor ID is not valid or no
+// sample was received yet.
+extern int color2can_latest_read(const struct color2can_latest *latest,
+                                 int sensor_id,
+                                 struct color2can_latest_sample *sample);
+
+// Time since the sample was received, in microseconds
+extern uint64_t color2can_latest_age(
+    const struct color2can_latest_sample *sample
+);
+
+// Make the client update 'latest' with each event it receives, before
+// returning or dispatching it. NULL disables it.
+extern void color2can_client_set_latest(struct color2can_client *client,
+                                        struct color2can_latest *latest);
+
+#ifdef __cplusplus
+}
+#endif
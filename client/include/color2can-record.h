@@ -0,0 +1,97 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <linux/can.h>
+
+// Binary log of CAN frames: a header, followed by records appended in
+// the order they were received. The file is written through a large
+// memory mapping, so appending a record is a copy into memory.
+
+#define COLOR2CAN_RECORD_MAGIC   "C2CREC\0\0"
+#define COLOR2CAN_RECORD_VERSION 1
+
+struct color2can_record_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t start_time; // host time (microseconds) of the recording
+};
+
+#define COLOR2CAN_RECORD_FD (1 << 0) // CAN FD frame
+
+struct color2can_record {
+    uint64_t time;   // kernel timestamp, in microseconds
+    uint32_t can_id; // SocketCAN ID, including the EFF/RTR/ERR flags
+    uint8_t len;     // 0...64
+    uint8_t flags;   // COLOR2CAN_RECORD_*
+    uint16_t reserved;
+
+    uint8_t data[]; // padded to a multiple of 8 bytes
+};
+
+// Size of a record holding 'len' bytes of data
+#define COLOR2CAN_RECORD_SIZE(len)\
+    (sizeof(struct color2can_record) + (((len) + 7) & ~7))
+
+struct color2can_record_writer;
+struct color2can_record_reader;
+
+// Writer: creates (or truncates) the file at 'path'. Returns NULL on
+// error, with errno set.
+extern struct color2can_record_writer *color2can_record_create(
+    const char *path
+);
+
+// Appends a frame of 'len' bytes. Returns 0 on success, or -1 on error
+// (errno is set).
+extern int color2can_record_append(struct color2can_record_writer *writer,
+                                   uint64_t time, uint32_t can_id,
+                                   const uint8_t *data, int len,
+                                   uint8_t flags);
+
+// Bytes written so far, including the header
+extern uint64_t color2can_record_size(
+    const struct color2can_record_writer *writer
+);
+
+// Truncates the file to the records written and closes it. Returns 0
+// on success, or -1 on error (errno is set).
+extern int color2can_record_finish(struct color2can_record_writer *writer);
+
+// Reader: maps the file at 'path'. Returns NULL on error, with errno set
+// (EINVAL if the file is not a log).
+extern struct color2can_record_reader *color2can_record_open(
+    const char *path
+);
+extern void color2can_record_close(struct color2can_record_reader *reader);
+
+extern const struct color2can_record_header *color2can_record_get_header(
+    const struct color2can_record_reader *reader
+);
+
+// Returns the next record, or NULL at the end of the log. A log that
+// was not finished (e.g. the recorder crashed) ends at the first
+// incomplete record.
+extern const struct color2can_record *color2can_record_next(
+    struct color2can_record_reader *reader
+);
+
+extern void color2can_record_rewind(struct color2can_record_reader *reader);
+
+// Position of the next record, which can be passed to
+// color2can_record_seek to read the log from there
+extern uint64_t color2can_record_tell(
+    const struct color2can_record_reader *reader
+);
+extern void color2can_record_seek(struct color2can_record_reader *reader,
+                                  uint64_t position);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,90 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "color2can-client.h"
+
+// Ring buffer of decoded events in shared memory, written by a single
+// process that owns the CAN bus and read by any number of processes.
+// Each reader has its own cursor. A reader that falls behind by more
+// than the capacity of the ring loses the oldest events, and is told how
+// many.
+
+#define COLOR2CAN_SHM_NAME "/color2can"
+
+// maximum number of readers attached at the same time
+#define COLOR2CAN_SHM_READERS 16
+
+// flags of color2can_shm_create
+#define COLOR2CAN_SHM_TAKEOVER 1 // replace an existing object
+
+struct color2can_shm_writer;
+struct color2can_shm_reader;
+
+struct color2can_shm_reader_info {
+    int pid;         // 0=slot not used
+    uint64_t cursor; // position of the next event to read
+    uint64_t lost;   // events overwritten before being read
+};
+
+// Writer: creates the shared memory object 'name', with room for
+// 'capacity' events (rounded up to a power of 2). If the object already
+// exists, fails with EEXIST, unless COLOR2CAN_SHM_TAKEOVER is set: then
+// the object is replaced, which is only meant for an object left by a
+// writer that crashed (readers of a live writer would stop receiving
+// events). Returns NULL on error, with errno set.
+extern struct color2can_shm_writer *color2can_shm_create(const char *name,
+                                                         uint32_t capacity,
+                                                         int flags);
+
+// Unmaps and removes the shared memory object
+extern void color2can_shm_destroy(struct color2can_shm_writer *writer);
+
+extern void color2can_shm_publish(struct color2can_shm_writer *writer,
+                                  const struct color2can_event *events,
+                                  int count);
+
+// Number of events published so far
+extern uint64_t color2can_shm_head(const struct color2can_shm_writer *writer);
+
+// Returns 0 if reader slot 'i' is in use, filling 'info'
+extern int color2can_shm_reader_info(const struct color2can_shm_writer *writer,
+                                     int i,
+                                     struct color2can_shm_reader_info *info);
+
+// Reader: attaches to the shared memory object 'name'. Only events
+// published after attaching are read. Returns NULL on error, with errno
+// set (EBUSY if all reader slots are in use).
+extern struct color2can_shm_reader *color2can_shm_attach(const char *name);
+extern void color2can_shm_detach(struct color2can_shm_reader *reader);
+
+// Reads up to 'max' events, returning their number. If events were lost
+// since the previous call, their number is added to 'lost' (if not
+// NULL). Returns -1 if the writer has gone away.
+extern int color2can_shm_read(struct color2can_shm_reader *reader,
+                              struct color2can_event *events, int max,
+                              uint64_t *lost);
+
+// Reads the next event without consuming it: points 'event' to a copy
+// held by the reader and returns 1; returns 0 if there are no events, or
+// -1 if the writer has gone away. Lost events are counted as by
+// color2can_shm_read. Until color2can_shm_release is called, peeking
+// again returns the same event, which the writer cannot overwrite.
+extern int color2can_shm_peek(struct color2can_shm_reader *reader,
+                              const struct color2can_event **event,
+                              uint64_t *lost);
+extern void color2can_shm_release(struct color2can_shm_reader *reader);
+
+// Waits until events are available or 'timeout' (in milliseconds, -1 to
+// wait forever) expires. Returns 1 if events are available, 0 otherwise.
+extern int color2can_shm_wait(struct color2can_shm_reader *reader,
+                              int timeout);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,49 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "color2can.h"
+
+// Bulk decoding of sample messages: unpacks an array of 8-byte payloads
+// (struct color2can_sample) into one array per field. On x86, SSE2 and
+// AVX2 kernels are used if the CPU supports them; elsewhere, or if the
+// compiler lays out the bitfields differently than the kernels expect,
+// the scalar kernel is used.
+
+#define COLOR2CAN_UNPACK_SCALAR 0
+#define COLOR2CAN_UNPACK_SSE2   1
+#define COLOR2CAN_UNPACK_AVX2   2
+#define COLOR2CAN_UNPACK_KERNELS 3
+
+struct color2can_sample_columns {
+    uint16_t *color[3];
+    uint16_t *clear;
+    uint8_t  *within_range;
+    uint8_t  *range_id;
+};
+
+// Unpacks 'count' samples from 'payloads' (count * 8 bytes, with no
+// alignment requirement) into the arrays of 'out', each having room for
+// 'count' values.
+extern void color2can_unpack_samples(
+    const void *payloads, size_t count,
+    const struct color2can_sample_columns *out
+);
+
+// Returns the kernel used by color2can_unpack_samples
+extern int color2can_unpack_get_kernel(void);
+
+// Selects a kernel. Returns 0 on success, or 1 if the kernel is not
+// supported by the CPU or by the bitfield layout.
+extern int color2can_unpack_set_kernel(int kernel);
+
+extern const char *color2can_unpack_kernel_name(int kernel);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,604 @@
+#include "color2can-archive.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define BLOCK_ROWS COLOR2CAN_ARCHIVE_BLOCK_ROWS
+#define COLUMNS    COLOR2CAN_ARCHIVE_COLUMNS
+
+// maximum size of a varint (LEB128) encoding a 64-bit value
+#define VARINT_MAX 10
+
+struct file_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+
+    uint64_t index_offset;
+    uint64_t block_count;
+};
+
+// Entry of the index. The columns of a block are stored one after the
+// other, starting at 'offset'.
+struct block_entry {
+    uint64_t offset;
+    uint64_t time_min, time_max;
+
+    uint32_t rows;
+    uint8_t sensor_id;
+    uint8_t reserved[3];
+
+    uint32_t column_size[COLUMNS];
+    uint32_t reserved2;
+};
+_Static_assert(sizeof(struct block_entry) == 64,
+               "unexpected size of struct block_entry");
+
+// Rows of a block, in columns
+struct block_rows {
+    uint64_t time[BLOCK_ROWS];
+    uint16_t color[3][BLOCK_ROWS];
+    uint16_t clear[BLOCK_ROWS];
+    uint8_t within_range[BLOCK_ROWS];
+    uint8_t range_id[BLOCK_ROWS];
+};
+
+/* ================================================================== */
+/*                               Codecs                               */
+/* ================================================================== */
+
+// Time is encoded as the difference between consecutive deltas, which
+// is close to 0 for periodic samples. Colors are encoded as deltas.
+// The range fields change rarely and are run-length encoded. All values
+// are zigzag-encoded varints.
+
+static inline uint64_t zigzag(int64_t val) {
+    return ((uint64_t) val << 1) ^ (uint64_t) (val >> 63);
+}
+
+static inline int64_t unzigzag(uint64_t val) {
+    return (int64_t) (val >> 1) ^ -(int64_t) (val & 1);
+}
+
+static inline uint8_t *put_varint(uint8_t *out, uint64_t val) {
+    while(val >= 0x80) {
+        *(out++) = val | 0x80;
+        val >>= 7;
+    }
+    *(out++) = val;
+    return out;
+}
+
+// Returns NULL if the varint does not end before 'end'
+static inline const uint8_t *get_varint(const uint8_t *in,
+                                        const uint8_t *end,
+                                        uint64_t *val) {
+    uint64_t result = 0;
+    for(int shift = 0; in < end && shift < 64; shift += 7) {
+        const uint8_t byte = *(in++);
+        result |= (uint64_t) (byte & 0x7f) << shift;
+        if(!(byte & 0x80)) {
+            *val = result;
+            return in;
+        }
+    }
+    return NULL;
+}
+
+static uint8_t *encode_time(uint8_t *out, const uint64_t *values, int n) {
+    int64_t prev_delta = 0;
+    for(int i = 0; i < n; i++) {
+        const int64_t delta = (i == 0) ? values[0] : values[i] - values[i - 1];
+        out = put_varint(out, zigzag(delta - prev_delta));
+        prev_delta = delta;
+    }
+    return out;
+}
+
+static int decode_time(const uint8_t *in, const uint8_t *end,
+                       uint64_t *values, int n) {
+    uint64_t value = 0;
+    int64_t delta = 0;
+    for(int i = 0; i < n; i++) {
+        uint64_t raw;
+        if(!(in = get_varint(in, end, &raw)))
+            return 1;
+
+        delta += unzigzag(raw);
+        value += delta;
+        values[i] = value;
+    }
+    return 0;
+}
+
+static uint8_t *encode_delta(uint8_t *out, const uint16_t *values, int n) {
+    int prev = 0;
+    for(int i = 0; i < n; i++) {
+        out = put_varint(out, zigzag(values[i] - prev));
+        prev = values[i];
+    }
+    return out;
+}
+
+static int decode_delta(const uint8_t *in, const uint8_t *end,
+                        uint16_t *values, int n) {
+    int value = 0;
+    for(int i = 0; i < n; i++) {
+        uint64_t raw;
+        if(!(in = get_varint(in, end, &raw)))
+            return 1;
+
+        value += unzigzag(raw);
+        values[i] = value;
+    }
+    return 0;
+}
+
+static uint8_t *encode_rle(uint8_t *out, const uint8_t *values, int n) {
+    for(int i = 0; i < n;) {
+        int run = 1;
+        while(i + run < n && values[i + run] == values[i])
+            run++;
+
+        out = put_varint(out, values[i]);
+        out = put_varint(out, run);
+        i += run;
+    }
+    return out;
+}
+
+static int decode_rle(const uint8_t *in, const uint8_t *end,
+                      uint8_t *values, int n) {
+    for(int i = 0; i < n;) {
+        uint64_t value, run;
+        if(!(in = get_varint(in, end, &value)) ||
+           !(in = get_varint(in, end, &run)) ||
+           run == 0 || run > n - i)
+            return 1;
+
+        memset(&values[i], value, run);
+        i += run;
+    }
+    return 0;
+}
+
+/* ================================================================== */
+/*                               Writer                               */
+/* ================================================================== */
+
+struct color2can_archive_writer {
+    FILE *file;
+    uint64_t offset;
+
+    // rows not written yet, for each sensor
+    struct block_rows *pending[COLOR2CAN_MAX_SENSOR_COUNT];
+    int pending_count[COLOR2CAN_MAX_SENSOR_COUNT];
+
+    // time of the latest sample of each sensor, also in written blocks
+    uint64_t last_time[COLOR2CAN_MAX_SENSOR_COUNT];
+
+    struct block_entry *index;
+    uint64_t block_count, index_capacity;
+
+    uint8_t buffer[COLUMNS * BLOCK_ROWS * VARINT_MAX];
+};
+
+struct color2can_archive_writer *color2can_archive_create(const char *path) {
+    struct color2can_archive_writer *writer = calloc(1, sizeof(*writer));
+    if(!writer)
+        return NULL;
+
+    writer->file = fopen(path, "wb");
+    if(!writer->file) {
+        const int err = errno;
+        free(writer);
+        errno = err;
+        return NULL;
+    }
+
+    // the header is written again by color2can_archive_finish
+    struct file_header header = { 0 };
+    fwrite(&header, sizeof(header), 1, writer->file);
+    writer->offset = sizeof(header);
+    return writer;
+}
+
+static int write_block(struct color2can_archive_writer *writer,
+                       int sensor_id) {
+    const struct block_rows *rows = writer->pending[sensor_id];
+    const int n = writer->pending_count[sensor_id];
+
+    if(writer->block_count == writer->index_capacity) {
+        const uint64_t capacity = writer->index_capacity * 2 + 64;
+        struct block_entry *index = realloc(
+            writer->index, capacity * sizeof(*index)
+        );
+        if(!index)
+            return -1;
+        writer->index          = index;
+        writer->index_capacity = capacity;
+    }
+
+    struct block_entry *entry = &writer->index[writer->block_count];
+    *entry = (struct block_entry) {
+        .offset    = writer->offset,
+        .time_min  = rows->time[0],
+        .time_max  = rows->time[n - 1],
+        .rows      = n,
+        .sensor_id = sensor_id
+    };
+
+    uint8_t *out = writer->buffer;
+    uint8_t *column_start[COLUMNS + 1];
+
+    column_start[COLOR2CAN_ARCHIVE_TIME] = out;
+    out = encode_time(out, rows->time, n);
+    for(int i = 0; i < 3; i++) {
+        column_start[COLOR2CAN_ARCHIVE_RED + i] = out;
+        out = encode_delta(out, rows->color[i], n);
+    }
+    column_start[COLOR2CAN_ARCHIVE_CLEAR] = out;
+    out = encode_delta(out, rows->clear, n);
+    column_start[COLOR2CAN_ARCHIVE_WITHIN_RANGE] = out;
+    out = encode_rle(out, rows->within_range, n);
+    column_start[COLOR2CAN_ARCHIVE_RANGE_ID] = out;
+    out = encode_rle(out, rows->range_id, n);
+    column_start[COLUMNS] = out;
+
+    for(int i = 0; i < COLUMNS; i++)
+        entry->column_size[i] = column_start[i + 1] - column_start[i];
+
+    const size_t size = out - writer->buffer;
+    if(fwrite(writer->buffer, 1, size, writer->file) != size)
+        return -1;
+
+    writer->offset += size;
+    writer->block_count++;
+    writer->pending_count[sensor_id] = 0;
+    return 0;
+}
+
+int color2can_archive_add(struct color2can_archive_writer *writer,
+                          int sensor_id, uint64_t time,
+                          const struct color2can_sample *sample) {
+    if(sensor_id < 1 || sensor_id >= COLOR2CAN_MAX_SENSOR_COUNT) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    // the reader expects the blocks of a sensor not to overlap
+    if(time < writer->last_time[sensor_id]) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    struct block_rows *rows = writer->pending[sensor_id];
+    if(!rows) {
+        rows = malloc(sizeof(*rows));
+        if(!rows)
+            return -1;
+        writer->pending[sensor_id] = rows;
+    }
+
+    const int i = writer->pending_count[sensor_id];
+    rows->time[i]         = time;
+    rows->color[0][i]     = sample->color[0];
+    rows->color[1][i]     = sample->color[1];
+    rows->color[2][i]     = sample->color[2];
+    rows->clear[i]        = sample->clear;
+    rows->within_range[i] = sample->within_range;
+    rows->range_id[i]     = sample->range_id;
+    writer->pending_count[sensor_id] = i + 1;
+    writer->last_time[sensor_id] = time;
+
+    if(i + 1 == BLOCK_ROWS)
+        return write_block(writer, sensor_id);
+    return 0;
+}
+
+int color2can_archive_finish(struct color2can_archive_writer *writer) {
+    int err = 0;
+    for(int i = 0; i < COLOR2CAN_MAX_SENSOR_COUNT; i++) {
+        if(!err && writer->pending_count[i] > 0 && write_block(writer, i))
+            err = errno;
+        free(writer->pending[i]);
+    }
+
+    struct file_header header = {
+        .magic        = COLOR2CAN_ARCHIVE_MAGIC,
+        .version      = COLOR2CAN_ARCHIVE_VERSION,
+        .index_offset = writer->offset,
+        .block_count  = writer->block_count
+    };
+    if(!err) {
+        const size_t count = writer->block_count;
+        if(fwrite(writer->index, sizeof(*writer->index), count,
+                  writer->file) != count ||
+           fseek(writer->file, 0, SEEK_SET) ||
+           fwrite(&header, sizeof(header), 1, writer->file) != 1)
+            err = errno;
+    }
+    if(fclose(writer->file) && !err)
+        err = errno;
+
+    free(writer->index);
+    free(writer);
+
+    if(err) {
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+/* ================================================================== */
+/*                               Reader                               */
+/* ================================================================== */
+
+struct color2can_archive_reader {
+    const uint8_t *data;
+    uint64_t size;
+
+    const struct block_entry *index;
+    uint64_t block_count;
+
+    // indexes of the blocks of each sensor, in time order
+    uint32_t *sensor_blocks[COLOR2CAN_MAX_SENSOR_COUNT];
+    uint32_t sensor_block_count[COLOR2CAN_MAX_SENSOR_COUNT];
+
+    struct block_rows rows;
+};
+
+static int check_index(const struct color2can_archive_reader *reader,
+                       uint64_t index_offset) {
+    for(uint64_t i = 0; i < reader->block_count; i++) {
+        const struct block_entry *entry = &reader->index[i];
+        if(entry->rows == 0 || entry->rows > BLOCK_ROWS ||
+           entry->sensor_id == 0 ||
+           entry->sensor_id >= COLOR2CAN_MAX_SENSOR_COUNT)
+            return 1;
+
+        uint64_t end = entry->offset;
+        for(int c = 0; c < COLUMNS; c++)
+            end += entry->column_size[c];
+        if(entry->offset < sizeof(struct file_header) || end > index_offset)
+            return 1;
+    }
+    return 0;
+}
+
+static int build_sensor_index(struct color2can_archive_reader *reader) {
+    for(uint64_t i = 0; i < reader->block_count; i++)
+        reader->sensor_block_count[reader->index[i].sensor_id]++;
+
+    for(int s = 0; s < COLOR2CAN_MAX_SENSOR_COUNT; s++) {
+        if(reader->sensor_block_count[s] == 0)
+            continue;
+
+        reader->sensor_blocks[s] = malloc(
+            reader->sensor_block_count[s] * sizeof(uint32_t)
+        );
+        if(!reader->sensor_blocks[s])
+            return 1;
+        reader->sensor_block_count[s] = 0;
+    }
+
+    // the writer writes the blocks of each sensor in time order
+    for(uint64_t i = 0; i < reader->block_count; i++) {
+        const int s = reader->index[i].sensor_id;
+        reader->sensor_blocks[s][reader->sensor_block_count[s]++] = i;
+    }
+    return 0;
+}
+
+struct color2can_archive_reader *color2can_archive_open(const char *path) {
+    const int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+        return NULL;
+
+    struct stat st;
+    if(fstat(fd, &st)) {
+        close(fd);
+        return NULL;
+    }
+
+    const struct file_header *header = NULL;
+    if(st.st_size >= sizeof(*header)) {
+        header = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(header == MAP_FAILED) {
+            close(fd);
+            return NULL;
+        }
+    }
+    close(fd);
+
+    if(!header ||
+       memcmp(header->magic, COLOR2CAN_ARCHIVE_MAGIC, 8) ||
+       header->version != COLOR2CAN_ARCHIVE_VERSION ||
+       header->index_offset > st.st_size ||
+       header->block_count > (st.st_size - header->index_offset) /
+                             sizeof(struct block_entry)) {
+        if(header)
+            munmap((void *) header, st.st_size);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    struct color2can_archive_reader *reader = calloc(1, sizeof(*reader));
+    if(!reader) {
+        munmap((void *) header, st.st_size);
+        return NULL;
+    }
+    reader->data        = (const uint8_t *) header;
+    reader->size        = st.st_size;
+    reader->index       = (const void *) (reader->data + header->index_offset);
+    reader->block_count = header->block_count;
+
+    if(check_index(reader, header->index_offset)) {
+        color2can_archive_close(reader);
+        errno = EINVAL;
+        return NULL;
+    }
+    if(build_sensor_index(reader)) {
+        color2can_archive_close(reader);
+        errno = ENOMEM;
+        return NULL;
+    }
+    return reader;
+}
+
+void color2can_archive_close(struct color2can_archive_reader *reader) {
+    if(!reader)
+        return;
+
+    for(int i = 0; i < COLOR2CAN_MAX_SENSOR_COUNT; i++)
+        free(reader->sensor_blocks[i]);
+    munmap((void *) reader->data, reader->size);
+    free(reader);
+}
+
+void color2can_archive_get_info(
+    const struct color2can_archive_reader *reader,
+    struct color2can_archive_info *info
+) {
+    memset(info, 0, sizeof(*info));
+    info->blocks = reader->block_count;
+
+    for(uint64_t i = 0; i < reader->block_count; i++) {
+        const struct block_entry *entry = &reader->index[i];
+        if(i == 0 || entry->time_min < info->time_min)
+            info->time_min = entry->time_min;
+        if(entry->time_max > info->time_max)
+            info->time_max = entry->time_max;
+
+        info->rows += entry->rows;
+        for(int c = 0; c < COLUMNS; c++)
+            info->column_size[c] += entry->column_size[c];
+    }
+}
+
+// Decodes the requested columns of a block
+static int decode_block(struct color2can_archive_reader *reader,
+                        const struct block_entry *entry, uint32_t columns) {
+    struct block_rows *rows = &reader->rows;
+    const int n = entry->rows;
+
+    const uint8_t *in = reader->data + entry->offset;
+    for(int c = 0; c < COLUMNS; c++) {
+        const uint8_t *end = in + entry->column_size[c];
+        if(columns & (1 << c)) {
+            int err;
+            if(c == COLOR2CAN_ARCHIVE_TIME)
+                err = decode_time(in, end, rows->time, n);
+            else if(c <= COLOR2CAN_ARCHIVE_BLUE)
+                err = decode_delta(in, end, rows->color[c - 1], n);
+            else if(c == COLOR2CAN_ARCHIVE_CLEAR)
+                err = decode_delta(in, end, rows->clear, n);
+            else if(c == COLOR2CAN_ARCHIVE_WITHIN_RANGE)
+                err = decode_rle(in, end, rows->within_range, n);
+            else
+                err = decode_rle(in, end, rows->range_id, n);
+
+            if(err)
+                return 1;
+        }
+        in = end;
+    }
+    return 0;
+}
+
+// Index of the first row with a time not less than 'time'
+static int lower_bound(const uint64_t *times, int n, uint64_t time) {
+    int lo = 0, hi = n;
+    while(lo < hi) {
+        const int mid = (lo + hi) / 2;
+        if(times[mid] < time)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+int64_t color2can_archive_query(struct color2can_archive_reader *reader,
+                                const struct color2can_archive_query *query,
+                                color2can_archive_callback callback,
+                                void *user) {
+    const uint64_t from = query->time_from;
+    const uint64_t to   = query->time_to ? query->time_to : UINT64_MAX;
+    const struct block_rows *rows = &reader->rows;
+
+    int64_t total = 0;
+    for(int s = 1; s < COLOR2CAN_MAX_SENSOR_COUNT; s++) {
+        if(query->sensors && !(query->sensors & (1u << s)))
+            continue;
+
+        const uint32_t *blocks = reader->sensor_blocks[s];
+        const uint32_t count   = reader->sensor_block_count[s];
+
+        // skip the blocks ending before 'from'
+        uint32_t lo = 0, hi = count;
+        while(lo < hi) {
+            const uint32_t mid = (lo + hi) / 2;
+            if(reader->index[blocks[mid]].time_max < from)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+
+        for(uint32_t b = lo; b < count; b++) {
+            const struct block_entry *entry = &reader->index[blocks[b]];
+            if(entry->time_min >= to)
+                break;
+
+            // blocks crossing the limits are cut by time
+            const bool partial = (entry->time_min < from ||
+                                  entry->time_max >= to);
+            uint32_t columns = query->columns;
+            if(partial)
+                columns |= 1 << COLOR2CAN_ARCHIVE_TIME;
+
+            if(decode_block(reader, entry, columns)) {
+                errno = EINVAL;
+                return -1;
+            }
+
+            int first = 0, last = entry->rows;
+            if(partial) {
+                first = lower_bound(rows->time, entry->rows, from);
+                last  = lower_bound(rows->time, entry->rows, to);
+            }
+            if(first == last)
+                continue;
+
+            const uint32_t c = query->columns;
+            struct color2can_archive_rows result = {
+                .sensor_id = s,
+                .count     = last - first
+            };
+            if(c & (1 << COLOR2CAN_ARCHIVE_TIME))
+                result.time = &rows->time[first];
+            for(int i = 0; i < 3; i++)
+                if(c & (1 << (COLOR2CAN_ARCHIVE_RED + i)))
+                    result.color[i] = &rows->color[i][first];
+            if(c & (1 << COLOR2CAN_ARCHIVE_CLEAR))
+                result.clear = &rows->clear[first];
+            if(c & (1 << COLOR2CAN_ARCHIVE_WITHIN_RANGE))
+                result.within_range = &rows->within_range[first];
+            if(c & (1 << COLOR2CAN_ARCHIVE_RANGE_ID))
+                result.range_id = &rows->range_id[first];
+
+            total += result.count;
+            if(callback && callback(&result, user))
+                return total;
+        }
+    }
+    return total;
+}
@@ -0,0 +1,403 @@
+#include "color2can-client.h"
+#include "color2can-latest.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/time.h>
+
+#include <net/if.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+
+#include <linux/can.h>
+#include <linux/can/raw.h>
+
+#define BATCH_SIZE 64
+
+#define CONTROL_SIZE (CMSG_SPACE(sizeof(struct timeval)) +\
+                      CMSG_SPACE(sizeof(uint32_t)))
+
+static const struct {
+    uint32_t mask_id;
+    int size;
+} event_types[COLOR2CAN_EVENT_TYPES] = {
+    [COLOR2CAN_EVENT_SAMPLE]      = {
+        COLOR2CAN_SAMPLE_MASK_ID, COLOR2CAN_SAMPLE_SIZE
+    },
+    [COLOR2CAN_EVENT_SAMPLE_INFO] = {
+        COLOR2CAN_SAMPLE_INFO_MASK_ID, COLOR2CAN_SAMPLE_INFO_SIZE
+    },
+    [COLOR2CAN_EVENT_BITRATE]     = {
+        COLOR2CAN_BITRATE_MASK_ID, COLOR2CAN_BITRATE_SIZE
+    },
+    [COLOR2CAN_EVENT_STATUS]      = {
+        COLOR2CAN_STATUS_MASK_ID, COLOR2CAN_STATUS_SIZE
+    },
+    [COLOR2CAN_EVENT_LATENCY]     = {
+        COLOR2CAN_LATENCY_MASK_ID, COLOR2CAN_LATENCY_SIZE
+    },
+    [COLOR2CAN_EVENT_TRACE]       = {
+        COLOR2CAN_TRACE_MASK_ID, COLOR2CAN_TRACE_SIZE
+    }
+};
+
+struct callback {
+    color2can_callback function;
+    void *user;
+};
+
+struct color2can_client {
+    int sockfd;
+
+    // event type of each message type (index: ID >> 5), or -1
+    int8_t type_of[64];
+
+    // receive buffers
+    struct can_frame frames[BATCH_SIZE];
+    struct iovec iovs[BATCH_SIZE];
+    struct mmsghdr msgs[BATCH_SIZE];
+    char control[BATCH_SIZE][CONTROL_SIZE];
+
+    struct color2can_event events[BATCH_SIZE];
+
+    struct callback callbacks[COLOR2CAN_MAX_SENSOR_COUNT]
+                             [COLOR2CAN_EVENT_TYPES];
+
+    struct color2can_latest *latest;
+
+    struct color2can_client_stats stats;
+};
+
+// Sets up the socket and the receive buffers
+static void init_client(struct color2can_client *client, uint32_t types) {
+    // only data frames of the subscribed types are received: requests
+    // sent by other hosts (RTR) are filtered out as well
+    struct can_filter filters[COLOR2CAN_EVENT_TYPES];
+    int filter_count = 0;
+
+    memset(client->type_of, -1, sizeof(client->type_of));
+    for(int i = 0; i < COLOR2CAN_EVENT_TYPES; i++) {
+        if(!(types & (1 << i)))
+            continue;
+
+        filters[filter_count++] = (struct can_filter) {
+            .can_id   = event_types[i].mask_id,
+            .can_mask = (CAN_SFF_MASK & ~0x1f) | CAN_EFF_FLAG | CAN_RTR_FLAG
+        };
+        client->type_of[event_types[i].mask_id >> 5] = i;
+    }
+    setsockopt(
+        client->sockfd, SOL_CAN_RAW, CAN_RAW_FILTER,
+        filters, filter_count * sizeof(struct can_filter)
+    );
+
+    const int enable = 1;
+    setsockopt(
+        client->sockfd, SOL_SOCKET, SO_TIMESTAMP, &enable, sizeof(enable)
+    );
+    setsockopt(
+        client->sockfd, SOL_SOCKET, SO_RXQ_OVFL, &enable, sizeof(enable)
+    );
+
+    for(int i = 0; i < BATCH_SIZE; i++) {
+        client->iovs[i] = (struct iovec) {
+            .iov_base = &client->frames[i],
+            .iov_len  = sizeof(struct can_frame)
+        };
+    }
+}
+
+struct color2can_client *color2can_client_open(const char *ifname,
+                                               uint32_t types) {
+    struct color2can_client *client = calloc(1, sizeof(*client));
+    if(!client)
+        return NULL;
+
+    client->sockfd = socket(PF_CAN, SOCK_RAW | SOCK_NONBLOCK, CAN_RAW);
+    if(client->sockfd < 0) {
+        free(client);
+        return NULL;
+    }
+    init_client(client, types);
+
+    struct ifreq ifr = { 0 };
+    strncpy(ifr.ifr_name, ifname, IFNAMSIZ - 1);
+
+    struct sockaddr_can addr = { 0 };
+    addr.can_family = AF_CAN;
+
+    if(ioctl(client->sockfd, SIOCGIFINDEX, &ifr) < 0)
+        goto error;
+    addr.can_ifindex = ifr.ifr_ifindex;
+
+    if(bind(client->sockfd, (struct sockaddr *) &addr, sizeof(addr)) < 0)
+        goto error;
+    return client;
+
+error: {
+        const int err = errno;
+        close(client->sockfd);
+        free(client);
+        errno = err;
+        return NULL;
+    }
+}
+
+struct color2can_client *color2can_client_open_socket(int sockfd,
+                                                      uint32_t types) {
+    const int flags = fcntl(sockfd, F_GETFL);
+    if(flags < 0 || fcntl(sockfd, F_SETFL, flags | O_NONBLOCK) < 0)
+        return NULL;
+
+    struct color2can_client *client = calloc(1, sizeof(*client));
+    if(!client)
+        return NULL;
+
+    client->sockfd = sockfd;
+    init_client(client, types);
+    return client;
+}
+
+void color2can_client_close(struct color2can_client *client) {
+    if(!client)
+        return;
+
+    close(client->sockfd);
+    free(client);
+}
+
+int color2can_client_fd(const struct color2can_client *client) {
+    return client->sockfd;
+}
+
+// Decode a frame, returning 0 if it is a valid event
+static int decode(struct color2can_client *client,
+                  const struct can_frame *frame,
+                  struct color2can_event *event) {
+    if(frame->can_id & (CAN_EFF_FLAG | CAN_RTR_FLAG | CAN_ERR_FLAG))
+        return 1;
+
+    const int type = client->type_of[(frame->can_id & CAN_SFF_MASK) >> 5];
+    const int sensor_id = frame->can_id & 0x1f;
+    if(type < 0 || sensor_id == 0)
+        return 1;
+
+    if(frame->can_dlc != event_types[type].size) {
+        client->stats.malformed++;
+        return 1;
+    }
+
+    event->type      = type;
+    event->sensor_id = sensor_id;
+    event->len       = frame->can_dlc;
+    memcpy(event->data, frame->data, frame->can_dlc);
+    return 0;
+}
+
+// Read a batch of frames: 'frames' is set to the number of frames read
+static int receive(struct color2can_client *client,
+                   struct color2can_event *events, int max, int *frames) {
+    *frames = 0;
+    if(max > BATCH_SIZE)
+        max = BATCH_SIZE;
+
+    for(int i = 0; i < max; i++) {
+        client->msgs[i].msg_hdr = (struct msghdr) {
+            .msg_iov        = &client->iovs[i],
+            .msg_iovlen     = 1,
+            .msg_control    = client->control[i],
+            .msg_controllen = CONTROL_SIZE
+        };
+    }
+
+    const int n = recvmmsg(client->sockfd, client->msgs, max,
+                           MSG_DONTWAIT, NULL);
+    if(n < 0)
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+    *frames = n;
+
+    int count = 0;
+    for(int i = 0; i < n; i++) {
+        struct msghdr *hdr = &client->msgs[i].msg_hdr;
+        client->stats.frames++;
+
+        struct color2can_event *event = &events[count];
+        if(decode(client, &client->frames[i], event))
+            continue;
+
+        struct timeval tv = { 0 };
+        for(struct cmsghdr *c = CMSG_FIRSTHDR(hdr); c;
+            c = CMSG_NXTHDR(hdr, c)) {
+            if(c->cmsg_level != SOL_SOCKET)
+                continue;
+
+            if(c->cmsg_type == SO_TIMESTAMP) {
+                memcpy(&tv, CMSG_DATA(c), sizeof(tv));
+            } else if(c->cmsg_type == SO_RXQ_OVFL) {
+                memcpy(
+                    &client->stats.dropped, CMSG_DATA(c),
+                    sizeof(client->stats.dropped)
+                );
+            }
+        }
+        event->time = (uint64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+        if(client->latest)
+            color2can_latest_update(client->latest, event);
+        count++;
+    }
+    client->stats.events += count;
+    return count;
+}
+
+int color2can_client_receive(struct color2can_client *client,
+                             struct color2can_event *events, int max) {
+    int frames;
+    return receive(client, events, max, &frames);
+}
+
+void color2can_client_set_callback(struct color2can_client *client,
+                                   int sensor_id, int type,
+                                   color2can_callback callback,
+                                   void *user) {
+    if(sensor_id < 0 || sensor_id >= COLOR2CAN_MAX_SENSOR_COUNT)
+        return;
+    if(type < 0 || type >= COLOR2CAN_EVENT_TYPES)
+        return;
+
+    client->callbacks[sensor_id][type] = (struct callback) {
+        .function = callback,
+        .user     = user
+    };
+}
+
+int color2can_client_dispatch(struct color2can_client *client) {
+    int total = 0;
+
+    // keep reading until the socket is empty
+    while(true) {
+        int frames;
+        const int n = receive(client, client->events, BATCH_SIZE, &frames);
+        if(n < 0)
+            return -1;
+
+        for(int i = 0; i < n; i++) {
+            const struct color2can_event *event = &client->events[i];
+
+            const struct callback *cb =
+                &client->callbacks[event->sensor_id][event->type];
+            if(!cb->function)
+                cb = &client->callbacks[0][event->type];
+
+            if(cb->function)
+                cb->function(event, cb->user);
+        }
+        total += n;
+
+        // a partial batch means there are no more frames
+        if(frames < BATCH_SIZE)
+            break;
+    }
+    return total;
+}
+
+void color2can_client_set_latest(struct color2can_client *client,
+                                 struct color2can_latest *latest) {
+    client->latest = latest;
+}
+
+void color2can_client_get_stats(const struct color2can_client *client,
+                                struct color2can_client_stats *stats) {
+    *stats = client->stats;
+}
+
+/* ================================================================== */
+/*                                Send                                */
+/* ================================================================== */
+
+int color2can_client_send(struct color2can_client *client,
+                          uint32_t id, const void *data, int len,
+                          bool rtr) {
+    if(len < 0 || len > CAN_MAX_DLEN) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    struct can_frame frame = { 0 };
+    frame.can_id  = id | (rtr ? CAN_RTR_FLAG : 0);
+    frame.can_dlc = len;
+    if(len > 0)
+        memcpy(frame.data, data, len);
+
+    if(write(client->sockfd, &frame, sizeof(frame)) != sizeof(frame))
+        return -1;
+    return 0;
+}
+
+int color2can_client_configure(struct color2can_client *client,
+                               int sensor_id,
+                               const struct color2can_config *config) {
+    return color2can_client_send(
+        client, COLOR2CAN_CONFIG_MASK_ID | sensor_id,
+        config, COLOR2CAN_CONFIG_SIZE, false
+    );
+}
+
+int color2can_client_configure_ext(struct color2can_client *client,
+                                   int sensor_id,
+                                   const struct color2can_config_ext *config) {
+    return color2can_client_send(
+        client, COLOR2CAN_CONFIG_MASK_ID | sensor_id,
+        config, COLOR2CAN_CONFIG_EXT_SIZE, false
+    );
+}
+
+int color2can_client_set_range(struct color2can_client *client,
+                               int sensor_id,
+                               const struct color2can_range *range) {
+    return color2can_client_send(
+        client, COLOR2CAN_RANGE_MASK_ID | sensor_id,
+        range, COLOR2CAN_RANGE_SIZE, false
+    );
+}
+
+int color2can_client_request_sample(struct color2can_client *client,
+                                    int sensor_id) {
+    return color2can_client_send(
+        client, COLOR2CAN_SAMPLE_MASK_ID | sensor_id, NULL, 0, true
+    );
+}
+
+int color2can_client_request_samples(struct color2can_client *client,
+                                     int sensor_id, int count, int spacing) {
+    struct color2can_request request = {
+        .count   = count,
+        .spacing = spacing
+    };
+    return color2can_client_send(
+        client, COLOR2CAN_SAMPLE_MASK_ID | sensor_id,
+        &request, COLOR2CAN_REQUEST_SIZE, false
+    );
+}
+
+int color2can_client_sync(struct color2can_client *client,
+                          int counter, int stagger) {
+    struct color2can_sync sync = {
+        .counter = counter,
+        .stagger = stagger
+    };
+    return color2can_client_send(
+        client, COLOR2CAN_SYNC_MASK_ID, &sync, COLOR2CAN_SYNC_SIZE, false
+    );
+}
+
+int color2can_client_request_status(struct color2can_client *client,
+                                    int sensor_id) {
+    return color2can_client_send(
+        client, COLOR2CAN_STATUS_MASK_ID | sensor_id, NULL, 0, true
+    );
+}
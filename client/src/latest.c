@@ -0,0 +1,127 @@
+#include "color2can-latest.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+// Values are stored as words, accessed with relaxed atomics: a reader
+// overlapping the writer sees a torn value, but no data race, and the
+// sequence tells it to retry.
+#define WORDS 4
+union value {
+    struct {
+        uint64_t time;
+        uint32_t sequence;
+        uint32_t info_valid;
+        struct color2can_sample sample;
+        struct color2can_sample_info info;
+    } fields;
+    uint64_t words[WORDS];
+};
+_Static_assert(sizeof(union value) == WORDS * sizeof(uint64_t),
+               "unexpected size of union value");
+
+struct entry {
+    _Alignas(64) uint32_t seq; // odd while the writer updates the entry
+    uint64_t words[WORDS];
+
+    // only accessed by the writer
+    union value current;
+};
+
+struct color2can_latest {
+    struct entry entries[COLOR2CAN_MAX_SENSOR_COUNT];
+};
+
+struct color2can_latest *color2can_latest_create(void) {
+    struct color2can_latest *latest;
+    if(posix_memalign((void **) &latest, 64, sizeof(*latest)))
+        return NULL;
+
+    memset(latest, 0, sizeof(*latest));
+    return latest;
+}
+
+void color2can_latest_destroy(struct color2can_latest *latest) {
+    free(latest);
+}
+
+static void publish(struct entry *e) {
+    const uint32_t seq = __atomic_load_n(&e->seq, __ATOMIC_RELAXED);
+
+    __atomic_store_n(&e->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    for(int i = 0; i < WORDS; i++)
+        __atomic_store_n(&e->words[i], e->current.words[i], __ATOMIC_RELAXED);
+
+    __atomic_store_n(&e->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+void color2can_latest_update(struct color2can_latest *latest,
+                             const struct color2can_event *event) {
+    if(event->sensor_id == 0 ||
+       event->sensor_id >= COLOR2CAN_MAX_SENSOR_COUNT)
+        return;
+
+    struct entry *e = &latest->entries[event->sensor_id];
+    if(event->type == COLOR2CAN_EVENT_SAMPLE) {
+        e->current.fields.time       = event->time;
+        e->current.fields.sequence++;
+        e->current.fields.info_valid = false;
+        e->current.fields.sample     = event->sample;
+    } else if(event->type == COLOR2CAN_EVENT_SAMPLE_INFO) {
+        // the info of a sample is sent right after it
+        if(e->current.fields.sequence == 0 ||
+           e->current.fields.info_valid)
+            return;
+
+        e->current.fields.info_valid = true;
+        e->current.fields.info       = event->sample_info;
+    } else {
+        return;
+    }
+    publish(e);
+}
+
+int color2can_latest_read(const struct color2can_latest *latest,
+                          int sensor_id,
+                          struct color2can_latest_sample *sample) {
+    if(sensor_id <= 0 || sensor_id >= COLOR2CAN_MAX_SENSOR_COUNT)
+        return 1;
+
+    const struct entry *e = &latest->entries[sensor_id];
+    union value value;
+    while(true) {
+        const uint32_t seq = __atomic_load_n(&e->seq, __ATOMIC_ACQUIRE);
+        if(seq & 1)
+            continue; // the writer is updating the entry
+
+        for(int i = 0; i < WORDS; i++)
+            value.words[i] = __atomic_load_n(&e->words[i], __ATOMIC_RELAXED);
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if(__atomic_load_n(&e->seq, __ATOMIC_RELAXED) == seq)
+            break;
+    }
+
+    if(value.fields.sequence == 0)
+        return 1;
+
+    *sample = (struct color2can_latest_sample) {
+        .sequence   = value.fields.sequence,
+        .info_valid = value.fields.info_valid,
+        .time       = value.fields.time,
+        .sample     = value.fields.sample,
+        .info       = value.fields.info
+    };
+    return 0;
+}
+
+uint64_t color2can_latest_age(const struct color2can_latest_sample *sample) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+
+    const uint64_t now = (uint64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+    return (now > sample->time ? now - sample->time : 0);
+}
@@ -0,0 +1,243 @@
+#include "color2can-record.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+// The file is mapped through a window, extended and moved forward as
+// records are appended. Windows start on a huge page boundary, so that
+// the kernel can back them with huge pages where the filesystem
+// supports it (e.g. tmpfs mounted with 'huge=').
+#define WINDOW_ALIGN ((uint64_t) 2 * 1024 * 1024)
+#define WINDOW_SIZE  ((uint64_t) 64 * 1024 * 1024)
+
+#define MAX_RECORD_SIZE COLOR2CAN_RECORD_SIZE(CANFD_MAX_DLEN)
+
+struct color2can_record_writer {
+    int fd;
+
+    uint8_t *window;
+    uint64_t window_start; // offset of the window in the file
+    uint64_t offset;       // end of the last record
+};
+
+struct color2can_record_reader {
+    const uint8_t *data;
+    uint64_t size;
+    uint64_t offset;
+};
+
+/* ================================================================== */
+/*                               Writer                               */
+/* ================================================================== */
+
+// Map a window containing at least MAX_RECORD_SIZE bytes after the
+// current offset, extending the file
+static int map_window(struct color2can_record_writer *writer) {
+    if(writer->window)
+        munmap(writer->window, WINDOW_SIZE);
+    writer->window = NULL;
+
+    // allocate the blocks now: running out of space while writing to
+    // the mapping would raise SIGBUS
+    const uint64_t start = writer->offset / WINDOW_ALIGN * WINDOW_ALIGN;
+    const int err = posix_fallocate(writer->fd, start, WINDOW_SIZE);
+    if(err) {
+        errno = err;
+        return -1;
+    }
+
+    // fault the pages in now, rather than while receiving frames
+    void *window = mmap(
+        NULL, WINDOW_SIZE, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, writer->fd, start
+    );
+    if(window == MAP_FAILED)
+        return -1;
+
+#ifdef MADV_HUGEPAGE
+    madvise(window, WINDOW_SIZE, MADV_HUGEPAGE);
+#endif
+    madvise(window, WINDOW_SIZE, MADV_SEQUENTIAL);
+
+    writer->window       = window;
+    writer->window_start = start;
+    return 0;
+}
+
+struct color2can_record_writer *color2can_record_create(const char *path) {
+    struct color2can_record_writer *writer = calloc(1, sizeof(*writer));
+    if(!writer)
+        return NULL;
+
+    writer->fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(writer->fd < 0 || map_window(writer)) {
+        const int err = errno;
+        if(writer->fd >= 0)
+            close(writer->fd);
+        free(writer);
+        errno = err;
+        return NULL;
+    }
+
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+
+    struct color2can_record_header header = {
+        .magic      = COLOR2CAN_RECORD_MAGIC,
+        .version    = COLOR2CAN_RECORD_VERSION,
+        .start_time = (uint64_t) tv.tv_sec * 1000000 + tv.tv_usec
+    };
+    memcpy(writer->window, &header, sizeof(header));
+    writer->offset = sizeof(header);
+    return writer;
+}
+
+int color2can_record_append(struct color2can_record_writer *writer,
+                            uint64_t time, uint32_t can_id,
+                            const uint8_t *data, int len,
+                            uint8_t flags) {
+    if(len < 0 || len > CANFD_MAX_DLEN) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if(writer->offset + MAX_RECORD_SIZE >
+       writer->window_start + WINDOW_SIZE) {
+        if(map_window(writer))
+            return -1;
+    }
+
+    struct color2can_record *record = (struct color2can_record *) (
+        writer->window + (writer->offset - writer->window_start)
+    );
+    record->time     = time;
+    record->can_id   = can_id;
+    record->len      = len;
+    record->flags    = flags;
+    record->reserved = 0;
+    memcpy(record->data, data, len);
+
+    writer->offset += COLOR2CAN_RECORD_SIZE(len);
+    return 0;
+}
+
+uint64_t color2can_record_size(const struct color2can_record_writer *writer) {
+    return writer->offset;
+}
+
+int color2can_record_finish(struct color2can_record_writer *writer) {
+    int err = 0;
+    if(writer->window)
+        munmap(writer->window, WINDOW_SIZE);
+    if(ftruncate(writer->fd, writer->offset))
+        err = errno;
+    if(close(writer->fd) && !err)
+        err = errno;
+    free(writer);
+
+    if(err) {
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+/* ================================================================== */
+/*                               Reader                               */
+/* ================================================================== */
+
+struct color2can_record_reader *color2can_record_open(const char *path) {
+    const int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+        return NULL;
+
+    struct stat st;
+    if(fstat(fd, &st)) {
+        close(fd);
+        return NULL;
+    }
+
+    const struct color2can_record_header *header = NULL;
+    if(st.st_size >= sizeof(*header)) {
+        header = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(header == MAP_FAILED) {
+            close(fd);
+            return NULL;
+        }
+    }
+    close(fd);
+
+    if(!header ||
+       memcmp(header->magic, COLOR2CAN_RECORD_MAGIC, 8) ||
+       header->version != COLOR2CAN_RECORD_VERSION) {
+        if(header)
+            munmap((void *) header, st.st_size);
+        errno = EINVAL;
+        return NULL;
+    }
+    madvise((void *) header, st.st_size, MADV_SEQUENTIAL);
+
+    struct color2can_record_reader *reader = malloc(sizeof(*reader));
+    if(!reader) {
+        munmap((void *) header, st.st_size);
+        return NULL;
+    }
+    reader->data   = (const uint8_t *) header;
+    reader->size   = st.st_size;
+    reader->offset = sizeof(*header);
+    return reader;
+}
+
+void color2can_record_close(struct color2can_record_reader *reader) {
+    if(!reader)
+        return;
+
+    munmap((void *) reader->data, reader->size);
+    free(reader);
+}
+
+const struct color2can_record_header *color2can_record_get_header(
+    const struct color2can_record_reader *reader
+) {
+    return (const struct color2can_record_header *) reader->data;
+}
+
+const struct color2can_record *color2can_record_next(
+    struct color2can_record_reader *reader
+) {
+    if(reader->offset + sizeof(struct color2can_record) > reader->size)
+        return NULL;
+
+    const struct color2can_record *record = (const void *) (
+        reader->data + reader->offset
+    );
+    // the space after the last record is zero-filled
+    if(record->time == 0 || record->len > CANFD_MAX_DLEN ||
+       reader->offset + COLOR2CAN_RECORD_SIZE(record->len) > reader->size)
+        return NULL;
+
+    reader->offset += COLOR2CAN_RECORD_SIZE(record->len);
+    return record;
+}
+
+void color2can_record_rewind(struct color2can_record_reader *reader) {
+    reader->offset = sizeof(struct color2can_record_header);
+}
+
+uint64_t color2can_record_tell(const struct color2can_record_reader *reader) {
+    return reader->offset;
+}
+
+void color2can_record_seek(struct color2can_record_reader *reader,
+                           uint64_t position) {
+    if(position < sizeof(struct color2can_record_header))
+        position = sizeof(struct color2can_record_header);
+    reader->offset = position;
+}
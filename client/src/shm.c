@@ -0,0 +1,425 @@
+#include "color2can-shm.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#define MAGIC   0x43324353 // "C2CS"
+#define VERSION 1
+
+// Events are stored as words, accessed with relaxed atomics: a reader
+// overtaken by the writer sees a torn event, but no data race, and the
+// sequence of the slot tells it that the event was lost. Readers only
+// use events copied out of the ring and checked.
+#define WORDS (sizeof(struct color2can_event) / sizeof(uint64_t))
+_Static_assert(sizeof(struct color2can_event) % sizeof(uint64_t) == 0,
+               "unexpected size of struct color2can_event");
+_Static_assert(_Alignof(struct color2can_event) <= _Alignof(uint64_t),
+               "unexpected alignment of struct color2can_event");
+
+struct slot {
+    uint64_t seq; // position of the event + 1, or 0 while being written
+    uint64_t words[WORDS];
+};
+
+struct reader_slot {
+    _Alignas(64) int32_t pid;
+    uint64_t cursor;
+    uint64_t lost;
+};
+
+struct header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t capacity; // power of 2
+    uint32_t alive;    // 0 after the writer is destroyed
+
+    _Alignas(64) uint64_t head; // events published
+
+    // incremented after publishing, to wake up waiting readers
+    _Alignas(64) uint32_t wake;
+    uint32_t waiters;
+
+    struct reader_slot readers[COLOR2CAN_SHM_READERS];
+
+    _Alignas(64) struct slot slots[];
+};
+
+struct color2can_shm_writer {
+    char *name;
+    struct header *header;
+    size_t size;
+};
+
+struct color2can_shm_reader {
+    struct header *header;
+    size_t size;
+
+    struct reader_slot *slot;
+    uint64_t cursor;
+
+    // the event returned by color2can_shm_peek, until it is released
+    bool held;
+    struct color2can_event event;
+};
+
+static size_t shm_size(uint32_t capacity) {
+    return sizeof(struct header) + capacity * sizeof(struct slot);
+}
+
+static int futex(uint32_t *addr, int op, uint32_t val,
+                 const struct timespec *timeout) {
+    return syscall(SYS_futex, addr, op, val, timeout, NULL, 0);
+}
+
+/* ================================================================== */
+/*                               Writer                               */
+/* ================================================================== */
+
+struct color2can_shm_writer *color2can_shm_create(const char *name,
+                                                  uint32_t capacity,
+                                                  int flags) {
+    if(capacity == 0 || capacity > (1u << 24)) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    uint32_t size = 1;
+    while(size < capacity)
+        size *= 2;
+    capacity = size;
+
+    struct color2can_shm_writer *writer = calloc(1, sizeof(*writer));
+    if(!writer)
+        return NULL;
+    writer->size = shm_size(capacity);
+
+    // readers of a live writer would be left on the removed object
+    if(flags & COLOR2CAN_SHM_TAKEOVER)
+        shm_unlink(name);
+    const int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if(fd < 0)
+        goto error;
+
+    if(ftruncate(fd, writer->size)) {
+        close(fd);
+        shm_unlink(name);
+        goto error;
+    }
+
+    writer->header = mmap(
+        NULL, writer->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0
+    );
+    close(fd);
+    if(writer->header == MAP_FAILED) {
+        shm_unlink(name);
+        goto error;
+    }
+
+    // the object is zero-filled: only set the fields that are not 0
+    writer->header->version  = VERSION;
+    writer->header->capacity = capacity;
+    writer->header->alive    = 1;
+    __atomic_store_n(&writer->header->magic, MAGIC, __ATOMIC_RELEASE);
+
+    writer->name = strdup(name);
+    return writer;
+
+error: {
+        const int err = errno;
+        free(writer);
+        errno = err;
+        return NULL;
+    }
+}
+
+void color2can_shm_destroy(struct color2can_shm_writer *writer) {
+    if(!writer)
+        return;
+
+    // wake up the readers, so that they notice
+    __atomic_store_n(&writer->header->alive, 0, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&writer->header->wake, 1, __ATOMIC_RELEASE);
+    futex(&writer->header->wake, FUTEX_WAKE, INT_MAX, NULL);
+
+    munmap(writer->header, writer->size);
+    shm_unlink(writer->name);
+    free(writer->name);
+    free(writer);
+}
+
+void color2can_shm_publish(struct color2can_shm_writer *writer,
+                           const struct color2can_event *events,
+                           int count) {
+    struct header *h = writer->header;
+    const uint32_t mask = h->capacity - 1;
+
+    uint64_t head = __atomic_load_n(&h->head, __ATOMIC_RELAXED);
+    for(int i = 0; i < count; i++, head++) {
+        struct slot *slot = &h->slots[head & mask];
+
+        uint64_t words[WORDS];
+        memcpy(words, &events[i], sizeof(words));
+
+        __atomic_store_n(&slot->seq, 0, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        for(int j = 0; j < WORDS; j++)
+            __atomic_store_n(&slot->words[j], words[j], __ATOMIC_RELAXED);
+        __atomic_store_n(&slot->seq, head + 1, __ATOMIC_RELEASE);
+    }
+    __atomic_store_n(&h->head, head, __ATOMIC_RELEASE);
+
+    __atomic_add_fetch(&h->wake, 1, __ATOMIC_RELEASE);
+    if(__atomic_load_n(&h->waiters, __ATOMIC_ACQUIRE) > 0)
+        futex(&h->wake, FUTEX_WAKE, INT_MAX, NULL);
+}
+
+uint64_t color2can_shm_head(const struct color2can_shm_writer *writer) {
+    return __atomic_load_n(&writer->header->head, __ATOMIC_RELAXED);
+}
+
+int color2can_shm_reader_info(const struct color2can_shm_writer *writer,
+                              int i,
+                              struct color2can_shm_reader_info *info) {
+    if(i < 0 || i >= COLOR2CAN_SHM_READERS)
+        return 1;
+
+    const struct reader_slot *r = &writer->header->readers[i];
+    info->pid = __atomic_load_n(&r->pid, __ATOMIC_ACQUIRE);
+    if(info->pid == 0)
+        return 1;
+
+    info->cursor = __atomic_load_n(&r->cursor, __ATOMIC_RELAXED);
+    info->lost   = __atomic_load_n(&r->lost, __ATOMIC_RELAXED);
+    return 0;
+}
+
+/* ================================================================== */
+/*                               Reader                               */
+/* ================================================================== */
+
+// Claim a reader slot: slots of processes that no longer exist are
+// reclaimed
+static struct reader_slot *claim_slot(struct header *h) {
+    const int32_t pid = getpid();
+
+    for(int i = 0; i < COLOR2CAN_SHM_READERS; i++) {
+        struct reader_slot *r = &h->readers[i];
+
+        int32_t owner = __atomic_load_n(&r->pid, __ATOMIC_ACQUIRE);
+        if(owner != 0 && (kill(owner, 0) == 0 || errno != ESRCH))
+            continue;
+
+        if(__atomic_compare_exchange_n(&r->pid, &owner, pid, false,
+                                       __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+            return r;
+    }
+    return NULL;
+}
+
+struct color2can_shm_reader *color2can_shm_attach(const char *name) {
+    const int fd = shm_open(name, O_RDWR, 0);
+    if(fd < 0)
+        return NULL;
+
+    struct stat st;
+    if(fstat(fd, &st) || st.st_size < sizeof(struct header)) {
+        close(fd);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    struct header *h = mmap(
+        NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0
+    );
+    close(fd);
+    if(h == MAP_FAILED)
+        return NULL;
+
+    int err = 0;
+    struct reader_slot *slot = NULL;
+    if(__atomic_load_n(&h->magic, __ATOMIC_ACQUIRE) != MAGIC ||
+       h->version != VERSION ||
+       st.st_size < shm_size(h->capacity))
+        err = EINVAL;
+    else if(!(slot = claim_slot(h)))
+        err = EBUSY;
+
+    struct color2can_shm_reader *reader = NULL;
+    if(!err && !(reader = calloc(1, sizeof(*reader))))
+        err = errno;
+
+    if(err) {
+        if(slot)
+            __atomic_store_n(&slot->pid, 0, __ATOMIC_RELEASE);
+        munmap(h, st.st_size);
+        errno = err;
+        return NULL;
+    }
+
+    reader->header = h;
+    reader->size   = st.st_size;
+    reader->slot   = slot;
+    reader->cursor = __atomic_load_n(&h->head, __ATOMIC_ACQUIRE);
+
+    __atomic_store_n(&slot->cursor, reader->cursor, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->lost, 0, __ATOMIC_RELAXED);
+    return reader;
+}
+
+void color2can_shm_detach(struct color2can_shm_reader *reader) {
+    if(!reader)
+        return;
+
+    __atomic_store_n(&reader->slot->pid, 0, __ATOMIC_RELEASE);
+    munmap(reader->header, reader->size);
+    free(reader);
+}
+
+// Skip the events that were already overwritten, returning their number
+static uint64_t skip_overwritten(struct color2can_shm_reader *reader,
+                                 uint64_t head) {
+    const uint32_t capacity = reader->header->capacity;
+    if(head - reader->cursor <= capacity)
+        return 0;
+
+    const uint64_t count = head - capacity - reader->cursor;
+    reader->cursor = head - capacity;
+    return count;
+}
+
+// Publish the cursor, and count the events lost since the last update
+static void update_cursor(struct color2can_shm_reader *reader,
+                          uint64_t lost_count, uint64_t *lost) {
+    __atomic_store_n(&reader->slot->cursor, reader->cursor, __ATOMIC_RELAXED);
+    if(lost_count > 0) {
+        __atomic_add_fetch(&reader->slot->lost, lost_count, __ATOMIC_RELAXED);
+        if(lost)
+            *lost += lost_count;
+    }
+}
+
+// Copies the event at the reader's cursor. Returns 0 if it is intact,
+// or 1 if the writer has overtaken the reader.
+static int copy_event(const struct color2can_shm_reader *reader,
+                      struct color2can_event *event) {
+    const struct header *h = reader->header;
+    const struct slot *slot = &h->slots[reader->cursor & (h->capacity - 1)];
+
+    const uint64_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+    uint64_t words[WORDS];
+    for(int j = 0; j < WORDS; j++)
+        words[j] = __atomic_load_n(&slot->words[j], __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+    if(seq != reader->cursor + 1 ||
+       __atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != seq)
+        return 1;
+
+    memcpy(event, words, sizeof(words));
+    return 0;
+}
+
+int color2can_shm_read(struct color2can_shm_reader *reader,
+                       struct color2can_event *events, int max,
+                       uint64_t *lost) {
+    struct header *h = reader->header;
+
+    int count = 0;
+    if(reader->held && max > 0) {
+        events[count++] = reader->event;
+        color2can_shm_release(reader);
+    }
+
+    const uint64_t head = __atomic_load_n(&h->head, __ATOMIC_ACQUIRE);
+    if(count == 0 && head == reader->cursor &&
+       !__atomic_load_n(&h->alive, __ATOMIC_ACQUIRE))
+        return -1;
+
+    uint64_t lost_count = skip_overwritten(reader, head);
+
+    while(count < max && reader->cursor < head) {
+        if(copy_event(reader, &events[count]))
+            lost_count++;
+        else
+            count++;
+        reader->cursor++;
+    }
+
+    update_cursor(reader, lost_count, lost);
+    return count;
+}
+
+int color2can_shm_peek(struct color2can_shm_reader *reader,
+                       const struct color2can_event **event,
+                       uint64_t *lost) {
+    struct header *h = reader->header;
+
+    if(reader->held) {
+        *event = &reader->event;
+        return 1;
+    }
+
+    const uint64_t head = __atomic_load_n(&h->head, __ATOMIC_ACQUIRE);
+    if(head == reader->cursor &&
+       !__atomic_load_n(&h->alive, __ATOMIC_ACQUIRE))
+        return -1;
+
+    uint64_t lost_count = skip_overwritten(reader, head);
+
+    // the cursor is only moved past the event when it is released
+    while(reader->cursor < head) {
+        if(!copy_event(reader, &reader->event)) {
+            reader->held = true;
+            break;
+        }
+        lost_count++;
+        reader->cursor++;
+    }
+
+    update_cursor(reader, lost_count, lost);
+    if(!reader->held)
+        return 0;
+
+    *event = &reader->event;
+    return 1;
+}
+
+void color2can_shm_release(struct color2can_shm_reader *reader) {
+    if(!reader->held)
+        return;
+
+    reader->held = false;
+    reader->cursor++;
+    update_cursor(reader, 0, NULL);
+}
+
+int color2can_shm_wait(struct color2can_shm_reader *reader, int timeout) {
+    struct header *h = reader->header;
+
+    const uint32_t wake = __atomic_load_n(&h->wake, __ATOMIC_ACQUIRE);
+    if(__atomic_load_n(&h->head, __ATOMIC_ACQUIRE) != reader->cursor ||
+       !__atomic_load_n(&h->alive, __ATOMIC_ACQUIRE))
+        return 1;
+
+    struct timespec ts = {
+        .tv_sec  = timeout / 1000,
+        .tv_nsec = (timeout % 1000) * 1000000L
+    };
+
+    __atomic_add_fetch(&h->waiters, 1, __ATOMIC_ACQ_REL);
+    futex(&h->wake, FUTEX_WAIT, wake, timeout < 0 ? NULL : &ts);
+    __atomic_sub_fetch(&h->waiters, 1, __ATOMIC_ACQ_REL);
+
+    return __atomic_load_n(&h->head, __ATOMIC_ACQUIRE) != reader->cursor;
+}
@@ -0,0 +1,288 @@
+#include "color2can-unpack.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+    #define HAVE_X86
+    #include <immintrin.h>
+#endif
+
+typedef void (*unpack_fn)(const uint8_t *in, size_t count,
+                          const struct color2can_sample_columns *out);
+
+static inline struct color2can_sample_columns offset_columns(
+    const struct color2can_sample_columns *out, size_t offset
+) {
+    return (struct color2can_sample_columns) {
+        .color = {
+            out->color[0] + offset,
+            out->color[1] + offset,
+            out->color[2] + offset
+        },
+        .clear        = out->clear        + offset,
+        .within_range = out->within_range + offset,
+        .range_id     = out->range_id     + offset
+    };
+}
+
+/* ================================================================== */
+/*                               Scalar                               */
+/* ================================================================== */
+
+// Reads the fields through the bitfields: this is the reference for the
+// other kernels.
+static void unpack_scalar(const uint8_t *in, size_t count,
+                          const struct color2can_sample_columns *out) {
+    for(size_t i = 0; i < count; i++) {
+        struct color2can_sample sample;
+        memcpy(&sample, in + i * COLOR2CAN_SAMPLE_SIZE, sizeof(sample));
+
+        out->color[0][i]     = sample.color[0];
+        out->color[1][i]     = sample.color[1];
+        out->color[2][i]     = sample.color[2];
+        out->clear[i]        = sample.clear;
+        out->within_range[i] = sample.within_range;
+        out->range_id[i]     = sample.range_id;
+    }
+}
+
+// The SIMD kernels read the sample as four 16-bit words: red, green,
+// blue, then clear (bits 0-10), within_range (bit 11) and range_id
+// (bits 12-15). This is how GCC and Clang lay out the bitfields on
+// little-endian targets.
+static bool layout_supported(void) {
+    if(sizeof(struct color2can_sample) != COLOR2CAN_SAMPLE_SIZE)
+        return false;
+
+    const struct {
+        struct color2can_sample sample;
+        uint16_t word;
+    } probes[] = {
+        { { .clear        = 0x7ff }, 0x07ff },
+        { { .within_range = 1     }, 0x0800 },
+        { { .range_id     = 0xf   }, 0xf000 }
+    };
+    for(int i = 0; i < sizeof(probes) / sizeof(probes[0]); i++) {
+        uint16_t words[4];
+        memcpy(words, &probes[i].sample, sizeof(words));
+        if(words[0] || words[1] || words[2] || words[3] != probes[i].word)
+            return false;
+    }
+    return true;
+}
+
+/* ================================================================== */
+/*                                SSE2                                */
+/* ================================================================== */
+
+#ifdef HAVE_X86
+
+// Transposes 8 samples (4 registers of 2 samples each) into registers
+// of 8 values of the same field
+#define TRANSPOSE_4x8(a, b, c, d, red, green, blue, word) do {\
+    const __m128i t0 = _mm_unpacklo_epi16(a, b);\
+    const __m128i t1 = _mm_unpackhi_epi16(a, b);\
+    const __m128i t2 = _mm_unpacklo_epi16(c, d);\
+    const __m128i t3 = _mm_unpackhi_epi16(c, d);\
+    const __m128i u0 = _mm_unpacklo_epi16(t0, t1);\
+    const __m128i u1 = _mm_unpackhi_epi16(t0, t1);\
+    const __m128i u2 = _mm_unpacklo_epi16(t2, t3);\
+    const __m128i u3 = _mm_unpackhi_epi16(t2, t3);\
+    red   = _mm_unpacklo_epi64(u0, u2);\
+    green = _mm_unpackhi_epi64(u0, u2);\
+    blue  = _mm_unpacklo_epi64(u1, u3);\
+    word  = _mm_unpackhi_epi64(u1, u3);\
+} while(0)
+
+__attribute__((target("sse2")))
+static void unpack_sse2(const uint8_t *in, size_t count,
+                        const struct color2can_sample_columns *out) {
+    const __m128i clear_mask = _mm_set1_epi16(0x07ff);
+    const __m128i bit_mask   = _mm_set1_epi16(0x0001);
+
+    size_t i = 0;
+    for(; i + 16 <= count; i += 16) {
+        const __m128i *src = (const __m128i *) (in + i * 8);
+
+        __m128i red[2], green[2], blue[2], word[2];
+        for(int h = 0; h < 2; h++) {
+            const __m128i a = _mm_loadu_si128(src + h * 4 + 0);
+            const __m128i b = _mm_loadu_si128(src + h * 4 + 1);
+            const __m128i c = _mm_loadu_si128(src + h * 4 + 2);
+            const __m128i d = _mm_loadu_si128(src + h * 4 + 3);
+            TRANSPOSE_4x8(a, b, c, d, red[h], green[h], blue[h], word[h]);
+
+            _mm_storeu_si128((__m128i *) &out->color[0][i + h * 8], red[h]);
+            _mm_storeu_si128((__m128i *) &out->color[1][i + h * 8], green[h]);
+            _mm_storeu_si128((__m128i *) &out->color[2][i + h * 8], blue[h]);
+            _mm_storeu_si128(
+                (__m128i *) &out->clear[i + h * 8],
+                _mm_and_si128(word[h], clear_mask)
+            );
+        }
+
+        const __m128i within = _mm_packus_epi16(
+            _mm_and_si128(_mm_srli_epi16(word[0], 11), bit_mask),
+            _mm_and_si128(_mm_srli_epi16(word[1], 11), bit_mask)
+        );
+        const __m128i range = _mm_packus_epi16(
+            _mm_srli_epi16(word[0], 12),
+            _mm_srli_epi16(word[1], 12)
+        );
+        _mm_storeu_si128((__m128i *) &out->within_range[i], within);
+        _mm_storeu_si128((__m128i *) &out->range_id[i], range);
+    }
+
+    const struct color2can_sample_columns tail = offset_columns(out, i);
+    unpack_scalar(in + i * 8, count - i, &tail);
+}
+
+/* ================================================================== */
+/*                                AVX2                                */
+/* ================================================================== */
+
+// Same as TRANSPOSE_4x8, in each 128-bit lane. The values are then
+// ordered by pairs: lane 0 holds samples 0-1, 4-5, 8-9 and 12-13.
+#define TRANSPOSE_4x8_LANES(a, b, c, d, red, green, blue, word) do {\
+    const __m256i t0 = _mm256_unpacklo_epi16(a, b);\
+    const __m256i t1 = _mm256_unpackhi_epi16(a, b);\
+    const __m256i t2 = _mm256_unpacklo_epi16(c, d);\
+    const __m256i t3 = _mm256_unpackhi_epi16(c, d);\
+    const __m256i u0 = _mm256_unpacklo_epi16(t0, t1);\
+    const __m256i u1 = _mm256_unpackhi_epi16(t0, t1);\
+    const __m256i u2 = _mm256_unpacklo_epi16(t2, t3);\
+    const __m256i u3 = _mm256_unpackhi_epi16(t2, t3);\
+    red   = _mm256_unpacklo_epi64(u0, u2);\
+    green = _mm256_unpackhi_epi64(u0, u2);\
+    blue  = _mm256_unpacklo_epi64(u1, u3);\
+    word  = _mm256_unpackhi_epi64(u1, u3);\
+} while(0)
+
+__attribute__((target("avx2")))
+static void unpack_avx2(const uint8_t *in, size_t count,
+                        const struct color2can_sample_columns *out) {
+    const __m256i clear_mask = _mm256_set1_epi16(0x07ff);
+    const __m256i bit_mask   = _mm256_set1_epi16(0x0001);
+
+    // puts the pairs of samples back in order
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+    size_t i = 0;
+    for(; i + 32 <= count; i += 32) {
+        const __m256i *src = (const __m256i *) (in + i * 8);
+
+        __m256i word[2];
+        for(int h = 0; h < 2; h++) {
+            const __m256i a = _mm256_loadu_si256(src + h * 4 + 0);
+            const __m256i b = _mm256_loadu_si256(src + h * 4 + 1);
+            const __m256i c = _mm256_loadu_si256(src + h * 4 + 2);
+            const __m256i d = _mm256_loadu_si256(src + h * 4 + 3);
+
+            __m256i red, green, blue;
+            TRANSPOSE_4x8_LANES(a, b, c, d, red, green, blue, word[h]);
+
+            red     = _mm256_permutevar8x32_epi32(red, order);
+            green   = _mm256_permutevar8x32_epi32(green, order);
+            blue    = _mm256_permutevar8x32_epi32(blue, order);
+            word[h] = _mm256_permutevar8x32_epi32(word[h], order);
+
+            const size_t j = i + h * 16;
+            _mm256_storeu_si256((__m256i *) &out->color[0][j], red);
+            _mm256_storeu_si256((__m256i *) &out->color[1][j], green);
+            _mm256_storeu_si256((__m256i *) &out->color[2][j], blue);
+            _mm256_storeu_si256(
+                (__m256i *) &out->clear[j],
+                _mm256_and_si256(word[h], clear_mask)
+            );
+        }
+
+        // packus works in each lane: reorder the quadwords after packing
+        __m256i within = _mm256_packus_epi16(
+            _mm256_and_si256(_mm256_srli_epi16(word[0], 11), bit_mask),
+            _mm256_and_si256(_mm256_srli_epi16(word[1], 11), bit_mask)
+        );
+        __m256i range = _mm256_packus_epi16(
+            _mm256_srli_epi16(word[0], 12),
+            _mm256_srli_epi16(word[1], 12)
+        );
+        within = _mm256_permute4x64_epi64(within, 0xd8); // 0, 2, 1, 3
+        range  = _mm256_permute4x64_epi64(range, 0xd8);
+
+        _mm256_storeu_si256((__m256i *) &out->within_range[i], within);
+        _mm256_storeu_si256((__m256i *) &out->range_id[i], range);
+    }
+
+    const struct color2can_sample_columns tail = offset_columns(out, i);
+    unpack_sse2(in + i * 8, count - i, &tail);
+}
+
+#endif // HAVE_X86
+
+/* ================================================================== */
+/*                              Dispatch                              */
+/* ================================================================== */
+
+static const unpack_fn kernels[COLOR2CAN_UNPACK_KERNELS] = {
+    [COLOR2CAN_UNPACK_SCALAR] = unpack_scalar,
+#ifdef HAVE_X86
+    [COLOR2CAN_UNPACK_SSE2]   = unpack_sse2,
+    [COLOR2CAN_UNPACK_AVX2]   = unpack_avx2
+#endif
+};
+
+static const char *kernel_names[COLOR2CAN_UNPACK_KERNELS] = {
+    [COLOR2CAN_UNPACK_SCALAR] = "scalar",
+    [COLOR2CAN_UNPACK_SSE2]   = "sse2",
+    [COLOR2CAN_UNPACK_AVX2]   = "avx2"
+};
+
+// -1 = not selected yet
+static int current_kernel = -1;
+
+static bool kernel_supported(int kernel) {
+    if(kernel == COLOR2CAN_UNPACK_SCALAR)
+        return true;
+    if(kernel < 0 || kernel >= COLOR2CAN_UNPACK_KERNELS ||
+       !kernels[kernel] || !layout_supported())
+        return false;
+
+#ifdef HAVE_X86
+    __builtin_cpu_init();
+    if(kernel == COLOR2CAN_UNPACK_SSE2)
+        return __builtin_cpu_supports("sse2");
+    if(kernel == COLOR2CAN_UNPACK_AVX2)
+        return __builtin_cpu_supports("avx2");
+#endif
+    return false;
+}
+
+int color2can_unpack_get_kernel(void) {
+    int kernel = __atomic_load_n(&current_kernel, __ATOMIC_RELAXED);
+    if(kernel < 0) {
+        kernel = COLOR2CAN_UNPACK_KERNELS - 1;
+        while(!kernel_supported(kernel))
+            kernel--;
+        __atomic_store_n(&current_kernel, kernel, __ATOMIC_RELAXED);
+    }
+    return kernel;
+}
+
+int color2can_unpack_set_kernel(int kernel) {
+    if(!kernel_supported(kernel))
+        return 1;
+
+    __atomic_store_n(&current_kernel, kernel, __ATOMIC_RELAXED);
+    return 0;
+}
+
+const char *color2can_unpack_kernel_name(int kernel) {
+    if(kernel < 0 || kernel >= COLOR2CAN_UNPACK_KERNELS)
+        return "unknown";
+    return kernel_names[kernel];
+}
+
+void color2can_unpack_samples(const void *payloads, size_t count,
+                              const struct color2can_sample_columns *out) {
+    kernels[color2can_unpack_get_kernel()](payloads, count, out);
+}
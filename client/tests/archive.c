@@ -0,0 +1,197 @@
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "color2can.h"
+#include "color2can-archive.h"
+
+// Writes the samples of two sensors to an archive, one of them filling
+// several blocks, then reads them back with queries over all the rows,
+// over a time interval crossing the blocks and over some columns.
+
+#define BLOCK_ROWS COLOR2CAN_ARCHIVE_BLOCK_ROWS
+
+// samples of each sensor
+#define COUNT_1 (BLOCK_ROWS * 2 + 1000)
+#define COUNT_2 500
+
+static int failures;
+
+#define CHECK(cond) do {\
+    if(!(cond)) {\
+        printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);\
+        failures++;\
+    }\
+} while(0)
+
+// periodic samples, with some jitter
+static uint64_t time_of(int sensor_id, int i) {
+    return 1000000 + (uint64_t) i * 2500 * sensor_id + (i * 7919) % 40;
+}
+
+static struct color2can_sample sample_of(int sensor_id, int i) {
+    const uint32_t hash = (i + sensor_id * 65536) * 2654435761u;
+    return (struct color2can_sample) {
+        .color        = { hash >> 16, 1000 + i % 300, sensor_id },
+        .clear        = hash & 0x7ff,
+        .within_range = (i / 100) % 2,
+        .range_id     = (i / 1000) % 16
+    };
+}
+
+struct expected {
+    uint32_t columns;
+    uint64_t from, to;
+
+    int64_t rows;
+    int next[COLOR2CAN_MAX_SENSOR_COUNT]; // next row of each sensor
+    int mismatches;
+};
+
+static int check_rows(const struct color2can_archive_rows *rows,
+                      void *user) {
+    struct expected *e = user;
+    const uint32_t c = e->columns;
+
+    // skip the rows before the interval
+    int *i = &e->next[rows->sensor_id];
+    while(time_of(rows->sensor_id, *i) < e->from)
+        (*i)++;
+
+    for(int r = 0; r < rows->count; r++, (*i)++) {
+        const uint64_t time = time_of(rows->sensor_id, *i);
+        const struct color2can_sample s = sample_of(rows->sensor_id, *i);
+
+        e->mismatches += (time >= e->to);
+        if(c & (1 << COLOR2CAN_ARCHIVE_TIME))
+            e->mismatches += (rows->time[r] != time);
+        else
+            e->mismatches += (rows->time != NULL);
+        if(c & (1 << COLOR2CAN_ARCHIVE_RED))
+            e->mismatches += (rows->color[0][r] != s.color[0]);
+        else
+            e->mismatches += (rows->color[0] != NULL);
+        if(c & (1 << COLOR2CAN_ARCHIVE_BLUE))
+            e->mismatches += (rows->color[2][r] != s.color[2]);
+        if(c & (1 << COLOR2CAN_ARCHIVE_CLEAR))
+            e->mismatches += (rows->clear[r] != s.clear);
+        if(c & (1 << COLOR2CAN_ARCHIVE_WITHIN_RANGE))
+            e->mismatches += (rows->within_range[r] != s.within_range);
+        if(c & (1 << COLOR2CAN_ARCHIVE_RANGE_ID))
+            e->mismatches += (rows->range_id[r] != s.range_id);
+    }
+    e->rows += rows->count;
+    return 0;
+}
+
+static int64_t run_query(struct color2can_archive_reader *reader,
+                         uint32_t sensors, uint64_t from, uint64_t to,
+                         uint32_t columns, struct expected *e) {
+    memset(e, 0, sizeof(*e));
+    e->columns = columns;
+    e->from    = from;
+    e->to      = to ? to : UINT64_MAX;
+
+    const struct color2can_archive_query query = {
+        .sensors   = sensors,
+        .time_from = from,
+        .time_to   = to,
+        .columns   = columns
+    };
+    return color2can_archive_query(reader, &query, check_rows, e);
+}
+
+// number of samples of a sensor in [from, to)
+static int64_t count_between(int sensor_id, int count,
+                             uint64_t from, uint64_t to) {
+    int64_t n = 0;
+    for(int i = 0; i < count; i++) {
+        const uint64_t time = time_of(sensor_id, i);
+        n += (time >= from && time < to);
+    }
+    return n;
+}
+
+int main(int argc, char *argv[]) {
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/color2can-test-%d.c2a",
+             (int) getpid());
+
+    struct color2can_archive_writer *writer = color2can_archive_create(path);
+    if(!writer) {
+        perror("[Archive] create");
+        return 1;
+    }
+
+    for(int i = 0; i < COUNT_1; i++) {
+        struct color2can_sample s = sample_of(1, i);
+        CHECK(color2can_archive_add(writer, 1, time_of(1, i), &s) == 0);
+        if(i < COUNT_2) {
+            s = sample_of(2, i);
+            CHECK(color2can_archive_add(writer, 2, time_of(2, i), &s) == 0);
+        }
+
+        // older samples are rejected, within a block and after a block
+        // was written
+        if(i == 10 || i == BLOCK_ROWS - 1) {
+            s = sample_of(1, i);
+            errno = 0;
+            CHECK(color2can_archive_add(
+                writer, 1, time_of(1, i - 1), &s
+            ) == -1);
+            CHECK(errno == EINVAL);
+        }
+    }
+    CHECK(color2can_archive_finish(writer) == 0);
+
+    struct color2can_archive_reader *reader = color2can_archive_open(path);
+    unlink(path);
+    if(!reader) {
+        perror("[Archive] open");
+        return 1;
+    }
+
+    struct color2can_archive_info info;
+    color2can_archive_get_info(reader, &info);
+    CHECK(info.blocks == 3 + 1);
+    CHECK(info.rows == COUNT_1 + COUNT_2);
+    CHECK(info.time_min == time_of(1, 0));
+    CHECK(info.time_max == time_of(1, COUNT_1 - 1));
+
+    struct expected e;
+
+    // all rows and columns
+    CHECK(run_query(reader, 0, 0, 0,
+                    COLOR2CAN_ARCHIVE_ALL_COLUMNS, &e) == COUNT_1 + COUNT_2);
+    CHECK(e.rows == COUNT_1 + COUNT_2);
+    CHECK(e.next[1] == COUNT_1 && e.next[2] == COUNT_2);
+    CHECK(e.mismatches == 0);
+
+    // an interval crossing the first two blocks of sensor 1
+    const uint64_t from = time_of(1, BLOCK_ROWS - 100) - 1;
+    const uint64_t to   = time_of(1, BLOCK_ROWS + 100) + 1;
+    const int64_t rows  = count_between(1, COUNT_1, from, to) +
+                          count_between(2, COUNT_2, from, to);
+    CHECK(rows == 201);
+    CHECK(run_query(reader, 0, from, to,
+                    COLOR2CAN_ARCHIVE_ALL_COLUMNS, &e) == rows);
+    CHECK(e.rows == rows && e.mismatches == 0);
+
+    // some columns of a single sensor
+    const uint32_t columns = (1 << COLOR2CAN_ARCHIVE_BLUE) |
+                             (1 << COLOR2CAN_ARCHIVE_RANGE_ID);
+    CHECK(run_query(reader, 1 << 2, 0, 0, columns, &e) == COUNT_2);
+    CHECK(e.next[1] == 0 && e.next[2] == COUNT_2);
+    CHECK(e.mismatches == 0);
+
+    color2can_archive_close(reader);
+
+    if(failures > 0) {
+        printf("[Archive] %d check(s) FAILED\n", failures);
+        return 1;
+    }
+    puts("[Archive] queries return the samples that were added");
+    return 0;
+}
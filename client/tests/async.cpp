@@ -0,0 +1,174 @@
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <optional>
+#include <stop_token>
+
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <linux/can.h>
+
+#include "color2can.h"
+#include "color2can-async.hpp"
+
+// Runs sample requests of the coroutine API over a socketpair, the other
+// end of which acts as the sensors: answers, timeouts whose late answer
+// is discarded, and cancellation.
+
+using namespace std::chrono_literals;
+
+static int failures;
+
+#define CHECK(cond) do {\
+    if(!(cond)) {\
+        printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);\
+        failures++;\
+    }\
+} while(0)
+
+// Sensors on the other end of the socketpair: each sample request is
+// answered after 'delay', in order, with the number of the answer as
+// the red component.
+struct FakeSensors {
+    int fd;
+    std::chrono::microseconds delay = 0us;
+    bool stopped = false;
+
+    struct Answer {
+        uint32_t id;
+        uint64_t time;
+    };
+    std::deque<Answer> answers;
+    uint16_t answered[COLOR2CAN_MAX_SENSOR_COUNT] = {};
+    int requests = 0;
+
+    static uint64_t now() {
+        timespec t;
+        clock_gettime(CLOCK_MONOTONIC, &t);
+        return (uint64_t) t.tv_sec * 1000000 + t.tv_nsec / 1000;
+    }
+
+    void poll() {
+        can_frame frame;
+        while(recv(fd, &frame, sizeof(frame), MSG_DONTWAIT) ==
+              sizeof(frame)) {
+            const uint32_t id = frame.can_id & CAN_SFF_MASK;
+            if(!(frame.can_id & CAN_RTR_FLAG) ||
+               (id & ~0x1f) != COLOR2CAN_SAMPLE_MASK_ID)
+                continue;
+
+            requests++;
+            answers.push_back({ id, now() + delay.count() });
+        }
+
+        while(!answers.empty() && answers.front().time <= now()) {
+            const uint32_t id = answers.front().id;
+            answers.pop_front();
+
+            color2can_sample sample = {};
+            sample.color[0] = ++answered[id & 0x1f];
+
+            can_frame answer = {};
+            answer.can_id  = id;
+            answer.can_dlc = COLOR2CAN_SAMPLE_SIZE;
+            memcpy(answer.data, &sample, sizeof(sample));
+            CHECK(send(fd, &answer, sizeof(answer), 0) == sizeof(answer));
+        }
+    }
+};
+
+static color2can::Task<void> run_sensors(color2can::Loop &loop,
+                                         FakeSensors &sensors) {
+    while(!sensors.stopped) {
+        sensors.poll();
+        co_await loop.sleep(500us);
+    }
+}
+
+static int red(const std::optional<color2can::Event> &event) {
+    return event ? event->sample.color[0] : -1;
+}
+
+static color2can::Task<void> request(color2can::Loop &loop, int sensor_id,
+                                     int *result) {
+    *result = red(co_await loop.sensor(sensor_id).sample(50ms));
+}
+
+static color2can::Task<void> cancel_after(color2can::Loop &loop,
+                                          std::stop_source &source,
+                                          std::chrono::microseconds time) {
+    co_await loop.sleep(time);
+    source.request_stop();
+}
+
+static color2can::Task<void> run_tests(color2can::Loop &loop,
+                                       FakeSensors &sensors) {
+    // a request is answered
+    CHECK(red(co_await loop.sensor(3).sample(50ms)) == 1);
+
+    // concurrent requests, to the same sensor and to another one
+    int results[4];
+    loop.spawn(request(loop, 3, &results[0]));
+    loop.spawn(request(loop, 3, &results[1]));
+    loop.spawn(request(loop, 4, &results[2]));
+    loop.spawn(request(loop, 3, &results[3]));
+    co_await loop.sleep(20ms);
+    CHECK(results[0] == 2 && results[1] == 3 && results[3] == 4);
+    CHECK(results[2] == 1);
+
+    // the late answer to a request that timed out is not given to the
+    // next request
+    sensors.delay = 30ms;
+    CHECK(!co_await loop.sensor(3).sample(10ms));
+    sensors.delay = 0us;
+    CHECK(red(co_await loop.sensor(3).sample(100ms)) == 6);
+
+    // a request is cancelled before its answer
+    sensors.delay = 30ms;
+    std::stop_source source;
+    const uint64_t start = FakeSensors::now();
+    loop.spawn(cancel_after(loop, source, 5ms));
+    CHECK(!co_await loop.sensor(3).sample(1s, source.get_token()));
+    CHECK(FakeSensors::now() - start < 25000);
+    CHECK(loop.pending() == 0);
+
+    // a request cancelled beforehand is not sent
+    const int requests = sensors.requests;
+    CHECK(!co_await loop.sensor(3).sample(1s, source.get_token()));
+    co_await loop.sleep(5ms);
+    CHECK(sensors.requests == requests);
+
+    // the answer to the cancelled request is discarded too
+    sensors.delay = 0us;
+    CHECK(red(co_await loop.sensor(3).sample(100ms)) == 8);
+
+    sensors.stopped = true;
+    loop.stop();
+}
+
+int main(int argc, char *argv[]) {
+    int fds[2];
+    if(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds)) {
+        perror("[Async] socketpair");
+        return 1;
+    }
+
+    {
+        color2can::Client client(fds[0]);
+        color2can::Loop loop(client);
+
+        FakeSensors sensors = { fds[1] };
+        loop.spawn(run_sensors(loop, sensors));
+        loop.spawn(run_tests(loop, sensors));
+        loop.run();
+    }
+    close(fds[1]);
+
+    if(failures > 0) {
+        printf("[Async] %d check(s) FAILED\n", failures);
+        return 1;
+    }
+    puts("[Async] requests are answered, time out and are cancelled");
+    return 0;
+}
@@ -0,0 +1,155 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <pthread.h>
+
+#include "color2can-client.h"
+#include "color2can-latest.h"
+
+// One writer stores samples in the table as fast as it can, while
+// several readers read them: every field of a sample is derived from
+// its sequence number, so a torn read shows up as fields that disagree.
+
+#define READERS 4
+#define SAMPLES 2000000
+
+// sensors written in turn, so that readers overlap the writer
+#define SENSORS 2
+
+static struct color2can_latest *latest;
+static bool done;
+
+struct reader_result {
+    uint64_t reads;
+    uint64_t torn;
+    uint64_t backwards; // sequence lower than in a previous read
+};
+
+static struct color2can_event sample_event(int sensor_id, uint32_t n) {
+    struct color2can_event event = {
+        .type      = COLOR2CAN_EVENT_SAMPLE,
+        .sensor_id = sensor_id,
+        .len       = COLOR2CAN_SAMPLE_SIZE,
+        .time      = (uint64_t) n * 1000 + sensor_id
+    };
+    event.sample = (struct color2can_sample) {
+        .color        = { n, n >> 16, ~n },
+        .clear        = n & 0x7ff,
+        .within_range = n & 1,
+        .range_id     = n & 0xf
+    };
+    return event;
+}
+
+static struct color2can_event info_event(int sensor_id, uint32_t n) {
+    struct color2can_event event = {
+        .type      = COLOR2CAN_EVENT_SAMPLE_INFO,
+        .sensor_id = sensor_id,
+        .len       = COLOR2CAN_SAMPLE_INFO_SIZE
+    };
+    event.sample_info = (struct color2can_sample_info) {
+        .sync_counter = n,
+        .time         = (uint64_t) n * 1000
+    };
+    return event;
+}
+
+// Returns true if the fields of the sample agree with its sequence
+static bool is_consistent(int sensor_id,
+                          const struct color2can_latest_sample *s) {
+    const uint32_t n = s->sequence;
+    const struct color2can_event expected = sample_event(sensor_id, n);
+
+    if(s->time != expected.time ||
+       s->sample.color[0] != expected.sample.color[0] ||
+       s->sample.color[1] != expected.sample.color[1] ||
+       s->sample.color[2] != expected.sample.color[2] ||
+       s->sample.clear != expected.sample.clear ||
+       s->sample.within_range != expected.sample.within_range ||
+       s->sample.range_id != expected.sample.range_id)
+        return false;
+
+    if(s->info_valid)
+        return s->info.sync_counter == (n & 0xff) &&
+               s->info.time == (uint64_t) n * 1000;
+    return true;
+}
+
+static void *reader(void *arg) {
+    struct reader_result *result = arg;
+    uint32_t last[SENSORS + 1] = { 0 };
+
+    while(!__atomic_load_n(&done, __ATOMIC_RELAXED)) {
+        for(int id = 1; id <= SENSORS; id++) {
+            struct color2can_latest_sample s;
+            if(color2can_latest_read(latest, id, &s))
+                continue;
+
+            result->reads++;
+            if(!is_consistent(id, &s))
+                result->torn++;
+            if(s.sequence < last[id])
+                result->backwards++;
+            last[id] = s.sequence;
+        }
+    }
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    latest = color2can_latest_create();
+    if(!latest) {
+        perror("[Latest] create");
+        return 1;
+    }
+
+    pthread_t threads[READERS];
+    struct reader_result results[READERS] = { 0 };
+    for(int i = 0; i < READERS; i++) {
+        if(pthread_create(&threads[i], NULL, reader, &results[i])) {
+            puts("[Latest] error creating thread");
+            return 1;
+        }
+    }
+
+    // the sequence counts the samples of each sensor, starting at 1
+    for(uint32_t n = 1; n <= SAMPLES; n++) {
+        for(int id = 1; id <= SENSORS; id++) {
+            struct color2can_event event = sample_event(id, n);
+            color2can_latest_update(latest, &event);
+            event = info_event(id, n);
+            color2can_latest_update(latest, &event);
+        }
+    }
+    __atomic_store_n(&done, true, __ATOMIC_RELAXED);
+
+    struct reader_result total = { 0 };
+    for(int i = 0; i < READERS; i++) {
+        pthread_join(threads[i], NULL);
+        total.reads     += results[i].reads;
+        total.torn      += results[i].torn;
+        total.backwards += results[i].backwards;
+    }
+
+    // after the writer is done, the last samples are read
+    bool last_ok = true;
+    for(int id = 1; id <= SENSORS; id++) {
+        struct color2can_latest_sample s;
+        last_ok &= !color2can_latest_read(latest, id, &s) &&
+                   s.sequence == SAMPLES && s.info_valid &&
+                   is_consistent(id, &s);
+    }
+    color2can_latest_destroy(latest);
+
+    printf(
+        "[Latest] %d readers: %llu reads, %llu torn, %llu backwards\n",
+        READERS, (unsigned long long) total.reads,
+        (unsigned long long) total.torn,
+        (unsigned long long) total.backwards
+    );
+    if(total.torn > 0 || total.backwards > 0 || !last_ok) {
+        puts("[Latest] FAILED");
+        return 1;
+    }
+    return 0;
+}
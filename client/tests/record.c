@@ -0,0 +1,125 @@
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "color2can-record.h"
+
+// Writes a log larger than the writer's mapping window, so that the
+// window is moved several times, then reads the records back and checks
+// that the file was truncated to the records written.
+
+// frames of 0...64 bytes: about 150MB, more than twice the window
+#define COUNT 3000000
+
+// record whose position is saved, to seek back to it
+#define SEEK_RECORD (COUNT / 2 + 7)
+
+static int failures;
+
+#define CHECK(cond) do {\
+    if(!(cond)) {\
+        printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);\
+        failures++;\
+    }\
+} while(0)
+
+static int len_of(uint32_t i) {
+    return i % (CANFD_MAX_DLEN + 1);
+}
+
+static void data_of(uint32_t i, uint8_t *data) {
+    for(int j = 0; j < len_of(i); j++)
+        data[j] = i * 31 + j;
+}
+
+// Returns 0 if the record is the i-th one written
+static int check_record(const struct color2can_record *record, uint32_t i) {
+    uint8_t data[CANFD_MAX_DLEN];
+    data_of(i, data);
+
+    const int len = len_of(i);
+    return record->time != (uint64_t) i + 1 ||
+           record->can_id != (0x6a0 | (i & 0x1f)) ||
+           record->len != len ||
+           record->flags != (len > CAN_MAX_DLEN ? COLOR2CAN_RECORD_FD : 0) ||
+           memcmp(record->data, data, len);
+}
+
+int main(int argc, char *argv[]) {
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/color2can-test-%d.log",
+             (int) getpid());
+
+    struct color2can_record_writer *writer = color2can_record_create(path);
+    if(!writer) {
+        perror("[Record] create");
+        return 1;
+    }
+
+    uint64_t size = sizeof(struct color2can_record_header);
+    uint64_t seek_position = 0;
+    for(uint32_t i = 0; i < COUNT; i++) {
+        uint8_t data[CANFD_MAX_DLEN];
+        data_of(i, data);
+
+        const int len = len_of(i);
+        if(i == SEEK_RECORD)
+            seek_position = size;
+        if(color2can_record_append(
+            writer, (uint64_t) i + 1, 0x6a0 | (i & 0x1f), data, len,
+            len > CAN_MAX_DLEN ? COLOR2CAN_RECORD_FD : 0
+        )) {
+            perror("[Record] append");
+            failures++;
+            break;
+        }
+        size += COLOR2CAN_RECORD_SIZE(len);
+    }
+    CHECK(color2can_record_size(writer) == size);
+    CHECK(color2can_record_finish(writer) == 0);
+
+    // the blocks allocated past the last record are truncated
+    struct stat st;
+    CHECK(stat(path, &st) == 0 && st.st_size == size);
+
+    struct color2can_record_reader *reader = color2can_record_open(path);
+    unlink(path);
+    if(!reader) {
+        perror("[Record] open");
+        return 1;
+    }
+    CHECK(!memcmp(color2can_record_get_header(reader)->magic,
+                  COLOR2CAN_RECORD_MAGIC, 8));
+
+    uint32_t count = 0, mismatches = 0;
+    const struct color2can_record *record;
+    while((record = color2can_record_next(reader))) {
+        mismatches += (check_record(record, count) != 0);
+        count++;
+    }
+    CHECK(count == COUNT);
+    CHECK(mismatches == 0);
+    CHECK(color2can_record_tell(reader) == size);
+
+    // seeking to a saved position reads the log from there
+    color2can_record_seek(reader, seek_position);
+    record = color2can_record_next(reader);
+    CHECK(record && check_record(record, SEEK_RECORD) == 0);
+
+    color2can_record_rewind(reader);
+    record = color2can_record_next(reader);
+    CHECK(record && check_record(record, 0) == 0);
+
+    color2can_record_close(reader);
+
+    if(failures > 0) {
+        printf("[Record] %d check(s) FAILED\n", failures);
+        return 1;
+    }
+    printf("[Record] %d records read back, file of %llu bytes\n",
+           COUNT, (unsigned long long) size);
+    return 0;
+}
@@ -0,0 +1,132 @@
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "color2can-client.h"
+#include "color2can-shm.h"
+
+// Publishes events to a ring in shared memory and reads them back, with
+// color2can_shm_read and with color2can_shm_peek, including events that
+// are overwritten while a slow reader holds them. Also checks that an
+// existing object is only replaced when asked to.
+
+#define CAPACITY 8
+
+static int failures;
+
+#define CHECK(cond) do {\
+    if(!(cond)) {\
+        printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);\
+        failures++;\
+    }\
+} while(0)
+
+static void publish(struct color2can_shm_writer *writer,
+                    uint64_t first, int count) {
+    for(int i = 0; i < count; i++) {
+        const struct color2can_event event = {
+            .type      = COLOR2CAN_EVENT_SAMPLE,
+            .sensor_id = 1,
+            .len       = 8,
+            .time      = first + i
+        };
+        color2can_shm_publish(writer, &event, 1);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    char name[64];
+    snprintf(name, sizeof(name), "/color2can-test-%d", (int) getpid());
+
+    struct color2can_shm_writer *writer =
+        color2can_shm_create(name, CAPACITY, 0);
+    if(!writer) {
+        perror("[SHM] create");
+        return 1;
+    }
+
+    // the object of a writer is not replaced by another one
+    errno = 0;
+    CHECK(color2can_shm_create(name, CAPACITY, 0) == NULL);
+    CHECK(errno == EEXIST);
+    struct color2can_shm_reader *reader = color2can_shm_attach(name);
+    if(!reader) {
+        perror("[SHM] attach");
+        color2can_shm_destroy(writer);
+        return 1;
+    }
+
+    const struct color2can_event *event;
+    struct color2can_event events[CAPACITY];
+    uint64_t lost = 0;
+
+    // copied and in-place reads see the same events
+    CHECK(color2can_shm_peek(reader, &event, &lost) == 0);
+    publish(writer, 100, 4);
+    CHECK(color2can_shm_read(reader, events, 2, &lost) == 2);
+    CHECK(events[0].time == 100 && events[1].time == 101);
+    for(uint64_t time = 102; time < 104; time++) {
+        CHECK(color2can_shm_peek(reader, &event, &lost) == 1);
+        CHECK(event->time == time && event->sensor_id == 1);
+        color2can_shm_release(reader);
+    }
+    CHECK(color2can_shm_peek(reader, &event, &lost) == 0);
+    CHECK(lost == 0);
+
+    // peeking again without releasing returns the same event
+    publish(writer, 200, 1);
+    CHECK(color2can_shm_peek(reader, &event, &lost) == 1);
+    CHECK(color2can_shm_peek(reader, &event, &lost) == 1);
+    CHECK(event->time == 200);
+
+    // the held event is a copy: it stays intact after its slot is
+    // overwritten
+    publish(writer, 300, CAPACITY);
+    CHECK(event->time == 200);
+    CHECK(color2can_shm_peek(reader, &event, &lost) == 1);
+    CHECK(event->time == 200);
+    color2can_shm_release(reader);
+    CHECK(lost == 0);
+
+    // a reader that fell behind skips the overwritten events
+    publish(writer, 400, 3);
+    CHECK(color2can_shm_peek(reader, &event, &lost) == 1);
+    CHECK(event->time == 300 + 3);
+    CHECK(lost == 3);
+
+    // reading returns the held event first
+    CHECK(color2can_shm_read(reader, events, CAPACITY, &lost) == 8);
+    CHECK(events[0].time == 303 && events[7].time == 402);
+
+    struct color2can_shm_reader_info info;
+    CHECK(color2can_shm_reader_info(writer, 0, &info) == 0);
+    CHECK(info.cursor == color2can_shm_head(writer));
+    CHECK(info.lost == lost);
+
+    // after the writer has gone away, the remaining events are read
+    publish(writer, 500, 1);
+    color2can_shm_destroy(writer);
+    CHECK(color2can_shm_peek(reader, &event, &lost) == 1);
+    CHECK(event->time == 500);
+    color2can_shm_release(reader);
+    CHECK(color2can_shm_peek(reader, &event, &lost) == -1);
+    color2can_shm_detach(reader);
+
+    // a stale object is replaced if asked to
+    writer = color2can_shm_create(name, CAPACITY, 0);
+    CHECK(writer != NULL);
+    struct color2can_shm_writer *takeover =
+        color2can_shm_create(name, CAPACITY, COLOR2CAN_SHM_TAKEOVER);
+    CHECK(takeover != NULL);
+    color2can_shm_destroy(takeover);
+    color2can_shm_destroy(writer);
+
+    if(failures > 0) {
+        printf("[SHM] %d check(s) FAILED\n", failures);
+        return 1;
+    }
+    puts("[SHM] peek and read match the published events");
+    return 0;
+}
@@ -0,0 +1,130 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "color2can.h"
+#include "color2can-unpack.h"
+
+// Compares the output of each kernel supported by this machine with the
+// values read through the bitfields of struct color2can_sample, for every
+// value of the packed word and for counts that exercise the kernels'
+// tails.
+
+// every value of the packed word, plus a tail for the kernels
+#define COUNT (65536 + 37)
+
+struct columns {
+    uint16_t color[3][COUNT];
+    uint16_t clear[COUNT];
+    uint8_t within_range[COUNT];
+    uint8_t range_id[COUNT];
+};
+
+static struct color2can_sample_columns columns_of(struct columns *c) {
+    return (struct color2can_sample_columns) {
+        .color        = { c->color[0], c->color[1], c->color[2] },
+        .clear        = c->clear,
+        .within_range = c->within_range,
+        .range_id     = c->range_id
+    };
+}
+
+// the reference: fields read through the bitfields
+static void unpack_bitfields(const uint8_t *in, size_t count,
+                             struct columns *out) {
+    for(size_t i = 0; i < count; i++) {
+        struct color2can_sample sample;
+        memcpy(&sample, in + i * COLOR2CAN_SAMPLE_SIZE, sizeof(sample));
+
+        out->color[0][i]     = sample.color[0];
+        out->color[1][i]     = sample.color[1];
+        out->color[2][i]     = sample.color[2];
+        out->clear[i]        = sample.clear;
+        out->within_range[i] = sample.within_range;
+        out->range_id[i]     = sample.range_id;
+    }
+}
+
+static uint64_t compare(const struct columns *expected,
+                        const struct columns *actual, size_t count) {
+    uint64_t errors = 0;
+    for(size_t i = 0; i < count; i++) {
+        errors += (expected->color[0][i]     != actual->color[0][i]);
+        errors += (expected->color[1][i]     != actual->color[1][i]);
+        errors += (expected->color[2][i]     != actual->color[2][i]);
+        errors += (expected->clear[i]        != actual->clear[i]);
+        errors += (expected->within_range[i] != actual->within_range[i]);
+        errors += (expected->range_id[i]     != actual->range_id[i]);
+    }
+    return errors;
+}
+
+static uint64_t check_kernel(const uint8_t *in,
+                             const struct columns *expected,
+                             struct columns *actual) {
+    struct color2can_sample_columns out = columns_of(actual);
+
+    memset(actual, 0xa5, sizeof(*actual));
+    color2can_unpack_samples(in, COUNT, &out);
+    uint64_t errors = compare(expected, actual, COUNT);
+
+    // short counts, ending in the middle of the kernels' blocks
+    for(size_t count = 0; count <= 70; count++) {
+        memset(actual, 0xa5, sizeof(*actual));
+        color2can_unpack_samples(in, count, &out);
+        errors += compare(expected, actual, count);
+
+        // nothing is written past 'count'
+        errors += (actual->clear[count]    != 0xa5a5);
+        errors += (actual->range_id[count] != 0xa5);
+    }
+    return errors;
+}
+
+int main(int argc, char *argv[]) {
+    // the input is misaligned by one byte on purpose
+    uint8_t *buffer = malloc(COUNT * COLOR2CAN_SAMPLE_SIZE + 1);
+    struct columns *expected = malloc(sizeof(*expected));
+    struct columns *actual   = malloc(sizeof(*actual));
+    if(!buffer || !expected || !actual) {
+        puts("[Unpack] not enough memory");
+        return 1;
+    }
+    uint8_t *in = buffer + 1;
+
+    uint32_t seed = 1;
+    for(size_t i = 0; i < COUNT; i++) {
+        uint16_t words[4];
+        for(int j = 0; j < 3; j++) {
+            seed = seed * 1103515245 + 12345;
+            words[j] = seed >> 16;
+        }
+        words[3] = i;
+        memcpy(in + i * COLOR2CAN_SAMPLE_SIZE, words, sizeof(words));
+    }
+    unpack_bitfields(in, COUNT, expected);
+
+    int failed = 0;
+    for(int k = 0; k < COLOR2CAN_UNPACK_KERNELS; k++) {
+        const char *name = color2can_unpack_kernel_name(k);
+        if(color2can_unpack_set_kernel(k)) {
+            printf("[Unpack] %-6s not supported: skipped\n", name);
+            continue;
+        }
+
+        const uint64_t errors = check_kernel(in, expected, actual);
+        if(errors > 0) {
+            printf("[Unpack] %-6s FAILED: %llu mismatches\n",
+                   name, (unsigned long long) errors);
+            failed++;
+        } else {
+            printf("[Unpack] %-6s matches the bitfields\n", name);
+        }
+    }
+
+    free(buffer);
+    free(expected);
+    free(actual);
+    return (failed > 0);
+}
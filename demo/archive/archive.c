@@ -0,0 +1,238 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <time.h>
+
+#include <unistd.h>
+
+#include <linux/can.h>
+
+#include "color2can.h"
+#include "color2can-record.h"
+#include "color2can-archive.h"
+
+// Builds archives of samples from logs of the recorder, and queries
+// them by sensor and time interval.
+
+static uint64_t get_time(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* ================================================================== */
+/*                               Build                                */
+/* ================================================================== */
+
+static int add_log(struct color2can_archive_writer *writer,
+                   const char *path, uint64_t *samples, uint64_t *skipped) {
+    struct color2can_record_reader *reader = color2can_record_open(path);
+    if(!reader) {
+        perror(path);
+        return 1;
+    }
+
+    const struct color2can_record *record;
+    while((record = color2can_record_next(reader))) {
+        if(record->can_id & (CAN_EFF_FLAG | CAN_RTR_FLAG | CAN_ERR_FLAG))
+            continue;
+
+        const int sensor_id = record->can_id % COLOR2CAN_MAX_SENSOR_COUNT;
+        const int msg_type  = record->can_id - sensor_id;
+        if(msg_type != COLOR2CAN_SAMPLE_MASK_ID)
+            continue;
+
+        // CAN FD batches are not archived
+        if(record->len != COLOR2CAN_SAMPLE_SIZE) {
+            (*skipped)++;
+            continue;
+        }
+
+        struct color2can_sample sample;
+        memcpy(&sample, record->data, COLOR2CAN_SAMPLE_SIZE);
+        if(color2can_archive_add(writer, sensor_id, record->time, &sample)) {
+            // logs of the same sensors must be given in time order
+            printf("[Archive] %s: samples out of order\n", path);
+            color2can_record_close(reader);
+            return 1;
+        }
+        (*samples)++;
+    }
+
+    color2can_record_close(reader);
+    return 0;
+}
+
+static int cmd_build(const char *path, char *logs[], int log_count) {
+    struct color2can_archive_writer *writer = color2can_archive_create(path);
+    if(!writer) {
+        perror(path);
+        return 1;
+    }
+
+    uint64_t samples = 0, skipped = 0;
+    int err = 0;
+    for(int i = 0; i < log_count && !err; i++)
+        err = add_log(writer, logs[i], &samples, &skipped);
+
+    if(color2can_archive_finish(writer)) {
+        perror(path);
+        err = 1;
+    }
+
+    printf(
+        "[Archive] samples=%llu skipped=%llu\n",
+        (unsigned long long) samples, (unsigned long long) skipped
+    );
+    return err;
+}
+
+/* ================================================================== */
+/*                                Info                                */
+/* ================================================================== */
+
+static int cmd_info(const char *path) {
+    struct color2can_archive_reader *reader = color2can_archive_open(path);
+    if(!reader) {
+        perror(path);
+        return 1;
+    }
+
+    struct color2can_archive_info info;
+    color2can_archive_get_info(reader, &info);
+    color2can_archive_close(reader);
+
+    printf("blocks: %llu\n", (unsigned long long) info.blocks);
+    printf("rows:   %llu\n", (unsigned long long) info.rows);
+    printf(
+        "time:   %llu.%06llu ... %llu.%06llu\n",
+        (unsigned long long) (info.time_min / 1000000),
+        (unsigned long long) (info.time_min % 1000000),
+        (unsigned long long) (info.time_max / 1000000),
+        (unsigned long long) (info.time_max % 1000000)
+    );
+
+    static const char *names[COLOR2CAN_ARCHIVE_COLUMNS] = {
+        "time", "red", "green", "blue", "clear", "within_range", "range_id"
+    };
+    uint64_t total = 0;
+    for(int c = 0; c < COLOR2CAN_ARCHIVE_COLUMNS; c++) {
+        total += info.column_size[c];
+        printf(
+            "  %-13s %12llu bytes  %6.3f bytes/row\n", names[c],
+            (unsigned long long) info.column_size[c],
+            info.rows ? (double) info.column_size[c] / info.rows : 0
+        );
+    }
+    printf(
+        "  %-13s %12llu bytes  %6.3f bytes/row\n", "total",
+        (unsigned long long) total,
+        info.rows ? (double) total / info.rows : 0
+    );
+    return 0;
+}
+
+/* ================================================================== */
+/*                               Query                                */
+/* ================================================================== */
+
+static int print_rows(const struct color2can_archive_rows *rows,
+                      void *user) {
+    for(int i = 0; i < rows->count; i++) {
+        printf(
+            "%llu.%06llu sensor=%d color=%d,%d,%d clear=%d range=%d\n",
+            (unsigned long long) (rows->time[i] / 1000000),
+            (unsigned long long) (rows->time[i] % 1000000),
+            rows->sensor_id,
+            rows->color[0][i], rows->color[1][i], rows->color[2][i],
+            rows->clear[i],
+            rows->within_range[i] ? rows->range_id[i] : -1
+        );
+    }
+    return 0;
+}
+
+static int cmd_query(const char *path,
+                     struct color2can_archive_query *query, bool count) {
+    struct color2can_archive_reader *reader = color2can_archive_open(path);
+    if(!reader) {
+        perror(path);
+        return 1;
+    }
+
+    // counting only needs the time column, to cut blocks at the limits
+    query->columns = count ? 0 : COLOR2CAN_ARCHIVE_ALL_COLUMNS;
+
+    const uint64_t start = get_time();
+    const int64_t rows = color2can_archive_query(
+        reader, query, count ? NULL : print_rows, NULL
+    );
+    const uint64_t elapsed = get_time() - start;
+    color2can_archive_close(reader);
+
+    if(rows < 0) {
+        printf("[Archive] %s: corrupted archive\n", path);
+        return 1;
+    }
+    if(count) {
+        printf(
+            "rows=%lld time=%.3f s\n",
+            (long long) rows, elapsed / 1e6
+        );
+    }
+    return 0;
+}
+
+static void usage(const char *arg0) {
+    printf("Usage:\n");
+    printf("  %s build <archive> <log>...\n", arg0);
+    printf("  %s info <archive>\n", arg0);
+    printf("  %s query [options] <archive>\n", arg0);
+    printf("    -s <id>    only sensor 'id' (can be repeated)\n");
+    printf("    -f <time>  from 'time' (seconds, inclusive)\n");
+    printf("    -t <time>  to 'time' (seconds, exclusive)\n");
+    printf("    -c         only count the rows\n");
+}
+
+int main(int argc, char *argv[]) {
+    if(argc >= 4 && !strcmp(argv[1], "build"))
+        return cmd_build(argv[2], &argv[3], argc - 3);
+
+    if(argc == 3 && !strcmp(argv[1], "info"))
+        return cmd_info(argv[2]);
+
+    if(argc >= 3 && !strcmp(argv[1], "query")) {
+        struct color2can_archive_query query = { 0 };
+        bool count = false;
+
+        optind = 2;
+        int opt;
+        while((opt = getopt(argc, argv, "s:f:t:c")) != -1) {
+            if(opt == 's') {
+                const int id = atoi(optarg);
+                if(id < 1 || id >= COLOR2CAN_MAX_SENSOR_COUNT) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                query.sensors |= 1u << id;
+            } else if(opt == 'f') {
+                query.time_from = atof(optarg) * 1e6;
+            } else if(opt == 't') {
+                query.time_to = atof(optarg) * 1e6;
+            } else if(opt == 'c') {
+                count = true;
+            } else {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+        if(optind == argc - 1)
+            return cmd_query(argv[optind], &query, count);
+    }
+
+    usage(argv[0]);
+    return 1;
+}
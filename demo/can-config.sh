@@ -1,3 +1,7 @@
 #!/bin/sh
-ip link set can0 type can bitrate 250000 phase-seg1 8 phase-seg2 7
+# usage: can-config.sh [bitrate]
+BITRATE=${1:-250000}
+
+ifconfig can0 down
+ip link set can0 type can bitrate $BITRATE sample-point 0.562
 ifconfig can0 up
@@ -0,0 +1,280 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <unistd.h>
+
+#include <net/if.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+
+#include <linux/can.h>
+#include <linux/can/raw.h>
+
+#include "color2can.h"
+
+static int sockfd;
+
+static int can_open(const char *ifname) {
+    if((sockfd = socket(PF_CAN, SOCK_RAW, CAN_RAW)) < 0) {
+        perror("Socket");
+        return 1;
+    }
+
+    const int enable_fd = 1;
+    if(setsockopt(sockfd, SOL_CAN_RAW, CAN_RAW_FD_FRAMES,
+                  &enable_fd, sizeof(enable_fd)) < 0) {
+        perror("CAN_RAW_FD_FRAMES");
+        return 1;
+    }
+
+    struct ifreq ifr = { 0 };
+    strncpy(ifr.ifr_name, ifname, IFNAMSIZ - 1);
+    ioctl(sockfd, SIOCGIFINDEX, &ifr);
+
+    struct sockaddr_can addr = { 0 };
+    addr.can_family  = AF_CAN;
+    addr.can_ifindex = ifr.ifr_ifindex;
+
+    if(bind(sockfd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        perror("Bind");
+        return 1;
+    }
+    return 0;
+}
+
+/* ================================================================== */
+/*                              Decoder                               */
+/* ================================================================== */
+
+// Decode a sample message, either classic (one sample) or CAN FD
+// (a batch of samples). Returns the number of samples written into
+// 'samples', or -1 if the message is malformed.
+static int decode_samples(const uint8_t *data, int len, int *sequence,
+                          struct color2can_sample *samples) {
+    if(len == COLOR2CAN_SAMPLE_SIZE) {
+        *sequence = -1;
+        memcpy(samples, data, COLOR2CAN_SAMPLE_SIZE);
+        return 1;
+    }
+
+    if(len < COLOR2CAN_SAMPLE_BATCH_SIZE(1))
+        return -1;
+
+    const struct color2can_sample_batch *batch = (const void *) data;
+    const int count = batch->count;
+    if(count < 1 || count > COLOR2CAN_SAMPLE_BATCH_MAX ||
+       COLOR2CAN_SAMPLE_BATCH_SIZE(count) > len)
+        return -1;
+
+    *sequence = batch->sequence;
+    memcpy(samples, batch->samples, count * COLOR2CAN_SAMPLE_SIZE);
+    return count;
+}
+
+static int cmd_decode(const char *ifname) {
+    if(can_open(ifname)) {
+        printf("Error trying to open CAN device\n");
+        return 1;
+    }
+
+    // expected sequence number of the next batch (-1 = unknown)
+    int next_sequence[COLOR2CAN_MAX_SENSOR_COUNT];
+    for(int i = 0; i < COLOR2CAN_MAX_SENSOR_COUNT; i++)
+        next_sequence[i] = -1;
+
+    while(1) {
+        struct canfd_frame frame;
+        if(read(sockfd, &frame, sizeof(frame)) < 0) {
+            perror("CAN read");
+            return 1;
+        }
+
+        if(frame.can_id & (CAN_RTR_FLAG | CAN_ERR_FLAG))
+            continue;
+
+        const int sensor_id = frame.can_id % COLOR2CAN_MAX_SENSOR_COUNT;
+        const int msg_type  = frame.can_id - sensor_id;
+        if(msg_type != COLOR2CAN_SAMPLE_MASK_ID)
+            continue;
+
+        struct color2can_sample samples[COLOR2CAN_SAMPLE_BATCH_MAX];
+        int sequence;
+        int count = decode_samples(frame.data, frame.len, &sequence, samples);
+        if(count < 0) {
+            printf("[Decoder] malformed sample message (len=%d)\n", frame.len);
+            continue;
+        }
+
+        if(sequence >= 0) {
+            int expected = next_sequence[sensor_id];
+            if(expected >= 0 && sequence != expected) {
+                printf(
+                    "[Decoder] sensor %d: lost %d batch(es)\n",
+                    sensor_id, (sequence - expected) & 0xff
+                );
+            }
+            next_sequence[sensor_id] = (sequence + 1) & 0xff;
+        }
+
+        for(int i = 0; i < count; i++) {
+            struct color2can_sample *s = &samples[i];
+            printf(
+                "sensor=%d seq=%d #%d color=%d,%d,%d clear=%d range=%d\n",
+                sensor_id, sequence, i,
+                s->color[0], s->color[1], s->color[2], s->clear,
+                s->within_range ? s->range_id : -1
+            );
+        }
+    }
+    return 0;
+}
+
+/* ================================================================== */
+/*                             Benchmark                              */
+/* ================================================================== */
+
+// Valid CAN FD data lengths
+static int fd_padded_len(int len) {
+    static const int lengths[] = { 12, 16, 20, 24, 32, 48, 64 };
+    if(len <= 8)
+        return len;
+    for(int i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++)
+        if(len <= lengths[i])
+            return lengths[i];
+    return 64;
+}
+
+// Time (in seconds) of a classic base-format data frame, including
+// worst-case stuff bits and the interframe space.
+static double classic_frame_time(int len, double bitrate) {
+    const int stuffed = 34 + 8 * len; // SOF...CRC
+    const int bits = stuffed + (stuffed - 1) / 4
+                   + 13; // CRC delimiter, ACK, EOF, IFS
+    return bits / bitrate;
+}
+
+// Time (in seconds) of a CAN FD base-format data frame with bit rate
+// switching, including worst-case stuff bits and the interframe space.
+static double fd_frame_time(int len, double bitrate, double data_bitrate) {
+    len = fd_padded_len(len);
+
+    // SOF, ID, RRS, IDE, FDF, res, BRS
+    const int arbitration = 17 + 16 / 4;
+
+    // ESI, DLC, data, then stuff count and CRC with fixed stuff bits
+    const int crc = (len <= 16 ? 17 : 21) + 4;
+    const int dynamic = 5 + 8 * len;
+    const int data = dynamic + (dynamic - 1) / 4 + crc + (crc + 3) / 4;
+
+    // CRC delimiter, ACK, EOF, IFS
+    const int tail = 13;
+
+    return (arbitration + tail) / bitrate + data / data_bitrate;
+}
+
+static uint64_t get_time_ns(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t) t.tv_sec * 1000000000 + (uint64_t) t.tv_nsec;
+}
+
+static void bench_decoder(void) {
+    const int iterations = 10000000;
+
+    uint8_t frames[COLOR2CAN_SAMPLE_BATCH_MAX][64];
+    for(int i = 0; i < COLOR2CAN_SAMPLE_BATCH_MAX; i++) {
+        struct color2can_sample_batch batch = {
+            .sequence = i,
+            .count    = i + 1
+        };
+        for(int j = 0; j <= i; j++)
+            batch.samples[j] = (struct color2can_sample) { { j, j, j } };
+        memcpy(frames[i], &batch, sizeof(batch));
+    }
+
+    uint64_t decoded = 0;
+    uint64_t start = get_time_ns();
+    for(int i = 0; i < iterations; i++) {
+        struct color2can_sample samples[COLOR2CAN_SAMPLE_BATCH_MAX];
+        int sequence;
+
+        const int n = i % COLOR2CAN_SAMPLE_BATCH_MAX;
+        decoded += decode_samples(
+            frames[n], fd_padded_len(COLOR2CAN_SAMPLE_BATCH_SIZE(n + 1)),
+            &sequence, samples
+        );
+        __asm__ volatile("" : : "r"(samples) : "memory");
+    }
+    uint64_t elapsed = get_time_ns() - start;
+
+    printf(
+        "Decoder: %.1f ns/frame, %.1f M samples/s\n\n",
+        (double) elapsed / iterations, decoded * 1000.0 / elapsed
+    );
+}
+
+static int cmd_bench(double bitrate, double data_bitrate,
+                     int sensors, int frequency) {
+    const double samples_per_second = (double) sensors * frequency;
+
+    printf(
+        "Bus: %.0f bit/s (data phase: %.0f bit/s), "
+        "%d sensor(s) at %d Hz = %.0f samples/s\n\n",
+        bitrate, data_bitrate, sensors, frequency, samples_per_second
+    );
+    bench_decoder();
+
+    printf("%-10s %5s %6s %11s %9s %15s\n",
+           "mode", "bytes", "us", "frames/s", "bus load", "max samples/s");
+
+    // classic CAN: one sample per frame
+    {
+        double t = classic_frame_time(COLOR2CAN_SAMPLE_SIZE, bitrate);
+        printf(
+            "%-10s %5d %6.1f %11.0f %8.1f%% %15.0f\n",
+            "classic", COLOR2CAN_SAMPLE_SIZE, t * 1e6,
+            samples_per_second, samples_per_second * t * 100, 1 / t
+        );
+    }
+
+    // CAN FD: batches of 1...7 samples per frame
+    for(int n = 1; n <= COLOR2CAN_SAMPLE_BATCH_MAX; n++) {
+        const int len = (n == 1 ? COLOR2CAN_SAMPLE_SIZE
+                                : COLOR2CAN_SAMPLE_BATCH_SIZE(n));
+        double t = fd_frame_time(len, bitrate, data_bitrate);
+        double frames = samples_per_second / n;
+
+        char mode[16];
+        snprintf(mode, sizeof(mode), "fd x%d", n);
+        printf(
+            "%-10s %5d %6.1f %11.0f %8.1f%% %15.0f\n",
+            mode, fd_padded_len(len), t * 1e6,
+            frames, frames * t * 100, n / t
+        );
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    if(argc >= 3 && !strcmp(argv[1], "decode"))
+        return cmd_decode(argv[2]);
+
+    if(argc >= 2 && !strcmp(argv[1], "bench")) {
+        double bitrate      = (argc > 2 ? atof(argv[2]) : 250000);
+        double data_bitrate = (argc > 3 ? atof(argv[3]) : 1000000);
+        int sensors         = (argc > 4 ? atoi(argv[4]) : 31);
+        int frequency       = (argc > 5 ? atoi(argv[5]) : 400);
+        return cmd_bench(bitrate, data_bitrate, sensors, frequency);
+    }
+
+    printf("Usage:\n");
+    printf("  %s decode <ifname>\n", argv[0]);
+    printf("  %s bench [bitrate] [data-bitrate] [sensors] [frequency]\n",
+           argv[0]);
+    return 1;
+}
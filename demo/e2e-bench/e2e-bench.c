@@ -0,0 +1,546 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdio.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#include <net/if.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+
+#include <linux/can.h>
+#include <linux/can/raw.h>
+
+#include "color2can.h"
+
+// End-to-end benchmark: runs 'count' instances of the firmware's host
+// build on a (virtual) CAN interface, configures them, requests samples
+// and measures what comes back. Each run uses fresh sensor processes.
+
+#define MAX_SENSORS (COLOR2CAN_MAX_SENSOR_COUNT - 1)
+#define MAX_VALUES 16
+
+#define WARMUP_TIME   200000 // in microseconds
+#define GRACE_TIME    100000 // in microseconds
+#define STARTUP_TIME 5000000 // in microseconds
+
+static int sockfd;
+
+// frames dropped by the socket, since it was opened
+static uint32_t socket_drops;
+
+static uint64_t get_time(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (uint64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+/* ================================================================== */
+/*                                CAN                                 */
+/* ================================================================== */
+
+static int can_open(const char *ifname) {
+    if((sockfd = socket(PF_CAN, SOCK_RAW, CAN_RAW)) < 0) {
+        perror("Socket");
+        return 1;
+    }
+
+    // sample requests sent by this socket are received back, so that
+    // latencies are measured between kernel timestamps
+    struct can_filter filters[] = {
+        { COLOR2CAN_SAMPLE_MASK_ID,      CAN_SFF_MASK & ~0x1f },
+        { COLOR2CAN_SAMPLE_INFO_MASK_ID, CAN_SFF_MASK & ~0x1f },
+        { COLOR2CAN_STATUS_MASK_ID,      CAN_SFF_MASK & ~0x1f }
+    };
+    setsockopt(
+        sockfd, SOL_CAN_RAW, CAN_RAW_FILTER, filters, sizeof(filters)
+    );
+
+    const int enable = 1;
+    setsockopt(sockfd, SOL_SOCKET, SO_TIMESTAMP, &enable, sizeof(enable));
+    setsockopt(sockfd, SOL_SOCKET, SO_RXQ_OVFL, &enable, sizeof(enable));
+    setsockopt(
+        sockfd, SOL_CAN_RAW, CAN_RAW_RECV_OWN_MSGS, &enable, sizeof(enable)
+    );
+
+    // do not lose frames during bursts
+    const int rcvbuf = 4 * 1024 * 1024;
+    setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+    struct ifreq ifr = { 0 };
+    strncpy(ifr.ifr_name, ifname, IFNAMSIZ - 1);
+    if(ioctl(sockfd, SIOCGIFINDEX, &ifr) < 0) {
+        perror("Interface");
+        return 1;
+    }
+
+    struct sockaddr_can addr = { 0 };
+    addr.can_family  = AF_CAN;
+    addr.can_ifindex = ifr.ifr_ifindex;
+
+    if(bind(sockfd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        perror("Bind");
+        return 1;
+    }
+    return 0;
+}
+
+static int can_write(uint32_t can_id, void *data, int len) {
+    struct can_frame frame = { 0 };
+
+    frame.can_id  = can_id;
+    frame.can_dlc = len;
+    if(len > 0)
+        memcpy(frame.data, data, len);
+
+    const int frame_size = sizeof(struct can_frame);
+    if(write(sockfd, &frame, frame_size) != frame_size) {
+        perror("CAN write");
+        return -1;
+    }
+    return len;
+}
+
+// Read a frame and its kernel timestamp (in microseconds).
+// 'own' is set if the frame was sent by this socket.
+static int can_read(struct can_frame *frame, uint64_t *time, bool *own) {
+    struct iovec iov = {
+        .iov_base = frame,
+        .iov_len  = sizeof(*frame)
+    };
+
+    char control[CMSG_SPACE(sizeof(struct timeval)) +
+                 CMSG_SPACE(sizeof(uint32_t))];
+    struct msghdr msg = {
+        .msg_iov        = &iov,
+        .msg_iovlen     = 1,
+        .msg_control    = control,
+        .msg_controllen = sizeof(control)
+    };
+
+    if(recvmsg(sockfd, &msg, MSG_DONTWAIT) < 0)
+        return -1;
+
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    for(struct cmsghdr *c = CMSG_FIRSTHDR(&msg); c;
+        c = CMSG_NXTHDR(&msg, c)) {
+        if(c->cmsg_level != SOL_SOCKET)
+            continue;
+
+        if(c->cmsg_type == SO_TIMESTAMP)
+            memcpy(&tv, CMSG_DATA(c), sizeof(tv));
+        else if(c->cmsg_type == SO_RXQ_OVFL)
+            memcpy(&socket_drops, CMSG_DATA(c), sizeof(socket_drops));
+    }
+
+    *time = (uint64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+    *own  = (msg.msg_flags & MSG_CONFIRM);
+    return 0;
+}
+
+/* ================================================================== */
+/*                              Sensors                               */
+/* ================================================================== */
+
+static struct {
+    pid_t pid;
+    int stdin_fd; // closing it makes the firmware exit
+} sensors[MAX_SENSORS + 1];
+
+static int sensors_start(const char *host, const char *ifname, int count) {
+    for(int id = 1; id <= count; id++) {
+        int fds[2];
+        if(pipe(fds)) {
+            perror("Pipe");
+            return 1;
+        }
+
+        pid_t pid = fork();
+        if(pid < 0) {
+            perror("Fork");
+            return 1;
+        }
+
+        if(pid == 0) {
+            dup2(fds[0], STDIN_FILENO);
+            close(fds[0]);
+            close(fds[1]);
+
+            int null = open("/dev/null", O_WRONLY);
+            dup2(null, STDOUT_FILENO);
+
+            char sensor_id[8];
+            snprintf(sensor_id, sizeof(sensor_id), "%d", id);
+            setenv("SENSOR_ID", sensor_id, 1);
+
+            execl(host, host, ifname, (char *) NULL);
+            perror("Exec");
+            _exit(1);
+        }
+
+        close(fds[0]);
+        sensors[id].pid      = pid;
+        sensors[id].stdin_fd = fds[1];
+    }
+    return 0;
+}
+
+static void sensors_stop(int count) {
+    for(int id = 1; id <= count; id++)
+        close(sensors[id].stdin_fd);
+
+    const uint64_t deadline = get_time() + 1000000;
+    for(int id = 1; id <= count; id++) {
+        while(waitpid(sensors[id].pid, NULL, WNOHANG) == 0) {
+            if(get_time() > deadline) {
+                kill(sensors[id].pid, SIGKILL);
+                waitpid(sensors[id].pid, NULL, 0);
+                break;
+            }
+            usleep(10000);
+        }
+    }
+}
+
+/* ================================================================== */
+/*                              Results                               */
+/* ================================================================== */
+
+#define PENDING_MAX 1024
+
+// time of the requests not answered yet
+struct pending {
+    uint64_t times[PENDING_MAX];
+    int head;
+    int count;
+};
+
+static struct {
+    uint32_t samples;
+    uint32_t overruns;
+    uint32_t requests;
+    uint32_t socket_drops; // at the start of the run
+
+    // latency of each request (in microseconds)
+    uint32_t *latencies;
+    uint32_t latency_count;
+    uint32_t latency_capacity;
+
+    struct pending pending[MAX_SENSORS + 1];
+} results;
+
+static void results_reset(void) {
+    uint32_t *latencies = results.latencies;
+    uint32_t capacity   = results.latency_capacity;
+
+    memset(&results, 0, sizeof(results));
+    results.latencies        = latencies;
+    results.latency_capacity = capacity;
+}
+
+static void add_latency(uint32_t latency) {
+    if(results.latency_count == results.latency_capacity) {
+        results.latency_capacity = (results.latency_capacity
+                                    ? results.latency_capacity * 2
+                                    : 4096);
+        results.latencies = realloc(
+            results.latencies,
+            results.latency_capacity * sizeof(uint32_t)
+        );
+    }
+    results.latencies[results.latency_count++] = latency;
+}
+
+static int compare_latency(const void *a, const void *b) {
+    const uint32_t x = *(const uint32_t *) a;
+    const uint32_t y = *(const uint32_t *) b;
+    return (x > y) - (x < y);
+}
+
+static uint32_t percentile(double p) {
+    if(results.latency_count == 0)
+        return 0;
+
+    uint32_t i = p * results.latency_count;
+    if(i >= results.latency_count)
+        i = results.latency_count - 1;
+    return results.latencies[i];
+}
+
+/* ================================================================== */
+/*                                Run                                 */
+/* ================================================================== */
+
+// Handle the frames received until now. Samples are only counted if
+// 'measure' is set.
+static void receive_frames(bool measure) {
+    struct can_frame frame;
+    uint64_t time;
+    bool own;
+
+    while(can_read(&frame, &time, &own) == 0) {
+        const int id   = frame.can_id & 0x1f;
+        const int type = frame.can_id & CAN_SFF_MASK & ~0x1f;
+
+        if(own) {
+            // a request of ours, with the time it was sent
+            if(type != COLOR2CAN_SAMPLE_MASK_ID || !measure)
+                continue;
+
+            struct pending *p = &results.pending[id];
+            if(p->count == PENDING_MAX)
+                continue;
+            p->times[(p->head + p->count) % PENDING_MAX] = time;
+            p->count++;
+            results.requests++;
+        } else if(type == COLOR2CAN_SAMPLE_MASK_ID) {
+            if(!measure)
+                continue;
+            results.samples++;
+
+            // answer the oldest request
+            struct pending *p = &results.pending[id];
+            if(p->count > 0) {
+                add_latency(time - p->times[p->head]);
+                p->head = (p->head + 1) % PENDING_MAX;
+                p->count--;
+            }
+        } else if(type == COLOR2CAN_SAMPLE_INFO_MASK_ID) {
+            struct color2can_sample_info info;
+            memcpy(&info, frame.data, sizeof(info));
+            if(measure && info.overrun)
+                results.overruns++;
+        }
+    }
+}
+
+// Wait until 'time', handling received frames meanwhile
+static void wait_until(uint64_t time, bool measure) {
+    while(true) {
+        receive_frames(measure);
+
+        const uint64_t now = get_time();
+        if(now >= time)
+            break;
+
+        const uint64_t delay = time - now;
+        struct timespec timeout = {
+            .tv_sec  = delay / 1000000,
+            .tv_nsec = (delay % 1000000) * 1000
+        };
+        struct pollfd pfd = { .fd = sockfd, .events = POLLIN };
+        ppoll(&pfd, 1, &timeout, NULL);
+    }
+}
+
+// Wait until all sensors reply to a status request
+static int wait_for_sensors(int count) {
+    const uint64_t deadline = get_time() + STARTUP_TIME;
+    while(get_time() < deadline) {
+        can_write(COLOR2CAN_STATUS_MASK_ID | CAN_RTR_FLAG, NULL, 0);
+
+        uint32_t ready = 0;
+        const uint64_t end = get_time() + 200000;
+        while(get_time() < end) {
+            struct pollfd pfd = { .fd = sockfd, .events = POLLIN };
+            poll(&pfd, 1, 10);
+
+            struct can_frame frame;
+            uint64_t time;
+            bool own;
+            while(can_read(&frame, &time, &own) == 0) {
+                const int type = frame.can_id & CAN_SFF_MASK & ~0x1f;
+                if(!own && type == COLOR2CAN_STATUS_MASK_ID)
+                    ready |= 1 << (frame.can_id & 0x1f);
+            }
+        }
+
+        const uint32_t all = ((1u << count) - 1) << 1;
+        if((ready & all) == all)
+            return 0;
+    }
+    return 1;
+}
+
+static int run(const char *host, const char *ifname, int count,
+               int frequency, int rtr_rate, double duration) {
+    results_reset();
+
+    if(sensors_start(host, ifname, count) || wait_for_sensors(count)) {
+        fprintf(stderr, "[Bench] sensors did not start\n");
+        sensors_stop(count);
+        return 1;
+    }
+
+    results.socket_drops = socket_drops;
+
+    // broadcast the configuration
+    struct color2can_config config = {
+        .transmit_frequency = frequency,
+        .color_space        = COLOR2CAN_SPACE_RGB,
+        .use_led            = COLOR2CAN_LED_NEVER,
+        .sample_info        = 1
+    };
+    can_write(COLOR2CAN_CONFIG_MASK_ID, &config, COLOR2CAN_CONFIG_SIZE);
+    wait_until(get_time() + WARMUP_TIME, false);
+
+    // request samples from each sensor in turn
+    const uint64_t start = get_time();
+    const uint64_t end   = start + duration * 1000000;
+    const double period = (rtr_rate > 0 ? 1e6 / (rtr_rate * count) : 0);
+
+    uint64_t next_request = start;
+    uint64_t sent = 0;
+    int next_sensor = 1;
+    while(get_time() < end) {
+        if(rtr_rate == 0) {
+            wait_until(end, true);
+            break;
+        }
+
+        wait_until(next_request < end ? next_request : end, true);
+        if(get_time() >= end)
+            break;
+
+        can_write(
+            (COLOR2CAN_SAMPLE_MASK_ID | next_sensor) | CAN_RTR_FLAG,
+            NULL, 0
+        );
+        next_sensor = next_sensor % count + 1;
+
+        sent++;
+        next_request = start + (uint64_t) (sent * period);
+    }
+
+    // stop periodic samples, and let the last requests be answered
+    config.transmit_frequency = 0;
+    can_write(COLOR2CAN_CONFIG_MASK_ID, &config, COLOR2CAN_CONFIG_SIZE);
+    wait_until(get_time() + GRACE_TIME, true);
+
+    sensors_stop(count);
+
+    // print the results
+    const uint64_t expected = (uint64_t) frequency * duration * count
+                            + results.requests;
+    const uint64_t dropped = (expected > results.samples
+                              ? expected - results.samples : 0);
+
+    qsort(results.latencies, results.latency_count, sizeof(uint32_t),
+          compare_latency);
+    printf(
+        "%d,%d,%d,%.1f,%lu,%.1f,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu\n",
+        count, frequency, rtr_rate, duration,
+        (unsigned long) results.samples, results.samples / duration,
+        (unsigned long) expected, (unsigned long) dropped,
+        (unsigned long) results.overruns,
+        (unsigned long) (socket_drops - results.socket_drops),
+        (unsigned long) percentile(0.5),
+        (unsigned long) percentile(0.99),
+        (unsigned long) percentile(0.999),
+        (unsigned long) percentile(1)
+    );
+    fflush(stdout);
+    return 0;
+}
+
+/* ================================================================== */
+/*                                Main                                */
+/* ================================================================== */
+
+// Parse a comma-separated list of values
+static int parse_list(const char *str, int *values, int min, int max) {
+    int count = 0;
+    while(*str) {
+        char *end;
+        const long val = strtol(str, &end, 10);
+        if(end == str || val < min || val > max || count == MAX_VALUES)
+            return 0;
+        values[count++] = val;
+
+        if(*end == ',')
+            end++;
+        else if(*end != '\0')
+            return 0;
+        str = end;
+    }
+    return count;
+}
+
+static void usage(const char *arg0) {
+    printf("Usage: %s [options] <ifname> <color-host>\n", arg0);
+    printf("Runs 'color-host' for each sensor on a (virtual) CAN\n");
+    printf("interface, and prints one CSV line per combination of:\n");
+    printf("  -n <list>  sensor count, 1...31 (default: 1,8,31)\n");
+    printf("  -f <list>  transmit frequency in Hz (default: 0,100,180)\n");
+    printf("  -r <list>  RTR requests per second per sensor "
+           "(default: 0,100)\n");
+    printf("  -d <time>  duration of each run in seconds (default: 5)\n");
+    printf("Lists are comma-separated. Latencies (in microseconds) are\n");
+    printf("measured from a request to the next sample of that sensor.\n");
+}
+
+int main(int argc, char *argv[]) {
+    int counts[MAX_VALUES]      = { 1, 8, 31 };
+    int frequencies[MAX_VALUES] = { 0, 100, 180 };
+    int rtr_rates[MAX_VALUES]   = { 0, 100 };
+    int count_n = 3, frequency_n = 3, rtr_rate_n = 2;
+    double duration = 5;
+
+    int opt;
+    while((opt = getopt(argc, argv, "n:f:r:d:")) != -1) {
+        bool ok = true;
+        if(opt == 'n')
+            ok = (count_n = parse_list(optarg, counts, 1, MAX_SENSORS));
+        else if(opt == 'f')
+            ok = (frequency_n = parse_list(optarg, frequencies, 0, 400));
+        else if(opt == 'r')
+            ok = (rtr_rate_n = parse_list(optarg, rtr_rates, 0, 10000));
+        else if(opt == 'd')
+            ok = ((duration = atof(optarg)) > 0);
+        else
+            ok = false;
+
+        if(!ok) {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if(optind != argc - 2) {
+        usage(argv[0]);
+        return 1;
+    }
+    const char *ifname = argv[optind];
+    const char *host   = argv[optind + 1];
+
+    if(can_open(ifname))
+        return 1;
+
+    puts("sensors,frequency,rtr_rate,duration,samples,sample_rate,"
+         "expected,dropped,overruns,socket_drops,"
+         "latency_p50,latency_p99,latency_p999,latency_max");
+    for(int n = 0; n < count_n; n++) {
+        for(int f = 0; f < frequency_n; f++) {
+            for(int r = 0; r < rtr_rate_n; r++) {
+                // nothing to measure
+                if(frequencies[f] == 0 && rtr_rates[r] == 0)
+                    continue;
+
+                fprintf(stderr, "[Bench] %d sensor(s), %d Hz, %d RTR/s\n",
+                        counts[n], frequencies[f], rtr_rates[r]);
+                run(host, ifname, counts[n],
+                    frequencies[f], rtr_rates[r], duration);
+            }
+        }
+    }
+    return 0;
+}
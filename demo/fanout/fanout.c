@@ -0,0 +1,291 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+
+#include <unistd.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+
+#include "color2can.h"
+#include "color2can-client.h"
+#include "color2can-shm.h"
+
+// Owns the CAN bus, decodes each frame once and publishes the events to
+// a ring buffer in shared memory, from which any number of processes
+// read them without a socket of their own.
+
+#define BATCH_SIZE 64
+
+static const char *type_names[COLOR2CAN_EVENT_TYPES] = {
+    [COLOR2CAN_EVENT_SAMPLE]      = "sample",
+    [COLOR2CAN_EVENT_SAMPLE_INFO] = "sample_info",
+    [COLOR2CAN_EVENT_BITRATE]     = "bitrate",
+    [COLOR2CAN_EVENT_STATUS]      = "status",
+    [COLOR2CAN_EVENT_LATENCY]     = "latency",
+    [COLOR2CAN_EVENT_TRACE]       = "trace"
+};
+
+static int open_signalfd(void) {
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+    return signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+}
+
+/* ================================================================== */
+/*                               Serve                                */
+/* ================================================================== */
+
+static void print_readers(struct color2can_shm_writer *writer) {
+    const uint64_t head = color2can_shm_head(writer);
+    printf("[Fanout] published=%llu\n", (unsigned long long) head);
+
+    for(int i = 0; i < COLOR2CAN_SHM_READERS; i++) {
+        struct color2can_shm_reader_info info;
+        if(color2can_shm_reader_info(writer, i, &info))
+            continue;
+
+        printf(
+            "[Fanout]   reader pid=%-7d lag=%-8llu lost=%llu\n",
+            info.pid,
+            (unsigned long long) (head - info.cursor),
+            (unsigned long long) info.lost
+        );
+    }
+}
+
+static int cmd_serve(const char *ifname, const char *name,
+                     uint32_t capacity, int report_period, bool takeover) {
+    struct color2can_client *client = color2can_client_open(
+        ifname, COLOR2CAN_CLIENT_ALL
+    );
+    if(!client) {
+        perror("[Fanout] CAN open");
+        return 1;
+    }
+
+    struct color2can_shm_writer *writer = color2can_shm_create(
+        name, capacity, takeover ? COLOR2CAN_SHM_TAKEOVER : 0
+    );
+    if(!writer) {
+        perror("[Fanout] shared memory");
+        if(errno == EEXIST)
+            puts("[Fanout] use -f if the previous server crashed");
+        color2can_client_close(client);
+        return 1;
+    }
+
+    const int sigfd = open_signalfd();
+    const int timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if(report_period > 0) {
+        const struct timespec period = {
+            .tv_sec  = report_period / 1000,
+            .tv_nsec = (report_period % 1000) * 1000000L
+        };
+        const struct itimerspec spec = {
+            .it_interval = period,
+            .it_value    = period
+        };
+        timerfd_settime(timerfd, 0, &spec, NULL);
+    }
+    printf("[Fanout] publishing %s to %s\n", ifname, name);
+
+    struct pollfd fds[3] = {
+        { .fd = color2can_client_fd(client), .events = POLLIN },
+        { .fd = sigfd,                       .events = POLLIN },
+        { .fd = timerfd,                     .events = POLLIN }
+    };
+
+    int err = 0;
+    while(true) {
+        if(poll(fds, 3, -1) < 0) {
+            if(errno == EINTR)
+                continue;
+            perror("[Fanout] poll");
+            err = 1;
+            break;
+        }
+
+        if(fds[1].revents)
+            break;
+
+        if(fds[2].revents) {
+            uint64_t expirations;
+            if(read(timerfd, &expirations, sizeof(expirations)) > 0)
+                print_readers(writer);
+        }
+
+        // publish the events of each batch at once, so that readers are
+        // woken up once per batch
+        struct color2can_event events[BATCH_SIZE];
+        int count;
+        while((count = color2can_client_receive(
+                  client, events, BATCH_SIZE)) > 0)
+            color2can_shm_publish(writer, events, count);
+
+        if(count < 0 && errno != EAGAIN) {
+            perror("[Fanout] CAN read");
+            err = 1;
+            break;
+        }
+    }
+
+    struct color2can_client_stats stats;
+    color2can_client_get_stats(client, &stats);
+    printf(
+        "[Fanout] frames=%llu malformed=%llu dropped=%u\n",
+        (unsigned long long) stats.frames,
+        (unsigned long long) stats.malformed,
+        stats.dropped
+    );
+    print_readers(writer);
+
+    color2can_shm_destroy(writer);
+    color2can_client_close(client);
+    close(timerfd);
+    close(sigfd);
+    return err;
+}
+
+/* ================================================================== */
+/*                                Dump                                */
+/* ================================================================== */
+
+static void print_event(const struct color2can_event *event) {
+    printf(
+        "%llu.%06llu sensor=%-2d %-11s",
+        (unsigned long long) (event->time / 1000000),
+        (unsigned long long) (event->time % 1000000),
+        event->sensor_id, type_names[event->type]
+    );
+
+    if(event->type == COLOR2CAN_EVENT_SAMPLE) {
+        const struct color2can_sample *s = &event->sample;
+        printf(
+            " rgb=(%u, %u, %u) clear=%u",
+            s->color[0], s->color[1], s->color[2], s->clear
+        );
+        if(s->within_range)
+            printf(" range=%u", s->range_id);
+    } else if(event->type == COLOR2CAN_EVENT_SAMPLE_INFO) {
+        printf(
+            " time=%llu%s",
+            (unsigned long long) event->sample_info.time,
+            event->sample_info.overrun ? " overrun" : ""
+        );
+    } else {
+        for(int i = 0; i < event->len; i++)
+            printf(" %02x", event->data[i]);
+    }
+    putchar('\n');
+}
+
+static int cmd_dump(const char *name, bool quiet) {
+    struct color2can_shm_reader *reader = color2can_shm_attach(name);
+    if(!reader) {
+        perror("[Dump] attach");
+        return 1;
+    }
+
+    const int sigfd = open_signalfd();
+
+    uint64_t received = 0, lost = 0;
+    while(true) {
+        struct signalfd_siginfo info;
+        if(read(sigfd, &info, sizeof(info)) > 0)
+            break;
+
+        struct color2can_event events[BATCH_SIZE];
+        const int count = color2can_shm_read(reader, events, BATCH_SIZE,
+                                             &lost);
+        if(count < 0) {
+            puts("[Dump] the writer has gone away");
+            break;
+        }
+
+        if(count == 0) {
+            // wake up periodically to check for signals
+            color2can_shm_wait(reader, 100);
+            continue;
+        }
+
+        received += count;
+        if(!quiet)
+            for(int i = 0; i < count; i++)
+                print_event(&events[i]);
+    }
+
+    printf(
+        "[Dump] received=%llu lost=%llu\n",
+        (unsigned long long) received, (unsigned long long) lost
+    );
+
+    color2can_shm_detach(reader);
+    close(sigfd);
+    return 0;
+}
+
+static void usage(const char *arg0) {
+    printf("Usage:\n");
+    printf("  %s serve [options] <ifname>\n", arg0);
+    printf("    -n <name>      shared memory object (default: %s)\n",
+           COLOR2CAN_SHM_NAME);
+    printf("    -c <capacity>  events in the ring buffer (default: 65536)\n");
+    printf("    -r <period>    print the readers' lag every 'period' ms\n");
+    printf("    -f             replace the object of a server that crashed\n");
+    printf("  %s dump [options]\n", arg0);
+    printf("    -n <name>      shared memory object (default: %s)\n",
+           COLOR2CAN_SHM_NAME);
+    printf("    -q             only count the events\n");
+}
+
+int main(int argc, char *argv[]) {
+    if(argc < 2) {
+        usage(argv[0]);
+        return 1;
+    }
+    const bool serve = !strcmp(argv[1], "serve");
+    const bool dump  = !strcmp(argv[1], "dump");
+
+    const char *name = COLOR2CAN_SHM_NAME;
+    int capacity = 65536;
+    int report_period = 0;
+    bool quiet = false;
+    bool takeover = false;
+
+    // parse the options following the command
+    optind = 2;
+    int opt;
+    while((opt = getopt(argc, argv, "n:c:r:fq")) != -1) {
+        if(opt == 'n') {
+            name = optarg;
+        } else if(opt == 'c' && serve) {
+            capacity = atoi(optarg);
+        } else if(opt == 'r' && serve) {
+            report_period = atoi(optarg);
+        } else if(opt == 'f' && serve) {
+            takeover = true;
+        } else if(opt == 'q' && dump) {
+            quiet = true;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if(serve && optind == argc - 1 && capacity > 0 && report_period >= 0)
+        return cmd_serve(argv[optind], name, capacity, report_period,
+                         takeover);
+    if(dump && optind == argc)
+        return cmd_dump(name, quiet);
+
+    usage(argv[0]);
+    return 1;
+}
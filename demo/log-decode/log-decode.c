@@ -0,0 +1,118 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "log.h"
+
+static const char *formats[LOG_FORMAT_COUNT] = {
+#define LOG_STRING(id, format) [id] = format,
+    LOG_FORMATS(LOG_STRING)
+#undef LOG_STRING
+};
+
+static int hex_value(char c) {
+    if(c >= '0' && c <= '9')
+        return c - '0';
+    if(c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if(c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+// Parse a hexadecimal dump of a record. Returns 0 on success.
+static int parse_record(const char *hex, struct log_record *record) {
+    uint8_t bytes[LOG_RECORD_SIZE];
+    for(int i = 0; i < LOG_RECORD_SIZE; i++) {
+        int high = hex_value(hex[2 * i]);
+        int low  = (high < 0 ? -1 : hex_value(hex[2 * i + 1]));
+        if(low < 0)
+            return 1;
+        bytes[i] = high << 4 | low;
+    }
+    memcpy(record, bytes, LOG_RECORD_SIZE);
+    return 0;
+}
+
+static void print_record(const struct log_record *record,
+                         uint64_t time, bool show_time) {
+    if(show_time)
+        printf("[%10.6f] ", time / 1e6);
+
+    if(record->format >= LOG_FORMAT_COUNT || record->argc > LOG_MAX_ARGS) {
+        printf("<unknown record: format=%d>\n", record->format);
+        return;
+    }
+
+    const int32_t *a = record->args;
+    printf(formats[record->format], a[0], a[1], a[2], a[3], a[4], a[5]);
+    printf("\n");
+}
+
+static int decode(FILE *in, bool show_time) {
+    const int prefix_len = strlen(LOG_BINARY_PREFIX);
+
+    // record times are 32-bit: extend them to 64 bits. Records written
+    // by different threads may be slightly out of order.
+    uint64_t time = 0;
+    bool first = true;
+
+    static char line[1024];
+    while(fgets(line, sizeof(line), in)) {
+        if(strncmp(line, LOG_BINARY_PREFIX, prefix_len) != 0) {
+            fputs(line, stdout);
+            continue;
+        }
+
+        struct log_record record;
+        if(strlen(line) < prefix_len + 2 * LOG_RECORD_SIZE ||
+           parse_record(&line[prefix_len], &record)) {
+            printf("<malformed record>\n");
+            continue;
+        }
+
+        if(first)
+            time = record.time;
+        else
+            time += (int32_t) (record.time - (uint32_t) time);
+        first = false;
+
+        print_record(&record, time, show_time);
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    bool show_time = true;
+    const char *filename = NULL;
+
+    for(int i = 1; i < argc; i++) {
+        if(!strcmp(argv[i], "--no-time")) {
+            show_time = false;
+        } else if(argv[i][0] != '-' && !filename) {
+            filename = argv[i];
+        } else {
+            printf("Usage: %s [--no-time] [capture-file]\n", argv[0]);
+            printf("Decodes binary log records ('log-binary' command)\n");
+            printf("in a capture of the sensor console. Other lines are\n");
+            printf("printed unchanged. Reads stdin if no file is given.\n");
+            return 1;
+        }
+    }
+
+    FILE *in = stdin;
+    if(filename) {
+        in = fopen(filename, "r");
+        if(!in) {
+            perror(filename);
+            return 1;
+        }
+    }
+
+    int err = decode(in, show_time);
+    if(in != stdin)
+        fclose(in);
+    return err;
+}
@@ -0,0 +1,407 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+
+#include <unistd.h>
+#include <signal.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/signalfd.h>
+
+#include <net/if.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+
+#include <linux/can.h>
+#include <linux/can/raw.h>
+
+#include "color2can.h"
+#include "color2can-record.h"
+
+// Records the Color-to-CAN traffic of a bus, with kernel timestamps,
+// into a binary log (see color2can-record.h), and replays it with the
+// original timing or faster.
+
+#define BATCH_SIZE 64
+
+#define MESSAGE_TYPES 10
+
+static int sockfd;
+
+static int can_open(const char *ifname, bool record) {
+    if((sockfd = socket(PF_CAN, SOCK_RAW, CAN_RAW)) < 0) {
+        perror("Socket");
+        return 1;
+    }
+
+    // CAN FD frames are only available on CAN FD interfaces
+    const int enable = 1;
+    setsockopt(
+        sockfd, SOL_CAN_RAW, CAN_RAW_FD_FRAMES, &enable, sizeof(enable)
+    );
+
+    if(record) {
+        // receive the data and RTR frames of all message types
+        struct can_filter filters[MESSAGE_TYPES];
+        for(int i = 0; i < MESSAGE_TYPES; i++) {
+            filters[i] = (struct can_filter) {
+                .can_id   = COLOR2CAN_TIME_MASK_ID + i * 0x20,
+                .can_mask = (CAN_SFF_MASK & ~0x1f) | CAN_EFF_FLAG
+            };
+        }
+        setsockopt(
+            sockfd, SOL_CAN_RAW, CAN_RAW_FILTER, filters, sizeof(filters)
+        );
+
+        setsockopt(sockfd, SOL_SOCKET, SO_TIMESTAMP, &enable, sizeof(enable));
+        setsockopt(sockfd, SOL_SOCKET, SO_RXQ_OVFL, &enable, sizeof(enable));
+
+        // a large buffer absorbs the time spent moving to the next
+        // window of the log. SO_RCVBUFFORCE can exceed rmem_max, but
+        // needs CAP_NET_ADMIN.
+        const int rcvbuf = 16 * 1024 * 1024;
+        if(setsockopt(sockfd, SOL_SOCKET, SO_RCVBUFFORCE,
+                      &rcvbuf, sizeof(rcvbuf)))
+            setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF,
+                       &rcvbuf, sizeof(rcvbuf));
+    } else {
+        // do not receive anything
+        setsockopt(sockfd, SOL_CAN_RAW, CAN_RAW_FILTER, NULL, 0);
+    }
+
+    struct ifreq ifr = { 0 };
+    strncpy(ifr.ifr_name, ifname, IFNAMSIZ - 1);
+    ioctl(sockfd, SIOCGIFINDEX, &ifr);
+
+    struct sockaddr_can addr = { 0 };
+    addr.can_family  = AF_CAN;
+    addr.can_ifindex = ifr.ifr_ifindex;
+
+    if(bind(sockfd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        perror("Bind");
+        return 1;
+    }
+    return 0;
+}
+
+static int open_signalfd(void) {
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+    return signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+}
+
+static uint64_t get_time(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* ================================================================== */
+/*                               Record                               */
+/* ================================================================== */
+
+static struct {
+    struct canfd_frame frames[BATCH_SIZE];
+    struct iovec iov[BATCH_SIZE];
+    char control[BATCH_SIZE][CMSG_SPACE(sizeof(struct timeval)) +
+                             CMSG_SPACE(sizeof(uint32_t))];
+    struct mmsghdr msgs[BATCH_SIZE];
+} rx;
+
+// Reads the frames available into the log. Returns the number of frames
+// read, or -1 on error.
+static int record_batch(struct color2can_record_writer *writer,
+                        uint32_t *dropped) {
+    for(int i = 0; i < BATCH_SIZE; i++) {
+        rx.iov[i] = (struct iovec) {
+            .iov_base = &rx.frames[i],
+            .iov_len  = sizeof(rx.frames[i])
+        };
+        rx.msgs[i].msg_hdr = (struct msghdr) {
+            .msg_iov        = &rx.iov[i],
+            .msg_iovlen     = 1,
+            .msg_control    = rx.control[i],
+            .msg_controllen = sizeof(rx.control[i])
+        };
+    }
+
+    const int count = recvmmsg(sockfd, rx.msgs, BATCH_SIZE, MSG_DONTWAIT,
+                               NULL);
+    if(count < 0)
+        return (errno == EAGAIN || errno == EINTR) ? 0 : -1;
+
+    for(int i = 0; i < count; i++) {
+        struct msghdr *msg = &rx.msgs[i].msg_hdr;
+
+        struct timeval tv;
+        gettimeofday(&tv, NULL);
+        for(struct cmsghdr *c = CMSG_FIRSTHDR(msg); c;
+            c = CMSG_NXTHDR(msg, c)) {
+            if(c->cmsg_level != SOL_SOCKET)
+                continue;
+
+            if(c->cmsg_type == SO_TIMESTAMP)
+                memcpy(&tv, CMSG_DATA(c), sizeof(tv));
+            else if(c->cmsg_type == SO_RXQ_OVFL)
+                memcpy(dropped, CMSG_DATA(c), sizeof(*dropped));
+        }
+        const uint64_t time = (uint64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+
+        const struct canfd_frame *frame = &rx.frames[i];
+        const bool fd = (rx.msgs[i].msg_len == CANFD_MTU);
+
+        if(color2can_record_append(
+            writer, time, frame->can_id, frame->data, frame->len,
+            fd ? COLOR2CAN_RECORD_FD : 0
+        ))
+            return -1;
+    }
+    return count;
+}
+
+static int cmd_record(const char *ifname, const char *path) {
+    if(can_open(ifname, true)) {
+        printf("Error trying to open CAN device\n");
+        return 1;
+    }
+
+    struct color2can_record_writer *writer = color2can_record_create(path);
+    if(!writer) {
+        perror("[Record] log");
+        return 1;
+    }
+
+    const int sigfd = open_signalfd();
+    printf("[Record] recording %s to %s\n", ifname, path);
+
+    struct pollfd fds[2] = {
+        { .fd = sockfd, .events = POLLIN },
+        { .fd = sigfd,  .events = POLLIN }
+    };
+
+    const uint64_t start = get_time();
+    uint64_t frames = 0;
+    uint32_t dropped = 0;
+
+    int err = 0;
+    while(true) {
+        if(poll(fds, 2, -1) < 0) {
+            if(errno == EINTR)
+                continue;
+            perror("[Record] poll");
+            err = 1;
+            break;
+        }
+
+        if(fds[1].revents)
+            break;
+
+        int count;
+        while((count = record_batch(writer, &dropped)) > 0)
+            frames += count;
+
+        if(count < 0) {
+            perror("[Record] error");
+            err = 1;
+            break;
+        }
+    }
+
+    const uint64_t elapsed = get_time() - start;
+    const uint64_t size = color2can_record_size(writer);
+    if(color2can_record_finish(writer)) {
+        perror("[Record] log");
+        err = 1;
+    }
+
+    printf(
+        "[Record] frames=%llu bytes=%llu time=%.1f s dropped=%u\n",
+        (unsigned long long) frames, (unsigned long long) size,
+        elapsed / 1e6, dropped
+    );
+    if(dropped > 0)
+        puts("[Record] WARNING: the socket dropped frames");
+
+    close(sigfd);
+    return err;
+}
+
+/* ================================================================== */
+/*                               Replay                               */
+/* ================================================================== */
+
+static void sleep_until(uint64_t time) {
+    const struct timespec ts = {
+        .tv_sec  = time / 1000000,
+        .tv_nsec = (time % 1000000) * 1000
+    };
+    while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) ==
+          EINTR);
+}
+
+// Writes a frame, waiting if the transmit queue is full
+static int write_frame(const struct color2can_record *record) {
+    struct canfd_frame frame = { 0 };
+    frame.can_id = record->can_id;
+    frame.len    = record->len;
+    memcpy(frame.data, record->data, record->len);
+
+    const bool fd = (record->flags & COLOR2CAN_RECORD_FD);
+    const int size = fd ? CANFD_MTU : CAN_MTU;
+
+    while(write(sockfd, &frame, size) != size) {
+        if(errno != ENOBUFS && errno != EAGAIN)
+            return -1;
+
+        struct pollfd pfd = { .fd = sockfd, .events = POLLOUT };
+        poll(&pfd, 1, 10);
+    }
+    return 0;
+}
+
+static int cmd_replay(const char *ifname, const char *path, double speed) {
+    struct color2can_record_reader *reader = color2can_record_open(path);
+    if(!reader) {
+        perror("[Replay] log");
+        return 1;
+    }
+
+    if(can_open(ifname, false)) {
+        printf("Error trying to open CAN device\n");
+        color2can_record_close(reader);
+        return 1;
+    }
+
+    const int sigfd = open_signalfd();
+
+    uint64_t frames = 0, errors = 0;
+    uint64_t max_delay = 0; // behind schedule, in microseconds
+
+    uint64_t first_time = 0, start = 0;
+    const struct color2can_record *record;
+    while((record = color2can_record_next(reader))) {
+        struct signalfd_siginfo info;
+        if(read(sigfd, &info, sizeof(info)) > 0)
+            break;
+
+        if(frames + errors == 0) {
+            first_time = record->time;
+            start      = get_time();
+        }
+
+        if(speed > 0) {
+            const uint64_t due = start + (record->time - first_time) / speed;
+            const uint64_t now = get_time();
+            if(now < due)
+                sleep_until(due);
+            else if(now - due > max_delay)
+                max_delay = now - due;
+        }
+
+        if(write_frame(record)) {
+            if(errors++ == 0)
+                perror("[Replay] CAN write");
+            continue;
+        }
+        frames++;
+    }
+
+    printf(
+        "[Replay] frames=%llu errors=%llu time=%.1f s max-delay=%llu us\n",
+        (unsigned long long) frames, (unsigned long long) errors,
+        (get_time() - start) / 1e6, (unsigned long long) max_delay
+    );
+
+    color2can_record_close(reader);
+    close(sigfd);
+    return errors > 0;
+}
+
+/* ================================================================== */
+/*                                Dump                                */
+/* ================================================================== */
+
+// Prints the log in the candump log format, so that it can be used
+// with can-utils
+static int cmd_dump(const char *path) {
+    struct color2can_record_reader *reader = color2can_record_open(path);
+    if(!reader) {
+        perror("[Dump] log");
+        return 1;
+    }
+
+    const struct color2can_record *record;
+    while((record = color2can_record_next(reader))) {
+        printf(
+            "(%llu.%06llu) rec ",
+            (unsigned long long) (record->time / 1000000),
+            (unsigned long long) (record->time % 1000000)
+        );
+
+        if(record->can_id & CAN_EFF_FLAG)
+            printf("%08X#", record->can_id & CAN_EFF_MASK);
+        else
+            printf("%03X#", record->can_id & CAN_SFF_MASK);
+
+        if(record->flags & COLOR2CAN_RECORD_FD)
+            printf("#0");
+
+        if(record->can_id & CAN_RTR_FLAG) {
+            putchar('R');
+            if(record->len > 0)
+                printf("%d", record->len);
+        } else {
+            for(int i = 0; i < record->len; i++)
+                printf("%02X", record->data[i]);
+        }
+        putchar('\n');
+    }
+
+    color2can_record_close(reader);
+    return 0;
+}
+
+static void usage(const char *arg0) {
+    printf("Usage:\n");
+    printf("  %s record <ifname> <file>\n", arg0);
+    printf("  %s replay [-s <speed>] <ifname> <file>\n", arg0);
+    printf("    -s <speed>  1=original timing (default), 2=twice as fast,\n");
+    printf("                0=as fast as possible\n");
+    printf("  %s dump <file>\n", arg0);
+}
+
+int main(int argc, char *argv[]) {
+    if(argc == 4 && !strcmp(argv[1], "record"))
+        return cmd_record(argv[2], argv[3]);
+
+    if(argc >= 2 && !strcmp(argv[1], "replay")) {
+        double speed = 1;
+
+        optind = 2;
+        int opt;
+        while((opt = getopt(argc, argv, "s:")) != -1) {
+            if(opt == 's') {
+                speed = atof(optarg);
+            } else {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+        if(optind == argc - 2 && speed >= 0)
+            return cmd_replay(argv[optind], argv[optind + 1], speed);
+    }
+
+    if(argc == 3 && !strcmp(argv[1], "dump"))
+        return cmd_dump(argv[2]);
+
+    usage(argv[0]);
+    return 1;
+}
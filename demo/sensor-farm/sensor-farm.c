@@ -0,0 +1,616 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include <errno.h>
+
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+
+#include <net/if.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+
+#include <linux/can.h>
+
+#include "color2can.h"
+
+// Emulates up to 31 sensors in a single process, on a single epoll
+// loop. Each sensor answers config, range, sample, sync and status
+// messages like the firmware does; time, bit rate, latency and trace
+// messages are ignored. Producing a sample takes 'delay' microseconds,
+// plus a random jitter.
+
+#define MAX_SENSORS (COLOR2CAN_MAX_SENSOR_COUNT - 1)
+#define RANGES_COUNT 16
+
+static int sockfd;
+
+static struct {
+    int delay;  // in microseconds
+    int jitter; // in microseconds
+
+    // replayed colors (r, g, b, clear), or NULL for synthetic colors
+    int (*trace)[4];
+    int trace_length;
+} options = {
+    .delay = 2400
+};
+
+static struct {
+    uint32_t rx_frames;
+    uint32_t rx_ignored;
+    uint32_t tx_frames;
+    uint32_t tx_errors;
+} farm_stats;
+
+static uint64_t get_time(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t) t.tv_sec * 1000000 + t.tv_nsec / 1000;
+}
+
+static uint64_t get_host_time(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (uint64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+/* ================================================================== */
+/*                                CAN                                 */
+/* ================================================================== */
+
+static int can_open(const char *ifname) {
+    if((sockfd = socket(PF_CAN, SOCK_RAW | SOCK_NONBLOCK, CAN_RAW)) < 0) {
+        perror("Socket");
+        return 1;
+    }
+
+    struct ifreq ifr = { 0 };
+    strncpy(ifr.ifr_name, ifname, IFNAMSIZ - 1);
+    if(ioctl(sockfd, SIOCGIFINDEX, &ifr) < 0) {
+        perror("Interface");
+        return 1;
+    }
+
+    struct sockaddr_can addr = { 0 };
+    addr.can_family  = AF_CAN;
+    addr.can_ifindex = ifr.ifr_ifindex;
+
+    if(bind(sockfd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        perror("Bind");
+        return 1;
+    }
+    return 0;
+}
+
+static int can_write(uint32_t can_id, const void *data, int len) {
+    struct can_frame frame = { 0 };
+
+    frame.can_id  = can_id;
+    frame.can_dlc = len;
+    memcpy(frame.data, data, len);
+
+    const int frame_size = sizeof(struct can_frame);
+    if(write(sockfd, &frame, frame_size) != frame_size) {
+        farm_stats.tx_errors++;
+        return 1;
+    }
+    farm_stats.tx_frames++;
+    return 0;
+}
+
+/* ================================================================== */
+/*                               Sensor                               */
+/* ================================================================== */
+
+static struct sensor {
+    int id;
+
+    // configuration
+    int color_space;
+    bool sample_info;
+    uint32_t transmit_period; // 0=on-demand, otherwise in microseconds
+
+    struct {
+        bool low_set;
+        int low[3];
+
+        bool high_set;
+        int high[3];
+    } ranges[RANGES_COUNT];
+
+    // periodic samples
+    uint64_t next_periodic;
+    bool overrun;
+
+    // requested samples
+    uint32_t requests;
+    uint32_t request_spacing; // in microseconds
+    uint64_t next_request;
+
+    // sample requested by a SYNC message
+    bool sync_pending;
+    uint8_t sync_counter;
+    uint64_t sync_time;
+
+    int trace_index;
+
+    uint64_t start_time;
+    uint32_t counters[COLOR2CAN_STATUS_COUNT];
+} sensors[MAX_SENSORS + 1];
+static int sensor_count = MAX_SENSORS;
+
+static int sample_delay(void) {
+    if(options.jitter == 0)
+        return options.delay;
+    return options.delay + rand() % (options.jitter + 1);
+}
+
+static void read_color(struct sensor *s, int rgbc[4]) {
+    if(options.trace) {
+        memcpy(rgbc, options.trace[s->trace_index], sizeof(int) * 4);
+        s->trace_index = (s->trace_index + 1) % options.trace_length;
+        return;
+    }
+
+    // a slowly changing scene, different for each sensor
+    const double phase = 2 * M_PI * (get_time() % 5000000) / 5000000
+                       + s->id * 0.7;
+    const int light[3] = { 300, 200, 100 };
+
+    rgbc[3] = 0;
+    for(int i = 0; i < 3; i++) {
+        rgbc[i] = light[i] * (1 + 0.5 * sin(phase + i * 2.1)) + rand() % 5;
+        rgbc[3] += rgbc[i];
+    }
+}
+
+static void convert_to_space(int color_space, int color[3],
+                             int r, int g, int b) {
+    if(color_space == COLOR2CAN_SPACE_RGB) {
+        color[0] = r;
+        color[1] = g;
+        color[2] = b;
+        return;
+    }
+
+    // same conversion as the firmware
+    int max = r;
+    if(g > max) max = g;
+    if(b > max) max = b;
+
+    int min = r;
+    if(g < min) min = g;
+    if(b < min) min = b;
+
+    const int chroma = max - min;
+
+    int hue = 0;
+    if(chroma != 0) {
+        if(max == r)
+            hue = (60 * (g - b) / chroma + 360) % 360;
+        else if(max == g)
+            hue = 60 * (b - r) / chroma + 120;
+        else
+            hue = 60 * (r - g) / chroma + 240;
+    }
+
+    color[0] = hue;
+    color[1] = (max != 0 ? 1023 * chroma / max : 0);
+    color[2] = max;
+}
+
+static void send_sample(struct sensor *s, bool synchronized) {
+    int rgbc[4];
+    read_color(s, rgbc);
+    s->counters[COLOR2CAN_STATUS_SAMPLES_PRODUCED]++;
+
+    int color[3];
+    convert_to_space(s->color_space, color, rgbc[0], rgbc[1], rgbc[2]);
+
+    struct color2can_sample data = {
+        .color = { color[0], color[1], color[2] },
+        .clear = rgbc[3]
+    };
+    for(int i = 0; i < RANGES_COUNT; i++) {
+        const int *low  = s->ranges[i].low;
+        const int *high = s->ranges[i].high;
+        if(!s->ranges[i].low_set || !s->ranges[i].high_set)
+            continue;
+
+        if(low[0] <= color[0] && color[0] <= high[0] &&
+           low[1] <= color[1] && color[1] <= high[1] &&
+           low[2] <= color[2] && color[2] <= high[2]) {
+            data.within_range = 1;
+            data.range_id     = i;
+            break;
+        }
+    }
+
+    if(can_write(COLOR2CAN_SAMPLE_MASK_ID | s->id,
+                 &data, COLOR2CAN_SAMPLE_SIZE)) {
+        s->counters[COLOR2CAN_STATUS_TX_ERRORS]++;
+        return;
+    }
+    s->counters[COLOR2CAN_STATUS_SAMPLES_SENT]++;
+
+    // as if the clock was perfectly synchronized to the host
+    if(s->sample_info || synchronized) {
+        struct color2can_sample_info info = {
+            .sync_counter = (synchronized ? s->sync_counter : 0),
+            .synchronized = synchronized,
+            .time_valid   = 1,
+            .overrun      = s->overrun,
+            .time         = get_host_time()
+        };
+        s->overrun = false;
+
+        if(can_write(COLOR2CAN_SAMPLE_INFO_MASK_ID | s->id,
+                     &info, COLOR2CAN_SAMPLE_INFO_SIZE))
+            s->counters[COLOR2CAN_STATUS_TX_ERRORS]++;
+    }
+}
+
+static void send_status(struct sensor *s) {
+    s->counters[COLOR2CAN_STATUS_UPTIME] =
+        (get_time() - s->start_time) / 1000000;
+
+    for(int i = 0; i < COLOR2CAN_STATUS_COUNT; i++) {
+        struct color2can_status status = {
+            .counter = i,
+            .value   = s->counters[i]
+        };
+        if(can_write(COLOR2CAN_STATUS_MASK_ID | s->id,
+                     &status, COLOR2CAN_STATUS_SIZE))
+            s->counters[COLOR2CAN_STATUS_TX_ERRORS]++;
+    }
+}
+
+static void handle_config(struct sensor *s, const struct can_frame *frame,
+                          uint64_t now) {
+    const bool extended = (frame->can_dlc == COLOR2CAN_CONFIG_EXT_SIZE);
+    if(frame->can_dlc != COLOR2CAN_CONFIG_SIZE && !extended)
+        return;
+
+    struct color2can_config_ext ext;
+    memcpy(&ext, frame->data, frame->can_dlc);
+
+    // invalidate pending requests
+    s->counters[COLOR2CAN_STATUS_REQUESTS_DROPPED] += s->requests;
+    s->requests = 0;
+    s->request_spacing = 0;
+    s->sync_pending = false;
+
+    // a new color space invalidates all ranges
+    s->color_space = ext.config.color_space;
+    for(int i = 0; i < RANGES_COUNT; i++) {
+        s->ranges[i].low_set  = false;
+        s->ranges[i].high_set = false;
+    }
+    s->sample_info = ext.config.sample_info;
+
+    if(extended)
+        s->transmit_period = ext.transmit_period;
+    else if(ext.config.transmit_frequency != 0)
+        s->transmit_period = 1000000 / ext.config.transmit_frequency;
+    else
+        s->transmit_period = 0;
+
+    s->next_periodic = now + s->transmit_period;
+    s->overrun = false;
+}
+
+static void handle_message(struct sensor *s, const struct can_frame *frame,
+                           uint64_t now) {
+    const bool rtr = (frame->can_id & CAN_RTR_FLAG);
+    const int type = (frame->can_id & CAN_SFF_MASK) & ~0x1f;
+
+    switch(type) {
+        case COLOR2CAN_CONFIG_MASK_ID:
+            handle_config(s, frame, now);
+            break;
+
+        case COLOR2CAN_RANGE_MASK_ID: {
+            if(frame->can_dlc != COLOR2CAN_RANGE_SIZE)
+                break;
+
+            struct color2can_range range;
+            memcpy(&range, frame->data, COLOR2CAN_RANGE_SIZE);
+
+            int *dest;
+            if(range.high) {
+                dest = s->ranges[range.range_id].high;
+                s->ranges[range.range_id].high_set = true;
+            } else {
+                dest = s->ranges[range.range_id].low;
+                s->ranges[range.range_id].low_set = true;
+            }
+            for(int i = 0; i < 3; i++)
+                dest[i] = range.color[i];
+        } break;
+
+        case COLOR2CAN_SAMPLE_MASK_ID: {
+            uint32_t count;
+            if(rtr || frame->can_dlc == 0) {
+                count = 1;
+            } else if(frame->can_dlc == COLOR2CAN_REQUEST_SIZE) {
+                struct color2can_request request;
+                memcpy(&request, frame->data, COLOR2CAN_REQUEST_SIZE);
+                count = request.count;
+
+                // unlike the firmware, which keeps the spacing of each
+                // burst, the latest burst sets it for all pending requests
+                if(count > 0)
+                    s->request_spacing = request.spacing * 100;
+            } else {
+                break;
+            }
+
+            if(s->requests == 0)
+                s->next_request = now + sample_delay();
+            s->requests += count;
+        } break;
+
+        case COLOR2CAN_SYNC_MASK_ID: {
+            struct color2can_sync sync = { 0 };
+            memcpy(&sync, frame->data, frame->can_dlc < COLOR2CAN_SYNC_SIZE
+                                         ? frame->can_dlc
+                                         : COLOR2CAN_SYNC_SIZE);
+
+            s->sync_pending = true;
+            s->sync_counter = sync.counter;
+            s->sync_time = now + sample_delay() + sync.stagger * 100 * s->id;
+        } break;
+
+        case COLOR2CAN_STATUS_MASK_ID:
+            // periodic status reports are not supported
+            if(rtr || frame->can_dlc == 0)
+                send_status(s);
+            break;
+
+        default:
+            s->counters[COLOR2CAN_STATUS_RX_FILTERED]++;
+            farm_stats.rx_ignored++;
+            break;
+    }
+}
+
+// Send the samples that are due, and return the time of the next one
+static uint64_t sensor_update(struct sensor *s, uint64_t now) {
+    uint64_t next = UINT64_MAX;
+
+    if(s->sync_pending) {
+        if(now >= s->sync_time) {
+            send_sample(s, true);
+            s->sync_pending = false;
+        } else {
+            next = s->sync_time;
+        }
+    }
+
+    if(s->requests > 0 && now >= s->next_request) {
+        send_sample(s, false);
+        s->requests--;
+
+        int delay = sample_delay();
+        if(delay < s->request_spacing)
+            delay = s->request_spacing;
+        s->next_request = now + delay;
+    }
+    if(s->requests > 0 && s->next_request < next)
+        next = s->next_request;
+
+    if(s->transmit_period != 0) {
+        if(now >= s->next_periodic) {
+            send_sample(s, false);
+
+            // skip the periods that were missed
+            s->next_periodic += s->transmit_period;
+            if(s->next_periodic <= now) {
+                const uint64_t missed = (now - s->next_periodic)
+                                      / s->transmit_period + 1;
+                s->next_periodic += missed * s->transmit_period;
+                s->overrun = true;
+            }
+        }
+        if(s->next_periodic < next)
+            next = s->next_periodic;
+    }
+    return next;
+}
+
+/* ================================================================== */
+/*                                Loop                                */
+/* ================================================================== */
+
+static void receive_frames(uint64_t now) {
+    struct can_frame frame;
+    while(read(sockfd, &frame, sizeof(frame)) == sizeof(frame)) {
+        farm_stats.rx_frames++;
+        if(frame.can_id & CAN_EFF_FLAG)
+            continue;
+
+        // ID=0 is broadcast
+        const int id = frame.can_id & 0x1f;
+        for(int i = 1; i <= sensor_count; i++) {
+            if(id == 0 || id == i)
+                handle_message(&sensors[i], &frame, now);
+        }
+    }
+}
+
+static void arm_timer(int timerfd, uint64_t time) {
+    struct itimerspec spec = { 0 };
+    if(time != UINT64_MAX) {
+        spec.it_value.tv_sec  = time / 1000000;
+        spec.it_value.tv_nsec = (time % 1000000) * 1000;
+
+        // a zero value would disarm the timer
+        if(spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0)
+            spec.it_value.tv_nsec = 1;
+    }
+    timerfd_settime(timerfd, TFD_TIMER_ABSTIME, &spec, NULL);
+}
+
+static int run(void) {
+    const int timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+
+    // SIGINT and SIGTERM are handled by the loop
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+    const int sigfd = signalfd(-1, &mask, SFD_NONBLOCK);
+
+    const int epfd = epoll_create1(0);
+    const int fds[] = { sockfd, timerfd, sigfd };
+    for(int i = 0; i < 3; i++) {
+        struct epoll_event ev = { .events = EPOLLIN, .data.fd = fds[i] };
+        if(epoll_ctl(epfd, EPOLL_CTL_ADD, fds[i], &ev)) {
+            perror("epoll");
+            return 1;
+        }
+    }
+
+    const uint64_t start = get_time();
+    for(int i = 1; i <= sensor_count; i++) {
+        sensors[i].id = i;
+        sensors[i].start_time = start;
+        sensors[i].trace_index = (options.trace_length > 0
+                                  ? (i * 97) % options.trace_length : 0);
+    }
+    printf("[Farm] emulating %d sensor(s)\n", sensor_count);
+
+    while(true) {
+        struct epoll_event events[3];
+        const int n = epoll_wait(epfd, events, 3, -1);
+        if(n < 0) {
+            if(errno == EINTR)
+                continue;
+            perror("epoll_wait");
+            return 1;
+        }
+
+        bool stop = false;
+        for(int i = 0; i < n; i++) {
+            if(events[i].data.fd == timerfd) {
+                // the timer is re-armed below
+                uint64_t expirations;
+                if(read(timerfd, &expirations, sizeof(expirations)) < 0)
+                    perror("timerfd");
+            } else if(events[i].data.fd == sigfd) {
+                stop = true;
+            }
+        }
+        if(stop)
+            break;
+
+        // handle received messages, then send what is due
+        const uint64_t now = get_time();
+        receive_frames(now);
+
+        uint64_t next = UINT64_MAX;
+        for(int i = 1; i <= sensor_count; i++) {
+            const uint64_t t = sensor_update(&sensors[i], now);
+            if(t < next)
+                next = t;
+        }
+        arm_timer(timerfd, next);
+    }
+
+    printf(
+        "[Farm] received %lu frames (%lu ignored), "
+        "sent %lu frames (%lu errors)\n",
+        (unsigned long) farm_stats.rx_frames,
+        (unsigned long) farm_stats.rx_ignored,
+        (unsigned long) farm_stats.tx_frames,
+        (unsigned long) farm_stats.tx_errors
+    );
+    return 0;
+}
+
+/* ================================================================== */
+/*                                Main                                */
+/* ================================================================== */
+
+// Load colors to replay: one sample per line, as 'red green blue clear'
+static int load_trace(const char *filename) {
+    FILE *file = fopen(filename, "r");
+    if(!file) {
+        perror(filename);
+        return 1;
+    }
+
+    char line[128];
+    while(fgets(line, sizeof(line), file)) {
+        int rgbc[4];
+        if(line[0] == '#' ||
+           sscanf(line, "%d %d %d %d",
+                  &rgbc[0], &rgbc[1], &rgbc[2], &rgbc[3]) != 4)
+            continue;
+
+        options.trace = realloc(
+            options.trace, (options.trace_length + 1) * sizeof(rgbc)
+        );
+        memcpy(options.trace[options.trace_length++], rgbc, sizeof(rgbc));
+    }
+    fclose(file);
+
+    if(options.trace_length == 0) {
+        printf("[Farm] %s: no colors found\n", filename);
+        return 1;
+    }
+    return 0;
+}
+
+static void usage(const char *arg0) {
+    printf("Usage: %s [options] <ifname>\n", arg0);
+    printf("Emulates sensors with IDs from 1 to 'count':\n");
+    printf("  -n <count>   number of sensors, 1...31 (default: 31)\n");
+    printf("  -d <delay>   time to produce a sample, in microseconds "
+           "(default: 2400)\n");
+    printf("  -j <jitter>  random delay added to each sample, in "
+           "microseconds\n");
+    printf("  -t <file>    replay colors from a file, one 'red green "
+           "blue clear'\n");
+    printf("               per line, instead of synthetic colors\n");
+}
+
+int main(int argc, char *argv[]) {
+    int opt;
+    while((opt = getopt(argc, argv, "n:d:j:t:")) != -1) {
+        if(opt == 'n') {
+            sensor_count = atoi(optarg);
+        } else if(opt == 'd') {
+            options.delay = atoi(optarg);
+        } else if(opt == 'j') {
+            options.jitter = atoi(optarg);
+        } else if(opt == 't') {
+            if(load_trace(optarg))
+                return 1;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if(optind != argc - 1 ||
+       sensor_count < 1 || sensor_count > MAX_SENSORS ||
+       options.delay < 0 || options.jitter < 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if(can_open(argv[optind]))
+        return 1;
+    return run();
+}
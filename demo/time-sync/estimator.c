@@ -0,0 +1,3 @@
+// The clock estimator of the firmware, built for the host so that it can
+// be tested against a simulated sensor clock.
+#include "../../firmware/apps/color/src/timesync.c"
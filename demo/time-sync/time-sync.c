@@ -0,0 +1,248 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdio.h>
+
+#include <unistd.h>
+#include <sys/time.h>
+
+#include <net/if.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+
+#include <linux/can.h>
+#include <linux/can/raw.h>
+
+#include "color2can.h"
+#include "timesync.h"
+
+#define HOST_TIME_MASK (((uint64_t) 1 << 48) - 1)
+
+static int sockfd;
+
+static int can_open(const char *ifname, bool recv_own_msgs) {
+    if((sockfd = socket(PF_CAN, SOCK_RAW, CAN_RAW)) < 0) {
+        perror("Socket");
+        return 1;
+    }
+
+    // only receive time messages
+    struct can_filter filter = {
+        .can_id   = COLOR2CAN_TIME_MASK_ID,
+        .can_mask = CAN_SFF_MASK | CAN_EFF_FLAG | CAN_RTR_FLAG
+    };
+    setsockopt(sockfd, SOL_CAN_RAW, CAN_RAW_FILTER, &filter, sizeof(filter));
+
+    const int enable = 1;
+    setsockopt(sockfd, SOL_SOCKET, SO_TIMESTAMP, &enable, sizeof(enable));
+    if(recv_own_msgs) {
+        setsockopt(
+            sockfd, SOL_CAN_RAW, CAN_RAW_RECV_OWN_MSGS,
+            &enable, sizeof(enable)
+        );
+    }
+
+    struct ifreq ifr = { 0 };
+    strncpy(ifr.ifr_name, ifname, IFNAMSIZ - 1);
+    ioctl(sockfd, SIOCGIFINDEX, &ifr);
+
+    struct sockaddr_can addr = { 0 };
+    addr.can_family  = AF_CAN;
+    addr.can_ifindex = ifr.ifr_ifindex;
+
+    if(bind(sockfd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        perror("Bind");
+        return 1;
+    }
+    return 0;
+}
+
+static int can_write(uint32_t can_id, void *data, int len) {
+    struct can_frame frame = { 0 };
+
+    frame.can_id  = can_id;
+    frame.can_dlc = len;
+    memcpy(frame.data, data, len);
+
+    const int frame_size = sizeof(struct can_frame);
+    if(write(sockfd, &frame, frame_size) != frame_size) {
+        perror("CAN write");
+        return -1;
+    }
+    return len;
+}
+
+// Read a frame and its kernel timestamp (in microseconds).
+// 'own' is set if the frame was sent by this socket.
+static int can_read(struct can_frame *frame, uint64_t *time, bool *own) {
+    struct iovec iov = {
+        .iov_base = frame,
+        .iov_len  = sizeof(*frame)
+    };
+
+    char control[CMSG_SPACE(sizeof(struct timeval))];
+    struct msghdr msg = {
+        .msg_iov        = &iov,
+        .msg_iovlen     = 1,
+        .msg_control    = control,
+        .msg_controllen = sizeof(control)
+    };
+
+    if(recvmsg(sockfd, &msg, 0) < 0) {
+        perror("CAN read");
+        return -1;
+    }
+
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    for(struct cmsghdr *c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c))
+        if(c->cmsg_level == SOL_SOCKET && c->cmsg_type == SO_TIMESTAMP)
+            memcpy(&tv, CMSG_DATA(c), sizeof(tv));
+
+    *time = (uint64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+    *own  = (msg.msg_flags & MSG_CONFIRM);
+    return 0;
+}
+
+static uint64_t get_host_time(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (uint64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+/* ================================================================== */
+/*                               Master                               */
+/* ================================================================== */
+
+static int cmd_master(int period) {
+    printf("[Master] sending time every %d ms\n", period);
+
+    for(uint8_t sequence = 0; true; sequence++) {
+        struct color2can_time sync = {
+            .sequence  = sequence,
+            .follow_up = 0
+        };
+        can_write(COLOR2CAN_TIME_MASK_ID, &sync, COLOR2CAN_TIME_SIZE);
+
+        // wait for the SYNC message to come back: its timestamp is the
+        // time at which it was sent
+        uint64_t time;
+        while(true) {
+            struct can_frame frame;
+            bool own;
+            if(can_read(&frame, &time, &own))
+                return 1;
+
+            struct color2can_time msg;
+            memcpy(&msg, frame.data, COLOR2CAN_TIME_SIZE);
+            if(own && !msg.follow_up && msg.sequence == sequence)
+                break;
+        }
+
+        struct color2can_time follow_up = {
+            .sequence  = sequence,
+            .follow_up = 1,
+            .time      = time & HOST_TIME_MASK
+        };
+        can_write(COLOR2CAN_TIME_MASK_ID, &follow_up, COLOR2CAN_TIME_SIZE);
+
+        usleep(period * 1000);
+    }
+    return 0;
+}
+
+/* ================================================================== */
+/*                          Simulated Sensor                          */
+/* ================================================================== */
+
+static struct {
+    uint64_t start;
+    double rate;   // 1 + drift
+    double offset; // in microseconds
+    int jitter;    // in microseconds
+} sim_clock;
+
+static uint64_t to_local_time(uint64_t host_time) {
+    return (host_time - sim_clock.start) * sim_clock.rate + sim_clock.offset;
+}
+
+static int cmd_sensor(double drift, double offset, int jitter) {
+    printf(
+        "[Sensor] simulating drift=%g ppm, offset=%g us, jitter=%d us\n",
+        drift, offset, jitter
+    );
+
+    sim_clock.start  = get_host_time();
+    sim_clock.rate   = 1 + drift / 1e6;
+    sim_clock.offset = offset;
+    sim_clock.jitter = jitter;
+
+    while(true) {
+        struct can_frame frame;
+        uint64_t rx_time;
+        bool own;
+        if(can_read(&frame, &rx_time, &own))
+            return 1;
+        if(frame.can_dlc != COLOR2CAN_TIME_SIZE)
+            continue;
+
+        // simulate the delay between reception and handling
+        uint64_t local_rx_time = to_local_time(rx_time);
+        if(jitter > 0)
+            local_rx_time += rand() % (jitter + 1);
+
+        struct color2can_time msg;
+        memcpy(&msg, frame.data, COLOR2CAN_TIME_SIZE);
+        timesync_handle_message(&msg, local_rx_time, true);
+
+        if(!msg.follow_up)
+            continue;
+
+        // compare the estimated host time with the real one
+        const uint64_t now = get_host_time();
+        uint64_t estimate;
+        if(timesync_to_host_time(to_local_time(now), &estimate)) {
+            printf("[Sensor] seq=%3d not synchronized\n", (int) msg.sequence);
+            continue;
+        }
+
+        int64_t error = (estimate - now) & HOST_TIME_MASK;
+        if(error & ((uint64_t) 1 << 47))
+            error -= (int64_t) 1 << 48;
+        printf(
+            "[Sensor] seq=%3d error=%+6lld us\n",
+            (int) msg.sequence, (long long) error
+        );
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    if(argc >= 3 && !strcmp(argv[1], "master")) {
+        if(can_open(argv[2], true)) {
+            printf("Error trying to open CAN device\n");
+            return 1;
+        }
+        return cmd_master(argc > 3 ? atoi(argv[3]) : 1000);
+    }
+
+    if(argc >= 3 && !strcmp(argv[1], "sensor")) {
+        if(can_open(argv[2], false)) {
+            printf("Error trying to open CAN device\n");
+            return 1;
+        }
+        return cmd_sensor(
+            argc > 3 ? atof(argv[3]) : 50,
+            argc > 4 ? atof(argv[4]) : 0,
+            argc > 5 ? atoi(argv[5]) : 20
+        );
+    }
+
+    printf("Usage:\n");
+    printf("  %s master <ifname> [period-ms]\n", argv[0]);
+    printf("  %s sensor <ifname> [drift-ppm] [offset-us] [jitter-us]\n",
+           argv[0]);
+    return 1;
+}
@@ -0,0 +1,254 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdio.h>
+
+#include <unistd.h>
+#include <poll.h>
+
+#include <net/if.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+
+#include <linux/can.h>
+#include <linux/can/raw.h>
+
+#include "color2can.h"
+
+static int sockfd;
+
+static int can_open(const char *ifname, int sensor_id) {
+    if((sockfd = socket(PF_CAN, SOCK_RAW, CAN_RAW)) < 0) {
+        perror("Socket");
+        return 1;
+    }
+
+    // only receive trace messages of the sensor
+    struct can_filter filter = {
+        .can_id   = COLOR2CAN_TRACE_MASK_ID | sensor_id,
+        .can_mask = CAN_SFF_MASK | CAN_EFF_FLAG | CAN_RTR_FLAG
+    };
+    setsockopt(sockfd, SOL_CAN_RAW, CAN_RAW_FILTER, &filter, sizeof(filter));
+
+    struct ifreq ifr = { 0 };
+    strncpy(ifr.ifr_name, ifname, IFNAMSIZ - 1);
+    ioctl(sockfd, SIOCGIFINDEX, &ifr);
+
+    struct sockaddr_can addr = { 0 };
+    addr.can_family  = AF_CAN;
+    addr.can_ifindex = ifr.ifr_ifindex;
+
+    if(bind(sockfd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        perror("Bind");
+        return 1;
+    }
+    return 0;
+}
+
+/* ================================================================== */
+/*                          Chrome Trace JSON                         */
+/* ================================================================== */
+
+#define ROW_LOOP   1 // CAN-IO thread: receiver, sender, processing, TX
+#define ROW_SENSOR 2 // integration and I2C transfers
+#define ROW_BUS    3 // received frames and queued requests
+
+static const struct {
+    const char *name;
+    int row;
+} events[COLOR2CAN_TRACE_EVENTS] = {
+    [COLOR2CAN_TRACE_RECEIVER]    = { "receiver",    ROW_LOOP   },
+    [COLOR2CAN_TRACE_SENDER]      = { "sender",      ROW_LOOP   },
+    [COLOR2CAN_TRACE_RX_FRAME]    = { "RX frame",    ROW_BUS    },
+    [COLOR2CAN_TRACE_REQUEST]     = { "request",     ROW_BUS    },
+    [COLOR2CAN_TRACE_INTEGRATION] = { "integration", ROW_SENSOR },
+    [COLOR2CAN_TRACE_I2C]         = { "I2C",         ROW_SENSOR },
+    [COLOR2CAN_TRACE_PROCESSING]  = { "processing",  ROW_LOOP   },
+    [COLOR2CAN_TRACE_TX]          = { "TX",          ROW_LOOP   }
+};
+
+static struct {
+    int pid;
+    bool first_event;
+
+    // event times are 32-bit: extend them to 64 bits, starting from 0
+    uint64_t time;
+    uint32_t raw_time;
+    bool time_valid;
+
+    // number of BEGIN events not matched by an END yet
+    int open_spans[COLOR2CAN_TRACE_EVENTS];
+} json;
+
+static void json_begin(int pid) {
+    json.pid = pid;
+    json.first_event = true;
+    json.time_valid = false;
+    memset(json.open_spans, 0, sizeof(json.open_spans));
+
+    static const char *rows[] = {
+        [ROW_LOOP]   = "CAN-IO thread",
+        [ROW_SENSOR] = "sensor",
+        [ROW_BUS]    = "bus"
+    };
+
+    printf("{\"traceEvents\":[\n");
+    printf(
+        "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+        "\"args\":{\"name\":\"sensor %d\"}}", pid, pid
+    );
+    for(int row = ROW_LOOP; row <= ROW_BUS; row++) {
+        printf(
+            ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,"
+            "\"tid\":%d,\"args\":{\"name\":\"%s\"}}", pid, row, rows[row]
+        );
+    }
+}
+
+static void json_event(const struct color2can_trace *event) {
+    if(event->event >= COLOR2CAN_TRACE_EVENTS)
+        return;
+
+    if(json.time_valid)
+        json.time += (uint32_t) (event->time - json.raw_time);
+    else
+        json.time = 0;
+    json.raw_time = event->time;
+    json.time_valid = true;
+
+    const char *phase;
+    switch(event->phase) {
+        case COLOR2CAN_TRACE_PHASE_BEGIN:
+            json.open_spans[event->event]++;
+            phase = "B";
+            break;
+
+        case COLOR2CAN_TRACE_PHASE_END:
+            // the buffer may start in the middle of a span
+            if(json.open_spans[event->event] == 0)
+                return;
+            json.open_spans[event->event]--;
+            phase = "E";
+            break;
+
+        case COLOR2CAN_TRACE_PHASE_INSTANT:
+            phase = "i\",\"s\":\"t";
+            break;
+
+        default:
+            return;
+    }
+
+    printf(
+        ",\n{\"name\":\"%s\",\"ph\":\"%s\",\"ts\":%llu,"
+        "\"pid\":%d,\"tid\":%d,\"args\":{\"arg\":%d}}",
+        events[event->event].name, phase,
+        (unsigned long long) json.time,
+        json.pid, events[event->event].row, event->arg
+    );
+}
+
+static void json_end(void) {
+    printf("\n],\"displayTimeUnit\":\"ms\"}\n");
+}
+
+/* ================================================================== */
+
+static int cmd_can(const char *ifname, int sensor_id) {
+    if(can_open(ifname, sensor_id)) {
+        fprintf(stderr, "Error trying to open CAN device\n");
+        return 1;
+    }
+
+    // request the trace buffer
+    struct can_frame request = {
+        .can_id  = COLOR2CAN_TRACE_MASK_ID | sensor_id,
+        .can_dlc = 0
+    };
+    if(write(sockfd, &request, sizeof(request)) != sizeof(request)) {
+        perror("CAN write");
+        return 1;
+    }
+
+    json_begin(sensor_id);
+    int count = 0;
+    while(true) {
+        struct pollfd fds = { .fd = sockfd, .events = POLLIN };
+        if(poll(&fds, 1, 1000) <= 0) {
+            fprintf(stderr, "Timeout: trace is incomplete\n");
+            break;
+        }
+
+        struct can_frame frame;
+        if(read(sockfd, &frame, sizeof(frame)) < 0) {
+            perror("CAN read");
+            return 1;
+        }
+        if(frame.can_dlc != COLOR2CAN_TRACE_SIZE)
+            continue;
+
+        struct color2can_trace event;
+        memcpy(&event, frame.data, COLOR2CAN_TRACE_SIZE);
+        if(event.event == COLOR2CAN_TRACE_LAST)
+            break;
+
+        json_event(&event);
+        count++;
+    }
+    json_end();
+
+    fprintf(stderr, "%d event(s) received\n", count);
+    return 0;
+}
+
+// Convert the output of the 'trace' command, captured from the sensor
+// console: lines with format "T <time> <event> <phase> <arg>"
+static int cmd_text(FILE *in) {
+    json_begin(0);
+
+    static char line[256];
+    while(fgets(line, sizeof(line), in)) {
+        unsigned long time;
+        int event, phase, arg;
+        if(sscanf(line, "T %lu %d %d %d", &time, &event, &phase, &arg) != 4)
+            continue;
+
+        struct color2can_trace e = {
+            .time  = time,
+            .event = event,
+            .phase = phase,
+            .arg   = arg
+        };
+        json_event(&e);
+    }
+    json_end();
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    if(argc >= 4 && !strcmp(argv[1], "can"))
+        return cmd_can(argv[2], atoi(argv[3]));
+
+    if(argc >= 2 && !strcmp(argv[1], "text")) {
+        if(argc == 2)
+            return cmd_text(stdin);
+
+        FILE *in = fopen(argv[2], "r");
+        if(!in) {
+            perror(argv[2]);
+            return 1;
+        }
+        int err = cmd_text(in);
+        fclose(in);
+        return err;
+    }
+
+    printf("Usage:\n");
+    printf("  %s can <ifname> <sensor-id>\n", argv[0]);
+    printf("  %s text [capture-file]\n", argv[0]);
+    printf("Writes the trace in Chrome trace format (JSON) to stdout.\n");
+    printf("Open it in chrome://tracing or https://ui.perfetto.dev\n");
+    return 1;
+}
@@ -0,0 +1,113 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "color2can.h"
+#include "color2can-unpack.h"
+
+// Measures the throughput of each kernel of the bulk sample decoder of
+// the client library. Its correctness is checked by the library's tests
+// (make test in client/).
+
+#define REPETITIONS 7
+
+static uint64_t get_time_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int compare_u64(const void *a, const void *b) {
+    const uint64_t x = *(const uint64_t *) a;
+    const uint64_t y = *(const uint64_t *) b;
+    return (x > y) - (x < y);
+}
+
+static int cmd_bench(size_t count) {
+    uint8_t *in = malloc(count * COLOR2CAN_SAMPLE_SIZE);
+    uint8_t *copy = malloc(count * COLOR2CAN_SAMPLE_SIZE);
+    struct color2can_sample_columns out = {
+        .color = {
+            malloc(count * sizeof(uint16_t)),
+            malloc(count * sizeof(uint16_t)),
+            malloc(count * sizeof(uint16_t))
+        },
+        .clear        = malloc(count * sizeof(uint16_t)),
+        .within_range = malloc(count),
+        .range_id     = malloc(count)
+    };
+    if(!in || !copy || !out.color[0] || !out.color[1] || !out.color[2] ||
+       !out.clear || !out.within_range || !out.range_id) {
+        puts("[Unpack] not enough memory");
+        return 1;
+    }
+
+    for(size_t i = 0; i < count * COLOR2CAN_SAMPLE_SIZE; i++)
+        in[i] = rand();
+
+    // fault the pages in
+    memcpy(copy, in, count * COLOR2CAN_SAMPLE_SIZE);
+    color2can_unpack_samples(in, count, &out);
+
+    const double bytes = (double) count * COLOR2CAN_SAMPLE_SIZE;
+    printf("%-8s %10s %10s\n", "kernel", "ns/sample", "GB/s");
+
+    // reference: copying the payloads, bound by memory bandwidth
+    uint64_t times[REPETITIONS];
+    for(int r = 0; r < REPETITIONS; r++) {
+        const uint64_t start = get_time_ns();
+        memcpy(copy, in, count * COLOR2CAN_SAMPLE_SIZE);
+        times[r] = get_time_ns() - start;
+    }
+    qsort(times, REPETITIONS, sizeof(uint64_t), compare_u64);
+    printf(
+        "%-8s %10.3f %10.2f\n", "memcpy",
+        (double) times[REPETITIONS / 2] / count,
+        bytes / times[REPETITIONS / 2]
+    );
+
+    for(int k = 0; k < COLOR2CAN_UNPACK_KERNELS; k++) {
+        if(color2can_unpack_set_kernel(k))
+            continue;
+
+        for(int r = 0; r < REPETITIONS; r++) {
+            const uint64_t start = get_time_ns();
+            color2can_unpack_samples(in, count, &out);
+            times[r] = get_time_ns() - start;
+        }
+        qsort(times, REPETITIONS, sizeof(uint64_t), compare_u64);
+        printf(
+            "%-8s %10.3f %10.2f\n", color2can_unpack_kernel_name(k),
+            (double) times[REPETITIONS / 2] / count,
+            bytes / times[REPETITIONS / 2]
+        );
+    }
+
+    free(in);
+    free(copy);
+    for(int i = 0; i < 3; i++)
+        free(out.color[i]);
+    free(out.clear);
+    free(out.within_range);
+    free(out.range_id);
+    return 0;
+}
+
+static void usage(const char *arg0) {
+    printf("Usage:\n");
+    printf("  %s bench [samples]\n", arg0);
+}
+
+int main(int argc, char *argv[]) {
+    if((argc == 2 || argc == 3) && !strcmp(argv[1], "bench")) {
+        const long count = (argc == 3) ? atol(argv[2]) : 16 * 1024 * 1024;
+        if(count > 0)
+            return cmd_bench(count);
+    }
+
+    usage(argv[0]);
+    return 1;
+}
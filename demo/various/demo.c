@@ -6,6 +6,8 @@
 
 #include <unistd.h>
 #include <pthread.h>
+#include <limits.h>
+#include <libgen.h>
 
 #include <net/if.h>
 #include <sys/types.h>
@@ -20,6 +22,26 @@ static int sockfd;
 
 #define RTR_BIT (1 << 30)
 
+// demo/can-config.sh, found relative to the executable (demo/various/bin)
+// so that the demo can be started from any directory
+static char can_config_script[PATH_MAX];
+
+static void find_can_config_script(void) {
+    char exe[PATH_MAX];
+    ssize_t len = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+    if(len < 0) {
+        perror("readlink");
+        strcpy(can_config_script, "can-config.sh");
+        return;
+    }
+    exe[len] = '\0';
+
+    snprintf(
+        can_config_script, sizeof(can_config_script),
+        "%s/../../can-config.sh", dirname(exe)
+    );
+}
+
 static int can_open(const char *ifname) {
     if((sockfd = socket(PF_CAN, SOCK_RAW, CAN_RAW)) < 0) {
         perror("Socket");
@@ -77,6 +99,64 @@ static void request_sample(void) {
     can_write(COLOR2CAN_SAMPLE_MASK_ID | RTR_BIT, data, 0);
 }
 
+static void request_status(void) {
+    printf("[Sender] requesting status\n");
+
+    uint8_t data[8];
+    can_write(COLOR2CAN_STATUS_MASK_ID | RTR_BIT, data, 0);
+}
+
+static void request_latency(void) {
+    printf("[Sender] requesting latency histogram\n");
+
+    uint8_t data[8];
+    can_write(COLOR2CAN_LATENCY_MASK_ID | RTR_BIT, data, 0);
+}
+
+static void request_samples(int count, int spacing) {
+    printf("[Sender] requesting %d samples (spacing=%d)\n", count, spacing);
+
+    struct color2can_request request = {
+        .count   = count,
+        .spacing = spacing
+    };
+    can_write(COLOR2CAN_SAMPLE_MASK_ID, &request, COLOR2CAN_REQUEST_SIZE);
+}
+
+static void send_sync(void) {
+    static uint8_t counter;
+    printf("[Sender] sending SYNC (counter=%d)\n", counter);
+
+    struct color2can_sync sync = {
+        .counter = counter++,
+        .stagger = 6 // 0.6ms: enough for one frame at 250 kbit/s
+    };
+    can_write(COLOR2CAN_SYNC_MASK_ID, &sync, COLOR2CAN_SYNC_SIZE);
+}
+
+// Ask all sensors to switch bit rate, then switch the host interface
+static void switch_bitrate(int bitrate) {
+    const int delay = 500; // in milliseconds
+    printf("[Sender] switching to %d bit/s in %d ms\n", bitrate, delay);
+
+    struct color2can_bitrate request = {
+        .bitrate = bitrate,
+        .delay   = delay,
+        .status  = COLOR2CAN_BITRATE_REQUEST
+    };
+    can_write(COLOR2CAN_BITRATE_MASK_ID, &request, COLOR2CAN_BITRATE_SIZE);
+
+    usleep(delay * 1000);
+
+    char cmd[PATH_MAX + 32];
+    snprintf(cmd, sizeof(cmd), "'%s' %d", can_config_script, bitrate);
+    if(system(cmd))
+        printf("[Sender] error reconfiguring the CAN interface\n");
+
+    // confirm the new bit rate to the sensors
+    request_sample();
+}
+
 static void *sender(void *arg) {
     struct color2can_config config = {
         .transmit_frequency = 0,
@@ -114,9 +194,30 @@ static void *sender(void *arg) {
     can_write(COLOR2CAN_RANGE_MASK_ID, &low_b,  COLOR2CAN_RANGE_SIZE);
     can_write(COLOR2CAN_RANGE_MASK_ID, &high_b, COLOR2CAN_RANGE_SIZE);
 
+    // empty line: request one sample
+    // <count> [spacing]: request multiple samples
+    // sync: make all sensors sample at the same time
+    // bitrate <bitrate>: switch the bus to a different bit rate
+    // status: request diagnostic counters
+    // latency: request the latency histogram
     while(1) {
-        getchar();
-        request_sample();
+        char line[64];
+        if(!fgets(line, sizeof(line), stdin))
+            break;
+
+        int count, spacing = 0, bitrate;
+        if(!strncmp(line, "sync", 4))
+            send_sync();
+        else if(sscanf(line, "bitrate %d", &bitrate) == 1)
+            switch_bitrate(bitrate);
+        else if(!strncmp(line, "status", 6))
+            request_status();
+        else if(!strncmp(line, "latency", 7))
+            request_latency();
+        else if(sscanf(line, "%d %d", &count, &spacing) >= 1 && count > 0)
+            request_samples(count, spacing);
+        else
+            request_sample();
     }
     return NULL;
 }
@@ -141,12 +242,51 @@ static void *receiver(void *arg) {
             printf("  color: %d, %d, %d\n", sample.color[0], sample.color[1], sample.color[2]);
             printf("  clear value: %d\n", sample.clear);
             printf("  within range: %d\n", sample.within_range ? sample.range_id : -1);
+        } else if(msg_type == COLOR2CAN_SAMPLE_INFO_MASK_ID) {
+            struct color2can_sample_info info;
+            memcpy(&info, data, COLOR2CAN_SAMPLE_INFO_SIZE);
+
+            if(info.synchronized)
+                printf("  SYNC counter: %d\n", (int) info.sync_counter);
+            if(info.time_valid)
+                printf("  time: %llu us\n", (unsigned long long) info.time);
+        } else if(msg_type == COLOR2CAN_STATUS_MASK_ID) {
+            struct color2can_status status;
+            memcpy(&status, data, COLOR2CAN_STATUS_SIZE);
+
+            printf(
+                "[Receiver] sensor %d status: counter %d = %u\n",
+                sensor_id, status.counter, (unsigned) status.value
+            );
+        } else if(msg_type == COLOR2CAN_LATENCY_MASK_ID) {
+            struct color2can_latency latency;
+            memcpy(&latency, data, COLOR2CAN_LATENCY_SIZE);
+
+            printf(
+                "[Receiver] sensor %d latency: phase %d, %d...%d us: %u%s\n",
+                sensor_id, latency.phase,
+                latency.bucket == 0 ? 0 : 1 << latency.bucket,
+                (1 << (latency.bucket + 1)) - 1,
+                (unsigned) latency.count, latency.last ? " (last)" : ""
+            );
+        } else if(msg_type == COLOR2CAN_BITRATE_MASK_ID) {
+            struct color2can_bitrate reply;
+            memcpy(&reply, data, COLOR2CAN_BITRATE_SIZE);
+
+            printf(
+                "[Receiver] sensor %d %s bit rate %u\n", sensor_id,
+                reply.status == COLOR2CAN_BITRATE_ACCEPTED ? "accepted"
+                                                           : "rejected",
+                (unsigned) reply.bitrate
+            );
         }
     }
     return NULL;
 }
 
 int main(int argc, char *argv[]) {
+    find_can_config_script();
+
     if(can_open("can0")) {
         printf("Error trying to open CAN device\n");
         return 1;
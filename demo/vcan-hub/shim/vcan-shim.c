@@ -0,0 +1,203 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+
+#include <unistd.h>
+#include <dlfcn.h>
+#include <sys/un.h>
+
+#include <net/if.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+
+#include <linux/can.h>
+#include <linux/can/raw.h>
+
+#include "vcan-hub.h"
+
+// Preloaded library (LD_PRELOAD) that turns the raw CAN sockets of a
+// process into clients of vcan-hub. Only the calls used by color-host
+// and e2e-bench are emulated: socket, setsockopt, ioctl(SIOCGIFINDEX),
+// bind and recvmsg. Frames are sent with write, unchanged.
+
+#define MAX_FD 1024
+
+#define MAX_FILTERS 16
+
+#define RECEIVE_BUFFER_SIZE (8 * 1024 * 1024)
+
+// state of each CAN socket, by file descriptor
+static struct can_socket {
+    bool is_can;
+    bool own;       // CAN_RAW_RECV_OWN_MSGS
+    bool fd_frames; // CAN_RAW_FD_FRAMES
+    bool timestamp; // SO_TIMESTAMP
+    bool overflow;  // SO_RXQ_OVFL
+
+    int filter_count;
+    struct can_filter filters[MAX_FILTERS];
+} sockets[MAX_FD];
+
+// the function that this library replaces
+#define REAL(name) static typeof(name) *real_##name;\
+    if(!real_##name)\
+        *(void **) &real_##name = dlsym(RTLD_NEXT, #name)
+
+static struct can_socket *can_socket(int fd) {
+    if(fd < 0 || fd >= MAX_FD || !sockets[fd].is_can)
+        return NULL;
+    return &sockets[fd];
+}
+
+int socket(int domain, int type, int protocol) {
+    REAL(socket);
+    if(domain != PF_CAN)
+        return real_socket(domain, type, protocol);
+
+    const int fd = real_socket(
+        AF_UNIX, SOCK_SEQPACKET | (type & (SOCK_NONBLOCK | SOCK_CLOEXEC)), 0
+    );
+    if(fd >= 0 && fd < MAX_FD) {
+        sockets[fd] = (struct can_socket) { .is_can = true };
+
+        // do not lose frames during bursts
+        const int size = RECEIVE_BUFFER_SIZE;
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    }
+    return fd;
+}
+
+int setsockopt(int fd, int level, int name,
+               const void *value, socklen_t len) {
+    REAL(setsockopt);
+    struct can_socket *s = can_socket(fd);
+    if(!s)
+        return real_setsockopt(fd, level, name, value, len);
+
+    const bool enable = (len >= sizeof(int) && *(const int *) value);
+    if(level == SOL_CAN_RAW) {
+        if(name == CAN_RAW_RECV_OWN_MSGS) {
+            s->own = enable;
+        } else if(name == CAN_RAW_FD_FRAMES) {
+            s->fd_frames = enable;
+        } else if(name == CAN_RAW_FILTER) {
+            if(len > sizeof(s->filters)) {
+                errno = EINVAL;
+                return -1;
+            }
+            s->filter_count = len / sizeof(struct can_filter);
+            memcpy(s->filters, value, len);
+        }
+        return 0;
+    }
+    if(level == SOL_SOCKET && name == SO_TIMESTAMP) {
+        s->timestamp = enable;
+        return 0;
+    }
+    if(level == SOL_SOCKET && name == SO_RXQ_OVFL) {
+        s->overflow = enable;
+        return 0;
+    }
+    return real_setsockopt(fd, level, name, value, len);
+}
+
+int ioctl(int fd, unsigned long request, ...) {
+    REAL(ioctl);
+
+    va_list args;
+    va_start(args, request);
+    void *arg = va_arg(args, void *);
+    va_end(args);
+
+    // any interface name is accepted
+    if(can_socket(fd) && request == SIOCGIFINDEX) {
+        ((struct ifreq *) arg)->ifr_ifindex = 1;
+        return 0;
+    }
+    return real_ioctl(fd, request, arg);
+}
+
+int bind(int fd, const struct sockaddr *addr, socklen_t len) {
+    REAL(bind);
+    struct can_socket *s = can_socket(fd);
+    if(!s)
+        return real_bind(fd, addr, len);
+
+    const char *path = getenv("VCAN_HUB");
+    struct sockaddr_un hub = { .sun_family = AF_UNIX };
+    strncpy(hub.sun_path, path ? path : VCAN_HUB_PATH,
+            sizeof(hub.sun_path) - 1);
+    if(connect(fd, (struct sockaddr *) &hub, sizeof(hub)))
+        return -1;
+
+    const uint8_t own = s->own;
+    return (write(fd, &own, 1) == 1 ? 0 : -1);
+}
+
+static bool matches(const struct can_socket *s, canid_t can_id) {
+    if(s->filter_count == 0)
+        return true;
+
+    for(int i = 0; i < s->filter_count; i++) {
+        const struct can_filter *f = &s->filters[i];
+        if((can_id & f->can_mask) == (f->can_id & f->can_mask))
+            return true;
+    }
+    return false;
+}
+
+// Appends a control message, if there is room for it
+static void put_control(struct msghdr *msg, size_t *used,
+                        int type, const void *data, size_t len) {
+    if(!msg->msg_control || msg->msg_controllen < *used + CMSG_SPACE(len))
+        return;
+
+    struct cmsghdr *c = (struct cmsghdr *) ((char *) msg->msg_control +
+                                            *used);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type  = type;
+    c->cmsg_len   = CMSG_LEN(len);
+    memcpy(CMSG_DATA(c), data, len);
+    *used += CMSG_SPACE(len);
+}
+
+ssize_t recvmsg(int fd, struct msghdr *msg, int flags) {
+    REAL(recvmsg);
+    const struct can_socket *s = can_socket(fd);
+    if(!s)
+        return real_recvmsg(fd, msg, flags);
+
+    while(true) {
+        struct vcan_hub_frame f;
+        const ssize_t n = recv(fd, &f, sizeof(f), flags);
+        if(n < 0)
+            return n;
+        if(n == 0) {
+            errno = EAGAIN;
+            return -1;
+        }
+
+        const bool is_fd = (f.flags & VCAN_HUB_FD);
+        if(!matches(s, f.frame.can_id) || (is_fd && !s->fd_frames))
+            continue;
+
+        size_t size = (is_fd ? CANFD_MTU : CAN_MTU);
+        if(size > msg->msg_iov[0].iov_len)
+            size = msg->msg_iov[0].iov_len;
+        memcpy(msg->msg_iov[0].iov_base, &f.frame, size);
+        msg->msg_flags = (f.flags & VCAN_HUB_OWN) ? MSG_CONFIRM : 0;
+
+        size_t used = 0;
+        if(s->timestamp)
+            put_control(msg, &used, SO_TIMESTAMP, &f.time, sizeof(f.time));
+        if(s->overflow)
+            put_control(msg, &used, SO_RXQ_OVFL,
+                        &f.dropped, sizeof(f.dropped));
+        msg->msg_controllen = used;
+        return size;
+    }
+}
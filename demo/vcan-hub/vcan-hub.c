@@ -0,0 +1,146 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+
+#include <unistd.h>
+#include <poll.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "vcan-hub.h"
+
+// Stands in for a vcan interface where the vcan module is not available.
+// Processes started with LD_PRELOAD=vcan-shim.so connect their raw CAN
+// sockets to this hub, which timestamps each frame when it arrives and
+// sends it to all the other clients, and back to the sender if it asked
+// for its own frames.
+
+#define MAX_CLIENTS 64
+
+// large enough to hold a burst of frames for a slow client
+#define SEND_BUFFER_SIZE (8 * 1024 * 1024)
+
+// fds[0] is the listening socket
+static struct pollfd fds[1 + MAX_CLIENTS];
+static int fd_count = 1;
+
+static struct client {
+    bool ready; // the first byte was received
+    bool own;   // wants its own frames back
+    uint32_t dropped;
+} clients[1 + MAX_CLIENTS];
+
+static int listen_on(const char *path) {
+    const int sockfd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    if(sockfd < 0) {
+        perror("[Hub] socket");
+        return -1;
+    }
+
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+    unlink(path);
+    if(bind(sockfd, (struct sockaddr *) &addr, sizeof(addr)) ||
+       listen(sockfd, MAX_CLIENTS)) {
+        perror("[Hub] bind");
+        close(sockfd);
+        return -1;
+    }
+    return sockfd;
+}
+
+static void accept_client(void) {
+    const int fd = accept(fds[0].fd, NULL, NULL);
+    if(fd < 0)
+        return;
+
+    // reuse the slot of a client that has gone away
+    int i = 1;
+    while(i < fd_count && fds[i].fd >= 0)
+        i++;
+    if(i > MAX_CLIENTS) {
+        puts("[Hub] too many clients");
+        close(fd);
+        return;
+    }
+    if(i == fd_count)
+        fd_count++;
+
+    const int size = SEND_BUFFER_SIZE;
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+
+    fds[i] = (struct pollfd) { .fd = fd, .events = POLLIN };
+    clients[i] = (struct client) { 0 };
+}
+
+static void broadcast(int sender, struct vcan_hub_frame *frame) {
+    for(int i = 1; i < fd_count; i++) {
+        if(fds[i].fd < 0 || !clients[i].ready)
+            continue;
+        if(i == sender && !clients[i].own)
+            continue;
+
+        frame->flags   = (frame->flags & VCAN_HUB_FD) |
+                         (i == sender ? VCAN_HUB_OWN : 0);
+        frame->dropped = clients[i].dropped;
+
+        // as a CAN socket would, drop frames that do not fit
+        if(send(fds[i].fd, frame, sizeof(*frame), MSG_DONTWAIT) < 0)
+            clients[i].dropped++;
+    }
+}
+
+static void receive(int i) {
+    struct vcan_hub_frame frame = { 0 };
+    const ssize_t len = recv(
+        fds[i].fd, &frame.frame, sizeof(frame.frame), MSG_DONTWAIT
+    );
+    if(len < 0 && errno == EAGAIN)
+        return;
+    if(len <= 0) {
+        close(fds[i].fd);
+        fds[i].fd = -1;
+        return;
+    }
+
+    if(!clients[i].ready) {
+        clients[i].own   = ((const uint8_t *) &frame.frame)[0];
+        clients[i].ready = true;
+        return;
+    }
+
+    gettimeofday(&frame.time, NULL);
+    if(len == CANFD_MTU)
+        frame.flags = VCAN_HUB_FD;
+    broadcast(i, &frame);
+}
+
+int main(int argc, char *argv[]) {
+    const char *path = (argc > 1 ? argv[1] : VCAN_HUB_PATH);
+
+    fds[0] = (struct pollfd) { .fd = listen_on(path), .events = POLLIN };
+    if(fds[0].fd < 0)
+        return 1;
+    printf("[Hub] listening on %s\n", path);
+    fflush(stdout);
+
+    while(true) {
+        if(poll(fds, fd_count, -1) < 0) {
+            if(errno == EINTR)
+                continue;
+            perror("[Hub] poll");
+            return 1;
+        }
+
+        if(fds[0].revents & POLLIN)
+            accept_client();
+        for(int i = 1; i < fd_count; i++)
+            if(fds[i].fd >= 0 &&
+               (fds[i].revents & (POLLIN | POLLHUP | POLLERR)))
+                receive(i);
+    }
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <sys/time.h>
+
+#include <linux/can.h>
+
+// Protocol between the hub and the processes that load the shim. A
+// client connects to the hub's socket (SOCK_SEQPACKET) and sends one
+// byte: 1 if it wants its own frames back, as with CAN_RAW_RECV_OWN_MSGS.
+// Then it sends raw struct can_frame or struct canfd_frame packets, and
+// receives struct vcan_hub_frame packets.
+
+// socket of the hub, unless set by the VCAN_HUB environment variable
+#define VCAN_HUB_PATH "/tmp/vcan-hub.sock"
+
+#define VCAN_HUB_OWN 1 // the frame was sent by the receiving client
+#define VCAN_HUB_FD  2 // CAN FD frame
+
+struct vcan_hub_frame {
+    struct timeval time; // when the frame reached the hub
+    uint32_t flags;      // VCAN_HUB_*
+    uint32_t dropped;    // frames the hub could not send to this client
+
+    struct canfd_frame frame;
+};
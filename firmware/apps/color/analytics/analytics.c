@@ -0,0 +1,936 @@
+/* Copyright 2025 Vulcalien
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "main.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include <linux/can.h>
+
+#include "color2can.h"
+#include "processing.h"
+#include "color2can-record.h"
+#include "color2can-archive.h"
+#include "color2can-unpack.h"
+
+// Offline analytics of recorded samples (logs of the recorder, or
+// archives). The inputs are split into parts, which worker processes
+// take in turn: processing.c keeps its configuration in globals, so each
+// worker has its own copy. For each sensor and class (no range, or range
+// 0...15) the statistics of the colors are computed, for the
+// classification recorded in the samples and for each candidate range
+// table, which is applied with processing_process_data.
+
+#define MAX_TABLES  8 // candidate range tables
+#define MAX_INPUTS  256
+#define MAX_BINS    256
+#define MAX_SENSORS COLOR2CAN_MAX_SENSOR_COUNT
+
+// class 0 = not within any range, class 1 + i = range i
+#define CLASSES (1 + RANGES_COUNT)
+
+// parts of each input, for each worker
+#define PARTS_PER_JOB 4
+
+// records of a log per part, at least
+#define LOG_CHUNK 65536
+
+#define BATCH_SIZE 4096
+
+/* ================================================================== */
+/*                               Inputs                               */
+/* ================================================================== */
+
+struct input {
+    const char *path;
+    struct color2can_archive_reader *archive;
+    struct color2can_record_reader *log;
+
+    // archives are split by time, logs by position
+    uint64_t time_min, time_max;
+    uint64_t *positions; // part i starts at positions[i]
+    int parts;
+};
+
+static struct input inputs[MAX_INPUTS];
+static int input_count;
+
+struct work_item {
+    int input;
+    int part;
+};
+
+static struct work_item *work_items;
+static int work_item_count;
+
+static int input_open(struct input *input, int parts) {
+    input->archive = color2can_archive_open(input->path);
+    if(input->archive) {
+        struct color2can_archive_info info;
+        color2can_archive_get_info(input->archive, &info);
+
+        input->time_min = info.time_min;
+        input->time_max = info.time_max;
+        input->parts = parts;
+        return 0;
+    }
+
+    input->log = color2can_record_open(input->path);
+    if(!input->log) {
+        perror(input->path);
+        return 1;
+    }
+
+    // find where each chunk of records starts
+    uint64_t records = 0;
+    while(color2can_record_next(input->log))
+        records++;
+
+    uint64_t chunk = (records + parts - 1) / parts;
+    if(chunk < LOG_CHUNK)
+        chunk = LOG_CHUNK;
+
+    input->positions = malloc((parts + 1) * sizeof(uint64_t));
+    if(!input->positions)
+        return 1;
+
+    color2can_record_rewind(input->log);
+    input->parts = 0;
+    for(uint64_t i = 0; i < records; i++) {
+        if(i % chunk == 0) {
+            input->positions[input->parts++] =
+                color2can_record_tell(input->log);
+        }
+        color2can_record_next(input->log);
+    }
+    input->positions[input->parts] = color2can_record_tell(input->log);
+    return 0;
+}
+
+/* ================================================================== */
+/*                            Range Tables                            */
+/* ================================================================== */
+
+struct range_table {
+    const char *name;
+    int space; // COLOR2CAN_SPACE_*
+
+    bool set[RANGES_COUNT];
+    int low[RANGES_COUNT][3];
+    int high[RANGES_COUNT][3];
+};
+
+// table 0 is the classification recorded in the samples
+static struct range_table tables[1 + MAX_TABLES];
+static int table_count = 1;
+
+// color space of the recorded samples
+static int recorded_space = COLOR2CAN_SPACE_RGB;
+
+static int parse_space(const char *name) {
+    if(!strcmp(name, "rgb"))
+        return COLOR2CAN_SPACE_RGB;
+    if(!strcmp(name, "hsv"))
+        return COLOR2CAN_SPACE_HSV;
+    return -1;
+}
+
+static const char *space_name(int space) {
+    return (space == COLOR2CAN_SPACE_HSV ? "hsv" : "rgb");
+}
+
+// Reads a table of lines 'space <rgb|hsv>' and
+// 'range <id> <low0> <low1> <low2> <high0> <high1> <high2>'
+static int load_table(const char *path, struct range_table *table) {
+    FILE *file = fopen(path, "r");
+    if(!file) {
+        perror(path);
+        return 1;
+    }
+
+    *table = (struct range_table) {
+        .name  = path,
+        .space = recorded_space
+    };
+
+    char line[256];
+    int line_number = 0;
+    int err = 0;
+    while(!err && fgets(line, sizeof(line), file)) {
+        line_number++;
+
+        char *comment = strchr(line, '#');
+        if(comment)
+            *comment = '\0';
+
+        char space[16];
+        int id, low[3], high[3];
+        if(sscanf(line, " space %15s", space) == 1) {
+            table->space = parse_space(space);
+            err = (table->space < 0);
+        } else if(sscanf(line, " range %d %d %d %d %d %d %d", &id,
+                         &low[0], &low[1], &low[2],
+                         &high[0], &high[1], &high[2]) == 7) {
+            if(id < 0 || id >= RANGES_COUNT) {
+                err = 1;
+            } else {
+                table->set[id] = true;
+                memcpy(table->low[id], low, sizeof(low));
+                memcpy(table->high[id], high, sizeof(high));
+            }
+        } else {
+            char c;
+            err = (sscanf(line, " %c", &c) == 1); // not an empty line
+        }
+    }
+    fclose(file);
+
+    if(err) {
+        printf("[Analytics] %s:%d: invalid line\n", path, line_number);
+        return 1;
+    }
+    return 0;
+}
+
+// Configures processing.c with a table
+static void table_apply(const struct range_table *table) {
+    // Colors recorded in the same space as the table are used as they
+    // are: the RGB conversion leaves them unchanged
+    const int space = (table->space == recorded_space ?
+                       COLOR2CAN_SPACE_RGB : table->space);
+    processing_set_color_space(space);
+
+    for(int i = 0; i < RANGES_COUNT; i++) {
+        if(!table->set[i])
+            continue;
+
+        processing_set_range(i, false, (int *) table->low[i]);
+        processing_set_range(i, true, (int *) table->high[i]);
+    }
+}
+
+/* ================================================================== */
+/*                               Labels                               */
+/* ================================================================== */
+
+// Expected class of the samples of a sensor in a time interval
+struct label {
+    uint64_t from, to;
+    int class;
+};
+
+static struct {
+    struct label *labels;
+    int count, capacity;
+} sensor_labels[MAX_SENSORS];
+
+static bool has_labels;
+
+static int label_add(int sensor_id, const struct label *label) {
+    typeof(sensor_labels[0]) *l = &sensor_labels[sensor_id];
+    if(l->count == l->capacity) {
+        l->capacity = l->capacity * 2 + 16;
+        l->labels = realloc(l->labels, l->capacity * sizeof(*l->labels));
+        if(!l->labels)
+            return 1;
+    }
+    l->labels[l->count++] = *label;
+    return 0;
+}
+
+static int compare_labels(const void *a, const void *b) {
+    const struct label *x = a, *y = b;
+    return (x->from > y->from) - (x->from < y->from);
+}
+
+// Reads lines '<sensor> <from> <to> <range>', with times in seconds,
+// sensor 0 meaning all sensors and range -1 meaning no range
+static int load_labels(const char *path) {
+    FILE *file = fopen(path, "r");
+    if(!file) {
+        perror(path);
+        return 1;
+    }
+
+    char line[256];
+    int line_number = 0;
+    int err = 0;
+    while(!err && fgets(line, sizeof(line), file)) {
+        line_number++;
+
+        char *comment = strchr(line, '#');
+        if(comment)
+            *comment = '\0';
+
+        int sensor_id, range;
+        double from, to;
+        const int n = sscanf(line, "%d %lf %lf %d",
+                             &sensor_id, &from, &to, &range);
+        if(n <= 0)
+            continue;
+
+        if(n != 4 || sensor_id < 0 || sensor_id >= MAX_SENSORS ||
+           range < -1 || range >= RANGES_COUNT || to <= from) {
+            err = 1;
+            break;
+        }
+
+        const struct label label = {
+            .from  = from * 1e6,
+            .to    = to * 1e6,
+            .class = range + 1
+        };
+        for(int s = 1; s < MAX_SENSORS && !err; s++)
+            if(sensor_id == 0 || sensor_id == s)
+                err = label_add(s, &label);
+    }
+    fclose(file);
+
+    if(err) {
+        printf("[Analytics] %s:%d: invalid line\n", path, line_number);
+        return 1;
+    }
+
+    for(int s = 1; s < MAX_SENSORS; s++) {
+        qsort(
+            sensor_labels[s].labels, sensor_labels[s].count,
+            sizeof(struct label), compare_labels
+        );
+    }
+    has_labels = true;
+    return 0;
+}
+
+// Returns the expected class of a sample, or -1 if it is not labeled
+static int label_find(int sensor_id, uint64_t time) {
+    const struct label *labels = sensor_labels[sensor_id].labels;
+
+    // last label starting at or before 'time'
+    int lo = 0, hi = sensor_labels[sensor_id].count;
+    while(lo < hi) {
+        const int mid = (lo + hi) / 2;
+        if(labels[mid].from <= time)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if(lo == 0 || time >= labels[lo - 1].to)
+        return -1;
+    return labels[lo - 1].class;
+}
+
+/* ================================================================== */
+/*                              Results                               */
+/* ================================================================== */
+
+struct class_stats {
+    uint64_t count;
+    int64_t sum[4]; // color[0...2], clear
+    double sum_sq[4];
+    int32_t min[4], max[4];
+};
+
+struct results {
+    uint64_t samples;
+    uint64_t labeled;
+
+    struct class_stats stats[1 + MAX_TABLES][MAX_SENSORS][CLASSES];
+    uint64_t confusion[1 + MAX_TABLES][CLASSES][CLASSES];
+
+    // histograms of the RGB channels (if the samples are in RGB) and
+    // of the HSV channels
+    uint64_t histogram[MAX_SENSORS][2][3][MAX_BINS];
+};
+
+static int bins = 32;
+
+// upper limit of each channel, for the histograms
+static const int channel_limit[2][3] = {
+    [COLOR2CAN_SPACE_RGB] = { 65536, 65536, 65536 },
+    [COLOR2CAN_SPACE_HSV] = { 360,   1024,  65536 }
+};
+
+static void stats_add(struct class_stats *stats, const int value[4]) {
+    if(stats->count == 0) {
+        for(int i = 0; i < 4; i++)
+            stats->min[i] = stats->max[i] = value[i];
+    }
+    stats->count++;
+
+    for(int i = 0; i < 4; i++) {
+        stats->sum[i]    += value[i];
+        stats->sum_sq[i] += (double) value[i] * value[i];
+        if(value[i] < stats->min[i]) stats->min[i] = value[i];
+        if(value[i] > stats->max[i]) stats->max[i] = value[i];
+    }
+}
+
+static void stats_merge(struct class_stats *dest,
+                        const struct class_stats *src) {
+    if(src->count == 0)
+        return;
+
+    for(int i = 0; i < 4; i++) {
+        if(dest->count == 0 || src->min[i] < dest->min[i])
+            dest->min[i] = src->min[i];
+        if(dest->count == 0 || src->max[i] > dest->max[i])
+            dest->max[i] = src->max[i];
+        dest->sum[i]    += src->sum[i];
+        dest->sum_sq[i] += src->sum_sq[i];
+    }
+    dest->count += src->count;
+}
+
+static void results_merge(struct results *dest, const struct results *src) {
+    dest->samples += src->samples;
+    dest->labeled += src->labeled;
+
+    for(int t = 0; t < table_count; t++) {
+        for(int s = 0; s < MAX_SENSORS; s++)
+            for(int c = 0; c < CLASSES; c++)
+                stats_merge(&dest->stats[t][s][c], &src->stats[t][s][c]);
+
+        for(int e = 0; e < CLASSES; e++)
+            for(int c = 0; c < CLASSES; c++)
+                dest->confusion[t][e][c] += src->confusion[t][e][c];
+    }
+
+    for(int s = 0; s < MAX_SENSORS; s++)
+        for(int sp = 0; sp < 2; sp++)
+            for(int ch = 0; ch < 3; ch++)
+                for(int b = 0; b < bins; b++)
+                    dest->histogram[s][sp][ch][b] +=
+                        src->histogram[s][sp][ch][b];
+}
+
+/* ================================================================== */
+/*                               Worker                               */
+/* ================================================================== */
+
+static struct {
+    int count;
+
+    uint64_t time[BATCH_SIZE];
+    uint8_t sensor_id[BATCH_SIZE];
+    uint16_t color[3][BATCH_SIZE];
+    uint16_t clear[BATCH_SIZE];
+    uint8_t within_range[BATCH_SIZE];
+    uint8_t range_id[BATCH_SIZE];
+
+    // payloads of sample messages, decoded in bulk
+    uint8_t payload[BATCH_SIZE][COLOR2CAN_SAMPLE_SIZE];
+} batch;
+
+static struct results *results;
+
+static inline void histogram_add(int sensor_id, int space,
+                                 const int color[3]) {
+    for(int ch = 0; ch < 3; ch++) {
+        int bin = (int64_t) color[ch] * bins / channel_limit[space][ch];
+        if(bin < 0) bin = 0;
+        if(bin >= bins) bin = bins - 1;
+        results->histogram[sensor_id][space][ch][bin]++;
+    }
+}
+
+static void batch_process(void) {
+    const int n = batch.count;
+    results->samples += n;
+
+    // expected class of each sample
+    static int8_t expected[BATCH_SIZE];
+    for(int i = 0; i < n; i++) {
+        expected[i] = -1;
+        if(has_labels)
+            expected[i] = label_find(batch.sensor_id[i], batch.time[i]);
+        results->labeled += (expected[i] >= 0);
+    }
+
+    // recorded classification and histograms
+    for(int i = 0; i < n; i++) {
+        const int s = batch.sensor_id[i];
+        const int value[4] = {
+            batch.color[0][i], batch.color[1][i], batch.color[2][i],
+            batch.clear[i]
+        };
+        const int class = batch.within_range[i] ? 1 + batch.range_id[i] : 0;
+
+        stats_add(&results->stats[0][s][class], value);
+        if(expected[i] >= 0)
+            results->confusion[0][expected[i]][class]++;
+
+        histogram_add(s, recorded_space, value);
+    }
+
+    if(recorded_space == COLOR2CAN_SPACE_RGB) {
+        // HSV histograms, converted by processing.c
+        processing_set_color_space(COLOR2CAN_SPACE_HSV);
+        for(int i = 0; i < n; i++) {
+            int color[3], clear, range_id;
+            bool within_range;
+            processing_process_data(
+                batch.color[0][i], batch.color[1][i], batch.color[2][i],
+                batch.clear[i], color, &clear, &within_range, &range_id
+            );
+            histogram_add(batch.sensor_id[i], COLOR2CAN_SPACE_HSV, color);
+        }
+    }
+
+    // classification by the candidate tables
+    for(int t = 1; t < table_count; t++) {
+        table_apply(&tables[t]);
+
+        for(int i = 0; i < n; i++) {
+            int color[3], clear, range_id = 0;
+            bool within_range;
+            processing_process_data(
+                batch.color[0][i], batch.color[1][i], batch.color[2][i],
+                batch.clear[i], color, &clear, &within_range, &range_id
+            );
+
+            const int value[4] = { color[0], color[1], color[2], clear };
+            const int class = within_range ? 1 + range_id : 0;
+
+            const int s = batch.sensor_id[i];
+            stats_add(&results->stats[t][s][class], value);
+            if(expected[i] >= 0)
+                results->confusion[t][expected[i]][class]++;
+        }
+    }
+    batch.count = 0;
+}
+
+static int archive_rows(const struct color2can_archive_rows *rows,
+                        void *user) {
+    for(int i = 0; i < rows->count; i++) {
+        const int j = batch.count++;
+        batch.time[j]         = rows->time[i];
+        batch.sensor_id[j]    = rows->sensor_id;
+        batch.color[0][j]     = rows->color[0][i];
+        batch.color[1][j]     = rows->color[1][i];
+        batch.color[2][j]     = rows->color[2][i];
+        batch.clear[j]        = rows->clear[i];
+        batch.within_range[j] = rows->within_range[i];
+        batch.range_id[j]     = rows->range_id[i];
+
+        if(batch.count == BATCH_SIZE)
+            batch_process();
+    }
+    return 0;
+}
+
+static void decode_payloads(void) {
+    const struct color2can_sample_columns columns = {
+        .color        = { batch.color[0], batch.color[1], batch.color[2] },
+        .clear        = batch.clear,
+        .within_range = batch.within_range,
+        .range_id     = batch.range_id
+    };
+    color2can_unpack_samples(batch.payload, batch.count, &columns);
+}
+
+static void process_log_part(struct input *input, int part) {
+    struct color2can_record_reader *log = input->log;
+    const uint64_t end = input->positions[part + 1];
+
+    color2can_record_seek(log, input->positions[part]);
+    while(color2can_record_tell(log) < end) {
+        const struct color2can_record *record = color2can_record_next(log);
+        if(!record)
+            break;
+
+        if(record->can_id & (CAN_EFF_FLAG | CAN_RTR_FLAG | CAN_ERR_FLAG))
+            continue;
+
+        const int sensor_id = record->can_id % MAX_SENSORS;
+        const int msg_type  = record->can_id - sensor_id;
+        if(msg_type != COLOR2CAN_SAMPLE_MASK_ID ||
+           record->len != COLOR2CAN_SAMPLE_SIZE)
+            continue;
+
+        const int j = batch.count++;
+        batch.time[j]      = record->time;
+        batch.sensor_id[j] = sensor_id;
+        memcpy(batch.payload[j], record->data, COLOR2CAN_SAMPLE_SIZE);
+
+        if(batch.count == BATCH_SIZE) {
+            decode_payloads();
+            batch_process();
+        }
+    }
+
+    decode_payloads();
+    batch_process();
+}
+
+static void process_archive_part(struct input *input, int part) {
+    const uint64_t span = input->time_max - input->time_min + 1;
+    struct color2can_archive_query query = {
+        .time_from = input->time_min + span * part / input->parts,
+        .time_to   = input->time_min + span * (part + 1) / input->parts,
+        .columns   = COLOR2CAN_ARCHIVE_ALL_COLUMNS
+    };
+    if(color2can_archive_query(input->archive, &query, archive_rows,
+                               NULL) < 0)
+        printf("[Analytics] %s: corrupted archive\n", input->path);
+
+    batch_process();
+}
+
+// index of the next work item to take, shared by the workers
+static int *next_item;
+
+static void worker(struct results *worker_results) {
+    results = worker_results;
+
+    while(true) {
+        const int i = __atomic_fetch_add(next_item, 1, __ATOMIC_RELAXED);
+        if(i >= work_item_count)
+            break;
+
+        struct input *input = &inputs[work_items[i].input];
+        if(input->archive)
+            process_archive_part(input, work_items[i].part);
+        else
+            process_log_part(input, work_items[i].part);
+    }
+}
+
+/* ================================================================== */
+/*                               Output                               */
+/* ================================================================== */
+
+static const char *class_name(int class, char buffer[8]) {
+    if(class == 0)
+        return "none";
+    snprintf(buffer, 8, "r%d", class - 1);
+    return buffer;
+}
+
+static void print_stats(const struct results *r, int t) {
+    const int space = (t == 0 ? recorded_space : tables[t].space);
+    const char *channels = (space == COLOR2CAN_SPACE_HSV ? "hsv" : "rgb");
+
+    printf(
+        "\n[Analytics] %s (%s)\n",
+        t == 0 ? "recorded classification" : tables[t].name,
+        space_name(space)
+    );
+    printf("%-6s %-5s %12s %7s", "sensor", "class", "count", "share");
+    for(int ch = 0; ch < 4; ch++) {
+        char name[2] = { ch < 3 ? channels[ch] : 'c', '\0' };
+        printf(" %9s %8s %13s", name, "sd", "min...max");
+    }
+    putchar('\n');
+
+    for(int s = 1; s < MAX_SENSORS; s++) {
+        uint64_t total = 0;
+        for(int c = 0; c < CLASSES; c++)
+            total += r->stats[t][s][c].count;
+
+        for(int c = 0; c < CLASSES; c++) {
+            const struct class_stats *stats = &r->stats[t][s][c];
+            if(stats->count == 0)
+                continue;
+
+            char buffer[8];
+            printf(
+                "%-6d %-5s %12llu %6.2f%%",
+                s, class_name(c, buffer),
+                (unsigned long long) stats->count,
+                100.0 * stats->count / total
+            );
+            for(int ch = 0; ch < 4; ch++) {
+                const double mean = (double) stats->sum[ch] / stats->count;
+                double var = stats->sum_sq[ch] / stats->count - mean * mean;
+                if(var < 0)
+                    var = 0;
+
+                char interval[24];
+                snprintf(interval, sizeof(interval), "%d...%d",
+                         stats->min[ch], stats->max[ch]);
+                printf(" %9.1f %8.1f %13s", mean, sqrt(var), interval);
+            }
+            putchar('\n');
+        }
+    }
+}
+
+static void print_confusion(const struct results *r, int t) {
+    bool expected_used[CLASSES] = { 0 }, class_used[CLASSES] = { 0 };
+    uint64_t total = 0, correct = 0;
+    for(int e = 0; e < CLASSES; e++) {
+        for(int c = 0; c < CLASSES; c++) {
+            const uint64_t n = r->confusion[t][e][c];
+            if(n == 0)
+                continue;
+
+            expected_used[e] = class_used[c] = true;
+            total += n;
+            if(e == c)
+                correct += n;
+        }
+    }
+
+    printf(
+        "[Analytics] confusion (rows: labels, columns: classes), "
+        "accuracy %.3f%%\n",
+        total ? 100.0 * correct / total : 0
+    );
+
+    char buffer[8];
+    printf("%-6s", "");
+    for(int c = 0; c < CLASSES; c++)
+        if(class_used[c])
+            printf(" %10s", class_name(c, buffer));
+    putchar('\n');
+
+    for(int e = 0; e < CLASSES; e++) {
+        if(!expected_used[e])
+            continue;
+
+        printf("%-6s", class_name(e, buffer));
+        for(int c = 0; c < CLASSES; c++)
+            if(class_used[c])
+                printf(" %10llu", (unsigned long long) r->confusion[t][e][c]);
+        putchar('\n');
+    }
+}
+
+static int write_histograms(const struct results *r, const char *path) {
+    FILE *file = fopen(path, "w");
+    if(!file) {
+        perror(path);
+        return 1;
+    }
+
+    static const char *channel_names[2][3] = {
+        [COLOR2CAN_SPACE_RGB] = { "red", "green", "blue" },
+        [COLOR2CAN_SPACE_HSV] = { "hue", "saturation", "value" }
+    };
+
+    fprintf(file, "sensor,channel,bin_low,bin_high,count\n");
+    for(int s = 1; s < MAX_SENSORS; s++) {
+        for(int sp = 0; sp < 2; sp++) {
+            for(int ch = 0; ch < 3; ch++) {
+                uint64_t total = 0;
+                for(int b = 0; b < bins; b++)
+                    total += r->histogram[s][sp][ch][b];
+                if(total == 0)
+                    continue;
+
+                const int limit = channel_limit[sp][ch];
+                for(int b = 0; b < bins; b++) {
+                    fprintf(
+                        file, "%d,%s,%lld,%lld,%llu\n",
+                        s, channel_names[sp][ch],
+                        (long long) limit * b / bins,
+                        (long long) limit * (b + 1) / bins,
+                        (unsigned long long) r->histogram[s][sp][ch][b]
+                    );
+                }
+            }
+        }
+    }
+    fclose(file);
+    return 0;
+}
+
+/* ================================================================== */
+/*                                Main                                */
+/* ================================================================== */
+
+static uint64_t now_us(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t) t.tv_sec * 1000000 + t.tv_nsec / 1000;
+}
+
+static int run(int jobs) {
+    // one part of each input per work item
+    for(int i = 0; i < input_count; i++) {
+        if(input_open(&inputs[i], jobs * PARTS_PER_JOB))
+            return 1;
+        work_item_count += inputs[i].parts;
+    }
+
+    work_items = malloc(work_item_count * sizeof(*work_items));
+    if(!work_items)
+        return 1;
+
+    int n = 0;
+    for(int i = 0; i < input_count; i++) {
+        for(int p = 0; p < inputs[i].parts; p++)
+            work_items[n++] = (struct work_item) { i, p };
+    }
+
+    // results of each worker, followed by the shared index of the next
+    // work item
+    const size_t size = (jobs + 1) * sizeof(struct results) + sizeof(int);
+    struct results *shared = mmap(
+        NULL, size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_ANONYMOUS, -1, 0
+    );
+    if(shared == MAP_FAILED) {
+        perror("[Analytics] mmap");
+        return 1;
+    }
+    next_item = (int *) &shared[jobs + 1];
+
+    const uint64_t start = now_us();
+
+    // flush before forking, so that buffered output is not duplicated
+    fflush(stdout);
+    for(int j = 0; j < jobs; j++) {
+        const pid_t pid = fork();
+        if(pid < 0) {
+            perror("[Analytics] fork");
+            return 1;
+        }
+        if(pid == 0) {
+            worker(&shared[1 + j]);
+            fflush(stdout);
+            _exit(0);
+        }
+    }
+
+    int err = 0;
+    int status;
+    while(wait(&status) > 0)
+        if(!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            err = 1;
+    if(err) {
+        puts("[Analytics] a worker failed");
+        return 1;
+    }
+
+    struct results *total = &shared[0];
+    for(int j = 0; j < jobs; j++)
+        results_merge(total, &shared[1 + j]);
+    const uint64_t elapsed = now_us() - start;
+
+    printf(
+        "[Analytics] %llu samples from %d input(s), %d worker(s): "
+        "%.3f s, %.1f M samples/s\n",
+        (unsigned long long) total->samples, input_count, jobs,
+        elapsed / 1e6, elapsed ? (double) total->samples / elapsed : 0
+    );
+    if(has_labels) {
+        printf(
+            "[Analytics] %llu labeled samples\n",
+            (unsigned long long) total->labeled
+        );
+    }
+
+    for(int t = 0; t < table_count; t++) {
+        print_stats(total, t);
+        if(has_labels)
+            print_confusion(total, t);
+    }
+
+    results = total;
+    return 0;
+}
+
+static void usage(const char *arg0) {
+    printf("Usage: %s [options] <input>...\n", arg0);
+    printf("Analyzes recorded samples: logs of the recorder or archives.\n");
+    printf("  -j <jobs>    worker processes (default: number of CPUs)\n");
+    printf("  -s <space>   color space of the samples, rgb or hsv "
+           "(default: rgb)\n");
+    printf("  -r <file>    candidate range table, with lines 'space "
+           "<rgb|hsv>' and\n");
+    printf("               'range <id> <low0> <low1> <low2> <high0> "
+           "<high1> <high2>'\n");
+    printf("               (up to %d tables)\n", MAX_TABLES);
+    printf("  -l <file>    labeled intervals, with lines '<sensor> "
+           "<from> <to> <range>'\n");
+    printf("               (times in seconds, sensor 0=all, range "
+           "-1=none)\n");
+    printf("  -H <file>    write the histograms as CSV\n");
+    printf("  -b <bins>    bins of the histograms (default: 32)\n");
+}
+
+int main(int argc, char *argv[]) {
+    int jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    const char *table_paths[MAX_TABLES];
+    int table_path_count = 0;
+    const char *labels_path = NULL;
+    const char *histogram_path = NULL;
+
+    int opt;
+    while((opt = getopt(argc, argv, "j:s:r:l:H:b:")) != -1) {
+        if(opt == 'j') {
+            jobs = atoi(optarg);
+        } else if(opt == 's') {
+            recorded_space = parse_space(optarg);
+        } else if(opt == 'r' && table_path_count < MAX_TABLES) {
+            table_paths[table_path_count++] = optarg;
+        } else if(opt == 'l') {
+            labels_path = optarg;
+        } else if(opt == 'H') {
+            histogram_path = optarg;
+        } else if(opt == 'b') {
+            bins = atoi(optarg);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if(optind == argc || argc - optind > MAX_INPUTS ||
+       jobs < 1 || recorded_space < 0 || bins < 1 || bins > MAX_BINS) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    for(int i = optind; i < argc; i++)
+        inputs[input_count++].path = argv[i];
+
+    tables[0] = (struct range_table) {
+        .name  = "recorded",
+        .space = recorded_space
+    };
+    for(int i = 0; i < table_path_count; i++) {
+        struct range_table *table = &tables[table_count++];
+        if(load_table(table_paths[i], table))
+            return 1;
+
+        // HSV cannot be converted back to RGB
+        if(recorded_space == COLOR2CAN_SPACE_HSV &&
+           table->space == COLOR2CAN_SPACE_RGB) {
+            printf("[Analytics] %s: samples recorded in HSV cannot be "
+                   "classified in RGB\n", table->name);
+            return 1;
+        }
+    }
+
+    if(labels_path && load_labels(labels_path))
+        return 1;
+
+    if(run(jobs))
+        return 1;
+
+    if(histogram_path && write_histograms(results, histogram_path))
+        return 1;
+    return 0;
+}
@@ -0,0 +1,330 @@
+/* Copyright 2025 Vulcalien
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "main.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "color2can.h"
+#include "hal.h"
+#include "processing.h"
+
+// Host benchmarks of the hot path: the protocol codec, using the structs
+// of color2can.h, and the processing kernels of processing.c. Each
+// benchmark is calibrated to run for at least 'min_time' per repetition,
+// then repeated: the median is reported together with the minimum and the
+// median absolute deviation.
+
+#define INPUT_COUNT 4096 // power of 2
+
+static struct {
+    int rgbc[INPUT_COUNT][4];
+    uint8_t sample[INPUT_COUNT][COLOR2CAN_SAMPLE_SIZE];
+    uint8_t config[INPUT_COUNT][COLOR2CAN_CONFIG_EXT_SIZE];
+} input;
+
+// results are accumulated here, so that they are not optimized away
+static volatile uint32_t sink;
+
+static uint64_t now_ns(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t) t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+static uint32_t random_next(void) {
+    static uint32_t state = 0x2545f491;
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+static void input_init(void) {
+    for(int i = 0; i < INPUT_COUNT; i++) {
+        for(int j = 0; j < 4; j++)
+            input.rgbc[i][j] = random_next() & 0xffff;
+
+        for(int j = 0; j < COLOR2CAN_SAMPLE_SIZE; j++)
+            input.sample[i][j] = random_next();
+        for(int j = 0; j < COLOR2CAN_CONFIG_EXT_SIZE; j++)
+            input.config[i][j] = random_next();
+    }
+}
+
+/* ================================================================== */
+/*                               Codec                                */
+/* ================================================================== */
+
+// Encode a sample into a CAN message, as write_sample does
+static void bench_encode_sample(long iterations, int arg) {
+    uint32_t acc = 0;
+    for(long i = 0; i < iterations; i++) {
+        const int *rgbc = input.rgbc[i & (INPUT_COUNT - 1)];
+        struct color2can_sample data = {
+            .color        = { rgbc[0], rgbc[1], rgbc[2] },
+            .clear        = rgbc[3],
+            .within_range = i & 1,
+            .range_id     = i & 0xf
+        };
+
+        struct hal_can_msg msg = {
+            .id  = COLOR2CAN_SAMPLE_MASK_ID | (i & 0x1f),
+            .len = COLOR2CAN_SAMPLE_SIZE
+        };
+        memcpy(msg.data, &data, COLOR2CAN_SAMPLE_SIZE);
+        acc += msg.data[i & 7];
+    }
+    sink += acc;
+}
+
+// Decode a sample message, as the host does
+static void bench_decode_sample(long iterations, int arg) {
+    uint32_t acc = 0;
+    for(long i = 0; i < iterations; i++) {
+        struct color2can_sample data;
+        memcpy(&data, input.sample[i & (INPUT_COUNT - 1)], sizeof(data));
+
+        acc += data.color[0] + data.color[1] + data.color[2]
+             + data.clear + data.within_range + data.range_id;
+    }
+    sink += acc;
+}
+
+// Encode a sample info message, as write_sample_info does
+static void bench_encode_sample_info(long iterations, int arg) {
+    uint32_t acc = 0;
+    for(long i = 0; i < iterations; i++) {
+        struct color2can_sample_info info = {
+            .sync_counter = i,
+            .synchronized = i & 1,
+            .time_valid   = 1,
+            .overrun      = (i >> 1) & 1,
+            .time         = i * 2500
+        };
+
+        uint8_t data[COLOR2CAN_SAMPLE_INFO_SIZE];
+        memcpy(data, &info, sizeof(data));
+        acc += data[i & 7];
+    }
+    sink += acc;
+}
+
+// Decode a config message, as handle_message does
+static void bench_decode_config(long iterations, int arg) {
+    uint32_t acc = 0;
+    for(long i = 0; i < iterations; i++) {
+        struct color2can_config_ext ext;
+        memcpy(&ext, input.config[i & (INPUT_COUNT - 1)], sizeof(ext));
+
+        acc += ext.config.transmit_frequency + ext.config.color_space
+             + ext.config.use_led + ext.config.sample_info
+             + ext.integration + ext.transmit_period;
+    }
+    sink += acc;
+}
+
+/* ================================================================== */
+/*                             Processing                             */
+/* ================================================================== */
+
+// Set the color space and 'arg' active ranges, none of them matching,
+// so that all of them are checked.
+static void processing_setup(int color_space, int active_ranges) {
+    processing_set_color_space(color_space);
+
+    int low[3]  = { 1, 1, 1 };
+    int high[3] = { 0, 0, 0 };
+    for(int i = 0; i < active_ranges; i++) {
+        processing_set_range(i, false, low);
+        processing_set_range(i, true, high);
+    }
+}
+
+static void setup_rgb(int arg) {
+    processing_setup(COLOR2CAN_SPACE_RGB, arg);
+}
+
+static void setup_hsv(int arg) {
+    processing_setup(COLOR2CAN_SPACE_HSV, arg);
+}
+
+static void bench_process(long iterations, int arg) {
+    uint32_t acc = 0;
+    for(long i = 0; i < iterations; i++) {
+        const int *rgbc = input.rgbc[i & (INPUT_COUNT - 1)];
+
+        int color[3], clear;
+        bool within_range;
+        int range_id;
+        processing_process_data(
+            rgbc[0], rgbc[1], rgbc[2], rgbc[3],
+            color, &clear, &within_range, &range_id
+        );
+        acc += color[0] + color[1] + color[2] + within_range;
+    }
+    sink += acc;
+}
+
+/* ================================================================== */
+/*                               Runner                               */
+/* ================================================================== */
+
+#define REPETITIONS_MAX 101
+
+static struct benchmark {
+    const char *name;
+    void (*setup)(int arg); // optional, not measured
+    void (*run)(long iterations, int arg);
+    int arg;
+} benchmarks[] = {
+    { "encode_sample",      NULL,      bench_encode_sample,      0  },
+    { "decode_sample",      NULL,      bench_decode_sample,      0  },
+    { "encode_sample_info", NULL,      bench_encode_sample_info, 0  },
+    { "decode_config",      NULL,      bench_decode_config,      0  },
+    { "rgb",                setup_rgb, bench_process,            0  },
+    { "hsv",                setup_hsv, bench_process,            0  },
+    { "rgb_ranges_1",       setup_rgb, bench_process,            1  },
+    { "rgb_ranges_2",       setup_rgb, bench_process,            2  },
+    { "rgb_ranges_4",       setup_rgb, bench_process,            4  },
+    { "rgb_ranges_8",       setup_rgb, bench_process,            8  },
+    { "rgb_ranges_16",      setup_rgb, bench_process,            16 },
+    { "hsv_ranges_16",      setup_hsv, bench_process,            16 }
+};
+#define BENCHMARK_COUNT (sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+struct result {
+    long iterations;
+    double median; // ns/op
+    double min;    // ns/op
+    double mad;    // ns/op, median absolute deviation
+};
+
+static int compare_double(const void *a, const void *b) {
+    const double x = *(const double *) a;
+    const double y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+static double median(double *values, int count) {
+    qsort(values, count, sizeof(double), compare_double);
+    if(count % 2)
+        return values[count / 2];
+    return (values[count / 2 - 1] + values[count / 2]) / 2;
+}
+
+static double run_once(const struct benchmark *b, long iterations) {
+    const uint64_t start = now_ns();
+    b->run(iterations, b->arg);
+    return (double) (now_ns() - start);
+}
+
+static void measure(const struct benchmark *b, int repetitions,
+                    uint64_t min_time, struct result *result) {
+    // double the iterations until a repetition is long enough; this also
+    // warms up the caches and branch predictors
+    long iterations = 1000;
+    while(run_once(b, iterations) < min_time)
+        iterations *= 2;
+
+    double times[REPETITIONS_MAX];
+    for(int i = 0; i < repetitions; i++)
+        times[i] = run_once(b, iterations) / iterations;
+
+    result->iterations = iterations;
+    result->median = median(times, repetitions);
+    result->min = times[0]; // sorted by median()
+
+    for(int i = 0; i < repetitions; i++) {
+        times[i] -= result->median;
+        if(times[i] < 0)
+            times[i] = -times[i];
+    }
+    result->mad = median(times, repetitions);
+}
+
+static void usage(const char *arg0) {
+    printf("Usage: %s [-r repetitions] [-t min-time-ms] [-c] [filter]\n",
+           arg0);
+    printf("Benchmarks the protocol codec and the processing kernels,\n");
+    printf("reporting ns/op and throughput. Only the benchmarks whose\n");
+    printf("name contains 'filter' are run. With -c, the results are\n");
+    printf("printed as CSV.\n");
+}
+
+int main(int argc, char *argv[]) {
+    int repetitions = 15;
+    int min_time_ms = 20;
+    bool csv = false;
+
+    int opt;
+    while((opt = getopt(argc, argv, "r:t:c")) != -1) {
+        if(opt == 'r') {
+            repetitions = atoi(optarg);
+        } else if(opt == 't') {
+            min_time_ms = atoi(optarg);
+        } else if(opt == 'c') {
+            csv = true;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if(optind < argc - 1 ||
+       repetitions < 1 || repetitions > REPETITIONS_MAX ||
+       min_time_ms < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+    const char *filter = (optind < argc ? argv[optind] : "");
+
+    input_init();
+
+    if(csv) {
+        puts("name,iterations,repetitions,ns_per_op,ns_per_op_min,"
+             "ns_per_op_mad,ops_per_s");
+    } else {
+        printf("[Benchmark] median of %d repetitions\n", repetitions);
+        printf("%-20s %12s %10s %10s %10s %14s\n",
+               "benchmark", "iterations", "ns/op", "min", "mad", "ops/s");
+    }
+
+    for(int i = 0; i < BENCHMARK_COUNT; i++) {
+        const struct benchmark *b = &benchmarks[i];
+        if(!strstr(b->name, filter))
+            continue;
+
+        if(b->setup)
+            b->setup(b->arg);
+
+        struct result r;
+        measure(b, repetitions, (uint64_t) min_time_ms * 1000000, &r);
+
+        if(csv) {
+            printf("%s,%ld,%d,%.3f,%.3f,%.3f,%.0f\n",
+                   b->name, r.iterations, repetitions,
+                   r.median, r.min, r.mad, 1e9 / r.median);
+        } else {
+            printf("%-20s %12ld %10.3f %10.3f %10.3f %14.0f\n",
+                   b->name, r.iterations,
+                   r.median, r.min, r.mad, 1e9 / r.median);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,286 @@
+/* Copyright 2025 Vulcalien
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "hal.h"
+#include "hal-linux.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include <net/if.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+
+#include <linux/can.h>
+#include <linux/can/raw.h>
+
+#include "hrtime.h"
+#include "tcs34725.h"
+
+/* ================================================================== */
+/*                                Time                                */
+/* ================================================================== */
+
+static pthread_mutex_t critical_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+int hal_time_init(void) {
+    return 0;
+}
+
+uint32_t hal_time_cycles(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+
+    const uint64_t ns = (uint64_t) t.tv_sec * 1000000000 + t.tv_nsec;
+    return ns * HAL_CYCLES_PER_US / 1000;
+}
+
+void hal_sleep_us(int us) {
+    usleep(us);
+}
+
+uint32_t hal_critical_enter(void) {
+    pthread_mutex_lock(&critical_mutex);
+    return 0;
+}
+
+void hal_critical_leave(uint32_t flags) {
+    pthread_mutex_unlock(&critical_mutex);
+}
+
+// Threads cannot be stopped: they keep running concurrently
+void hal_sched_lock(void) {
+}
+
+void hal_sched_unlock(void) {
+}
+
+/* ================================================================== */
+/*                                LEDs                                */
+/* ================================================================== */
+
+static bool leds[2];
+
+void hal_led_set(int led, bool on) {
+    if(leds[led] != on && debug_flag)
+        printf("[HAL] %s LED %s\n", led == HAL_LED_RED ? "red" : "green",
+               on ? "on" : "off");
+    leds[led] = on;
+}
+
+/* ================================================================== */
+/*                                I2C                                 */
+/* ================================================================== */
+
+int hal_i2c_init(int address, int frequency) {
+    // the simulated sensor is the only device on the bus
+    return (address != 0x29);
+}
+
+void hal_i2c_set_reset(bool on) {
+    if(on)
+        tcs34725_reset();
+}
+
+int hal_i2c_write(const uint8_t *buf, int len) {
+    return tcs34725_write(buf, len);
+}
+
+int hal_i2c_writeread(const uint8_t *cmd, int cmdlen,
+                      uint8_t *buf, int len) {
+    return tcs34725_writeread(cmd, cmdlen, buf, len);
+}
+
+/* ================================================================== */
+/*                                CAN                                 */
+/* ================================================================== */
+
+// the board's CAN clock and time quanta per bit
+#define CAN_CLOCK_FREQUENCY 80000000
+#define CAN_QUANTA          16
+#define CAN_MAX_PRESCALER   1024
+
+// when the device queue is full, wait this long before writing again
+#define TX_RETRY_US 200
+
+static const char *can_ifname = "vcan0";
+static int sockfd;
+static bool tx_full;
+
+// virtual interfaces have no bit rate: only remember it
+static int bitrate = 250000;
+
+void hal_linux_set_can_interface(const char *ifname) {
+    can_ifname = ifname;
+}
+
+void hal_linux_set_can_socket(int fd) {
+    can_ifname = NULL;
+    sockfd = fd;
+}
+
+int hal_can_open(void) {
+    // the socket was given by hal_linux_set_can_socket
+    if(!can_ifname)
+        return 0;
+
+    if((sockfd = socket(PF_CAN, SOCK_RAW, CAN_RAW)) < 0)
+        return 1;
+
+    const int enable = 1;
+    setsockopt(sockfd, SOL_SOCKET, SO_TIMESTAMP, &enable, sizeof(enable));
+    setsockopt(
+        sockfd, SOL_CAN_RAW, CAN_RAW_FD_FRAMES, &enable, sizeof(enable)
+    );
+
+    struct ifreq ifr = { 0 };
+    strncpy(ifr.ifr_name, can_ifname, IFNAMSIZ - 1);
+    if(ioctl(sockfd, SIOCGIFINDEX, &ifr) < 0)
+        goto error;
+
+    struct sockaddr_can addr = { 0 };
+    addr.can_family  = AF_CAN;
+    addr.can_ifindex = ifr.ifr_ifindex;
+    if(bind(sockfd, (struct sockaddr *) &addr, sizeof(addr)) < 0)
+        goto error;
+
+    printf("[HAL] using CAN interface %s\n", can_ifname);
+    return 0;
+
+error:
+    close(sockfd);
+    return 1;
+}
+
+int hal_can_read(struct hal_can_msg *msg) {
+    struct canfd_frame frame;
+    struct iovec iov = {
+        .iov_base = &frame,
+        .iov_len  = sizeof(frame)
+    };
+
+    char control[CMSG_SPACE(sizeof(struct timeval))];
+    struct msghdr hdr = {
+        .msg_iov        = &iov,
+        .msg_iovlen     = 1,
+        .msg_control    = control,
+        .msg_controllen = sizeof(control)
+    };
+
+    int nbytes = recvmsg(sockfd, &hdr, MSG_DONTWAIT);
+    if(nbytes < 0)
+        return (errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1);
+
+    // error frames are not messages
+    if(frame.can_id & CAN_ERR_FLAG)
+        return hal_can_read(msg);
+
+    msg->id  = frame.can_id & CAN_EFF_MASK;
+    msg->len = frame.len;
+    msg->rtr = (frame.can_id & CAN_RTR_FLAG) != 0;
+    memcpy(msg->data, frame.data, msg->len);
+
+    // the kernel's timestamp is in wall-clock time: use it to compute
+    // the age of the message
+    msg->time_valid = false;
+    for(struct cmsghdr *c = CMSG_FIRSTHDR(&hdr); c; c = CMSG_NXTHDR(&hdr, c)) {
+        if(c->cmsg_level != SOL_SOCKET || c->cmsg_type != SO_TIMESTAMP)
+            continue;
+
+        struct timeval ts, now;
+        memcpy(&ts, CMSG_DATA(c), sizeof(ts));
+        gettimeofday(&now, NULL);
+
+        int64_t age = (int64_t) (now.tv_sec - ts.tv_sec) * 1000000
+                    + now.tv_usec - ts.tv_usec;
+        if(age < 0)
+            age = 0;
+
+        msg->time_valid = true;
+        msg->time       = hrtime_us() - age;
+    }
+    return 1;
+}
+
+int hal_can_write(const struct hal_can_msg *msg) {
+    struct canfd_frame frame = {
+        .can_id = msg->id | (msg->rtr ? CAN_RTR_FLAG : 0),
+        .len    = msg->len
+    };
+    memcpy(frame.data, msg->data, msg->len);
+
+    // messages longer than 8 bytes are sent as CAN FD frames
+    int size = CAN_MTU;
+    if(msg->len > CAN_MAX_DLEN) {
+        frame.flags = CANFD_BRS;
+        size = CANFD_MTU;
+    }
+    tx_full = false;
+    if(send(sockfd, &frame, size, MSG_DONTWAIT) == size)
+        return 0;
+
+    tx_full = (errno == ENOBUFS || errno == EAGAIN);
+    return (tx_full ? 1 : -1);
+}
+
+int hal_can_wait(int timeout, bool writable) {
+    struct pollfd fds = {
+        .fd     = sockfd,
+        .events = POLLIN
+    };
+
+    // if messages arrived while busy, their reception time is unknown
+    if(poll(&fds, 1, 0) > 0)
+        return 0;
+
+    // SocketCAN reports POLLOUT even when the device queue is full
+    if(writable && tx_full && timeout > TX_RETRY_US)
+        timeout = TX_RETRY_US;
+
+    const struct timespec t = {
+        .tv_sec  = timeout / 1000000,
+        .tv_nsec = (timeout % 1000000) * 1000
+    };
+    return ppoll(&fds, 1, &t, NULL) > 0;
+}
+
+int hal_can_get_bitrate(void) {
+    return bitrate;
+}
+
+int hal_can_check_bitrate(int val) {
+    if(val <= 0 || val > 1000000)
+        return 1;
+    if(CAN_CLOCK_FREQUENCY % (val * CAN_QUANTA) != 0)
+        return 1;
+    if(CAN_CLOCK_FREQUENCY / (val * CAN_QUANTA) > CAN_MAX_PRESCALER)
+        return 1;
+    return 0;
+}
+
+int hal_can_set_bitrate(int val) {
+    if(hal_can_check_bitrate(val))
+        return 1;
+
+    bitrate = val;
+    return 0;
+}
@@ -0,0 +1,26 @@
+/* Copyright 2025 Vulcalien
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include "main.h"
+
+// Linux-specific settings of the HAL, to be called before color_main
+
+extern void hal_linux_set_can_interface(const char *ifname);
+
+// Uses an already open socket, carrying struct canfd_frame messages,
+// instead of a CAN interface (e.g. one end of a socketpair, in tests)
+extern void hal_linux_set_can_socket(int fd);
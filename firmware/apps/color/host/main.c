@@ -0,0 +1,44 @@
+/* Copyright 2025 Vulcalien
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "main.h"
+
+#include <stdio.h>
+
+#include "hal-linux.h"
+#include "tcs34725.h"
+
+extern int color_main(int argc, char *argv[]);
+
+int main(int argc, char *argv[]) {
+    if(argc != 2 && argc != 5) {
+        printf("Usage: %s <ifname> [red green blue]\n", argv[0]);
+        printf("Runs the firmware on a (virtual) CAN interface, with a\n");
+        printf("simulated color sensor. The optional color is the light\n");
+        printf("reaching the sensor, in counts per 2.4ms cycle.\n");
+        return 1;
+    }
+
+    hal_linux_set_can_interface(argv[1]);
+    if(argc == 5)
+        tcs34725_set_light(atoi(argv[2]), atoi(argv[3]), atoi(argv[4]));
+
+    // the sensor starts powered off, as after a reset
+    tcs34725_reset();
+
+    // commands are read from the standard input, as from the console
+    char *args[] = { argv[0], NULL };
+    return color_main(1, args);
+}
@@ -0,0 +1,164 @@
+/* Copyright 2025 Vulcalien
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "tcs34725.h"
+
+#include <string.h>
+#include <math.h>
+
+#include "hrtime.h"
+
+#define REG_ENABLE  0x00
+#define REG_ATIME   0x01
+#define REG_CONTROL 0x0f
+#define REG_ID      0x12
+#define REG_STATUS  0x13
+#define REG_CDATAL  0x14
+#define REG_COUNT   0x20
+
+#define ENABLE_PON  (1 << 0)
+#define ENABLE_AEN  (1 << 1)
+#define ENABLE_AIEN (1 << 4) // INT pin drives the LED: on if clear
+
+#define STATUS_AVALID (1 << 0)
+
+#define CMD_BIT            0x80
+#define CMD_TYPE_MASK      0x60
+#define CMD_AUTO_INCREMENT 0x20
+#define CMD_ADDR_MASK      0x1f
+
+#define CYCLE_US 2400
+
+// light added by the LED, reflected by the target
+#define LED_LIGHT 200
+
+// the scene's colors oscillate with this period (in microseconds)
+#define SCENE_PERIOD 5000000
+
+static uint8_t regs[REG_COUNT];
+
+static int address;
+static bool auto_increment;
+
+static int light[3] = { 300, 200, 100 };
+
+// start of the first integration cycle, and latest latched cycle
+static uint64_t start_time;
+static int64_t latched_cycle;
+
+void tcs34725_reset(void) {
+    memset(regs, 0, sizeof(regs));
+    regs[REG_ATIME] = 0xff;
+    regs[REG_ID]    = 0x44;
+
+    address = 0;
+    auto_increment = false;
+    latched_cycle = -1;
+}
+
+void tcs34725_set_light(int r, int g, int b) {
+    light[0] = r;
+    light[1] = g;
+    light[2] = b;
+}
+
+static int cycle_time(void) {
+    return (256 - regs[REG_ATIME]) * CYCLE_US;
+}
+
+static void write_data(int channel, int value) {
+    if(value > 65535)
+        value = 65535;
+    regs[REG_CDATAL + 2 * channel]     = value & 0xff;
+    regs[REG_CDATAL + 2 * channel + 1] = value >> 8;
+}
+
+// Latch the colors of the latest complete integration cycle
+static void update_data(void) {
+    const uint8_t enable = regs[REG_ENABLE];
+    if(!(enable & ENABLE_PON) || !(enable & ENABLE_AEN))
+        return;
+
+    const uint64_t now = hrtime_us();
+    if(now < start_time + cycle_time())
+        return;
+
+    const int64_t cycle = (now - start_time) / cycle_time() - 1;
+    if(cycle == latched_cycle)
+        return;
+    latched_cycle = cycle;
+
+    const uint64_t end = start_time + (cycle + 1) * cycle_time();
+    const double phase = 2 * M_PI * (end % SCENE_PERIOD) / SCENE_PERIOD;
+    const int led = (enable & ENABLE_AIEN) ? 0 : LED_LIGHT;
+
+    const int cycles = 256 - regs[REG_ATIME];
+    int clear = 0;
+    for(int i = 0; i < 3; i++) {
+        const double level = light[i] * (1 + 0.5 * sin(phase + i * 2.1));
+        const int value = (level + led + (cycle * 7 + i) % 5) * cycles;
+        write_data(1 + i, value);
+        clear += value;
+    }
+    write_data(0, clear);
+
+    regs[REG_STATUS] |= STATUS_AVALID;
+}
+
+static void write_register(int addr, uint8_t val) {
+    if(addr == REG_ENABLE) {
+        // enabling RGBC starts a new integration, after a 2.4ms init
+        if(!(regs[REG_ENABLE] & ENABLE_AEN) && (val & ENABLE_AEN)) {
+            start_time = hrtime_us() + CYCLE_US;
+            latched_cycle = -1;
+            regs[REG_STATUS] &= ~STATUS_AVALID;
+        }
+    }
+    if(addr != REG_ID && addr != REG_STATUS && addr < REG_CDATAL)
+        regs[addr] = val;
+}
+
+static void set_command(uint8_t cmd) {
+    address = cmd & CMD_ADDR_MASK;
+    auto_increment = ((cmd & CMD_TYPE_MASK) == CMD_AUTO_INCREMENT);
+}
+
+int tcs34725_write(const uint8_t *buf, int len) {
+    if(len < 1 || !(buf[0] & CMD_BIT))
+        return 1;
+
+    set_command(buf[0]);
+    for(int i = 1; i < len; i++) {
+        if(address < REG_COUNT)
+            write_register(address, buf[i]);
+        if(auto_increment)
+            address++;
+    }
+    return 0;
+}
+
+int tcs34725_writeread(const uint8_t *cmd, int cmdlen,
+                       uint8_t *buf, int len) {
+    if(tcs34725_write(cmd, cmdlen))
+        return 1;
+
+    update_data();
+    for(int i = 0; i < len; i++) {
+        buf[i] = (address < REG_COUNT ? regs[address] : 0);
+        if(auto_increment)
+            address++;
+    }
+    return 0;
+}
@@ -0,0 +1,30 @@
+/* Copyright 2025 Vulcalien
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include "main.h"
+
+// Register model of the TCS34725 color sensor, driven by the HAL's I2C
+// functions. Colors follow a simulated scene that changes over time.
+
+extern void tcs34725_reset(void);
+
+// Sets the light reaching the sensor, in counts per 2.4ms cycle
+extern void tcs34725_set_light(int r, int g, int b);
+
+extern int tcs34725_write(const uint8_t *buf, int len);
+extern int tcs34725_writeread(const uint8_t *cmd, int cmdlen,
+                              uint8_t *buf, int len);
@@ -0,0 +1,670 @@
+/* Copyright 2025 Vulcalien
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "main.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include <linux/can.h>
+
+#include "color2can.h"
+#include "hal.h"
+#include "hal-linux.h"
+#include "hrtime.h"
+#include "log.h"
+#include "color.h"
+#include "processing.h"
+#include "can-io.h"
+#include "status.h"
+#include "tcs34725.h"
+#include "timesync.h"
+#include "profile.h"
+
+// Tests of the firmware on the host: range classification, the TCS34725
+// register model, and the handling of config, range, sample request and
+// time messages through the Linux HAL. The CAN bus is one end of a
+// socketpair, the test acting as the host on the other end.
+
+static int failures;
+
+#define CHECK(cond) do {\
+    if(!(cond)) {\
+        printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);\
+        failures++;\
+    }\
+} while(0)
+
+/* ================================================================== */
+/*                        Range Classification                        */
+/* ================================================================== */
+
+static void set_range(int id, int l0, int l1, int l2,
+                      int h0, int h1, int h2) {
+    int low[3]  = { l0, l1, l2 };
+    int high[3] = { h0, h1, h2 };
+    processing_set_range(id, false, low);
+    processing_set_range(id, true, high);
+}
+
+// Returns the range of a color, or -1 if it is not within any range
+static int classify(int r, int g, int b) {
+    int color[3], clear;
+    bool within_range;
+    int range_id = -1;
+    if(processing_process_data(r, g, b, r + g + b,
+                               color, &clear, &within_range, &range_id))
+        return -2;
+    return (within_range ? range_id : -1);
+}
+
+static bool bench_done;
+
+static void *run_bench(void *arg) {
+    for(int i = 0; i < 20; i++) {
+        processing_bench(COLOR2CAN_SPACE_RGB, RANGES_COUNT, 100000);
+        processing_bench(COLOR2CAN_SPACE_HSV, 0, 100000);
+    }
+    __atomic_store_n(&bench_done, true, __ATOMIC_RELAXED);
+    return NULL;
+}
+
+// The benchmark runs while the CAN-IO thread processes samples: the
+// configuration must not change under it
+static void test_bench_concurrency(void) {
+    pthread_t thread;
+    CHECK(pthread_create(&thread, NULL, run_bench, NULL) == 0);
+
+    int wrong = 0;
+    while(!__atomic_load_n(&bench_done, __ATOMIC_RELAXED)) {
+        wrong += (classify(50, 50, 50) != 6);
+        wrong += (classify(0, 100, 0) != 3);
+    }
+    pthread_join(thread, NULL);
+    CHECK(wrong == 0);
+}
+
+static void test_ranges(void) {
+    processing_set_color_space(COLOR2CAN_SPACE_RGB);
+    CHECK(classify(100, 100, 100) == -1);
+
+    // bounds are inclusive
+    set_range(4, 10, 20, 30, 40, 50, 60);
+    CHECK(classify(10, 20, 30) == 4);
+    CHECK(classify(40, 50, 60) == 4);
+    CHECK(classify(25, 35, 45) == 4);
+    CHECK(classify(9, 35, 45) == -1);
+    CHECK(classify(25, 35, 61) == -1);
+
+    // the first matching range is reported
+    set_range(9, 0, 0, 0, 100, 100, 100);
+    CHECK(classify(25, 35, 45) == 4);
+    CHECK(classify(70, 70, 70) == 9);
+    set_range(1, 0, 0, 0, 100, 100, 100);
+    CHECK(classify(25, 35, 45) == 1);
+
+    // a range is only active once both bounds are set
+    int low[3] = { 0, 0, 0 };
+    processing_set_range(0, false, low);
+    CHECK(classify(250, 250, 250) == -1);
+
+    // changing the color space invalidates all ranges
+    processing_set_color_space(COLOR2CAN_SPACE_HSV);
+    CHECK(classify(25, 35, 45) == -1);
+
+    // HSV: hue in degrees, saturation and value in [0, 1023] and counts
+    set_range(2, 0, 1023, 0, 0, 1023, 1000);
+    CHECK(classify(100, 0, 0) == 2);
+    CHECK(classify(0, 100, 0) == -1);
+    set_range(3, 120, 1023, 0, 120, 1023, 1000);
+    CHECK(classify(0, 100, 0) == 3);
+    set_range(5, 240, 1023, 0, 240, 1023, 1000);
+    CHECK(classify(0, 0, 100) == 5);
+    set_range(6, 0, 0, 50, 0, 0, 50);
+    CHECK(classify(50, 50, 50) == 6);
+
+    test_bench_concurrency();
+}
+
+/* ================================================================== */
+/*                           TCS34725 Model                           */
+/* ================================================================== */
+
+#define CMD                0x80
+#define CMD_AUTO_INCREMENT 0xa0
+
+#define REG_ENABLE 0x00
+#define REG_ATIME  0x01
+#define REG_ID     0x12
+#define REG_STATUS 0x13
+#define REG_CDATAL 0x14
+
+#define ENABLE_PON (1 << 0)
+#define ENABLE_AEN (1 << 1)
+
+#define STATUS_AVALID (1 << 0)
+
+static void write_reg(int reg, uint8_t val) {
+    const uint8_t buf[2] = { CMD | reg, val };
+    CHECK(tcs34725_write(buf, 2) == 0);
+}
+
+static uint8_t read_reg(int reg) {
+    const uint8_t cmd = CMD | reg;
+    uint8_t val = 0;
+    CHECK(tcs34725_writeread(&cmd, 1, &val, 1) == 0);
+    return val;
+}
+
+// Reads the clear, red, green and blue channels
+static void read_data(int data[4]) {
+    const uint8_t cmd = CMD_AUTO_INCREMENT | REG_CDATAL;
+    uint8_t buf[8] = { 0 };
+    CHECK(tcs34725_writeread(&cmd, 1, buf, 8) == 0);
+    for(int i = 0; i < 4; i++)
+        data[i] = buf[2 * i] | buf[2 * i + 1] << 8;
+}
+
+static void test_tcs34725(void) {
+    tcs34725_reset();
+    tcs34725_set_light(300, 200, 100);
+
+    // commands must have the command bit set
+    const uint8_t raw = REG_ID;
+    CHECK(tcs34725_write(&raw, 1) != 0);
+
+    // ID and STATUS are read-only
+    CHECK(read_reg(REG_ID) == 0x44);
+    write_reg(REG_ID, 0);
+    CHECK(read_reg(REG_ID) == 0x44);
+    CHECK(!(read_reg(REG_STATUS) & STATUS_AVALID));
+
+    // one cycle: 2.4ms of initialization, then 2.4ms of integration
+    write_reg(REG_ENABLE, ENABLE_PON | ENABLE_AEN);
+    CHECK(!(read_reg(REG_STATUS) & STATUS_AVALID));
+    hal_sleep_us(6000);
+    CHECK(read_reg(REG_STATUS) & STATUS_AVALID);
+
+    int one[4];
+    read_data(one);
+    CHECK(one[0] == one[1] + one[2] + one[3]);
+    CHECK(one[1] > 0 && one[2] > 0 && one[3] > 0);
+
+    // restarting the integration invalidates the data
+    write_reg(REG_ATIME, 256 - 4);
+    write_reg(REG_ENABLE, ENABLE_PON);
+    write_reg(REG_ENABLE, ENABLE_PON | ENABLE_AEN);
+    CHECK(!(read_reg(REG_STATUS) & STATUS_AVALID));
+    hal_sleep_us(2400 + 3 * 2400);
+    CHECK(!(read_reg(REG_STATUS) & STATUS_AVALID));
+    hal_sleep_us(3000);
+    CHECK(read_reg(REG_STATUS) & STATUS_AVALID);
+
+    // counts are proportional to the number of cycles: the scene varies
+    // by at most 50%, which four cycles always exceed
+    int four[4];
+    read_data(four);
+    CHECK(four[0] == four[1] + four[2] + four[3]);
+    for(int i = 1; i < 4; i++)
+        CHECK(four[i] > one[i]);
+}
+
+/* ================================================================== */
+/*                            CAN Messages                            */
+/* ================================================================== */
+
+#define SENSOR_ID 1
+
+// the host's and the sensor's ends of the bus
+static int bus;
+static int sensor_bus;
+
+// usual default size of a send buffer, in bytes
+#define TX_QUEUE_SIZE 212992
+
+static void send_message(uint32_t id, bool rtr, const void *data, int len) {
+    struct can_frame frame = {
+        .can_id  = id | (rtr ? CAN_RTR_FLAG : 0),
+        .can_dlc = len
+    };
+    memcpy(frame.data, data, len);
+    CHECK(send(bus, &frame, sizeof(frame), 0) == sizeof(frame));
+}
+
+// when the sensor sent the latest message received, in microseconds
+static uint64_t received_time;
+
+// Reads a message from the bus, with the time it was sent
+static int read_message(struct canfd_frame *frame) {
+    struct iovec iov = {
+        .iov_base = frame,
+        .iov_len  = sizeof(*frame)
+    };
+    char control[CMSG_SPACE(sizeof(struct timeval))];
+    struct msghdr msg = {
+        .msg_iov        = &iov,
+        .msg_iovlen     = 1,
+        .msg_control    = control,
+        .msg_controllen = sizeof(control)
+    };
+    if(recvmsg(bus, &msg, MSG_DONTWAIT) <= 0)
+        return 1;
+
+    struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+    if(c && c->cmsg_level == SOL_SOCKET && c->cmsg_type == SO_TIMESTAMP) {
+        struct timeval tv;
+        memcpy(&tv, CMSG_DATA(c), sizeof(tv));
+        received_time = (uint64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+    }
+    return 0;
+}
+
+// Runs the firmware until it sends a message with the given ID, for at
+// most 'timeout' microseconds. Returns 0 if the message was received.
+static int receive_message(uint32_t id, void *data, int len, int timeout) {
+    const uint64_t end = hrtime_us() + timeout;
+    while(hrtime_us() < end) {
+        can_io_run_once();
+
+        struct canfd_frame frame;
+        while(!read_message(&frame)) {
+            if(frame.can_id != id)
+                continue;
+
+            CHECK(frame.len == len);
+            memcpy(data, frame.data, len);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void configure(int color_space) {
+    const struct color2can_config config = {
+        .color_space = color_space,
+        .use_led     = COLOR2CAN_LED_NEVER
+    };
+    send_message(
+        COLOR2CAN_CONFIG_MASK_ID | SENSOR_ID, false,
+        &config, COLOR2CAN_CONFIG_SIZE
+    );
+}
+
+static void send_range(int id, bool high, int c0, int c1, int c2) {
+    const struct color2can_range range = {
+        .color    = { c0, c1, c2 },
+        .range_id = id,
+        .high     = high
+    };
+    send_message(
+        COLOR2CAN_RANGE_MASK_ID | SENSOR_ID, false,
+        &range, COLOR2CAN_RANGE_SIZE
+    );
+}
+
+// Requests a sample with an RTR message. Returns 0 if it was received.
+static int request_sample(struct color2can_sample *sample) {
+    send_message(COLOR2CAN_SAMPLE_MASK_ID | SENSOR_ID, true, NULL, 0);
+    return receive_message(
+        COLOR2CAN_SAMPLE_MASK_ID | SENSOR_ID,
+        sample, COLOR2CAN_SAMPLE_SIZE, 100000
+    );
+}
+
+// Runs the firmware without reading the bus: its TX queue may fill up
+static void run_without_reading(int time) {
+    const uint64_t end = hrtime_us() + time;
+    while(hrtime_us() < end)
+        can_io_run_once();
+}
+
+// Sets the size of the sensor's TX queue: 0 is the smallest send buffer,
+// which only holds a few frames
+static void set_tx_queue_size(int size) {
+    setsockopt(sensor_bus, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+}
+
+// 'spacing' is in units of 100us
+static void request_burst(int count, int spacing) {
+    const struct color2can_request request = {
+        .count   = count,
+        .spacing = spacing
+    };
+    send_message(
+        COLOR2CAN_SAMPLE_MASK_ID | SENSOR_ID, false,
+        &request, COLOR2CAN_REQUEST_SIZE
+    );
+}
+
+#ifdef CONFIG_CAN_FD
+static void configure_batches(int transmit_frequency, int batch_size) {
+    const struct color2can_config config = {
+        .transmit_frequency = transmit_frequency,
+        .color_space        = COLOR2CAN_SPACE_RGB,
+        .use_led            = COLOR2CAN_LED_NEVER,
+        .batch_size         = batch_size
+    };
+    send_message(
+        COLOR2CAN_CONFIG_MASK_ID | SENSOR_ID, false,
+        &config, COLOR2CAN_CONFIG_SIZE
+    );
+}
+
+// Receives batches of 'size' samples, until 'count' samples are received
+// or none arrive for 'timeout' microseconds. Returns the samples received,
+// or -1 if a sequence number was skipped.
+static int receive_batches(int size, int count, uint8_t *sequence,
+                           int timeout) {
+    struct color2can_sample_batch batch;
+    int received = 0;
+    while(received < count &&
+          !receive_message(COLOR2CAN_SAMPLE_MASK_ID | SENSOR_ID, &batch,
+                           COLOR2CAN_SAMPLE_BATCH_SIZE(size), timeout)) {
+        CHECK(batch.count == size);
+        if(batch.sequence != *sequence)
+            return -1;
+        (*sequence)++;
+        received += batch.count;
+    }
+    return received;
+}
+
+static void test_batches(void) {
+    // on demand, the last batch is sent once all requests are answered
+    configure_batches(0, 2);
+    request_burst(5, 0);
+
+    uint8_t sequence = 0;
+    CHECK(receive_batches(2, 4, &sequence, 100000) == 4);
+    CHECK(receive_batches(1, 1, &sequence, 100000) == 1);
+
+    // a config message sends the samples taken with the old one
+    configure_batches(100, 7);
+    run_without_reading(25000);
+    configure_batches(0, 0);
+
+    struct color2can_sample_batch batch;
+    CHECK(receive_message(
+        COLOR2CAN_SAMPLE_MASK_ID | SENSOR_ID, &batch,
+        COLOR2CAN_SAMPLE_BATCH_SIZE(3), 100000
+    ) == 0);
+    CHECK(batch.count == 3 && batch.sequence == sequence);
+    sequence++;
+
+    // batches that do not fit in the TX queue are sent later, in order
+    set_tx_queue_size(0);
+    status_counters.samples_sent = 0;
+
+    configure_batches(0, 2);
+    request_burst(40, 0);
+    run_without_reading(300000);
+    CHECK(status_counters.samples_sent < 40);
+    CHECK(receive_batches(2, 40, &sequence, 100000) == 40);
+    CHECK(status_counters.samples_sent == 40);
+    set_tx_queue_size(TX_QUEUE_SIZE);
+}
+#endif
+
+// the host's clock: 100ppm faster than the sensor's, with an offset
+static uint64_t host_clock(uint64_t local_time) {
+    return 123456789 + local_time + local_time / 10000;
+}
+
+static void send_time(int sequence, bool follow_up, uint64_t time) {
+    const struct color2can_time msg = {
+        .sequence  = sequence,
+        .follow_up = follow_up,
+        .time      = time
+    };
+    send_message(
+        COLOR2CAN_TIME_MASK_ID, false, &msg, COLOR2CAN_TIME_SIZE
+    );
+}
+
+static void test_timesync(void) {
+    // Each SYNC message waits in the socket, behind a status request,
+    // before the firmware reads it: only the frame's own timestamp tells
+    // when it arrived.
+    for(int i = 0; i < 5; i++) {
+        send_message(COLOR2CAN_STATUS_MASK_ID | SENSOR_ID, true, NULL, 0);
+
+        const uint64_t sync_time = hrtime_us();
+        send_time(i, false, 0);
+        hal_sleep_us(2000);
+        send_time(i, true, host_clock(sync_time));
+
+        run_without_reading(100000);
+    }
+
+    const uint64_t now = hrtime_us();
+    uint64_t host_time;
+    CHECK(timesync_to_host_time(now, &host_time) == 0);
+
+    const int64_t error = host_time - (host_clock(now) & 0xffffffffffff);
+    CHECK(error > -100 && error < 100);
+
+    // discard the status replies
+    struct canfd_frame frame;
+    while(!read_message(&frame))
+        ;
+}
+
+static void test_bitrate(void) {
+    // fill the TX queue with status messages
+    set_tx_queue_size(0);
+    send_message(COLOR2CAN_STATUS_MASK_ID | SENSOR_ID, true, NULL, 0);
+    run_without_reading(20000);
+
+    const struct color2can_bitrate request = {
+        .bitrate  = 500000,
+        .delay    = 10,
+        .sequence = 42,
+        .status   = COLOR2CAN_BITRATE_REQUEST
+    };
+    send_message(
+        COLOR2CAN_BITRATE_MASK_ID, false,
+        &request, COLOR2CAN_BITRATE_SIZE
+    );
+
+    // the sensor does not switch before its reply is sent
+    run_without_reading(50000);
+    CHECK(hal_can_get_bitrate() == 250000);
+
+    struct color2can_bitrate reply;
+    CHECK(receive_message(
+        COLOR2CAN_BITRATE_MASK_ID | SENSOR_ID,
+        &reply, COLOR2CAN_BITRATE_SIZE, 100000
+    ) == 0);
+    CHECK(reply.sequence == 42);
+    CHECK(reply.status == COLOR2CAN_BITRATE_ACCEPTED);
+
+    run_without_reading(10000);
+    CHECK(hal_can_get_bitrate() == 500000);
+
+    // confirm the new bit rate, and discard the status messages
+    configure(COLOR2CAN_SPACE_RGB);
+    set_tx_queue_size(TX_QUEUE_SIZE);
+    receive_message(0, NULL, 0, 50000);
+}
+
+// The console only requests the reset: the stages are cleared by the
+// CAN thread, the only one that updates them
+static void test_profile(void) {
+    CHECK(profile_stages[PROFILE_HANDLE_MESSAGE].count > 0);
+
+    profile_reset();
+    CHECK(profile_stages[PROFILE_HANDLE_MESSAGE].count > 0);
+
+    can_io_run_once();
+    for(int i = 0; i < PROFILE_STAGES; i++)
+        CHECK(profile_stages[i].count == 0);
+}
+
+static void test_can(void) {
+    int fds[2];
+    CHECK(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds) == 0);
+    bus        = fds[0];
+    sensor_bus = fds[1];
+
+    // frames are timestamped when they are sent
+    const int enable = 1;
+    setsockopt(bus, SOL_SOCKET, SO_TIMESTAMP, &enable, sizeof(enable));
+    setsockopt(sensor_bus, SOL_SOCKET, SO_TIMESTAMP,
+               &enable, sizeof(enable));
+    hal_linux_set_can_socket(sensor_bus);
+
+    CHECK(color_init() == 0);
+    CHECK(can_io_init() == 0);
+    CHECK(can_io_set_sensor_id(SENSOR_ID) == 0);
+
+    struct color2can_sample sample;
+    configure(COLOR2CAN_SPACE_RGB);
+    CHECK(request_sample(&sample) == 0);
+    CHECK(sample.color[0] > 0 && sample.color[1] > 0 && sample.color[2] > 0);
+    CHECK(!sample.within_range);
+
+    // range 2 never matches, range 7 matches all colors
+    send_range(2, false, 1, 1, 1);
+    send_range(2, true,  0, 0, 0);
+    send_range(7, false, 0, 0, 0);
+    send_range(7, true,  65535, 65535, 65535);
+    CHECK(request_sample(&sample) == 0);
+    CHECK(sample.within_range && sample.range_id == 7);
+
+    // updating one bound: the first matching range is reported
+    send_range(2, true, 65535, 65535, 65535);
+    CHECK(request_sample(&sample) == 0);
+    CHECK(sample.within_range && sample.range_id == 2);
+
+    // a config message invalidates the ranges
+    configure(COLOR2CAN_SPACE_RGB);
+    CHECK(request_sample(&sample) == 0);
+    CHECK(!sample.within_range);
+
+    // requests addressed to other sensors are not answered
+    send_message(COLOR2CAN_SAMPLE_MASK_ID | (SENSOR_ID + 1), true, NULL, 0);
+    CHECK(receive_message(
+        COLOR2CAN_SAMPLE_MASK_ID | SENSOR_ID,
+        &sample, COLOR2CAN_SAMPLE_SIZE, 50000
+    ) != 0);
+
+    // a burst request is answered with 'count' samples
+    request_burst(3, 0);
+    int received = 0;
+    while(!receive_message(COLOR2CAN_SAMPLE_MASK_ID | SENSOR_ID,
+                           &sample, COLOR2CAN_SAMPLE_SIZE, 50000))
+        received++;
+    CHECK(received == 3);
+
+    // the spacing only applies within a burst: 40ms, not between bursts
+    request_burst(2, 400);
+    request_burst(2, 400);
+    uint64_t times[4];
+    for(int i = 0; i < 4; i++) {
+        CHECK(receive_message(
+            COLOR2CAN_SAMPLE_MASK_ID | SENSOR_ID,
+            &sample, COLOR2CAN_SAMPLE_SIZE, 100000
+        ) == 0);
+        times[i] = received_time;
+    }
+    CHECK(times[1] - times[0] >= 40000);
+    CHECK(times[2] - times[1] <  20000);
+    CHECK(times[3] - times[2] >= 40000);
+
+    // bursts that do not fit in the request queue are counted, then the
+    // config message drops the others
+    status_counters.requests_dropped = 0;
+    for(int i = 0; i < 18; i++)
+        request_burst(1, 10);
+    can_io_run_once();
+    CHECK(status_counters.requests_dropped == 2);
+
+    configure(COLOR2CAN_SPACE_RGB);
+    can_io_run_once();
+    CHECK(status_counters.requests_dropped == 2 + 15);
+    while(!receive_message(COLOR2CAN_SAMPLE_MASK_ID | SENSOR_ID,
+                           &sample, COLOR2CAN_SAMPLE_SIZE, 10000))
+        ;
+
+    // 400 Hz at the shortest integration time: periodic samples are read
+    // from consecutive cycles, without restarting the integration
+    const struct color2can_config fast = {
+        .transmit_frequency = 400,
+        .color_space        = COLOR2CAN_SPACE_RGB,
+        .use_led            = COLOR2CAN_LED_NEVER
+    };
+    send_message(
+        COLOR2CAN_CONFIG_MASK_ID | SENSOR_ID, false,
+        &fast, COLOR2CAN_CONFIG_SIZE
+    );
+    CHECK(receive_message(
+        COLOR2CAN_SAMPLE_MASK_ID | SENSOR_ID,
+        &sample, COLOR2CAN_SAMPLE_SIZE, 50000
+    ) == 0);
+
+    // each cycle has different colors in the sensor model
+    struct color2can_sample previous = sample;
+    int duplicates = 0;
+    received = 0;
+    const uint64_t end = hrtime_us() + 250000;
+    while(!receive_message(COLOR2CAN_SAMPLE_MASK_ID | SENSOR_ID,
+                           &sample, COLOR2CAN_SAMPLE_SIZE, 50000)) {
+        received++;
+        if(!memcmp(&sample, &previous, sizeof(sample)))
+            duplicates++;
+        previous = sample;
+
+        if(hrtime_us() >= end)
+            break;
+    }
+    CHECK(received >= 80 && received <= 102);
+    CHECK(duplicates == 0);
+
+    // stop periodic samples
+    configure(COLOR2CAN_SPACE_RGB);
+
+#ifdef CONFIG_CAN_FD
+    test_batches();
+#endif
+    test_timesync();
+    test_bitrate();
+    test_profile();
+
+    close(fds[0]);
+    close(fds[1]);
+}
+
+int main(int argc, char *argv[]) {
+    hrtime_init();
+    log_init();
+
+    test_ranges();
+    test_tcs34725();
+    test_can();
+
+    // let the log thread print the pending records
+    hal_sleep_us(100000);
+
+    if(failures > 0) {
+        printf("[Tests] %d check(s) FAILED\n", failures);
+        return 1;
+    }
+    puts("[Tests] all checks passed");
+    return 0;
+}
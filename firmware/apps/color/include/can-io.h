@@ -17,7 +17,22 @@
 
 #include "main.h"
 
+// Opens the CAN device and starts the CAN-IO thread
 extern int can_io_start(void);
 
+// Only open the CAN device: can_io_run_once must then be called in a
+// loop. Used to drive the application from a simulation.
+extern int can_io_init(void);
+extern void can_io_run_once(void);
+
 extern int can_io_set_sensor_id(int id);
 extern int can_io_set_transmit_frequency(int val);
+extern int can_io_set_transmit_period(int val);
+extern int can_io_set_sample_info(int val);
+
+extern void can_io_print_latency(void);
+extern void can_io_reset_latency(void);
+
+#ifdef CONFIG_CAN_FD
+extern int can_io_set_batch_size(int val);
+#endif
@@ -20,5 +20,22 @@
 extern int color_init(void);
 
 extern int color_read_data(int *r, int *g, int *b, int *clear);
+extern int color_restart_integration(void);
 
 extern int color_set_led_usage(int val);
+extern int color_set_integration_time(int cycles);
+
+// In continuous mode, consecutive reads return consecutive integration
+// cycles, as periodic samples need. Otherwise, each read returns a cycle
+// that started after the previous read.
+extern void color_set_continuous(bool enable);
+
+// minimum time between two reads in continuous mode, in microseconds
+extern int color_get_read_period(void);
+
+// time from color_restart_integration to the end of the following read,
+// in microseconds
+extern int color_get_restart_period(void);
+
+// Returns the cycles per I2C read of the status and color registers
+extern uint32_t color_bench_i2c(int iterations);
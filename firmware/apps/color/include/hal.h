@@ -0,0 +1,116 @@
+/* Copyright 2025 Vulcalien
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include "main.h"
+
+// Hardware abstraction layer: the application only reaches the hardware
+// through these functions. src/hal-nuttx.c implements them on the board,
+// host/hal-linux.c on Linux (SocketCAN and a simulated sensor).
+
+/* ================================================================== */
+/*                                Time                                */
+/* ================================================================== */
+
+// frequency of the cycle counter
+#define HAL_CYCLES_PER_US 80
+
+extern int hal_time_init(void);
+
+#ifdef __NuttX__
+// Cortex-M4 cycle counter: read inline, since it is used for profiling
+#define DWT_CYCCNT (*(volatile uint32_t *) 0xe0001004)
+
+static inline uint32_t hal_time_cycles(void) {
+    return DWT_CYCCNT;
+}
+#else
+extern uint32_t hal_time_cycles(void);
+#endif
+
+extern void hal_sleep_us(int us);
+
+// Prevents other threads and interrupt handlers from running
+extern uint32_t hal_critical_enter(void);
+extern void hal_critical_leave(uint32_t flags);
+
+// Prevents other threads from running
+extern void hal_sched_lock(void);
+extern void hal_sched_unlock(void);
+
+/* ================================================================== */
+/*                                LEDs                                */
+/* ================================================================== */
+
+#define HAL_LED_RED   0
+#define HAL_LED_GREEN 1
+
+extern void hal_led_set(int led, bool on);
+
+/* ================================================================== */
+/*                                I2C                                 */
+/* ================================================================== */
+
+extern int hal_i2c_init(int address, int frequency);
+
+// Drives the reset line of the I2C bus
+extern void hal_i2c_set_reset(bool on);
+
+// Both return 0 on success, 1 on error
+extern int hal_i2c_write(const uint8_t *buf, int len);
+extern int hal_i2c_writeread(const uint8_t *cmd, int cmdlen,
+                             uint8_t *buf, int len);
+
+/* ================================================================== */
+/*                                CAN                                 */
+/* ================================================================== */
+
+#define HAL_CAN_MAX_DATALEN 64
+
+struct hal_can_msg {
+    uint32_t id;
+    uint8_t len; // in bytes, up to 8 (or 64 for CAN FD)
+    bool rtr;
+
+    // reception time (hrtime clock, in microseconds), if known
+    bool time_valid;
+    uint64_t time;
+
+    uint8_t data[HAL_CAN_MAX_DATALEN];
+};
+
+extern int hal_can_open(void);
+
+// Returns 1 if a message was read, 0 if there are none, -1 on error
+extern int hal_can_read(struct hal_can_msg *msg);
+
+// Messages longer than 8 bytes are sent as CAN FD frames, padded to the
+// next valid length. Returns 0 on success, 1 if the TX queue is full (the
+// message can be sent again later), -1 on error.
+extern int hal_can_write(const struct hal_can_msg *msg);
+
+// Waits until a message can be read, the TX queue has room (only if
+// 'writable' is set) or the timeout (in microseconds) expires. Returns 1
+// if a message arrived during the wait, 0 otherwise (also if messages
+// were already waiting).
+extern int hal_can_wait(int timeout, bool writable);
+
+// Returns the bit rate, or -1 if it is not known
+extern int hal_can_get_bitrate(void);
+
+// Returns 0 if the bit rate can be set
+extern int hal_can_check_bitrate(int bitrate);
+extern int hal_can_set_bitrate(int bitrate);
@@ -0,0 +1,30 @@
+/* Copyright 2025 Vulcalien
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include "main.h"
+
+#include "hal.h"
+
+extern int hrtime_init(void);
+
+static inline uint32_t hrtime_cyccnt(void) {
+    return hal_time_cycles();
+}
+
+// Must be called at least once every 53 seconds (2^32 cycles at 80MHz)
+extern uint64_t hrtime_cycles(void);
+extern uint64_t hrtime_us(void);
@@ -0,0 +1,101 @@
+/* Copyright 2025 Vulcalien
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include "main.h"
+
+// Messages are stored as binary records in a ring buffer and formatted
+// later by a low-priority thread, so that logging does not stall the
+// sample pipeline. Arguments are integers only.
+//
+// This table is shared with the host decoder (demo/log-decode): only
+// append new formats, so that old dumps can still be decoded.
+#define LOG_FORMATS(X)\
+    X(LOG_CONFIGURING,      "=== Configuring ===")\
+    X(LOG_MALFORMED,        "[CAN-IO] malformed message 0x%x "\
+                            "(size=%d, expected=%d)")\
+    X(LOG_MALFORMED_CONFIG, "[CAN-IO] malformed config message "\
+                            "(size=%d, expected=%d or %d)")\
+    X(LOG_RX_ERROR,         "[CAN-IO] error reading from CAN device")\
+    X(LOG_TX_ERROR,         "[CAN-IO] error writing to CAN device")\
+    X(LOG_SENSOR_ID,        "[CAN-IO] setting sensor ID to %d (err=%d)")\
+    X(LOG_TRANSMIT_FREQ,    "[CAN-IO] setting transmit frequency to %d "\
+                            "(err=%d)")\
+    X(LOG_TRANSMIT_PERIOD,  "[CAN-IO] setting transmit period to %d us "\
+                            "(min=%d, err=%d)")\
+    X(LOG_SAMPLE_INFO,      "[CAN-IO] setting sample info to %d (err=0)")\
+    X(LOG_BATCH_SIZE,       "[CAN-IO] setting batch size to %d (err=%d)")\
+    X(LOG_BITRATE_REQUEST,  "[CAN-IO] bit rate %d requested in %d ms "\
+                            "(err=%d)")\
+    X(LOG_BITRATE_CONFIRM,  "[CAN-IO] bit rate %d confirmed")\
+    X(LOG_BITRATE_SWITCH,   "[CAN-IO] switched bit rate to %d")\
+    X(LOG_BITRATE_RESTORE,  "[CAN-IO] bus is silent: restored bit rate %d")\
+    X(LOG_COLOR_READ,       "[Color] read R:%d, G:%d, B:%d - C:%d")\
+    X(LOG_LED_USAGE,        "[Color] setting LED usage to %d (err=%d)")\
+    X(LOG_INTEGRATION,      "[Color] setting integration time to %d us "\
+                            "(err=%d)")\
+    X(LOG_IN_RANGE,         "[Processing] color is in range %d")\
+    X(LOG_COLOR_SPACE,      "[Processing] set color space to %d (err=%d)")\
+    X(LOG_RANGE_LOW,        "[Processing] setting range %d low  "\
+                            "(%d, %d, %d)")\
+    X(LOG_RANGE_HIGH,       "[Processing] setting range %d high "\
+                            "(%d, %d, %d)")\
+    X(LOG_PERIOD_RAISED,    "[CAN-IO] transmit period raised to %d us "\
+                            "for bit rate %d")\
+    X(LOG_LATENCY_RESET,    "[CAN-IO] latency histogram reset")\
+    X(LOG_BITRATE_ERROR,    "[CAN-IO] error setting bit rate %d")\
+    X(LOG_REQUESTS_DROPPED, "[CAN-IO] request queue full: %d requests "\
+                            "dropped")
+
+#define LOG_ENUM(id, format) id,
+enum log_format {
+    LOG_FORMATS(LOG_ENUM)
+    LOG_FORMAT_COUNT
+};
+#undef LOG_ENUM
+
+#define LOG_MAX_ARGS 6
+
+struct log_record {
+    uint32_t time; // in microseconds, lower 32 bits
+    uint16_t format;
+    uint8_t  argc;
+    uint8_t  reserved;
+    int32_t  args[LOG_MAX_ARGS];
+};
+#define LOG_RECORD_SIZE 32
+
+// Prefix of the lines printed in binary mode, followed by the record
+// encoded as hexadecimal
+#define LOG_BINARY_PREFIX "#L "
+
+extern int log_init(void);
+
+// Safe to call from any thread. If the buffer is full, the record is
+// dropped and counted.
+extern void log_write(int format, int argc, const int32_t *args);
+
+// Print records as text (false) or as binary dumps (true)
+extern void log_set_binary(bool binary);
+extern bool log_get_binary(void);
+
+#define LOG(format, ...) do {\
+    const int32_t log_args_[] = { 0, ##__VA_ARGS__ };\
+    log_write(\
+        format, sizeof(log_args_) / sizeof(log_args_[0]) - 1,\
+        &log_args_[1]\
+    );\
+} while(0)
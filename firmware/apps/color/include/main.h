@@ -19,8 +19,4 @@
 #include <stdbool.h>
 #include <stdint.h>
 
-#define BOARD_RED_LED   0
-#define BOARD_GREEN_LED 1
-extern void board_userled(int led, bool ledon);
-
 extern bool debug_flag;
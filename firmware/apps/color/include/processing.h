@@ -17,8 +17,19 @@
 
 #include "main.h"
 
-extern int processing_get_data(int color[3], int *clear,
-                               bool *within_range, int *range_id);
+#define RANGES_COUNT 16
+
+// Process a color already read from the sensor
+extern int processing_process_data(int r, int g, int b, int c,
+                                   int color[3], int *clear,
+                                   bool *within_range, int *range_id);
 
 extern int processing_set_color_space(int color_space);
 extern int processing_set_range(int id, bool high, int color[3]);
+
+// Returns the cycles per call of processing_process_data, using the given
+// color space and number of active ranges (none of them matching). The
+// benchmark uses a configuration of its own: the current one is neither
+// read nor changed.
+extern uint32_t processing_bench(int color_space, int active_ranges,
+                                 int iterations);
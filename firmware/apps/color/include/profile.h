@@ -0,0 +1,66 @@
+/* Copyright 2025 Vulcalien
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include "main.h"
+
+#define PROFILE_COLOR_READ     0
+#define PROFILE_CONVERT        1
+#define PROFILE_RANGE_SCAN     2
+#define PROFILE_HANDLE_MESSAGE 3
+#define PROFILE_WRITE_SAMPLE   4
+#define PROFILE_STAGES 5
+
+#ifdef CONFIG_CUSTOM_COLOR_PROFILE
+
+#include "hrtime.h"
+
+struct profile_stage {
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint64_t total;
+};
+
+extern struct profile_stage profile_stages[PROFILE_STAGES];
+
+static inline void profile_record(int stage, uint32_t cycles) {
+    struct profile_stage *s = &profile_stages[stage];
+    if(s->count == 0 || cycles < s->min)
+        s->min = cycles;
+    if(cycles > s->max)
+        s->max = cycles;
+    s->total += cycles;
+    s->count++;
+}
+
+#define PROFILE_BEGIN(stage)\
+    const uint32_t profile_start_##stage = hrtime_cyccnt()
+#define PROFILE_END(stage)\
+    profile_record(stage, hrtime_cyccnt() - profile_start_##stage)
+
+#else
+
+#define PROFILE_BEGIN(stage)
+#define PROFILE_END(stage)
+
+#endif
+
+extern void profile_print(void);
+extern void profile_reset(void);
+
+// Called by the CAN thread: clears the stages if a reset was requested
+extern void profile_apply_reset(void);
@@ -0,0 +1,39 @@
+/* Copyright 2025 Vulcalien
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include "main.h"
+
+// Diagnostic counters: each one is only written by a single thread
+struct status_counters {
+    uint32_t samples_produced;
+    uint32_t samples_sent;
+    uint32_t invalid_data;
+    uint32_t i2c_errors;
+    uint32_t tx_errors;
+    uint32_t rx_errors;
+    uint32_t rx_filtered;
+    uint32_t requests_dropped;
+    uint32_t loop_max_latency; // in microseconds
+};
+
+extern struct status_counters status_counters;
+
+// Returns the value of a COLOR2CAN_STATUS_* counter
+extern uint32_t status_get(int counter);
+
+extern void status_print(void);
+extern void status_reset_latency(void);
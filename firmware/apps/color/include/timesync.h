@@ -0,0 +1,26 @@
+/* Copyright 2025 Vulcalien
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include "main.h"
+
+struct color2can_time;
+
+extern void timesync_handle_message(const struct color2can_time *msg,
+                                    uint64_t rx_time, bool rx_time_valid);
+
+// Convert a local time (see hrtime_us) to the host's time domain.
+extern int timesync_to_host_time(uint64_t local_time, uint64_t *host_time);
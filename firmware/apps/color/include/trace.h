@@ -0,0 +1,53 @@
+/* Copyright 2025 Vulcalien
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include "main.h"
+
+#include "color2can.h"
+
+#ifdef CONFIG_CUSTOM_COLOR_TRACE
+
+extern void trace_record(int event, int phase, int arg);
+
+#define TRACE_BEGIN(event, arg)\
+    trace_record(event, COLOR2CAN_TRACE_PHASE_BEGIN, arg)
+#define TRACE_END(event, arg)\
+    trace_record(event, COLOR2CAN_TRACE_PHASE_END, arg)
+#define TRACE_INSTANT(event, arg)\
+    trace_record(event, COLOR2CAN_TRACE_PHASE_INSTANT, arg)
+
+#else
+
+#define TRACE_BEGIN(event, arg)   do {} while(0)
+#define TRACE_END(event, arg)     do {} while(0)
+#define TRACE_INSTANT(event, arg) do {} while(0)
+
+#endif
+
+// Stops recording and returns the number of recorded events. Calls can
+// be nested (e.g. by the console and the CAN thread): recording resumes,
+// and the buffer is cleared, when every reader has called
+// trace_read_end.
+extern int trace_read_begin(void);
+extern void trace_read_end(void);
+
+// Reads the i-th oldest recorded event, between trace_read_begin and
+// trace_read_end
+extern void trace_get(int i, struct color2can_trace *event);
+
+// Prints the recorded events, then clears the buffer
+extern void trace_print(void);
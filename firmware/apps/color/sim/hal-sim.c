@@ -0,0 +1,243 @@
+/* Copyright 2025 Vulcalien
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "hal.h"
+#include "sim.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "tcs34725.h"
+
+static uint64_t now; // in microseconds
+
+// Move the clock forward to 'time', running the script's events
+static void advance(uint64_t time) {
+    while(script_next_time() <= time) {
+        const uint64_t t = script_next_time();
+        if(t > now)
+            now = t;
+        script_run_next();
+    }
+    if(time > now)
+        now = time;
+}
+
+uint64_t sim_time(void) {
+    return now;
+}
+
+/* ================================================================== */
+/*                                Time                                */
+/* ================================================================== */
+
+static pthread_mutex_t critical_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+int hal_time_init(void) {
+    return 0;
+}
+
+uint32_t hal_time_cycles(void) {
+    return now * HAL_CYCLES_PER_US;
+}
+
+void hal_sleep_us(int us) {
+    advance(now + us);
+}
+
+// the log thread also takes timestamps
+uint32_t hal_critical_enter(void) {
+    pthread_mutex_lock(&critical_mutex);
+    return 0;
+}
+
+void hal_critical_leave(uint32_t flags) {
+    pthread_mutex_unlock(&critical_mutex);
+}
+
+void hal_sched_lock(void) {
+}
+
+void hal_sched_unlock(void) {
+}
+
+/* ================================================================== */
+/*                                LEDs                                */
+/* ================================================================== */
+
+void hal_led_set(int led, bool on) {
+}
+
+/* ================================================================== */
+/*                                I2C                                 */
+/* ================================================================== */
+
+#define I2C_FREQUENCY 400000
+
+// time of a transfer: start, address and 9 bits per byte
+static void i2c_transfer(int bytes) {
+    advance(now + (10 + 9 * (1 + bytes)) * 1000000 / I2C_FREQUENCY);
+}
+
+int hal_i2c_init(int address, int frequency) {
+    return (address != 0x29);
+}
+
+void hal_i2c_set_reset(bool on) {
+    if(on)
+        tcs34725_reset();
+}
+
+int hal_i2c_write(const uint8_t *buf, int len) {
+    i2c_transfer(len);
+    return tcs34725_write(buf, len);
+}
+
+int hal_i2c_writeread(const uint8_t *cmd, int cmdlen,
+                      uint8_t *buf, int len) {
+    i2c_transfer(cmdlen);
+    i2c_transfer(len);
+    return tcs34725_writeread(cmd, cmdlen, buf, len);
+}
+
+/* ================================================================== */
+/*                                CAN                                 */
+/* ================================================================== */
+
+// as in the board's configuration: CONFIG_CAN_RXFIFOSIZE, and
+// CONFIG_CAN_TXFIFOSIZE plus the 3 transmit mailboxes
+#define RX_FIFO_MAX  1024
+#define RX_FIFO_SIZE 255
+#define TX_FIFO_SIZE (8 + 3)
+
+static struct {
+    struct hal_can_msg msgs[RX_FIFO_MAX];
+    int size;
+    int head;
+    int count;
+    uint32_t overflows;
+} rx_fifo = { .size = RX_FIFO_SIZE };
+
+// completion times of the messages being transmitted
+static uint64_t tx_done[TX_FIFO_SIZE];
+static uint64_t bus_free_time;
+
+static int bitrate = 250000;
+
+void sim_set_rx_fifo_size(int size) {
+    if(size < 1)
+        size = 1;
+    if(size > RX_FIFO_MAX)
+        size = RX_FIFO_MAX;
+    rx_fifo.size = size;
+}
+
+void sim_receive(const struct hal_can_msg *msg) {
+    if(rx_fifo.count == rx_fifo.size) {
+        rx_fifo.overflows++;
+        return;
+    }
+
+    const int i = (rx_fifo.head + rx_fifo.count) % rx_fifo.size;
+    rx_fifo.msgs[i] = *msg;
+    rx_fifo.msgs[i].time_valid = true;
+    rx_fifo.msgs[i].time       = now;
+    rx_fifo.count++;
+
+    stats_receive(msg);
+}
+
+uint32_t sim_rx_overflows(void) {
+    return rx_fifo.overflows;
+}
+
+int hal_can_open(void) {
+    return 0;
+}
+
+int hal_can_read(struct hal_can_msg *msg) {
+    if(rx_fifo.count == 0)
+        return 0;
+
+    *msg = rx_fifo.msgs[rx_fifo.head];
+    rx_fifo.head = (rx_fifo.head + 1) % rx_fifo.size;
+    rx_fifo.count--;
+    return 1;
+}
+
+// Time (in microseconds) of a classic data frame, including worst-case
+// stuff bits and the interframe space.
+static uint64_t frame_time(int len) {
+    const int stuffed = 34 + 8 * len; // SOF...CRC
+    const int bits = stuffed + (stuffed - 1) / 4
+                   + 13; // CRC delimiter, ACK, EOF, IFS
+    return (uint64_t) bits * 1000000 / bitrate;
+}
+
+int hal_can_write(const struct hal_can_msg *msg) {
+    // find a free mailbox
+    int mailbox = -1;
+    for(int i = 0; i < TX_FIFO_SIZE; i++)
+        if(tx_done[i] <= now)
+            mailbox = i;
+    if(mailbox < 0)
+        return 1; // TX queue full
+
+    // messages are sent one after the other
+    const uint64_t start = (bus_free_time > now ? bus_free_time : now);
+    bus_free_time = start + frame_time(msg->len);
+    tx_done[mailbox] = bus_free_time;
+
+    stats_transmit(msg, bus_free_time);
+    return 0;
+}
+
+int hal_can_wait(int timeout, bool writable) {
+    // if messages arrived while busy, their reception time is unknown
+    if(rx_fifo.count > 0)
+        return 0;
+
+    uint64_t deadline = now + timeout;
+
+    // the TX queue has room as soon as a mailbox is done
+    if(writable)
+        for(int i = 0; i < TX_FIFO_SIZE; i++)
+            if(tx_done[i] < deadline)
+                deadline = (tx_done[i] > now ? tx_done[i] : now);
+    while(script_next_time() <= deadline) {
+        advance(script_next_time());
+        if(rx_fifo.count > 0)
+            return 1;
+    }
+    advance(deadline);
+    return 0;
+}
+
+int hal_can_get_bitrate(void) {
+    return bitrate;
+}
+
+int hal_can_check_bitrate(int val) {
+    return (val <= 0 || val > 1000000);
+}
+
+int hal_can_set_bitrate(int val) {
+    if(hal_can_check_bitrate(val))
+        return 1;
+
+    bitrate = val;
+    return 0;
+}
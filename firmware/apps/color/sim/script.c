@@ -0,0 +1,186 @@
+/* Copyright 2025 Vulcalien
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "sim.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tcs34725.h"
+
+#define EVENT_SEND  0
+#define EVENT_LIGHT 1
+#define EVENT_END   2
+
+static struct event {
+    int type;
+    uint64_t time;
+    uint64_t period; // 0=not periodic
+
+    struct hal_can_msg msg;
+    int light[3];
+} *events;
+static int event_count;
+
+static uint64_t end_time = UINT64_MAX;
+
+// Parses a time: microseconds, or followed by 'us', 'ms' or 's'
+static int parse_time(const char *str, uint64_t *time) {
+    char *end;
+    const double val = strtod(str, &end);
+    if(end == str || val < 0)
+        return 1;
+
+    double unit = 1;
+    if(!strcmp(end, "s"))
+        unit = 1000000;
+    else if(!strcmp(end, "ms"))
+        unit = 1000;
+    else if(strcmp(end, "us") && strcmp(end, ""))
+        return 1;
+
+    *time = val * unit + 0.5;
+    return 0;
+}
+
+// Parses '<id> [R | <byte>...]'
+static int parse_msg(char *args, struct hal_can_msg *msg) {
+    *msg = (struct hal_can_msg) { 0 };
+
+    char *tok = strtok(args, " \t\n");
+    if(!tok || sscanf(tok, "%x", &msg->id) != 1)
+        return 1;
+
+    while((tok = strtok(NULL, " \t\n"))) {
+        if(!strcmp(tok, "R")) {
+            msg->rtr = true;
+            continue;
+        }
+
+        unsigned int byte;
+        if(msg->len == 8 || sscanf(tok, "%x", &byte) != 1 || byte > 0xff)
+            return 1;
+        msg->data[msg->len++] = byte;
+    }
+    return 0;
+}
+
+static int parse_line(char *line, struct event *e) {
+    char time[32], type[16];
+    int offset;
+    if(sscanf(line, "%31s %15s %n", time, type, &offset) != 2)
+        return 1;
+    if(parse_time(time, &e->time))
+        return 1;
+
+    char *args = line + offset;
+    if(!strcmp(type, "send")) {
+        e->type = EVENT_SEND;
+        return parse_msg(args, &e->msg);
+    } else if(!strcmp(type, "every")) {
+        char period[32];
+        if(sscanf(args, "%31s %n", period, &offset) != 1)
+            return 1;
+        if(parse_time(period, &e->period) || e->period == 0)
+            return 1;
+
+        e->type = EVENT_SEND;
+        return parse_msg(args + offset, &e->msg);
+    } else if(!strcmp(type, "light")) {
+        e->type = EVENT_LIGHT;
+        return sscanf(
+            args, "%d %d %d", &e->light[0], &e->light[1], &e->light[2]
+        ) != 3;
+    } else if(!strcmp(type, "end")) {
+        e->type = EVENT_END;
+        return 0;
+    }
+    return 1;
+}
+
+int script_load(const char *filename) {
+    FILE *file = fopen(filename, "r");
+    if(!file) {
+        perror("[Script] error opening script");
+        return 1;
+    }
+
+    int err = 0;
+    char line[256];
+    for(int n = 1; fgets(line, sizeof(line), file); n++) {
+        // skip comments and empty lines
+        char *hash = strchr(line, '#');
+        if(hash)
+            *hash = '\0';
+        if(strspn(line, " \t\n") == strlen(line))
+            continue;
+
+        struct event e = { 0 };
+        if(parse_line(line, &e)) {
+            printf("[Script] %s:%d: invalid event\n", filename, n);
+            err = 1;
+            break;
+        }
+
+        if(e.type == EVENT_END) {
+            if(e.time < end_time)
+                end_time = e.time;
+            continue;
+        }
+
+        events = realloc(events, (event_count + 1) * sizeof(*events));
+        events[event_count++] = e;
+    }
+    fclose(file);
+    return err;
+}
+
+uint64_t script_next_time(void) {
+    uint64_t next = UINT64_MAX;
+    for(int i = 0; i < event_count; i++)
+        if(events[i].time < next)
+            next = events[i].time;
+
+    // events after the end are never run
+    return (next < end_time ? next : UINT64_MAX);
+}
+
+void script_run_next(void) {
+    const uint64_t time = script_next_time();
+
+    for(int i = 0; i < event_count; i++) {
+        struct event *e = &events[i];
+        if(e->time != time)
+            continue;
+
+        if(e->type == EVENT_SEND)
+            sim_receive(&e->msg);
+        else if(e->type == EVENT_LIGHT)
+            tcs34725_set_light(e->light[0], e->light[1], e->light[2]);
+
+        if(e->period != 0) {
+            e->time += e->period;
+        } else {
+            // remove the event
+            *e = events[--event_count];
+            i--;
+        }
+    }
+}
+
+uint64_t script_end_time(void) {
+    return end_time;
+}
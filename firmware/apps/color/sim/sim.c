@@ -0,0 +1,110 @@
+/* Copyright 2025 Vulcalien
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "sim.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "hrtime.h"
+#include "log.h"
+#include "color.h"
+#include "can-io.h"
+#include "status.h"
+#include "tcs34725.h"
+
+static double wall_time(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void usage(const char *arg0) {
+    printf("Usage: %s [-i sensor-id] [-f rx-fifo] [-o output] <script>\n",
+           arg0);
+    printf("Runs the firmware on a virtual clock, with the CAN messages\n");
+    printf("and sensor light given by the script. Messages sent by the\n");
+    printf("firmware are written to 'output' in candump log format.\n");
+}
+
+int main(int argc, char *argv[]) {
+    int sensor_id = 1;
+
+    int opt;
+    while((opt = getopt(argc, argv, "i:f:o:")) != -1) {
+        if(opt == 'i') {
+            sensor_id = atoi(optarg);
+        } else if(opt == 'f') {
+            sim_set_rx_fifo_size(atoi(optarg));
+        } else if(opt == 'o') {
+            if(stats_open_output(optarg))
+                return 1;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if(optind != argc - 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if(script_load(argv[optind]))
+        return 1;
+
+    const uint64_t end_time = script_end_time();
+    if(end_time == UINT64_MAX) {
+        puts("[Sim] the script has no 'end' event");
+        return 1;
+    }
+
+    hrtime_init();
+    log_init();
+
+    // the sensor starts powered off, as after a reset
+    tcs34725_reset();
+    if(color_init()) {
+        puts("[Sim] color sensor initialization failed");
+        return 1;
+    }
+
+    can_io_init();
+    can_io_set_sensor_id(sensor_id);
+
+    const double start = wall_time();
+    while(sim_time() < end_time) {
+        const uint64_t time = sim_time();
+        can_io_run_once();
+
+        // the loop itself takes some time
+        if(sim_time() == time)
+            hal_sleep_us(1);
+    }
+    const double elapsed = wall_time() - start;
+
+    // let the log thread print the remaining records
+    usleep(100000);
+
+    printf(
+        "[Sim] simulated %.3f s in %.3f s (%.0fx real time)\n",
+        end_time / 1e6, elapsed, end_time / 1e6 / elapsed
+    );
+    stats_print();
+    status_print();
+    can_io_print_latency();
+    return 0;
+}
@@ -0,0 +1,74 @@
+/* Copyright 2025 Vulcalien
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include "main.h"
+
+#include "hal.h"
+
+/* ================================================================== */
+/*                           Virtual Clock                            */
+/* ================================================================== */
+
+// hal-sim.c: time only moves when the application sleeps, waits for
+// messages or performs I2C and CAN transfers.
+
+extern uint64_t sim_time(void); // in microseconds
+
+// Size of the driver's receive FIFO: messages arriving when it is full
+// are dropped.
+extern void sim_set_rx_fifo_size(int size);
+
+// Called by the script when a message arrives on the bus
+extern void sim_receive(const struct hal_can_msg *msg);
+
+extern uint32_t sim_rx_overflows(void);
+
+/* ================================================================== */
+/*                               Script                               */
+/* ================================================================== */
+
+// script.c: scripted CAN messages and sensor light, one event per line:
+//   <time> send <id> [R | <byte>...]            one message
+//   <time> every <period> <id> [R | <byte>...]  periodic messages
+//   <time> light <red> <green> <blue>           light on the sensor
+//   <time> end                                  end of the simulation
+// Times are in microseconds, or followed by 'ms' or 's'. IDs and bytes
+// are hexadecimal.
+
+extern int script_load(const char *filename);
+
+// Returns the time of the next event, or UINT64_MAX if there is none
+extern uint64_t script_next_time(void);
+
+// Runs all events scheduled at script_next_time()
+extern void script_run_next(void);
+
+extern uint64_t script_end_time(void);
+
+/* ================================================================== */
+/*                             Statistics                             */
+/* ================================================================== */
+
+// stats.c: measurements of the messages sent by the application
+
+extern int stats_open_output(const char *filename);
+
+// 'time' is when the message left the bus
+extern void stats_transmit(const struct hal_can_msg *msg, uint64_t time);
+extern void stats_receive(const struct hal_can_msg *msg);
+
+extern void stats_print(void);
@@ -0,0 +1,199 @@
+/* Copyright 2025 Vulcalien
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "sim.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "color2can.h"
+
+#define MESSAGE_TYPES 16
+#define TYPE_OF(id) (((id) - COLOR2CAN_TIME_MASK_ID) >> 5)
+
+static const char *type_names[MESSAGE_TYPES] = {
+    "time", "sync", "config", "range", "sample", "sample info",
+    "bitrate", "status", "latency", "trace"
+};
+
+static FILE *output;
+
+static uint32_t rx_count;
+static uint32_t tx_count[MESSAGE_TYPES];
+static uint32_t tx_other;
+
+static uint32_t overruns;
+
+// time between consecutive samples
+static struct {
+    bool started;
+    uint64_t last;
+    uint64_t min;
+    uint64_t max;
+    uint64_t total;
+    uint32_t count;
+} gaps;
+
+// time of the requests not answered yet
+#define PENDING_MAX 256
+static struct {
+    uint64_t times[PENDING_MAX];
+    int head;
+    int count;
+} pending;
+
+// latency of each request (in microseconds)
+static uint32_t *latencies;
+static uint32_t latency_count;
+static uint32_t latency_capacity;
+
+int stats_open_output(const char *filename) {
+    output = fopen(filename, "w");
+    if(!output) {
+        perror("[Stats] error opening output file");
+        return 1;
+    }
+    return 0;
+}
+
+static bool is_type(uint32_t id, uint32_t mask_id) {
+    return (id & ~0x1f) == mask_id;
+}
+
+static void add_latency(uint32_t latency) {
+    if(latency_count == latency_capacity) {
+        latency_capacity = (latency_capacity ? latency_capacity * 2 : 1024);
+        latencies = realloc(
+            latencies, latency_capacity * sizeof(*latencies)
+        );
+    }
+    latencies[latency_count++] = latency;
+}
+
+void stats_transmit(const struct hal_can_msg *msg, uint64_t time) {
+    if(output) {
+        // candump log format
+        fprintf(output, "(%llu.%06llu) sim %03X#",
+                (unsigned long long) (time / 1000000),
+                (unsigned long long) (time % 1000000),
+                (unsigned int) msg->id);
+        for(int i = 0; i < msg->len; i++)
+            fprintf(output, "%02X", msg->data[i]);
+        fputc('\n', output);
+    }
+
+    if(msg->id >= COLOR2CAN_TIME_MASK_ID &&
+       TYPE_OF(msg->id) < MESSAGE_TYPES)
+        tx_count[TYPE_OF(msg->id)]++;
+    else
+        tx_other++;
+
+    if(is_type(msg->id, COLOR2CAN_SAMPLE_MASK_ID)) {
+        if(gaps.started) {
+            const uint64_t gap = time - gaps.last;
+            if(gaps.count == 0 || gap < gaps.min)
+                gaps.min = gap;
+            if(gap > gaps.max)
+                gaps.max = gap;
+            gaps.total += gap;
+            gaps.count++;
+        }
+        gaps.last = time;
+        gaps.started = true;
+
+        // answer the oldest request
+        if(pending.count > 0) {
+            add_latency(time - pending.times[pending.head]);
+            pending.head = (pending.head + 1) % PENDING_MAX;
+            pending.count--;
+        }
+    } else if(is_type(msg->id, COLOR2CAN_SAMPLE_INFO_MASK_ID)) {
+        struct color2can_sample_info info;
+        memcpy(&info, msg->data, sizeof(info));
+        if(info.overrun)
+            overruns++;
+    }
+}
+
+void stats_receive(const struct hal_can_msg *msg) {
+    rx_count++;
+
+    // single sample requests
+    if(is_type(msg->id, COLOR2CAN_SAMPLE_MASK_ID) &&
+       (msg->rtr || msg->len == 0)) {
+        if(pending.count == PENDING_MAX)
+            return;
+
+        const int i = (pending.head + pending.count) % PENDING_MAX;
+        pending.times[i] = sim_time();
+        pending.count++;
+    }
+}
+
+static int compare_latency(const void *a, const void *b) {
+    const uint32_t x = *(const uint32_t *) a;
+    const uint32_t y = *(const uint32_t *) b;
+    return (x > y) - (x < y);
+}
+
+static uint32_t percentile(double p) {
+    uint32_t i = p * latency_count;
+    if(i >= latency_count)
+        i = latency_count - 1;
+    return latencies[i];
+}
+
+void stats_print(void) {
+    if(output)
+        fclose(output);
+
+    printf("[Stats] messages received: %lu (dropped: %lu)\n",
+           (unsigned long) rx_count, (unsigned long) sim_rx_overflows());
+
+    puts("[Stats] messages sent:");
+    for(int i = 0; i < MESSAGE_TYPES; i++)
+        if(tx_count[i] > 0)
+            printf("  %-12s %10lu\n",
+                   type_names[i] ? type_names[i] : "unknown",
+                   (unsigned long) tx_count[i]);
+    if(tx_other > 0)
+        printf("  %-12s %10lu\n", "other", (unsigned long) tx_other);
+
+    if(gaps.count > 0) {
+        printf(
+            "[Stats] time between samples (us): "
+            "min %llu, avg %llu, max %llu\n",
+            (unsigned long long) gaps.min,
+            (unsigned long long) (gaps.total / gaps.count),
+            (unsigned long long) gaps.max
+        );
+    }
+    printf("[Stats] overrun samples: %lu\n", (unsigned long) overruns);
+
+    if(latency_count > 0) {
+        qsort(latencies, latency_count, sizeof(*latencies),
+              compare_latency);
+        printf(
+            "[Stats] request latency (us) over %lu requests: "
+            "p50 %lu, p99 %lu, p999 %lu, max %lu\n",
+            (unsigned long) latency_count,
+            (unsigned long) percentile(0.5),
+            (unsigned long) percentile(0.99),
+            (unsigned long) percentile(0.999),
+            (unsigned long) latencies[latency_count - 1]
+        );
+    }
+}
@@ -0,0 +1,113 @@
+/* Copyright 2025 Vulcalien
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "bench.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "color2can.h"
+#include "hal.h"
+#include "color.h"
+#include "processing.h"
+#include "hrtime.h"
+
+static void print_result(const char *name, uint32_t cycles) {
+    printf("  %-22s %8lu\n", name, (unsigned long) cycles);
+}
+
+// Encode a sample into a CAN message, as write_sample does before
+// writing it to the device.
+static uint32_t bench_encode(int iterations) {
+    const uint64_t start = hrtime_cycles();
+    for(int i = 0; i < iterations; i++) {
+        struct color2can_sample data = {
+            .color        = { i, i >> 1, i >> 2 },
+            .clear        = i,
+            .within_range = i & 1,
+            .range_id     = i & 0xf
+        };
+
+        struct hal_can_msg msg = {
+            .id  = COLOR2CAN_SAMPLE_MASK_ID | (i & 0x1f),
+            .len = COLOR2CAN_SAMPLE_SIZE
+        };
+        memcpy(msg.data, &data, COLOR2CAN_SAMPLE_SIZE);
+        __asm__ volatile("" : : "r"(&msg) : "memory");
+    }
+    return (hrtime_cycles() - start) / iterations;
+}
+
+// Decode a config message, as handle_message does
+static uint32_t bench_decode(int iterations) {
+    struct hal_can_msg msg = {
+        .id  = COLOR2CAN_CONFIG_MASK_ID,
+        .len = COLOR2CAN_CONFIG_EXT_SIZE
+    };
+    memset(msg.data, 0x5a, COLOR2CAN_CONFIG_EXT_SIZE);
+
+    const uint64_t start = hrtime_cycles();
+    for(int i = 0; i < iterations; i++) {
+        __asm__ volatile("" : : "r"(&msg) : "memory");
+
+        int msg_sensor_id = msg.id % COLOR2CAN_MAX_SENSOR_COUNT;
+        int msg_type      = msg.id - msg_sensor_id;
+        if(msg_type != COLOR2CAN_CONFIG_MASK_ID)
+            continue;
+
+        struct color2can_config_ext ext;
+        memcpy(&ext, msg.data, msg.len);
+
+        int fields[] = {
+            ext.config.transmit_frequency, ext.config.color_space,
+            ext.config.use_led, ext.config.sample_info,
+            ext.integration, ext.transmit_period
+        };
+        __asm__ volatile("" : : "r"(fields) : "memory");
+    }
+    return (hrtime_cycles() - start) / iterations;
+}
+
+int bench_run(int iterations, bool i2c) {
+    if(iterations <= 0) {
+        puts("[Bench] the number of iterations must be positive");
+        return 1;
+    }
+    printf("[Bench] cycles per operation (%d iterations):\n", iterations);
+
+    // other threads would disturb the measurements
+    hal_sched_lock();
+
+    print_result("rgb", processing_bench(COLOR2CAN_SPACE_RGB, 0, iterations));
+    print_result("hsv", processing_bench(COLOR2CAN_SPACE_HSV, 0, iterations));
+
+    for(int n = 1; n <= RANGES_COUNT; n++) {
+        char name[32];
+        snprintf(name, sizeof(name), "rgb + %d range(s)", n);
+        print_result(
+            name, processing_bench(COLOR2CAN_SPACE_RGB, n, iterations)
+        );
+    }
+
+    print_result("encode sample", bench_encode(iterations));
+    print_result("decode config", bench_decode(iterations));
+
+    hal_sched_unlock();
+
+    // the I2C transfers block, so the CAN-IO thread may run meanwhile
+    if(i2c)
+        print_result("I2C read", color_bench_i2c(iterations));
+    return 0;
+}
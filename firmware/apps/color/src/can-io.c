@@ -17,72 +17,349 @@
 
 #include <stdio.h>
 #include <string.h>
-#include <errno.h>
-#include <fcntl.h>
-#include <unistd.h>
-#include <sys/ioctl.h>
-#include <nuttx/can/can.h>
+#include <pthread.h>
 
 #include "color2can.h"
+#include "hal.h"
 #include "processing.h"
 #include "color.h"
+#include "hrtime.h"
+#include "timesync.h"
+#include "status.h"
+#include "profile.h"
+#include "log.h"
+#include "trace.h"
 
-static int can_fd;
 static int sensor_id;
 
-static int requests;
-static int transmit_frequency;
+static int requests; // samples requested and not sent yet
+static int transmit_period; // in microseconds, 0=on-demand
+static bool sample_info;
+
+// nominal bit rate of the bus
+#define DEFAULT_BITRATE 250000
+static int bitrate = DEFAULT_BITRATE;
+
+// time of the next periodic sample
+static uint64_t next_periodic_time;
+static bool overrun;
+
+// reception time of the messages being handled
+static uint64_t rx_time;
+static bool rx_time_valid; // false if messages may have arrived earlier
+
+// times of the steps of retrieve_data
+struct sample_timing {
+    uint64_t start;
+    uint64_t read;
+    uint64_t processed;
+};
+
+// state of the latest SYNC message
+static struct {
+    bool pending; // a sample should be taken
+    bool ready;   // the sample was taken, but not sent yet
+
+    int counter;
+    uint64_t slot_time; // when this sensor may send the sample
+
+    struct color2can_sample sample;
+    struct sample_timing sample_timing;
+} sync_state;
+
+#ifdef CONFIG_CAN_FD
+static int batch_size;
+static struct color2can_sample_batch batch;
+
+static int flush_batch(void);
+#endif
+
+static void handle_bitrate_request(const struct color2can_bitrate *request);
+static int send_bitrate_reply(void);
+static void handle_status_request(const struct hal_can_msg *msg);
+static void handle_latency_request(const struct hal_can_msg *msg);
+static void handle_trace_request(const struct hal_can_msg *msg);
+static void confirm_bitrate(void);
+static int min_transmit_period(int rate);
+
+/* ================================================================== */
+/*                           Request Queue                            */
+/* ================================================================== */
+
+// Pending requests, oldest first. Each burst keeps its own spacing, which
+// only applies between its own samples; requests without spacing (e.g.
+// consecutive single requests) share a group.
+#define REQUEST_QUEUE_SIZE 16
+
+struct request_group {
+    int count;   // samples not sent yet
+    int spacing; // in microseconds
+    bool started;
+
+    // the first sample answers a request message received at 'arrival'
+    bool timed;
+    uint64_t arrival;
+};
+
+static struct {
+    struct request_group groups[REQUEST_QUEUE_SIZE];
+    int head;
+    int count;
+} request_queue;
+
+static void add_requests(int count, int spacing) {
+    if(count <= 0)
+        return;
+
+    struct request_group *last = NULL;
+    if(request_queue.count > 0) {
+        const int i = (request_queue.head + request_queue.count - 1)
+                    % REQUEST_QUEUE_SIZE;
+        last = &request_queue.groups[i];
+    }
+
+    if(last && last->spacing == 0 && spacing == 0) {
+        last->count += count;
+    } else if(request_queue.count < REQUEST_QUEUE_SIZE) {
+        const int i = (request_queue.head + request_queue.count)
+                    % REQUEST_QUEUE_SIZE;
+        request_queue.groups[i] = (struct request_group) {
+            .count   = count,
+            .spacing = spacing
+        };
+        request_queue.count++;
+    } else {
+        // too many spaced bursts are pending
+        status_counters.requests_dropped += count;
+        LOG(LOG_REQUESTS_DROPPED, count);
+        return;
+    }
+    requests += count;
+}
+
+// Adds a single request, whose latency is measured from 'arrival'
+static void add_timed_request(uint64_t arrival) {
+    // if the queue is full, the request is not measured
+    if(request_queue.count == REQUEST_QUEUE_SIZE) {
+        add_requests(1, 0);
+        return;
+    }
+
+    const int i = (request_queue.head + request_queue.count)
+                % REQUEST_QUEUE_SIZE;
+    request_queue.groups[i] = (struct request_group) {
+        .count   = 1,
+        .timed   = true,
+        .arrival = arrival
+    };
+    request_queue.count++;
+    requests++;
+}
+
+// Marks the oldest request as satisfied
+static void complete_request(void) {
+    struct request_group *group = &request_queue.groups[request_queue.head];
+    group->started = true;
+    group->timed   = false;
+    requests--;
+
+    if(--group->count == 0) {
+        request_queue.head = (request_queue.head + 1) % REQUEST_QUEUE_SIZE;
+        request_queue.count--;
+    }
+}
+
+static void clear_requests(void) {
+    status_counters.requests_dropped += requests;
+    requests = 0;
+    request_queue.count = 0;
+}
+
+/* ================================================================== */
+/*                         Latency Histogram                          */
+/* ================================================================== */
+
+// Bucket i counts latencies in [2^i, 2^(i+1)) microseconds, except for
+// the first (which also counts 0) and the last (which has no limit).
+static uint32_t latency_histogram[COLOR2CAN_LATENCY_PHASES]
+                                 [COLOR2CAN_LATENCY_BUCKETS];
+
+// set by can_io_reset_latency, applied by the CAN thread
+static bool latency_reset_pending;
+
+static inline void add_latency(int phase, uint64_t from, uint64_t to) {
+    const uint32_t latency = (to > from ? to - from : 0);
+
+    int bucket = 0;
+    if(latency > 1)
+        bucket = 31 - __builtin_clz(latency);
+    if(bucket >= COLOR2CAN_LATENCY_BUCKETS)
+        bucket = COLOR2CAN_LATENCY_BUCKETS - 1;
+
+    latency_histogram[phase][bucket]++;
+}
+
+static inline void record_latency(uint64_t arrival,
+                                  const struct sample_timing *t,
+                                  uint64_t written) {
+    add_latency(COLOR2CAN_LATENCY_QUEUE,      arrival,      t->start);
+    add_latency(COLOR2CAN_LATENCY_SENSOR,     t->start,     t->read);
+    add_latency(COLOR2CAN_LATENCY_PROCESSING, t->read,      t->processed);
+    add_latency(COLOR2CAN_LATENCY_TX,         t->processed, written);
+    add_latency(COLOR2CAN_LATENCY_TOTAL,      arrival,      written);
+}
+
+// Returns the arrival time of a message, as precisely as possible
+static inline uint64_t msg_arrival_time(const struct hal_can_msg *msg) {
+    return (msg->time_valid ? msg->time : rx_time);
+}
 
 /* ================================================================== */
 /*                              Receiver                              */
 /* ================================================================== */
 
-#define RECEIVER_BUFFER_SIZE (sizeof(struct can_msg_s))
+// Returns true if a message was sent by the host. Sensors also send
+// sample, bit rate, status, latency and trace messages, but not with the
+// length of a request.
+static inline bool is_host_message(const struct hal_can_msg *msg,
+                                   int msg_type) {
+    const bool empty = (msg->rtr || msg->len == 0);
+    switch(msg_type) {
+        case COLOR2CAN_TIME_MASK_ID:
+        case COLOR2CAN_SYNC_MASK_ID:
+        case COLOR2CAN_CONFIG_MASK_ID:
+        case COLOR2CAN_RANGE_MASK_ID:
+            return true;
+
+        case COLOR2CAN_BITRATE_MASK_ID: {
+            struct color2can_bitrate request;
+            if(msg->len != COLOR2CAN_BITRATE_SIZE)
+                return false;
+            memcpy(&request, msg->data, COLOR2CAN_BITRATE_SIZE);
+            return request.status == COLOR2CAN_BITRATE_REQUEST;
+        }
+
+        case COLOR2CAN_SAMPLE_MASK_ID:
+            return empty || msg->len == COLOR2CAN_REQUEST_SIZE;
+        case COLOR2CAN_STATUS_MASK_ID:
+            return empty || msg->len == COLOR2CAN_STATUS_REQUEST_SIZE;
+        case COLOR2CAN_LATENCY_MASK_ID:
+            return empty || msg->len == COLOR2CAN_LATENCY_RESET_SIZE;
+        case COLOR2CAN_TRACE_MASK_ID:
+            return empty;
 
-static inline void handle_message(const struct can_msg_s *msg) {
-    int msg_sensor_id = msg->cm_hdr.ch_id % COLOR2CAN_MAX_SENSOR_COUNT;
-    int msg_type      = msg->cm_hdr.ch_id - msg_sensor_id;
+        default:
+            return false;
+    }
+}
+
+static inline void handle_message(const struct hal_can_msg *msg) {
+    int msg_sensor_id = msg->id % COLOR2CAN_MAX_SENSOR_COUNT;
+    int msg_type      = msg->id - msg_sensor_id;
 
     // check if message is addressed to this device (ID=0 is broadcast)
-    if(msg_sensor_id != 0 && msg_sensor_id != sensor_id)
+    if(msg_sensor_id != 0 && msg_sensor_id != sensor_id) {
+        status_counters.rx_filtered++;
         return;
+    }
+
+    // Only the host confirms a new bit rate: sensors that switched could
+    // otherwise confirm each other while the host is unreachable.
+    if(is_host_message(msg, msg_type))
+        confirm_bitrate();
 
     switch(msg_type) {
+        case COLOR2CAN_TIME_MASK_ID: {
+            if(msg->len != COLOR2CAN_TIME_SIZE) {
+                LOG(
+                    LOG_MALFORMED, COLOR2CAN_TIME_MASK_ID,
+                    msg->len, COLOR2CAN_TIME_SIZE
+                );
+                break;
+            }
+
+            // the driver's timestamp is exact even if the message was
+            // not the first one read after waking up
+            struct color2can_time time;
+            memcpy(&time, msg->data, COLOR2CAN_TIME_SIZE);
+            timesync_handle_message(
+                &time, msg_arrival_time(msg),
+                msg->time_valid || rx_time_valid
+            );
+        } break;
+
+        case COLOR2CAN_SYNC_MASK_ID: {
+            struct color2can_sync sync = { 0 };
+            memcpy(&sync, msg->data, msg->len < COLOR2CAN_SYNC_SIZE
+                                        ? msg->len
+                                        : COLOR2CAN_SYNC_SIZE);
+
+            // a sample that was not sent yet is replaced by the new one
+            sync_state.pending = true;
+            sync_state.ready   = false;
+
+            // The slots start when all sensors are expected to have
+            // taken their sample: counting from the SYNC message, a sensor
+            // would miss its slot while sampling and send when ready.
+            sync_state.counter   = sync.counter;
+            sync_state.slot_time = hrtime_us() + color_get_restart_period()
+                                 + sync.stagger * 100 * sensor_id;
+        } break;
+
         case COLOR2CAN_CONFIG_MASK_ID: {
-            if(msg->cm_hdr.ch_dlc != COLOR2CAN_CONFIG_SIZE) {
-                printf(
-                    "[CAN-IO] malformed config message "
-                    "(size=%d, expected=%d)\n",
-                    msg->cm_hdr.ch_dlc, COLOR2CAN_CONFIG_SIZE
+            const bool extended = (
+                msg->len == COLOR2CAN_CONFIG_EXT_SIZE
+            );
+            if(msg->len != COLOR2CAN_CONFIG_SIZE && !extended) {
+                LOG(
+                    LOG_MALFORMED_CONFIG, msg->len,
+                    COLOR2CAN_CONFIG_SIZE, COLOR2CAN_CONFIG_EXT_SIZE
                 );
                 break;
             }
 
-            struct color2can_config config;
-            memcpy(&config, msg->cm_data, COLOR2CAN_CONFIG_SIZE);
+            struct color2can_config_ext ext;
+            memcpy(&ext, msg->data, msg->len);
+            struct color2can_config *config = &ext.config;
 
             // invalidate pending requests
-            requests = 0;
+            clear_requests();
+            sync_state.pending = false;
+            sync_state.ready   = false;
+
+#ifdef CONFIG_CAN_FD
+            // samples taken with the old configuration are sent now
+            flush_batch();
+#endif
+
+            LOG(LOG_CONFIGURING);
+            if(extended)
+                color_set_integration_time(ext.integration + 1);
+            processing_set_color_space(config->color_space);
+            color_set_led_usage(config->use_led);
+            can_io_set_sample_info(config->sample_info);
+#ifdef CONFIG_CAN_FD
+            can_io_set_batch_size(config->batch_size);
+#endif
 
-            puts("=== Configuring ===");
-            can_io_set_transmit_frequency(config.transmit_frequency);
-            processing_set_color_space(config.color_space);
-            color_set_led_usage(config.use_led);
-            puts("");
+            // the transmit period depends on the other settings
+            if(extended)
+                can_io_set_transmit_period(ext.transmit_period);
+            else
+                can_io_set_transmit_frequency(config->transmit_frequency);
         } break;
 
         case COLOR2CAN_RANGE_MASK_ID: {
-            if(msg->cm_hdr.ch_dlc != COLOR2CAN_RANGE_SIZE) {
-                printf(
-                    "[CAN-IO] malformed range message "
-                    "(size=%d, expected=%d)\n",
-                    msg->cm_hdr.ch_dlc, COLOR2CAN_RANGE_SIZE
+            if(msg->len != COLOR2CAN_RANGE_SIZE) {
+                LOG(
+                    LOG_MALFORMED, COLOR2CAN_RANGE_MASK_ID,
+                    msg->len, COLOR2CAN_RANGE_SIZE
                 );
                 break;
             }
 
             struct color2can_range range;
-            memcpy(&range, msg->cm_data, COLOR2CAN_RANGE_SIZE);
+            memcpy(&range, msg->data, COLOR2CAN_RANGE_SIZE);
 
             int color[3] = {
                 range.color[0],
@@ -92,40 +369,78 @@ static inline void handle_message(const struct can_msg_s *msg) {
             processing_set_range(range.range_id, range.high, color);
         } break;
 
+        case COLOR2CAN_BITRATE_MASK_ID: {
+            if(msg->len != COLOR2CAN_BITRATE_SIZE) {
+                LOG(
+                    LOG_MALFORMED, COLOR2CAN_BITRATE_MASK_ID,
+                    msg->len, COLOR2CAN_BITRATE_SIZE
+                );
+                break;
+            }
+
+            struct color2can_bitrate request;
+            memcpy(&request, msg->data, COLOR2CAN_BITRATE_SIZE);
+            handle_bitrate_request(&request);
+        } break;
+
+        case COLOR2CAN_STATUS_MASK_ID: {
+            handle_status_request(msg);
+        } break;
+
+        case COLOR2CAN_LATENCY_MASK_ID: {
+            handle_latency_request(msg);
+        } break;
+
+        case COLOR2CAN_TRACE_MASK_ID: {
+            handle_trace_request(msg);
+        } break;
+
         case COLOR2CAN_SAMPLE_MASK_ID: {
             // if RTR=1 or len=0, request a data message
-            if(msg->cm_hdr.ch_rtr || msg->cm_hdr.ch_dlc == 0)
-                requests++;
+            if(msg->rtr || msg->len == 0) {
+                add_timed_request(msg_arrival_time(msg));
+                TRACE_INSTANT(COLOR2CAN_TRACE_REQUEST, requests);
+            } else if(msg->len == COLOR2CAN_REQUEST_SIZE) {
+                struct color2can_request request;
+                memcpy(&request, msg->data, COLOR2CAN_REQUEST_SIZE);
+
+                add_requests(request.count, request.spacing * 100);
+                TRACE_INSTANT(COLOR2CAN_TRACE_REQUEST, requests);
+            }
         } break;
+
+        default:
+            status_counters.rx_filtered++;
+            break;
     }
 }
 
 static void receiver(void) {
-    static char buffer[RECEIVER_BUFFER_SIZE];
-
-    // keep reading messages until the file descriptor is empty
+    // keep reading messages until there are none left
     while(true) {
-        int offset = 0;
-
-        // read CAN message(s)
-        int nbytes = read(can_fd, buffer, RECEIVER_BUFFER_SIZE);
-        if(nbytes < 0) {
-            if(errno != EAGAIN)
-                puts("[CAN-IO] error reading from CAN device");
+        struct hal_can_msg msg;
+        int ret = hal_can_read(&msg);
+        if(ret <= 0) {
+            if(ret < 0) {
+                status_counters.rx_errors++;
+                LOG(LOG_RX_ERROR);
+            }
 
             // there are no new messages: break the loop
             break;
         }
 
-        // handle CAN message(s)
-        while(offset < nbytes) {
-            struct can_msg_s *msg = (struct can_msg_s *) &buffer[offset];
-            handle_message(msg);
+        TRACE_BEGIN(COLOR2CAN_TRACE_RECEIVER, msg.len);
 
-            // move buffer offset forward
-            int msglen = CAN_MSGLEN(msg->cm_hdr.ch_dlc);
-            offset += msglen;
-        }
+        TRACE_INSTANT(COLOR2CAN_TRACE_RX_FRAME, msg.id);
+        PROFILE_BEGIN(PROFILE_HANDLE_MESSAGE);
+        handle_message(&msg);
+        PROFILE_END(PROFILE_HANDLE_MESSAGE);
+
+        TRACE_END(COLOR2CAN_TRACE_RECEIVER, msg.len);
+
+        // only the first message read after waking up is on time
+        rx_time_valid = false;
     }
 }
 
@@ -133,39 +448,179 @@ static void receiver(void) {
 /*                               Sender                               */
 /* ================================================================== */
 
+// set when a message did not fit in the TX queue
+static bool tx_full;
+
+// Returns 0 on success, 1 if the TX queue is full, -1 on error. A full TX
+// queue is not an error: the message should be sent again once it has
+// room.
+static int write_message(int id, const void *data, int datalen) {
+    struct hal_can_msg msg = {
+        .id  = id,
+        .len = datalen
+    };
+    memcpy(msg.data, data, datalen);
+
+    TRACE_BEGIN(COLOR2CAN_TRACE_TX, id);
+    int err = hal_can_write(&msg);
+    TRACE_END(COLOR2CAN_TRACE_TX, id);
+    if(err > 0) {
+        tx_full = true;
+        return 1;
+    }
+    if(err < 0) {
+        status_counters.tx_errors++;
+        LOG(LOG_TX_ERROR);
+        return -1;
+    }
+    return 0;
+}
+
 static inline int write_sample(struct color2can_sample *data) {
-    struct can_msg_s msg;
+    PROFILE_BEGIN(PROFILE_WRITE_SAMPLE);
+    int err = write_message(
+        COLOR2CAN_SAMPLE_MASK_ID | sensor_id,
+        data, sizeof(struct color2can_sample)
+    );
+    PROFILE_END(PROFILE_WRITE_SAMPLE);
+    if(!err)
+        status_counters.samples_sent++;
+    return err;
+}
 
-    const int datalen = sizeof(struct color2can_sample);
-    const int id = COLOR2CAN_SAMPLE_MASK_ID | sensor_id;
+static inline int write_sample_info(struct color2can_sample_info *info) {
+    return write_message(
+        COLOR2CAN_SAMPLE_INFO_MASK_ID | sensor_id,
+        info, sizeof(struct color2can_sample_info)
+    );
+}
 
-    // set CAN header
-    msg.cm_hdr = (struct can_hdr_s) {
-        .ch_id  = id,
-        .ch_dlc = datalen,
-        .ch_rtr = false,
-        .ch_tcf = false
-    };
+// Sample and sample info messages that did not fit in the TX queue: they
+// are sent before any newer sample.
+static struct {
+    bool sample_pending;
+    bool info_pending;
+#ifdef CONFIG_CAN_FD
+    bool batch_pending; // the batch itself is kept
+#endif
+
+    struct color2can_sample sample;
+    struct color2can_sample_info info;
+} unsent;
 
-    // set CAN data
-    memcpy(msg.cm_data, data, datalen);
+static inline bool has_unsent(void) {
+#ifdef CONFIG_CAN_FD
+    if(unsent.batch_pending)
+        return true;
+#endif
+    return unsent.sample_pending || unsent.info_pending;
+}
 
-    // write CAN message
-    const int msglen = CAN_MSGLEN(datalen);
-    const int nbytes = write(can_fd, &msg, msglen);
-    if(nbytes != msglen) {
-        printf("[CAN-IO] error writing to CAN device\n");
+// Returns 1 if the TX queue is still full
+static int send_unsent(void) {
+#ifdef CONFIG_CAN_FD
+    // the batch was filled before the samples below
+    if(unsent.batch_pending && flush_batch() > 0)
         return 1;
+#endif
+    if(unsent.sample_pending) {
+        if(write_sample(&unsent.sample) > 0)
+            return 1;
+        unsent.sample_pending = false;
+    }
+    if(unsent.info_pending) {
+        if(write_sample_info(&unsent.info) > 0)
+            return 1;
+        unsent.info_pending = false;
     }
     return 0;
 }
 
-static inline int retrieve_data(struct color2can_sample *data) {
+static int write_sample_and_info(const struct color2can_sample *data,
+                                 const struct color2can_sample_info *info) {
+    unsent.sample_pending = true;
+    unsent.sample = *data;
+
+    unsent.info_pending = (info != NULL);
+    if(info)
+        unsent.info = *info;
+    return send_unsent();
+}
+
+// Set the time of a sample, if the clock is synchronized to the host.
+static inline void set_sample_time(struct color2can_sample_info *info,
+                                   uint64_t time) {
+    uint64_t host_time;
+    if(timesync_to_host_time(time, &host_time))
+        return;
+
+    info->time_valid = true;
+    info->time       = host_time;
+}
+
+#ifdef CONFIG_CAN_FD
+// Returns 1 if the TX queue is full: the batch is then kept, and sent
+// again by send_unsent.
+static int flush_batch(void) {
+    if(batch.count == 0)
+        return 0;
+
+    int err = write_message(
+        COLOR2CAN_SAMPLE_MASK_ID | sensor_id,
+        &batch, COLOR2CAN_SAMPLE_BATCH_SIZE(batch.count)
+    );
+    unsent.batch_pending = (err > 0);
+    if(err > 0)
+        return 1;
+    if(!err)
+        status_counters.samples_sent += batch.count;
+
+    batch.sequence++;
+    batch.count = 0;
+    return err;
+}
+
+static int send_sample(struct color2can_sample *data,
+                       struct color2can_sample_info *info) {
+    // sample info messages are not sent for batched samples
+    if(batch_size <= 1)
+        return write_sample_and_info(data, info);
+
+    batch.samples[batch.count++] = *data;
+    if(batch.count >= batch_size)
+        return flush_batch();
+    return 0;
+}
+#else
+static int send_sample(struct color2can_sample *data,
+                       struct color2can_sample_info *info) {
+    return write_sample_and_info(data, info);
+}
+#endif
+
+static inline int retrieve_data(struct color2can_sample *data,
+                                struct sample_timing *timing) {
+    timing->start = hrtime_us();
+
+    int r, g, b, c;
+    PROFILE_BEGIN(PROFILE_COLOR_READ);
+    int err = color_read_data(&r, &g, &b, &c);
+    PROFILE_END(PROFILE_COLOR_READ);
+    if(err)
+        return 1;
+    timing->read = hrtime_us();
+
     int color[3], clear;
     bool within_range;
     int range_id;
-    if(processing_get_data(color, &clear, &within_range, &range_id))
+    TRACE_BEGIN(COLOR2CAN_TRACE_PROCESSING, 0);
+    err = processing_process_data(r, g, b, c,
+                                  color, &clear, &within_range, &range_id);
+    TRACE_END(COLOR2CAN_TRACE_PROCESSING, 0);
+    if(err)
         return 1;
+    timing->processed = hrtime_us();
+    status_counters.samples_produced++;
 
     data->color[0] = color[0];
     data->color[1] = color[1];
@@ -177,20 +632,98 @@ static inline int retrieve_data(struct color2can_sample *data) {
     return 0;
 }
 
-static uint64_t get_time_us(void) {
-    struct timespec t;
-    clock_gettime(CLOCK_MONOTONIC, &t);
-    return (uint64_t) t.tv_sec * 1000000 + (uint64_t) t.tv_nsec / 1000;
+static uint64_t latest_write_time;
+
+// Returns the time (in microseconds) before the next pending request
+// can be satisfied, or -1 if there are no pending requests.
+static int pending_request_delay(void) {
+    if(requests == 0)
+        return -1;
+
+    // the spacing is only kept between samples of the same burst
+    const struct request_group *group =
+        &request_queue.groups[request_queue.head];
+    if(!group->started || group->spacing == 0)
+        return 0;
+
+    uint64_t elapsed = hrtime_us() - latest_write_time;
+    if(elapsed >= group->spacing)
+        return 0;
+    return group->spacing - elapsed;
+}
+
+// Returns the time (in microseconds) before the sample requested by a
+// SYNC message can be sent, or -1 if there is no such sample.
+static int sync_delay(void) {
+    if(sync_state.pending)
+        return 0;
+    if(!sync_state.ready)
+        return -1;
+
+    uint64_t now = hrtime_us();
+    if(now >= sync_state.slot_time)
+        return 0;
+    return sync_state.slot_time - now;
+}
+
+static void sync_sender(void) {
+    // start sampling as soon as possible after the SYNC message
+    if(sync_state.pending) {
+        TRACE_BEGIN(COLOR2CAN_TRACE_SENDER, 0);
+        color_restart_integration();
+        int err = retrieve_data(&sync_state.sample, &sync_state.sample_timing);
+        TRACE_END(COLOR2CAN_TRACE_SENDER, 0);
+        if(err)
+            return;
+
+        sync_state.pending = false;
+        sync_state.ready   = true;
+    }
+
+    // wait for this sensor's time slot before sending the sample
+    if(sync_delay() == 0) {
+        struct color2can_sample_info info = {
+            .sync_counter = sync_state.counter,
+            .synchronized = true
+        };
+        set_sample_time(&info, sync_state.sample_timing.read);
+
+        write_sample_and_info(&sync_state.sample, &info);
+        sync_state.ready = false;
+    }
+}
+
+// Returns the time (in microseconds) before the next periodic sample is
+// due, or -1 if samples are not sent periodically.
+static int periodic_delay(void) {
+    if(transmit_period == 0 || requests > 0)
+        return -1;
+
+    uint64_t now = hrtime_us();
+    if(now >= next_periodic_time)
+        return 0;
+    return next_periodic_time - now;
 }
 
 static void sender(void) {
-    static uint64_t latest_write_time;
+    // do not take new samples before the previous ones are sent
+    if(send_unsent())
+        return;
+
+    sync_sender();
 
     // check if an automatic request should be made
-    if(requests == 0 && transmit_frequency > 0) {
-        int period = 1000000 / transmit_frequency;
-        if(get_time_us() - latest_write_time >= period)
-            requests++;
+    if(periodic_delay() == 0) {
+        uint64_t now = hrtime_us();
+
+        // if a whole period was missed, skip ahead instead of catching up
+        if(now - next_periodic_time >= transmit_period) {
+            if(next_periodic_time != 0)
+                overrun = true;
+            next_periodic_time = now;
+        }
+        next_periodic_time += transmit_period;
+        add_requests(1, 0);
     }
 
     // Try to satisfy one pending request: it's best to only satisfy one
@@ -199,67 +732,414 @@ static void sender(void) {
     // For example: 1000 requests are sent, then shortly after a config
     // message is sent; that config message should invalidate all
     // unhandled requests.
-    if(requests > 0) {
+    if(pending_request_delay() == 0) {
+        TRACE_BEGIN(COLOR2CAN_TRACE_SENDER, requests);
+
         struct color2can_sample data;
-        if(retrieve_data(&data))
+        struct sample_timing timing;
+        if(retrieve_data(&data, &timing)) {
+            TRACE_END(COLOR2CAN_TRACE_SENDER, requests);
             return;
+        }
+
+        struct color2can_sample_info info = {
+            .overrun = overrun
+        };
+        set_sample_time(&info, timing.read);
+        overrun = false;
+
+        send_sample(&data, sample_info ? &info : NULL);
+        latest_write_time = hrtime_us();
+
+        // only samples answering a request message are measured
+        const struct request_group *group =
+            &request_queue.groups[request_queue.head];
+        if(group->timed)
+            record_latency(group->arrival, &timing, latest_write_time);
 
-        write_sample(&data);
-        requests--;
-        latest_write_time = get_time_us();
+        complete_request();
+
+#ifdef CONFIG_CAN_FD
+        // in on-demand mode, do not hold samples that were requested
+        if(requests == 0 && transmit_period == 0)
+            flush_batch();
+#endif
+        TRACE_END(COLOR2CAN_TRACE_SENDER, requests);
     }
 }
 
 /* ================================================================== */
+/*                           Status Report                            */
+/* ================================================================== */
+
+static struct {
+    uint32_t pending; // bitmask of counters to send
+    int period;       // in microseconds, 0=disabled
+    uint64_t next_time;
+} status_report;
+
+static void handle_status_request(const struct hal_can_msg *msg) {
+    if(msg->rtr || msg->len == 0) {
+        status_report.pending = (1 << COLOR2CAN_STATUS_COUNT) - 1;
+    } else if(msg->len == COLOR2CAN_STATUS_REQUEST_SIZE) {
+        struct color2can_status_request request;
+        memcpy(&request, msg->data, COLOR2CAN_STATUS_REQUEST_SIZE);
+
+        status_report.period    = request.period * 1000;
+        status_report.next_time = hrtime_us();
+    }
+}
+
+// Returns the time (in microseconds) before a status message should be
+// sent, or -1 if status messages are not requested.
+static int status_delay(void) {
+    if(status_report.pending)
+        return 0;
+    if(status_report.period == 0)
+        return -1;
+
+    uint64_t now = hrtime_us();
+    if(now >= status_report.next_time)
+        return 0;
+    return status_report.next_time - now;
+}
+
+static void status_sender(void) {
+    if(status_delay() != 0)
+        return;
+
+    if(!status_report.pending) {
+        status_report.pending = (1 << COLOR2CAN_STATUS_COUNT) - 1;
+        status_report.next_time += status_report.period;
+    }
+
+    // send one counter at a time, not to fill the TX queue
+    int counter = 0;
+    while(!(status_report.pending & (1 << counter)))
+        counter++;
 
-static inline int open_can_fd(void) {
-    can_fd = open("/dev/can0", O_RDWR | O_NOCTTY);
-    if(can_fd < 0)
+    struct color2can_status status = {
+        .counter = counter,
+        .value   = status_get(counter)
+    };
+    int err = write_message(
+        COLOR2CAN_STATUS_MASK_ID | sensor_id,
+        &status, COLOR2CAN_STATUS_SIZE
+    );
+    if(err)
+        return;
+
+    status_report.pending &= ~(1 << counter);
+    if(counter == COLOR2CAN_STATUS_LOOP_MAX_LATENCY)
+        status_reset_latency();
+}
+
+/* ================================================================== */
+/*                          Latency Report                            */
+/* ================================================================== */
+
+#define LATENCY_ENTRIES (COLOR2CAN_LATENCY_PHASES * COLOR2CAN_LATENCY_BUCKETS)
+
+static struct {
+    bool pending;
+    int next; // index of the next histogram entry to check
+} latency_report;
+
+static void handle_latency_request(const struct hal_can_msg *msg) {
+    if(msg->rtr || msg->len == 0) {
+        latency_report.pending = true;
+        latency_report.next    = 0;
+    } else if(msg->len == COLOR2CAN_LATENCY_RESET_SIZE) {
+        can_io_reset_latency();
+    }
+}
+
+// Returns the index of the first non-empty histogram entry starting
+// from 'start', or -1 if there is none.
+static inline int next_latency_entry(int start) {
+    const uint32_t *entries = &latency_histogram[0][0];
+    for(int i = start; i < LATENCY_ENTRIES; i++)
+        if(entries[i] != 0)
+            return i;
+    return -1;
+}
+
+static void latency_sender(void) {
+    if(__atomic_exchange_n(&latency_reset_pending, false, __ATOMIC_ACQUIRE)) {
+        memset(latency_histogram, 0, sizeof(latency_histogram));
+        LOG(LOG_LATENCY_RESET);
+    }
+
+    if(!latency_report.pending)
+        return;
+
+    // only non-empty buckets are sent
+    int i = next_latency_entry(latency_report.next);
+    int next = (i < 0 ? -1 : next_latency_entry(i + 1));
+
+    struct color2can_latency latency = {
+        .last = (next < 0)
+    };
+    if(i >= 0) {
+        latency.phase  = i / COLOR2CAN_LATENCY_BUCKETS;
+        latency.bucket = i % COLOR2CAN_LATENCY_BUCKETS;
+        latency.count  = latency_histogram[latency.phase][latency.bucket];
+    }
+
+    int err = write_message(
+        COLOR2CAN_LATENCY_MASK_ID | sensor_id,
+        &latency, COLOR2CAN_LATENCY_SIZE
+    );
+    if(err)
+        return;
+
+    latency_report.pending = (next >= 0);
+    latency_report.next    = next;
+}
+
+/* ================================================================== */
+/*                            Trace Report                            */
+/* ================================================================== */
+
+static struct {
+    bool pending;
+    int next;  // index of the next event to send
+    int count; // number of events to send
+} trace_report;
+
+static void handle_trace_request(const struct hal_can_msg *msg) {
+    if(trace_report.pending)
+        return;
+
+    if(msg->rtr || msg->len == 0) {
+        // the report itself should not be recorded
+        trace_report.pending = true;
+        trace_report.next    = 0;
+        trace_report.count   = trace_read_begin();
+    }
+}
+
+static void trace_sender(void) {
+    if(!trace_report.pending)
+        return;
+
+    struct color2can_trace event = {
+        .event = COLOR2CAN_TRACE_LAST
+    };
+    if(trace_report.next < trace_report.count)
+        trace_get(trace_report.next, &event);
+
+    int err = write_message(
+        COLOR2CAN_TRACE_MASK_ID | sensor_id,
+        &event, COLOR2CAN_TRACE_SIZE
+    );
+    if(err)
+        return; // sent again once the TX queue has room
+
+    if(event.event != COLOR2CAN_TRACE_LAST) {
+        trace_report.next++;
+    } else {
+        trace_report.pending = false;
+        trace_read_end();
+    }
+}
+
+/* ================================================================== */
+/*                          Bit Rate Switch                           */
+/* ================================================================== */
+
+// if no message is received after switching, restore the old bit rate
+#define BITRATE_FALLBACK_TIMEOUT 2000000 // 2s
+
+static struct {
+    bool pending;    // waiting to switch
+    bool confirming; // switched, waiting for a message
+    uint64_t time;   // switch time or fallback deadline
+
+    int new_bitrate;
+    int old_bitrate;
+
+    // the reply to the latest request, until it fits in the TX queue
+    bool reply_pending;
+    struct color2can_bitrate reply;
+} bitrate_switch;
+
+static int set_bitrate(int val) {
+    if(hal_can_set_bitrate(val)) {
+        LOG(LOG_BITRATE_ERROR, val);
         return 1;
+    }
 
-    // enable non-blocking reads
-    int flags = fcntl(can_fd, F_GETFL);
-    fcntl(can_fd, F_SETFL, flags | O_NONBLOCK);
+    bitrate = val;
 
+    // the configuration may have changed since the switch was accepted
+    const int min_period = min_transmit_period(bitrate);
+    if(transmit_period != 0 && transmit_period < min_period) {
+        transmit_period = min_period;
+        LOG(LOG_PERIOD_RAISED, transmit_period, bitrate);
+    }
     return 0;
 }
 
-static inline void print_bit_timing(int fd) {
-    struct canioc_bittiming_s bt;
-    int ret = ioctl(
-        fd, CANIOC_GET_BITTIMING,
-        (unsigned long) ((uintptr_t) &bt)
+static void handle_bitrate_request(const struct color2can_bitrate *request) {
+    // ignore acknowledgements sent by other sensors
+    if(request->status != COLOR2CAN_BITRATE_REQUEST)
+        return;
+
+    // A new switch cannot start until the previous one is confirmed.
+    // The transmit period must also be long enough at the new bit rate.
+    int err = bitrate_switch.confirming ||
+              request->bitrate > 1000000 ||
+              hal_can_check_bitrate(request->bitrate) ||
+              (transmit_period != 0 &&
+               transmit_period < min_transmit_period(request->bitrate));
+    if(!err) {
+        bitrate_switch.pending     = true;
+        bitrate_switch.time        = hrtime_us() + request->delay * 1000;
+        bitrate_switch.new_bitrate = request->bitrate;
+    }
+
+    bitrate_switch.reply_pending = true;
+    bitrate_switch.reply = *request;
+    bitrate_switch.reply.status = (err ? COLOR2CAN_BITRATE_REJECTED
+                                       : COLOR2CAN_BITRATE_ACCEPTED);
+    send_bitrate_reply();
+
+    LOG(LOG_BITRATE_REQUEST, request->bitrate, request->delay, err);
+}
+
+// Returns 1 if the reply is still waiting for room in the TX queue
+static int send_bitrate_reply(void) {
+    if(!bitrate_switch.reply_pending)
+        return 0;
+
+    int err = write_message(
+        COLOR2CAN_BITRATE_MASK_ID | sensor_id,
+        &bitrate_switch.reply, COLOR2CAN_BITRATE_SIZE
     );
+    if(err > 0)
+        return 1;
+
+    bitrate_switch.reply_pending = false;
+    return 0;
+}
+
+static void confirm_bitrate(void) {
+    if(!bitrate_switch.confirming)
+        return;
+
+    bitrate_switch.confirming = false;
+    LOG(LOG_BITRATE_CONFIRM, bitrate);
+}
+
+// Returns the time (in microseconds) before the bit rate switch needs
+// attention, or -1 if there is no switch in progress.
+static int bitrate_switch_delay(void) {
+    if(bitrate_switch.reply_pending)
+        return 0;
+    if(!bitrate_switch.pending && !bitrate_switch.confirming)
+        return -1;
 
-    if(ret < 0) {
-        printf("[CAN-IO] bit timing not available\n");
+    uint64_t now = hrtime_us();
+    if(now >= bitrate_switch.time)
+        return 0;
+    return bitrate_switch.time - now;
+}
+
+static void bitrate_switcher(void) {
+    // the host must know the outcome before the sensor switches
+    if(send_bitrate_reply())
+        return;
+    if(bitrate_switch_delay() != 0)
+        return;
+
+    if(bitrate_switch.pending) {
+        bitrate_switch.pending = false;
+
+        // save the old bit rate, in case the bus goes silent
+        bitrate_switch.old_bitrate = bitrate;
+        if(set_bitrate(bitrate_switch.new_bitrate))
+            return;
+
+        bitrate_switch.confirming = true;
+        bitrate_switch.time = hrtime_us() + BITRATE_FALLBACK_TIMEOUT;
+        LOG(LOG_BITRATE_SWITCH, bitrate);
     } else {
-        printf("[CAN-IO] bit timing:\n");
-        printf("   Baud: %lu\n", (unsigned long) bt.bt_baud);
-        printf("  TSEG1: %u\n", bt.bt_tseg1);
-        printf("  TSEG2: %u\n", bt.bt_tseg2);
-        printf("    SJW: %u\n", bt.bt_sjw);
+        bitrate_switch.confirming = false;
+        set_bitrate(bitrate_switch.old_bitrate);
+        LOG(LOG_BITRATE_RESTORE, bitrate);
     }
 }
 
+/* ================================================================== */
+
+// Wait until a message arrives, the TX queue has room (if it was full)
+// or the timeout (in microseconds) expires.
+static inline void wait_for_messages(int timeout) {
+    int ret = hal_can_wait(timeout, tx_full);
+    rx_time = hrtime_us();
+    rx_time_valid = (ret > 0);
+
+    // messages that did not fit are sent again in the next iteration
+    tx_full = false;
+}
+
+void can_io_run_once(void) {
+    const uint64_t start = hrtime_us();
+
+    profile_apply_reset();
+    receiver();
+    sender();
+    status_sender();
+    latency_sender();
+    trace_sender();
+    bitrate_switcher();
+
+    const uint32_t latency = hrtime_us() - start;
+    if(latency > status_counters.loop_max_latency)
+        status_counters.loop_max_latency = latency;
+
+    // time before the next sample is due
+    int delay = -1;
+    const int delays[] = {
+        has_unsent() ? 0 : -1,
+        pending_request_delay(), sync_delay(), periodic_delay(),
+        status_delay(), bitrate_switch_delay(),
+        latency_report.pending ? 0 : -1,
+        trace_report.pending ? 0 : -1
+    };
+    for(int i = 0; i < sizeof(delays) / sizeof(delays[0]); i++)
+        if(delays[i] >= 0 && (delay < 0 || delays[i] < delay))
+            delay = delays[i];
+
+    // if the TX queue is full, do not retry before it has room
+    if(delay != 0 || tx_full)
+        wait_for_messages(delay <= 0 || delay > 10000 ? 10000 : delay);
+}
+
 static void *can_io_run(void *arg) {
     puts("[CAN-IO] thread started");
-    while(true) {
-        receiver();
-        sender();
+    while(true)
+        can_io_run_once();
+    return NULL;
+}
 
-        // if there are no pending requests, sleep
-        if(requests == 0)
-            usleep(500); // wait 0.5ms
+int can_io_init(void) {
+    while(hal_can_open()) {
+        perror("[CAN-IO] error opening CAN device");
+        hal_sleep_us(1000000);
     }
-    return NULL;
+    puts("[CAN-IO] CAN device opened");
+
+    int val = hal_can_get_bitrate();
+    if(val > 0)
+        bitrate = val;
+    return 0;
 }
 
 int can_io_start(void) {
-    while(open_can_fd())
-        perror("[CAN-IO] error opening /dev/can0");
-    puts("[CAN-IO] /dev/can0 opened");
-    print_bit_timing(can_fd);
+    if(can_io_init())
+        return 1;
 
     pthread_t thread;
     if(pthread_create(&thread, NULL, can_io_run, NULL)) {
@@ -276,17 +1156,104 @@ int can_io_set_sensor_id(int id) {
     else
         err = 1;
 
-    printf("[CAN-IO] setting sensor ID to %d (err=%d)\n", id, err);
+    LOG(LOG_SENSOR_ID, id, err);
     return err;
 }
 
+// worst-case length of a sample or sample info message
+#define SAMPLE_MESSAGE_BITS 135
+
+static int min_transmit_period(int rate) {
+    int period = color_get_read_period();
+
+    const int messages = (sample_info ? 2 : 1);
+    const int bus_time = (int64_t) messages * SAMPLE_MESSAGE_BITS
+                       * 1000000 / rate;
+    if(bus_time > period)
+        period = bus_time;
+    return period;
+}
+
 int can_io_set_transmit_frequency(int val) {
     int err = 0;
-    if(val <= 400)
-        transmit_frequency = val;
+    if(val == 0)
+        err = can_io_set_transmit_period(0);
+    else if(val > 0 && val <= 400)
+        err = can_io_set_transmit_period(1000000 / val);
     else
         err = 1;
 
-    printf("[CAN-IO] setting transmit frequency to %d (err=%d)\n", val, err);
+    LOG(LOG_TRANSMIT_FREQ, val, err);
+    return err;
+}
+
+int can_io_set_transmit_period(int val) {
+    int err = 0;
+    if(val == 0 || (val > 0 && val >= min_transmit_period(bitrate))) {
+        transmit_period = val;
+        next_periodic_time = 0;
+        overrun = false;
+
+        // periodic samples are read from consecutive cycles
+        color_set_continuous(val != 0);
+    } else {
+        err = 1;
+    }
+
+    LOG(LOG_TRANSMIT_PERIOD, val, min_transmit_period(bitrate), err);
+    return err;
+}
+
+int can_io_set_sample_info(int val) {
+    sample_info = val;
+    LOG(LOG_SAMPLE_INFO, val);
+    return 0;
+}
+
+#ifdef CONFIG_CAN_FD
+int can_io_set_batch_size(int val) {
+    int err = 0;
+    if(val >= 0 && val <= COLOR2CAN_SAMPLE_BATCH_MAX) {
+        flush_batch();
+        batch_size = val;
+    } else {
+        err = 1;
+    }
+
+    LOG(LOG_BATCH_SIZE, val, err);
     return err;
 }
+#endif
+
+void can_io_print_latency(void) {
+    static const char *phases[COLOR2CAN_LATENCY_PHASES] = {
+        [COLOR2CAN_LATENCY_QUEUE]      = "queue",
+        [COLOR2CAN_LATENCY_SENSOR]     = "sensor",
+        [COLOR2CAN_LATENCY_PROCESSING] = "processing",
+        [COLOR2CAN_LATENCY_TX]         = "TX",
+        [COLOR2CAN_LATENCY_TOTAL]      = "total"
+    };
+
+    puts("[CAN-IO] request latency (us):");
+    for(int phase = 0; phase < COLOR2CAN_LATENCY_PHASES; phase++) {
+        printf("  %s\n", phases[phase]);
+        for(int i = 0; i < COLOR2CAN_LATENCY_BUCKETS; i++) {
+            uint32_t count = latency_histogram[phase][i];
+            if(count == 0)
+                continue;
+
+            printf(
+                "    %6lu...%-6lu %lu\n",
+                (unsigned long) (i == 0 ? 0 : 1 << i),
+                (unsigned long) (1 << (i + 1)) - 1,
+                (unsigned long) count
+            );
+        }
+    }
+}
+
+// The histogram is only written by the CAN thread, which resets it
+// within one iteration of its loop.
+void can_io_reset_latency(void) {
+    __atomic_store_n(&latency_reset_pending, true, __ATOMIC_RELEASE);
+}
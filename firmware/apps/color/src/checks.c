@@ -9,6 +9,11 @@ _Static_assert(
     "size of struct color2can_config is incorrect"
 );
 
+_Static_assert(
+    sizeof(struct color2can_config_ext) == COLOR2CAN_CONFIG_EXT_SIZE,
+    "size of struct color2can_config_ext is incorrect"
+);
+
 _Static_assert(
     sizeof(struct color2can_range) == COLOR2CAN_RANGE_SIZE,
     "size of struct color2can_range is incorrect"
@@ -18,3 +23,54 @@ _Static_assert(
     sizeof(struct color2can_sample) == COLOR2CAN_SAMPLE_SIZE,
     "size of struct color2can_sample is incorrect"
 );
+
+_Static_assert(
+    sizeof(struct color2can_request) == COLOR2CAN_REQUEST_SIZE,
+    "size of struct color2can_request is incorrect"
+);
+
+_Static_assert(
+    sizeof(struct color2can_sample_batch) ==
+        COLOR2CAN_SAMPLE_BATCH_SIZE(COLOR2CAN_SAMPLE_BATCH_MAX),
+    "size of struct color2can_sample_batch is incorrect"
+);
+
+_Static_assert(
+    sizeof(struct color2can_sync) == COLOR2CAN_SYNC_SIZE,
+    "size of struct color2can_sync is incorrect"
+);
+
+_Static_assert(
+    sizeof(struct color2can_sample_info) == COLOR2CAN_SAMPLE_INFO_SIZE,
+    "size of struct color2can_sample_info is incorrect"
+);
+
+_Static_assert(
+    sizeof(struct color2can_time) == COLOR2CAN_TIME_SIZE,
+    "size of struct color2can_time is incorrect"
+);
+
+_Static_assert(
+    sizeof(struct color2can_bitrate) == COLOR2CAN_BITRATE_SIZE,
+    "size of struct color2can_bitrate is incorrect"
+);
+
+_Static_assert(
+    sizeof(struct color2can_status_request) == COLOR2CAN_STATUS_REQUEST_SIZE,
+    "size of struct color2can_status_request is incorrect"
+);
+
+_Static_assert(
+    sizeof(struct color2can_status) == COLOR2CAN_STATUS_SIZE,
+    "size of struct color2can_status is incorrect"
+);
+
+_Static_assert(
+    sizeof(struct color2can_latency) == COLOR2CAN_LATENCY_SIZE,
+    "size of struct color2can_latency is incorrect"
+);
+
+_Static_assert(
+    sizeof(struct color2can_trace) == COLOR2CAN_TRACE_SIZE,
+    "size of struct color2can_trace is incorrect"
+);
@@ -16,54 +16,105 @@
 #include "color.h"
 
 #include <stdio.h>
-#include <unistd.h>
-#include <nuttx/i2c/i2c_master.h>
 
 #include "color2can.h"
+#include "hal.h"
+#include "hrtime.h"
+#include "status.h"
+#include "log.h"
+#include "trace.h"
 
-extern struct i2c_master_s *i2cmain;
-static struct i2c_config_s i2c_config;
+// duration of one integration cycle
+#define INTEGRATION_CYCLE_US 2400
+
+// initialization of the RGBC, after it is enabled
+#define RGBC_INIT_US 2400
+
+#define STATUS_AVALID (1 << 0)
+
+// interval between reads of the STATUS register, while waiting for AVALID
+#define AVALID_POLL_US 200
 
 static int led_usage;
+static int integration_time = INTEGRATION_CYCLE_US; // in microseconds
+static bool continuous;
+
+// The next read returns the cycle that ends at cycle_start plus the
+// integration time or, in continuous mode, the last one ending by then.
+static uint64_t cycle_start;
+
+static inline int sensor_write(uint8_t *buf, int len) {
+    TRACE_BEGIN(COLOR2CAN_TRACE_I2C, len);
+    int err = hal_i2c_write(buf, len);
+    TRACE_END(COLOR2CAN_TRACE_I2C, len);
+    if(err)
+        status_counters.i2c_errors++;
+    return err;
+}
 
-extern void set_i2c_rst(bool on);
+static inline int sensor_writeread(uint8_t *cmd, uint8_t *buf, int len) {
+    TRACE_BEGIN(COLOR2CAN_TRACE_I2C, 1 + len);
+    int err = hal_i2c_writeread(cmd, 1, buf, len);
+    TRACE_END(COLOR2CAN_TRACE_I2C, 1 + len);
+    if(err)
+        status_counters.i2c_errors++;
+    return err;
+}
 
 static inline void color_reset(void) {
-    set_i2c_rst(0);
-    usleep(2000);
-    set_i2c_rst(1);
-    usleep(2000);
-    set_i2c_rst(0);
-    usleep(10000);
+    hal_i2c_set_reset(0);
+    hal_sleep_us(2000);
+    hal_i2c_set_reset(1);
+    hal_sleep_us(2000);
+    hal_i2c_set_reset(0);
+    hal_sleep_us(10000);
 }
 
 static inline int detect_sensor(void) {
     uint8_t cmd = 0x92; // addr = 0x12 (ID register)
-    uint8_t id;
-    i2c_writeread(i2cmain, &i2c_config, &cmd, 1, &id, 1);
+    uint8_t id = 0;
+    sensor_writeread(&cmd, &id, 1);
     return (id != 0x44);
 }
 
+// Disables, then enables RGBC: this clears AVALID and starts a new
+// integration cycle, after the RGBC initialization.
+static inline void restart_cycle(bool led) {
+    const int led_bit = (!led) << 4;
+    uint8_t disable[] = {
+        0x80,           // addr = 0x00 (ENABLE register)
+        0x01 | led_bit, // ENABLE: Power on, RGBC disable, LED on/off
+    };
+    uint8_t enable[] = {
+        0x80,           // addr = 0x00 (ENABLE register)
+        0x03 | led_bit, // ENABLE: Power on, RGBC enable, LED on/off
+    };
+    sensor_write(disable, sizeof(disable));
+    sensor_write(enable, sizeof(enable));
+
+    cycle_start = hrtime_us() + RGBC_INIT_US;
+}
+
 static inline int initialize_sensor(void) {
     uint8_t buf[] = {
         0xa0, // addr = 0x00 (ENABLE register), auto-increment
         0x13, // ENABLE: Power on, RGBC enable, LED off
         0xff, // ATIME:  2.4 ms
     };
-    i2c_write(i2cmain, &i2c_config, buf, sizeof(buf));
-    usleep(10000); // wait 10ms
+    sensor_write(buf, sizeof(buf));
+    cycle_start = hrtime_us() + RGBC_INIT_US;
+
+    hal_sleep_us(10000); // wait 10ms
     return 0;
 }
 
 int color_init(void) {
-    // prepare I2C configuration
-    i2c_config.frequency = 400000; // 400 KHz
-    i2c_config.address   = 0x29;
-    i2c_config.addrlen   = 7;
+    // prepare I2C configuration: 400 KHz
+    hal_i2c_init(0x29, 400000);
 
     puts("[Color] resetting sensor");
-    board_userled(BOARD_RED_LED,   true);
-    board_userled(BOARD_GREEN_LED, true);
+    hal_led_set(HAL_LED_RED,   true);
+    hal_led_set(HAL_LED_GREEN, true);
     color_reset();
 
     if(detect_sensor()) {
@@ -78,8 +129,8 @@ int color_init(void) {
     }
     puts("[Color] initialization complete");
 
-    board_userled(BOARD_RED_LED,   false);
-    board_userled(BOARD_GREEN_LED, false);
+    hal_led_set(HAL_LED_RED,   false);
+    hal_led_set(HAL_LED_GREEN, false);
     return 0;
 }
 
@@ -89,23 +140,68 @@ static inline void toggle_led(bool enable) {
         0x80,           // addr = 0x00 (ENABLE register)
         0x03 | led_bit, // ENABLE: Power on, RGBC enable, LED on/off
     };
-    i2c_write(i2cmain, &i2c_config, buf, sizeof(buf));
+    sensor_write(buf, sizeof(buf));
 }
 
-int color_read_data(int *r, int *g, int *b, int *clear) {
-    toggle_led(led_usage != COLOR2CAN_LED_NEVER);
-    usleep(2400);
+// Reads the STATUS register, then the (clear, r, g, b) values, once the
+// cycle that started at 'cycle_start' is complete. Returns the time of
+// the transfer in 'time'.
+static inline int read_cycle(uint8_t data[9], uint64_t *time) {
+    TRACE_BEGIN(COLOR2CAN_TRACE_INTEGRATION, 0);
+    const uint64_t end = cycle_start + integration_time;
+    uint64_t now = hrtime_us();
+    if(now < end)
+        hal_sleep_us(end - now);
 
-    // read STATUS register, then read the (clear, r, g, b) values
+    // The sensor's oscillator may be slower than nominal: poll AVALID
+    // for up to 1/8 of the integration time.
+    const uint64_t deadline = end + integration_time / 8;
     uint8_t cmd = 0xb3; // addr = 0x13 (STATUS register), auto-increment
+    int err;
+    while(true) {
+        *time = hrtime_us();
+        err = sensor_writeread(&cmd, data, 9);
+        if(err || (data[0] & STATUS_AVALID))
+            break;
+
+        now = hrtime_us();
+        if(now >= deadline)
+            break;
+        hal_sleep_us(AVALID_POLL_US);
+    }
+    TRACE_END(COLOR2CAN_TRACE_INTEGRATION, 0);
+    return err;
+}
+
+int color_read_data(int *r, int *g, int *b, int *clear) {
+    // the whole cycle must be integrated with the LED on
+    if(led_usage == COLOR2CAN_LED_SAMPLING)
+        restart_cycle(true);
+
     uint8_t data[9];
-    i2c_writeread(i2cmain, &i2c_config, &cmd, 1, data, sizeof(data));
+    uint64_t read_time;
+    int err = read_cycle(data, &read_time);
+
+    // The sensor integrates continuously, and the cycle in progress
+    // started before this read. In continuous mode, the next read returns
+    // that cycle: it follows the one just read, and ends within an
+    // integration time. Otherwise, restart it, so that the next read
+    // returns a cycle that started after this one.
+    if(led_usage == COLOR2CAN_LED_SAMPLING)
+        toggle_led(false);
+    else if(continuous)
+        cycle_start = read_time;
+    else
+        restart_cycle(led_usage == COLOR2CAN_LED_ALWAYS);
 
-    toggle_led(led_usage == COLOR2CAN_LED_ALWAYS);
+    if(err)
+        return 1;
 
     // if data is not valid, return an error
-    if(!(data[0] & 1))
+    if(!(data[0] & STATUS_AVALID)) {
+        status_counters.invalid_data++;
         return 1;
+    }
 
     *clear = data[1] | data[2] << 8;
     *r     = data[3] | data[4] << 8;
@@ -113,14 +209,17 @@ int color_read_data(int *r, int *g, int *b, int *clear) {
     *b     = data[7] | data[8] << 8;
 
     if(debug_flag) {
-        printf(
-            "[Color] read R:%d, G:%d, B:%d - C:%d\n",
-            *r, *g, *b, *clear
-        );
+        LOG(LOG_COLOR_READ, *r, *g, *b, *clear);
     }
     return 0;
 }
 
+int color_restart_integration(void) {
+    // the next read waits for the RGBC initialization and a full cycle
+    restart_cycle(led_usage != COLOR2CAN_LED_NEVER);
+    return 0;
+}
+
 int color_set_led_usage(int val) {
     int err = 0;
     switch(val) {
@@ -128,11 +227,69 @@ int color_set_led_usage(int val) {
         case COLOR2CAN_LED_SAMPLING:
         case COLOR2CAN_LED_ALWAYS:
             led_usage = val;
+            restart_cycle(val == COLOR2CAN_LED_ALWAYS);
             break;
 
         default:
             err = 1;
     }
-    printf("[Color] setting LED usage to %d (err=%d)\n", val, err);
+    LOG(LOG_LED_USAGE, val, err);
+    return err;
+}
+
+int color_set_integration_time(int cycles) {
+    int err = 0;
+    if(cycles >= 1 && cycles <= 256) {
+        uint8_t buf[] = {
+            0x81,                   // addr = 0x01 (ATIME register)
+            (uint8_t) (256 - cycles) // ATIME: cycles * 2.4 ms
+        };
+        sensor_write(buf, sizeof(buf));
+        integration_time = cycles * INTEGRATION_CYCLE_US;
+
+        // the cycle in progress has the previous integration time
+        restart_cycle(led_usage == COLOR2CAN_LED_ALWAYS);
+    } else {
+        err = 1;
+    }
+
+    LOG(LOG_INTEGRATION, cycles * INTEGRATION_CYCLE_US, err);
     return err;
 }
+
+void color_set_continuous(bool enable) {
+    // the cycle in progress may have started before the latest read
+    if(continuous && !enable && led_usage != COLOR2CAN_LED_SAMPLING)
+        restart_cycle(led_usage == COLOR2CAN_LED_ALWAYS);
+    continuous = enable;
+}
+
+int color_get_read_period(void) {
+    // with LED_SAMPLING, each read restarts the cycle
+    if(led_usage == COLOR2CAN_LED_SAMPLING)
+        return color_get_restart_period();
+
+    // in continuous mode, the I2C transfers overlap the next cycle
+    return integration_time;
+}
+
+int color_get_restart_period(void) {
+    // the RGBC initialization, a full integration cycle and the I2C
+    // transfers. With LED_SAMPLING, the LED is also switched off.
+    int period = RGBC_INIT_US + integration_time + INTEGRATION_CYCLE_US / 4;
+    if(led_usage == COLOR2CAN_LED_SAMPLING)
+        period += INTEGRATION_CYCLE_US / 8;
+    return period;
+}
+
+uint32_t color_bench_i2c(int iterations) {
+    uint8_t cmd = 0xb3; // addr = 0x13 (STATUS register), auto-increment
+    uint8_t data[9];
+
+    const uint64_t start = hrtime_cycles();
+    for(int i = 0; i < iterations; i++)
+        sensor_writeread(&cmd, data, sizeof(data));
+    const uint64_t elapsed = hrtime_cycles() - start;
+
+    return elapsed / iterations;
+}
@@ -0,0 +1,303 @@
+/* Copyright 2025 Vulcalien
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "hal.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <nuttx/irq.h>
+#include <nuttx/i2c/i2c_master.h>
+#include <nuttx/can/can.h>
+#include <arch/board/board.h>
+
+#include "hrtime.h"
+
+_Static_assert(
+    STM32L4_HCLK_FREQUENCY / 1000000 == HAL_CYCLES_PER_US,
+    "HAL_CYCLES_PER_US does not match the CPU clock"
+);
+
+/* ================================================================== */
+/*                                Time                                */
+/* ================================================================== */
+
+// Cortex-M4 debug registers
+#define DEMCR    (*(volatile uint32_t *) 0xe000edfc)
+#define DWT_CTRL (*(volatile uint32_t *) 0xe0001000)
+
+#define DEMCR_TRCENA       (1 << 24)
+#define DWT_CTRL_CYCCNTENA (1 << 0)
+
+int hal_time_init(void) {
+    DEMCR |= DEMCR_TRCENA;
+    DWT_CYCCNT = 0;
+    DWT_CTRL |= DWT_CTRL_CYCCNTENA;
+    return 0;
+}
+
+void hal_sleep_us(int us) {
+    usleep(us);
+}
+
+uint32_t hal_critical_enter(void) {
+    return enter_critical_section();
+}
+
+void hal_critical_leave(uint32_t flags) {
+    leave_critical_section(flags);
+}
+
+void hal_sched_lock(void) {
+    sched_lock();
+}
+
+void hal_sched_unlock(void) {
+    sched_unlock();
+}
+
+/* ================================================================== */
+/*                                LEDs                                */
+/* ================================================================== */
+
+#define BOARD_RED_LED   0
+#define BOARD_GREEN_LED 1
+extern void board_userled(int led, bool ledon);
+
+void hal_led_set(int led, bool on) {
+    board_userled(led == HAL_LED_RED ? BOARD_RED_LED : BOARD_GREEN_LED, on);
+}
+
+/* ================================================================== */
+/*                                I2C                                 */
+/* ================================================================== */
+
+extern struct i2c_master_s *i2cmain;
+extern void set_i2c_rst(bool on);
+
+static struct i2c_config_s i2c_config;
+
+int hal_i2c_init(int address, int frequency) {
+    i2c_config.frequency = frequency;
+    i2c_config.address   = address;
+    i2c_config.addrlen   = 7;
+    return 0;
+}
+
+void hal_i2c_set_reset(bool on) {
+    set_i2c_rst(on);
+}
+
+int hal_i2c_write(const uint8_t *buf, int len) {
+    return i2c_write(i2cmain, &i2c_config, buf, len) < 0;
+}
+
+int hal_i2c_writeread(const uint8_t *cmd, int cmdlen,
+                      uint8_t *buf, int len) {
+    return i2c_writeread(i2cmain, &i2c_config, cmd, cmdlen, buf, len) < 0;
+}
+
+/* ================================================================== */
+/*                                CAN                                 */
+/* ================================================================== */
+
+#define CAN_CLOCK_FREQUENCY STM32L4_PCLK1_FREQUENCY
+#define CAN_MAX_PRESCALER   1024
+
+static int can_fd;
+
+static inline int msg_datalen(const struct can_msg_s *msg) {
+#ifdef CONFIG_CAN_FD
+    return can_dlc2bytes(msg->cm_hdr.ch_dlc);
+#else
+    return msg->cm_hdr.ch_dlc;
+#endif
+}
+
+static inline void print_bit_timing(void) {
+    struct canioc_bittiming_s bt;
+    int ret = ioctl(
+        can_fd, CANIOC_GET_BITTIMING,
+        (unsigned long) ((uintptr_t) &bt)
+    );
+
+    if(ret < 0) {
+        printf("[HAL] bit timing not available\n");
+    } else {
+        printf("[HAL] bit timing:\n");
+        printf("   Baud: %lu\n", (unsigned long) bt.bt_baud);
+        printf("  TSEG1: %u\n", bt.bt_tseg1);
+        printf("  TSEG2: %u\n", bt.bt_tseg2);
+        printf("    SJW: %u\n", bt.bt_sjw);
+    }
+}
+
+int hal_can_open(void) {
+    can_fd = open("/dev/can0", O_RDWR | O_NOCTTY);
+    if(can_fd < 0)
+        return 1;
+
+    // enable non-blocking reads
+    int flags = fcntl(can_fd, F_GETFL);
+    fcntl(can_fd, F_SETFL, flags | O_NONBLOCK);
+
+    print_bit_timing();
+    return 0;
+}
+
+// Returns the arrival time of a message, as precisely as possible
+static inline void set_arrival_time(struct hal_can_msg *msg,
+                                    const struct can_msg_s *raw) {
+#ifdef CONFIG_CAN_TIMESTAMP
+    // The driver's timestamp has the resolution of the system tick, in
+    // a different time base: use it to compute the age of the message.
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    int64_t age = (int64_t) (now.tv_sec - raw->cm_hdr.ch_ts.tv_sec) * 1000000
+                + now.tv_nsec / 1000 - raw->cm_hdr.ch_ts.tv_usec;
+    if(age < 0)
+        age = 0;
+
+    msg->time_valid = true;
+    msg->time       = hrtime_us() - age;
+#else
+    msg->time_valid = false;
+#endif
+}
+
+int hal_can_read(struct hal_can_msg *msg) {
+    struct can_msg_s raw;
+
+    int nbytes = read(can_fd, &raw, sizeof(raw));
+    if(nbytes < 0)
+        return (errno == EAGAIN ? 0 : -1);
+
+    msg->id  = raw.cm_hdr.ch_id;
+    msg->len = msg_datalen(&raw);
+    msg->rtr = raw.cm_hdr.ch_rtr;
+    memcpy(msg->data, raw.cm_data, msg->len);
+
+    set_arrival_time(msg, &raw);
+    return 1;
+}
+
+int hal_can_write(const struct hal_can_msg *msg) {
+    struct can_msg_s raw;
+
+    // set CAN header
+    raw.cm_hdr = (struct can_hdr_s) {
+        .ch_id  = msg->id,
+        .ch_dlc = msg->len,
+        .ch_rtr = msg->rtr,
+        .ch_tcf = false
+    };
+
+#ifdef CONFIG_CAN_FD
+    // messages longer than 8 bytes are sent as CAN FD frames, padded
+    // to the next valid length
+    if(msg->len > 8) {
+        raw.cm_hdr.ch_dlc = can_bytes2dlc(msg->len);
+        raw.cm_hdr.ch_edl = true;
+        raw.cm_hdr.ch_brs = true;
+
+        memset(&raw.cm_data[msg->len], 0, msg_datalen(&raw) - msg->len);
+    }
+#endif
+
+    // set CAN data
+    memcpy(raw.cm_data, msg->data, msg->len);
+
+    // write CAN message
+    const int msglen = CAN_MSGLEN(msg_datalen(&raw));
+    if(write(can_fd, &raw, msglen) == msglen)
+        return 0;
+    return (errno == EAGAIN ? 1 : -1);
+}
+
+int hal_can_wait(int timeout, bool writable) {
+    struct pollfd fds = {
+        .fd     = can_fd,
+        .events = POLLIN
+    };
+
+    // if messages arrived while busy, their reception time is unknown
+    if(poll(&fds, 1, 0) > 0)
+        return 0;
+
+    // poll() has a resolution of 1ms: sleep for shorter timeouts
+    if(timeout < 1000) {
+        usleep(timeout);
+        return 0;
+    }
+
+    if(writable)
+        fds.events |= POLLOUT;
+    if(poll(&fds, 1, timeout / 1000) <= 0)
+        return 0;
+    return (fds.revents & POLLIN) != 0;
+}
+
+int hal_can_get_bitrate(void) {
+    struct canioc_bittiming_s bt;
+    int ret = ioctl(
+        can_fd, CANIOC_GET_BITTIMING,
+        (unsigned long) ((uintptr_t) &bt)
+    );
+    return (ret < 0 ? -1 : (int) bt.bt_baud);
+}
+
+// Keep the current time segments and only change the prescaler: the
+// bit rate is valid if the CAN clock can be divided exactly.
+static int get_bit_timing(int rate, struct canioc_bittiming_s *bt) {
+    int ret = ioctl(
+        can_fd, CANIOC_GET_BITTIMING,
+        (unsigned long) ((uintptr_t) bt)
+    );
+    if(ret < 0 || rate <= 0 || rate > 1000000)
+        return 1;
+
+    const uint32_t quanta = 1 + bt->bt_tseg1 + bt->bt_tseg2;
+    if(CAN_CLOCK_FREQUENCY % (rate * quanta) != 0)
+        return 1;
+    if(CAN_CLOCK_FREQUENCY / (rate * quanta) > CAN_MAX_PRESCALER)
+        return 1;
+
+    bt->bt_baud = rate;
+    return 0;
+}
+
+int hal_can_check_bitrate(int bitrate) {
+    struct canioc_bittiming_s bt;
+    return get_bit_timing(bitrate, &bt);
+}
+
+int hal_can_set_bitrate(int bitrate) {
+    struct canioc_bittiming_s bt;
+    if(get_bit_timing(bitrate, &bt))
+        return 1;
+
+    int ret = ioctl(
+        can_fd, CANIOC_SET_BITTIMING,
+        (unsigned long) ((uintptr_t) &bt)
+    );
+    return ret < 0;
+}
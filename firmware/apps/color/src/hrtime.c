@@ -0,0 +1,42 @@
+/* Copyright 2025 Vulcalien
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "hrtime.h"
+
+#include "hal.h"
+
+// 64-bit extension of the cycle counter
+static uint64_t cycles;
+static uint32_t latest_cyccnt;
+
+int hrtime_init(void) {
+    return hal_time_init();
+}
+
+uint64_t hrtime_cycles(void) {
+    const uint32_t flags = hal_critical_enter();
+
+    const uint32_t cyccnt = hrtime_cyccnt();
+    cycles += (uint32_t) (cyccnt - latest_cyccnt);
+    latest_cyccnt = cyccnt;
+
+    const uint64_t result = cycles;
+    hal_critical_leave(flags);
+    return result;
+}
+
+uint64_t hrtime_us(void) {
+    return hrtime_cycles() / HAL_CYCLES_PER_US;
+}
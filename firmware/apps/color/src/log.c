@@ -0,0 +1,173 @@
+/* Copyright 2025 Vulcalien
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "log.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "hrtime.h"
+
+// must be a power of two
+#define LOG_BUFFER_SIZE 64
+
+// time between two checks of the buffer (in microseconds)
+#define DRAIN_PERIOD 20000
+
+#define DRAINER_PRIORITY 50
+
+_Static_assert(
+    sizeof(struct log_record) == LOG_RECORD_SIZE,
+    "size of struct log_record is incorrect"
+);
+
+static const char *formats[LOG_FORMAT_COUNT] = {
+#define LOG_STRING(id, format) [id] = format,
+    LOG_FORMATS(LOG_STRING)
+#undef LOG_STRING
+};
+
+// Bounded multi-producer queue: a slot can be written when its
+// sequence number equals the write position, and read when it equals
+// the read position plus one.
+static struct log_slot {
+    uint32_t sequence;
+    struct log_record record;
+} slots[LOG_BUFFER_SIZE];
+
+static uint32_t write_pos;
+static uint32_t read_pos; // only used by the drainer thread
+
+static uint32_t dropped;
+static bool binary_mode;
+
+void log_write(int format, int argc, const int32_t *args) {
+    struct log_slot *slot;
+
+    uint32_t pos = __atomic_load_n(&write_pos, __ATOMIC_RELAXED);
+    while(true) {
+        slot = &slots[pos % LOG_BUFFER_SIZE];
+        uint32_t seq = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+
+        int32_t diff = (int32_t) (seq - pos);
+        if(diff == 0) {
+            // the slot is free: try to reserve it
+            if(__atomic_compare_exchange_n(
+                &write_pos, &pos, pos + 1, true,
+                __ATOMIC_RELAXED, __ATOMIC_RELAXED
+            ))
+                break;
+        } else if(diff < 0) {
+            // the buffer is full
+            __atomic_fetch_add(&dropped, 1, __ATOMIC_RELAXED);
+            return;
+        } else {
+            // another thread reserved the slot
+            pos = __atomic_load_n(&write_pos, __ATOMIC_RELAXED);
+        }
+    }
+
+    if(argc > LOG_MAX_ARGS)
+        argc = LOG_MAX_ARGS;
+
+    struct log_record *record = &slot->record;
+    record->time   = hrtime_us();
+    record->format = format;
+    record->reserved = 0;
+    record->argc   = argc;
+    memset(record->args, 0, sizeof(record->args));
+    memcpy(record->args, args, argc * sizeof(int32_t));
+
+    __atomic_store_n(&slot->sequence, pos + 1, __ATOMIC_RELEASE);
+}
+
+static bool log_read(struct log_record *record) {
+    struct log_slot *slot = &slots[read_pos % LOG_BUFFER_SIZE];
+    uint32_t seq = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+    if(seq != read_pos + 1)
+        return false;
+
+    *record = slot->record;
+    __atomic_store_n(
+        &slot->sequence, read_pos + LOG_BUFFER_SIZE, __ATOMIC_RELEASE
+    );
+    read_pos++;
+    return true;
+}
+
+static void print_record(const struct log_record *record) {
+    if(binary_mode) {
+        const uint8_t *bytes = (const uint8_t *) record;
+
+        printf(LOG_BINARY_PREFIX);
+        for(int i = 0; i < LOG_RECORD_SIZE; i++)
+            printf("%02x", bytes[i]);
+        printf("\n");
+        return;
+    }
+
+    const int32_t *a = record->args;
+    if(record->format < LOG_FORMAT_COUNT)
+        printf(formats[record->format], a[0], a[1], a[2], a[3], a[4], a[5]);
+    else
+        printf("[Log] unknown format %d", record->format);
+    printf("\n");
+}
+
+static void *log_run(void *arg) {
+    while(true) {
+        struct log_record record;
+        while(log_read(&record))
+            print_record(&record);
+
+        uint32_t lost = __atomic_exchange_n(&dropped, 0, __ATOMIC_RELAXED);
+        if(lost > 0)
+            printf("[Log] %u record(s) dropped\n", (unsigned) lost);
+
+        usleep(DRAIN_PERIOD);
+    }
+    return NULL;
+}
+
+int log_init(void) {
+    for(int i = 0; i < LOG_BUFFER_SIZE; i++)
+        slots[i].sequence = i;
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+
+    struct sched_param param = { .sched_priority = DRAINER_PRIORITY };
+    pthread_attr_setschedparam(&attr, &param);
+
+    pthread_t thread;
+    int err = pthread_create(&thread, &attr, log_run, NULL);
+    pthread_attr_destroy(&attr);
+    if(err) {
+        puts("[Log] error creating thread");
+        return 1;
+    }
+    return 0;
+}
+
+void log_set_binary(bool binary) {
+    binary_mode = binary;
+}
+
+bool log_get_binary(void) {
+    return binary_mode;
+}
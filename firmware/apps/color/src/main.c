@@ -20,6 +20,12 @@
 
 #include "can-io.h"
 #include "color.h"
+#include "hrtime.h"
+#include "status.h"
+#include "profile.h"
+#include "bench.h"
+#include "log.h"
+#include "trace.h"
 
 bool debug_flag = false;
 
@@ -39,19 +45,71 @@ static int cmd_debug(void) {
     return 0;
 }
 
+static int cmd_status(void) {
+    status_print();
+    return 0;
+}
+
+static int cmd_latency(void) {
+    can_io_print_latency();
+    return 0;
+}
+
+static int cmd_latency_reset(void) {
+    can_io_reset_latency();
+    return 0;
+}
+
+static int cmd_stats(void) {
+    profile_print();
+    profile_reset();
+    return 0;
+}
+
+static int cmd_bench(void) {
+    int iterations, i2c;
+    scanf("%d %d", &iterations, &i2c);
+    bench_run(iterations, i2c);
+    return 0;
+}
+
+static int cmd_trace(void) {
+    trace_print();
+    return 0;
+}
+
+static int cmd_log_binary(void) {
+    log_set_binary(!log_get_binary());
+    printf(
+        "[Main] binary log %s\n",
+        log_get_binary() ? "ENABLED" : "DISABLED"
+    );
+    return 0;
+}
+
 static int cmd_help(char *arg0) {
     printf("Usage: %s [command] [args]\n", arg0);
     printf("List of available commands:\n");
-    printf("    set-id      sets the sensor ID\n");
-    printf("    debug       toggles debug messages\n");
-    printf("    exit        exits the program\n");
-    printf("    help        prints this help message\n");
+    printf("    set-id         sets the sensor ID\n");
+    printf("    debug          toggles debug messages\n");
+    printf("    status         prints diagnostic counters\n");
+    printf("    latency        prints the request latency histogram\n");
+    printf("    latency-reset  resets the request latency histogram\n");
+    printf("    stats          prints and resets cycle counts per stage\n");
+    printf("    bench          runs benchmarks: bench <iterations> <i2c>\n");
+    printf("    trace          prints and clears the event trace\n");
+    printf("    log-binary     toggles binary log records (see log-decode)\n");
+    printf("    exit           exits the program\n");
+    printf("    help           prints this help message\n");
     return 0;
 }
 
 int color_main(int argc, char *argv[]) {
     char *arg0 = (argc > 0 ? argv[0] : "<PROGRAM-NAME>");
 
+    hrtime_init();
+    log_init();
+
     while(color_init())
         puts("[Main] Color sensor initialization failed: retrying");
 
@@ -68,12 +126,27 @@ int color_main(int argc, char *argv[]) {
     cmd_help(arg0);
     while(true) {
         static char cmd[128];
-        scanf("%127s", cmd);
+        if(scanf("%127s", cmd) != 1)
+            break;
 
         if(!strcmp(cmd, "set-id"))
             cmd_set_id();
         else if(!strcmp(cmd, "debug"))
             cmd_debug();
+        else if(!strcmp(cmd, "status"))
+            cmd_status();
+        else if(!strcmp(cmd, "latency"))
+            cmd_latency();
+        else if(!strcmp(cmd, "latency-reset"))
+            cmd_latency_reset();
+        else if(!strcmp(cmd, "stats"))
+            cmd_stats();
+        else if(!strcmp(cmd, "bench"))
+            cmd_bench();
+        else if(!strcmp(cmd, "trace"))
+            cmd_trace();
+        else if(!strcmp(cmd, "log-binary"))
+            cmd_log_binary();
         else if(!strcmp(cmd, "exit"))
             break;
         else
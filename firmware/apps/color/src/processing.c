@@ -15,25 +15,27 @@
  */
 #include "processing.h"
 
-#include <stdio.h>
-
 #include "color2can.h"
-#include "color.h"
+#include "profile.h"
+#include "log.h"
+#include "hrtime.h"
 
-#define RANGES_COUNT 16
-static struct {
+struct range {
     bool low_set;
     int low[3];
 
     bool high_set;
     int high[3];
-} ranges[RANGES_COUNT];
+};
+
+typedef void (*convert_function)(int color[3], int r, int g, int b);
 
-static void (*convert_to_space)(int color[3], int r, int g, int b);
+static struct range ranges[RANGES_COUNT];
+static convert_function convert_to_space;
 
-static bool is_color_in_range(int color[3], int range) {
-    int *low  = ranges[range].low;
-    int *high = ranges[range].high;
+static bool is_color_in_range(int color[3], const struct range *range) {
+    const int *low  = range->low;
+    const int *high = range->high;
 
     return (
         low[0] <= color[0] && color[0] <= high[0] &&
@@ -42,37 +44,49 @@ static bool is_color_in_range(int color[3], int range) {
     );
 }
 
-int processing_get_data(int color[3], int *clear,
-                        bool *within_range, int *range_id) {
-    int r, g, b, c;
-    if(color_read_data(&r, &g, &b, &c))
-        return 1;
-
-    if(!convert_to_space)
+// Processes a color with the given configuration
+static int process(const struct range *ranges, convert_function convert,
+                   int r, int g, int b, int c,
+                   int color[3], int *clear,
+                   bool *within_range, int *range_id) {
+    if(!convert)
         return 1;
 
     // convert from RGB to the configured color space
-    convert_to_space(color, r, g, b);
+    PROFILE_BEGIN(PROFILE_CONVERT);
+    convert(color, r, g, b);
+    PROFILE_END(PROFILE_CONVERT);
     *clear = c;
 
     // check if color is within a range
+    PROFILE_BEGIN(PROFILE_RANGE_SCAN);
     *within_range = false;
     for(int i = 0; i < RANGES_COUNT; i++) {
         if(!ranges[i].low_set || !ranges[i].high_set)
             continue;
 
-        if(is_color_in_range(color, i)) {
+        if(is_color_in_range(color, &ranges[i])) {
             if(debug_flag)
-                printf("[Processing] color is in range %d\n", i);
+                LOG(LOG_IN_RANGE, i);
             *within_range = true;
             *range_id = i;
             break;
         }
     }
+    PROFILE_END(PROFILE_RANGE_SCAN);
 
     return 0;
 }
 
+int processing_process_data(int r, int g, int b, int c,
+                            int color[3], int *clear,
+                            bool *within_range, int *range_id) {
+    return process(
+        ranges, convert_to_space,
+        r, g, b, c, color, clear, within_range, range_id
+    );
+}
+
 static void rgb(int color[3], int r, int g, int b) {
     color[0] = r;
     color[1] = g;
@@ -129,7 +143,7 @@ int processing_set_color_space(int color_space) {
         ranges[i].high_set = false;
     }
 
-    printf("[Processing] set color space to %d (err=%d)\n", color_space, err);
+    LOG(LOG_COLOR_SPACE, color_space, err);
     return err;
 }
 
@@ -143,14 +157,48 @@ int processing_set_range(int id, bool high, int color[3]) {
         ranges[id].low_set = true;
     }
 
-    printf(
-        "[Processing] setting range %d %s (",
-        id, high ? "high" : "low "
-    );
-    for(int i = 0; i < 3; i++) {
+    for(int i = 0; i < 3; i++)
         dest[i] = color[i];
-        printf("%d%s", dest[i], i != 2 ? ", " : ")");
-    }
-    puts("");
+
+    LOG(
+        high ? LOG_RANGE_HIGH : LOG_RANGE_LOW,
+        id, dest[0], dest[1], dest[2]
+    );
     return 0;
 }
+
+uint32_t processing_bench(int color_space, int active_ranges,
+                          int iterations) {
+    // a configuration of its own, as the CAN-IO thread may be using the
+    // current one
+    const convert_function convert =
+        (color_space == COLOR2CAN_SPACE_HSV ? hsv : rgb);
+
+    // ranges that never match, so that all active ranges are checked
+    struct range bench_ranges[RANGES_COUNT];
+    for(int i = 0; i < RANGES_COUNT; i++) {
+        const bool active = (i < active_ranges);
+        bench_ranges[i].low_set  = active;
+        bench_ranges[i].high_set = active;
+        for(int j = 0; j < 3; j++) {
+            bench_ranges[i].low[j]  = 1;
+            bench_ranges[i].high[j] = 0;
+        }
+    }
+
+    const uint64_t start = hrtime_cycles();
+    for(int i = 0; i < iterations; i++) {
+        int color[3], clear;
+        bool within_range;
+        int range_id;
+        process(
+            bench_ranges, convert,
+            i & 0xffff, (i * 7) & 0xffff, (i * 13) & 0xffff, i & 0xffff,
+            color, &clear, &within_range, &range_id
+        );
+        __asm__ volatile("" : : "r"(color) : "memory");
+    }
+    const uint64_t elapsed = hrtime_cycles() - start;
+
+    return elapsed / iterations;
+}
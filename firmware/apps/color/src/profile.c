@@ -0,0 +1,83 @@
+/* Copyright 2025 Vulcalien
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "profile.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef CONFIG_CUSTOM_COLOR_PROFILE
+
+struct profile_stage profile_stages[PROFILE_STAGES];
+
+// set by profile_reset, applied by the CAN thread
+static bool reset_pending;
+
+void profile_print(void) {
+    static const char *names[PROFILE_STAGES] = {
+        [PROFILE_COLOR_READ]     = "color_read_data",
+        [PROFILE_CONVERT]        = "convert_to_space",
+        [PROFILE_RANGE_SCAN]     = "range scan",
+        [PROFILE_HANDLE_MESSAGE] = "handle_message",
+        [PROFILE_WRITE_SAMPLE]   = "write_sample"
+    };
+
+    puts("[Profile] cycles per stage:");
+    printf("  %-18s %8s %10s %10s %10s\n",
+           "stage", "count", "min", "avg", "max");
+    for(int i = 0; i < PROFILE_STAGES; i++) {
+        // the CAN thread may be updating the stage: print a copy, so that
+        // the count tested is the one used to compute the average
+        const struct profile_stage copy = profile_stages[i];
+        const struct profile_stage *s = &copy;
+        if(s->count == 0) {
+            printf("  %-18s %8d\n", names[i], 0);
+            continue;
+        }
+
+        printf(
+            "  %-18s %8lu %10lu %10lu %10lu\n", names[i],
+            (unsigned long) s->count,
+            (unsigned long) s->min,
+            (unsigned long) (s->total / s->count),
+            (unsigned long) s->max
+        );
+    }
+}
+
+// The stages are only written by the CAN thread, which resets them
+// within one iteration of its loop.
+void profile_reset(void) {
+    __atomic_store_n(&reset_pending, true, __ATOMIC_RELEASE);
+}
+
+void profile_apply_reset(void) {
+    if(__atomic_exchange_n(&reset_pending, false, __ATOMIC_ACQUIRE))
+        memset(profile_stages, 0, sizeof(profile_stages));
+}
+
+#else
+
+void profile_print(void) {
+    puts("[Profile] not available: enable CONFIG_CUSTOM_COLOR_PROFILE");
+}
+
+void profile_reset(void) {
+}
+
+void profile_apply_reset(void) {
+}
+
+#endif
@@ -0,0 +1,73 @@
+/* Copyright 2025 Vulcalien
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "status.h"
+
+#include <stdio.h>
+
+#include "color2can.h"
+#include "hrtime.h"
+
+struct status_counters status_counters;
+
+uint32_t status_get(int counter) {
+    const struct status_counters *c = &status_counters;
+    switch(counter) {
+        case COLOR2CAN_STATUS_UPTIME:
+            return hrtime_us() / 1000000;
+        case COLOR2CAN_STATUS_SAMPLES_PRODUCED:
+            return c->samples_produced;
+        case COLOR2CAN_STATUS_SAMPLES_SENT:
+            return c->samples_sent;
+        case COLOR2CAN_STATUS_INVALID_DATA:
+            return c->invalid_data;
+        case COLOR2CAN_STATUS_I2C_ERRORS:
+            return c->i2c_errors;
+        case COLOR2CAN_STATUS_TX_ERRORS:
+            return c->tx_errors;
+        case COLOR2CAN_STATUS_RX_ERRORS:
+            return c->rx_errors;
+        case COLOR2CAN_STATUS_RX_FILTERED:
+            return c->rx_filtered;
+        case COLOR2CAN_STATUS_REQUESTS_DROPPED:
+            return c->requests_dropped;
+        case COLOR2CAN_STATUS_LOOP_MAX_LATENCY:
+            return c->loop_max_latency;
+    }
+    return 0;
+}
+
+void status_print(void) {
+    static const char *names[COLOR2CAN_STATUS_COUNT] = {
+        [COLOR2CAN_STATUS_UPTIME]            = "uptime (s)",
+        [COLOR2CAN_STATUS_SAMPLES_PRODUCED]  = "samples produced",
+        [COLOR2CAN_STATUS_SAMPLES_SENT]      = "samples sent",
+        [COLOR2CAN_STATUS_INVALID_DATA]      = "invalid data",
+        [COLOR2CAN_STATUS_I2C_ERRORS]        = "I2C errors",
+        [COLOR2CAN_STATUS_TX_ERRORS]         = "TX errors",
+        [COLOR2CAN_STATUS_RX_ERRORS]         = "RX errors",
+        [COLOR2CAN_STATUS_RX_FILTERED]       = "RX filtered",
+        [COLOR2CAN_STATUS_REQUESTS_DROPPED]  = "requests dropped",
+        [COLOR2CAN_STATUS_LOOP_MAX_LATENCY]  = "loop max latency (us)"
+    };
+
+    puts("[Status] counters:");
+    for(int i = 0; i < COLOR2CAN_STATUS_COUNT; i++)
+        printf("  %-22s %lu\n", names[i], (unsigned long) status_get(i));
+}
+
+void status_reset_latency(void) {
+    status_counters.loop_max_latency = 0;
+}
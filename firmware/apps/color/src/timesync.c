@@ -0,0 +1,110 @@
+/* Copyright 2025 Vulcalien
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "timesync.h"
+
+#include "color2can.h"
+
+#define HOST_TIME_MASK (((uint64_t) 1 << 48) - 1)
+
+// if the error is greater than this, the host time jumped: start over
+#define RESYNC_THRESHOLD 10000 // 10ms
+
+// latest time SYNC message
+static struct {
+    bool valid;
+    int sequence;
+    uint64_t rx_time;
+} latest_sync;
+
+// latest reference point, (local time, host time)
+static struct {
+    int count;
+    uint64_t local_time;
+    uint64_t host_time;
+
+    // rate difference between clocks, in parts per billion
+    int64_t drift;
+} ref;
+
+// difference between two 48-bit host times, sign-extended
+static inline int64_t host_time_diff(uint64_t a, uint64_t b) {
+    int64_t diff = (a - b) & HOST_TIME_MASK;
+    if(diff & ((uint64_t) 1 << 47))
+        diff -= (int64_t) 1 << 48;
+    return diff;
+}
+
+static inline int64_t local_to_host_delta(int64_t local_delta) {
+    return local_delta + local_delta * ref.drift / 1000000000;
+}
+
+static void add_reference_point(uint64_t local_time, uint64_t host_time) {
+    if(ref.count > 0) {
+        const int64_t local_delta = local_time - ref.local_time;
+        const int64_t host_delta  = host_time_diff(host_time, ref.host_time);
+        const int64_t error = host_delta - local_to_host_delta(local_delta);
+
+        if(local_delta <= 0 ||
+           error > RESYNC_THRESHOLD || error < -RESYNC_THRESHOLD) {
+            ref.count = 0;
+        } else {
+            const int64_t drift = (host_delta - local_delta) * 1000000000
+                                / local_delta;
+
+            // the first measurement is used as-is, then it is filtered
+            if(ref.count == 1)
+                ref.drift = drift;
+            else
+                ref.drift += (drift - ref.drift) / 4;
+        }
+    }
+
+    if(ref.count == 0)
+        ref.drift = 0;
+    if(ref.count < 2)
+        ref.count++;
+
+    ref.local_time = local_time;
+    ref.host_time  = host_time;
+}
+
+void timesync_handle_message(const struct color2can_time *msg,
+                             uint64_t rx_time, bool rx_time_valid) {
+    if(!msg->follow_up) {
+        // the reception time is only meaningful if the message was
+        // read as soon as it arrived
+        latest_sync.valid    = rx_time_valid;
+        latest_sync.sequence = msg->sequence;
+        latest_sync.rx_time  = rx_time;
+        return;
+    }
+
+    // a follow-up message carries the time at which the host sent the
+    // corresponding SYNC message
+    if(latest_sync.valid && latest_sync.sequence == msg->sequence)
+        add_reference_point(latest_sync.rx_time, msg->time);
+    latest_sync.valid = false;
+}
+
+int timesync_to_host_time(uint64_t local_time, uint64_t *host_time) {
+    if(ref.count == 0)
+        return 1;
+
+    const int64_t local_delta = local_time - ref.local_time;
+    *host_time = (ref.host_time + local_to_host_delta(local_delta))
+               & HOST_TIME_MASK;
+    return 0;
+}
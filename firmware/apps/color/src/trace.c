@@ -0,0 +1,114 @@
+/* Copyright 2025 Vulcalien
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "trace.h"
+
+#include <stdio.h>
+
+#ifdef CONFIG_CUSTOM_COLOR_TRACE
+
+#include "hal.h"
+#include "hrtime.h"
+
+// must be a power of two
+#define TRACE_BUFFER_SIZE 256
+
+static struct color2can_trace buffer[TRACE_BUFFER_SIZE];
+
+// Events are recorded by the CAN thread and read by the console or by
+// the CAN thread itself: both are protected by the critical section.
+
+// total number of events recorded: the oldest ones are overwritten
+static uint32_t write_pos;
+
+// events are not recorded while being read
+static int readers;
+
+void trace_record(int event, int phase, int arg) {
+    // hrtime_us enters the critical section: call it first
+    const struct color2can_trace entry = {
+        .time  = hrtime_us(),
+        .event = event,
+        .phase = phase,
+        .arg   = arg
+    };
+
+    const uint32_t flags = hal_critical_enter();
+    if(readers == 0)
+        buffer[write_pos++ % TRACE_BUFFER_SIZE] = entry;
+    hal_critical_leave(flags);
+}
+
+static inline int recorded_count(void) {
+    if(write_pos < TRACE_BUFFER_SIZE)
+        return write_pos;
+    return TRACE_BUFFER_SIZE;
+}
+
+int trace_read_begin(void) {
+    const uint32_t flags = hal_critical_enter();
+    readers++;
+    const int count = recorded_count();
+    hal_critical_leave(flags);
+    return count;
+}
+
+void trace_read_end(void) {
+    const uint32_t flags = hal_critical_enter();
+    if(--readers == 0)
+        write_pos = 0;
+    hal_critical_leave(flags);
+}
+
+void trace_get(int i, struct color2can_trace *event) {
+    // while there are readers, the buffer does not change
+    const uint32_t first = write_pos - recorded_count();
+    *event = buffer[(first + i) % TRACE_BUFFER_SIZE];
+}
+
+void trace_print(void) {
+    const int count = trace_read_begin();
+
+    // one line per event: T <time> <event> <phase> <arg>
+    printf("[Trace] %d event(s)\n", count);
+    for(int i = 0; i < count; i++) {
+        struct color2can_trace event;
+        trace_get(i, &event);
+        printf(
+            "T %lu %d %d %d\n", (unsigned long) event.time,
+            event.event, event.phase, event.arg
+        );
+    }
+
+    trace_read_end();
+}
+
+#else
+
+int trace_read_begin(void) {
+    return 0;
+}
+
+void trace_read_end(void) {
+}
+
+void trace_get(int i, struct color2can_trace *event) {
+}
+
+void trace_print(void) {
+    puts("[Trace] not available: enable CONFIG_CUSTOM_COLOR_TRACE");
+}
+
+#endif
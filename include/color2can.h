@@ -34,6 +34,24 @@ struct color2can_config {
     uint16_t transmit_frequency : 9; // 0=on-demand, 1...400Hz
     uint16_t color_space        : 1; // 0=RGB, 1=HSV
     uint16_t use_led            : 2; // 0=never, 1=when sampling, 2=always
+    uint16_t batch_size         : 3; // CAN FD only: 0/1=disabled, 2...7
+    uint16_t sample_info        : 1; // 1=send sample info after each sample
+};
+
+// Sent on COLOR2CAN_CONFIG_MASK_ID instead of struct color2can_config,
+// to set the transmit period with a finer resolution than the transmit
+// frequency. The period must not be shorter than the integration time,
+// nor than the time needed to transmit a sample on the bus. With the LED
+// on only when sampling, it must also include the 2.4ms of RGBC
+// initialization and the I2C transfers of each sample.
+#define COLOR2CAN_CONFIG_EXT_SIZE 8
+struct color2can_config_ext {
+    struct color2can_config config; // transmit_frequency is ignored
+
+    uint8_t integration; // integration time: (1 + value) * 2.4ms
+    uint8_t reserved;
+
+    uint32_t transmit_period; // 0=on-demand, otherwise in microseconds
 };
 
 #define COLOR2CAN_RANGE_SIZE 8
@@ -53,12 +71,183 @@ struct color2can_sample {
     uint16_t range_id : 4; // 0...15
 };
 
+// Sent by the host on COLOR2CAN_SAMPLE_MASK_ID to request 'count'
+// samples at once. Requests are served in order of arrival, and the
+// spacing only applies between the samples of the same burst. Like single
+// requests, it is invalidated by a config message. The sensor queues up
+// to 16 bursts: requests that do not fit are dropped and counted.
+#define COLOR2CAN_REQUEST_SIZE 4
+struct color2can_request {
+    uint16_t count;   // 1...65535, 0 is ignored
+    uint16_t spacing; // time between samples: 0=minimum, 1...65535 * 100us
+};
+
+// CAN FD only: multiple samples packed into a single sample message.
+// The frame length is padded to the next valid CAN FD length, so the
+// number of samples must be read from 'count'.
+#define COLOR2CAN_SAMPLE_BATCH_MAX 7
+#define COLOR2CAN_SAMPLE_BATCH_HEADER_SIZE 8
+#define COLOR2CAN_SAMPLE_BATCH_SIZE(count)\
+    (COLOR2CAN_SAMPLE_BATCH_HEADER_SIZE + (count) * COLOR2CAN_SAMPLE_SIZE)
+struct color2can_sample_batch {
+    uint8_t sequence; // incremented after each batch
+    uint8_t count;    // 1...7
+    uint8_t reserved[6];
+
+    struct color2can_sample samples[COLOR2CAN_SAMPLE_BATCH_MAX];
+};
+
+// Broadcast by the host to make all sensors take a sample at the same
+// time. Each sensor replies with a sample message followed by a sample
+// info message, delayed by (sensor ID * stagger) to avoid collisions.
+// The delay counts from the end of the sampling (RGBC initialization
+// and integration time), which is the same for sensors configured alike.
+#define COLOR2CAN_SYNC_SIZE 2
+struct color2can_sync {
+    uint8_t counter; // copied into the sample info message
+    uint8_t stagger; // response delay per sensor ID: 0...255 * 100us
+};
+
+// Sent by the sensor after a sample message, carrying information about
+// the sample that does not fit into struct color2can_sample.
+#define COLOR2CAN_SAMPLE_INFO_SIZE 8
+struct color2can_sample_info {
+    uint64_t sync_counter : 8; // counter of the SYNC message
+    uint64_t synchronized : 1; // 1=sample was requested by a SYNC message
+    uint64_t time_valid   : 1; // 1=sensor clock is synchronized to host
+    uint64_t overrun      : 1; // 1=periodic samples were skipped before
+    uint64_t reserved     : 5;
+    uint64_t time         : 48; // host time (microseconds) of the sample
+};
+
+// Broadcast by the host to synchronize the sensors' clocks. The host
+// sends a SYNC message, then a follow-up message with the same sequence
+// number, carrying the time at which the SYNC message was sent. The
+// time unit is the microsecond, truncated to 48 bits.
+#define COLOR2CAN_TIME_SIZE 8
+struct color2can_time {
+    uint64_t sequence  : 8;
+    uint64_t follow_up : 1; // 0=SYNC, 1=follow-up
+    uint64_t reserved  : 7;
+    uint64_t time      : 48; // follow-up only: host time of the SYNC
+};
+
+// Sent by the host to switch the bus to a different bit rate, 'delay'
+// milliseconds after the message is received. Each sensor replies with
+// the same message, setting 'status' to accepted or rejected. If no
+// message is received within 2 seconds after switching, the sensor
+// restores the previous bit rate.
+#define COLOR2CAN_BITRATE_REQUEST  0
+#define COLOR2CAN_BITRATE_ACCEPTED 1
+#define COLOR2CAN_BITRATE_REJECTED 2
+
+#define COLOR2CAN_BITRATE_SIZE 8
+struct color2can_bitrate {
+    uint32_t bitrate; // in bit/s
+    uint16_t delay;   // in milliseconds
+
+    uint8_t sequence; // copied into the reply
+    uint8_t status;   // 0=request, 1=accepted, 2=rejected
+};
+
+// Sent by the sensor, one message per counter, when requested by an
+// empty status message (or RTR=1). A request carrying a 2-byte period
+// (in milliseconds) makes the sensor send all counters periodically;
+// a period of 0 stops it. The loop latency counter is reset after it is
+// sent.
+#define COLOR2CAN_STATUS_UPTIME            0 // in seconds
+#define COLOR2CAN_STATUS_SAMPLES_PRODUCED  1
+#define COLOR2CAN_STATUS_SAMPLES_SENT      2
+#define COLOR2CAN_STATUS_INVALID_DATA      3 // sensor data not valid
+#define COLOR2CAN_STATUS_I2C_ERRORS        4
+#define COLOR2CAN_STATUS_TX_ERRORS         5
+#define COLOR2CAN_STATUS_RX_ERRORS         6
+#define COLOR2CAN_STATUS_RX_FILTERED       7 // not addressed to the sensor
+#define COLOR2CAN_STATUS_REQUESTS_DROPPED  8 // invalidated or not queued
+#define COLOR2CAN_STATUS_LOOP_MAX_LATENCY  9 // in microseconds
+#define COLOR2CAN_STATUS_COUNT 10
+
+#define COLOR2CAN_STATUS_REQUEST_SIZE 2
+struct color2can_status_request {
+    uint16_t period; // in milliseconds, 0=disabled
+};
+
+#define COLOR2CAN_STATUS_SIZE 8
+struct color2can_status {
+    uint8_t counter; // COLOR2CAN_STATUS_*
+    uint8_t reserved[3];
+
+    uint32_t value;
+};
+
+// Latency of sample requests (RTR), from the arrival of the request to
+// the sample message being written, split into phases. An empty latency
+// message (or RTR=1) requests the histogram: the sensor sends one
+// message per non-empty bucket, the last one having 'last' set. A 1-byte
+// latency message resets the histogram.
+#define COLOR2CAN_LATENCY_QUEUE      0 // waiting to be handled
+#define COLOR2CAN_LATENCY_SENSOR     1 // integration and I2C transfers
+#define COLOR2CAN_LATENCY_PROCESSING 2 // color space and ranges
+#define COLOR2CAN_LATENCY_TX         3 // writing the sample message
+#define COLOR2CAN_LATENCY_TOTAL      4
+#define COLOR2CAN_LATENCY_PHASES     5
+
+#define COLOR2CAN_LATENCY_BUCKETS 16
+
+#define COLOR2CAN_LATENCY_RESET_SIZE 1
+
+#define COLOR2CAN_LATENCY_SIZE 8
+struct color2can_latency {
+    uint8_t phase;  // COLOR2CAN_LATENCY_*
+    uint8_t bucket; // [2^bucket, 2^(bucket+1)) microseconds
+    uint8_t last;   // 1=last message of the histogram
+    uint8_t reserved;
+
+    uint32_t count;
+};
+
+// Timeline of begin/end events recorded by the sensor, if built with
+// CONFIG_CUSTOM_COLOR_TRACE. An empty trace message (or RTR=1) requests
+// the buffer: the sensor pauses recording, sends one message per event
+// (oldest first) followed by a message with event=COLOR2CAN_TRACE_LAST,
+// then clears the buffer and resumes recording.
+#define COLOR2CAN_TRACE_RECEIVER    0 // handling received messages
+#define COLOR2CAN_TRACE_SENDER      1 // producing and sending a sample
+#define COLOR2CAN_TRACE_RX_FRAME    2 // arg=CAN ID
+#define COLOR2CAN_TRACE_REQUEST     3 // arg=pending requests
+#define COLOR2CAN_TRACE_INTEGRATION 4 // waiting for the integration
+#define COLOR2CAN_TRACE_I2C         5 // arg=bytes
+#define COLOR2CAN_TRACE_PROCESSING  6 // color space and ranges
+#define COLOR2CAN_TRACE_TX          7 // arg=CAN ID
+#define COLOR2CAN_TRACE_EVENTS      8
+#define COLOR2CAN_TRACE_LAST     0xff // end of the buffer
+
+#define COLOR2CAN_TRACE_PHASE_BEGIN   0
+#define COLOR2CAN_TRACE_PHASE_END     1
+#define COLOR2CAN_TRACE_PHASE_INSTANT 2
+
+#define COLOR2CAN_TRACE_SIZE 8
+struct color2can_trace {
+    uint32_t time; // in microseconds (sensor clock), lower 32 bits
+
+    uint8_t event; // COLOR2CAN_TRACE_*
+    uint8_t phase; // COLOR2CAN_TRACE_PHASE_*
+    uint16_t arg;
+};
+
 // number of distinct sensor IDs (ID=0 is broadcast)
 #define COLOR2CAN_MAX_SENSOR_COUNT 32
 
-#define COLOR2CAN_CONFIG_MASK_ID 0x660 // 0x660...0x67f
-#define COLOR2CAN_RANGE_MASK_ID  0x680 // 0x680...0x69f
-#define COLOR2CAN_SAMPLE_MASK_ID 0x6a0 // 0x6a0...0x6bf
+#define COLOR2CAN_TIME_MASK_ID        0x620 // 0x620...0x63f
+#define COLOR2CAN_SYNC_MASK_ID        0x640 // 0x640...0x65f
+#define COLOR2CAN_CONFIG_MASK_ID      0x660 // 0x660...0x67f
+#define COLOR2CAN_RANGE_MASK_ID       0x680 // 0x680...0x69f
+#define COLOR2CAN_SAMPLE_MASK_ID      0x6a0 // 0x6a0...0x6bf
+#define COLOR2CAN_SAMPLE_INFO_MASK_ID 0x6c0 // 0x6c0...0x6df
+#define COLOR2CAN_BITRATE_MASK_ID     0x6e0 // 0x6e0...0x6ff
+#define COLOR2CAN_STATUS_MASK_ID      0x700 // 0x700...0x71f
+#define COLOR2CAN_LATENCY_MASK_ID     0x720 // 0x720...0x73f
+#define COLOR2CAN_TRACE_MASK_ID       0x740 // 0x740...0x75f
 
 #ifdef __cplusplus
 }